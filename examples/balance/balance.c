@@ -168,6 +168,7 @@ int zero_out_controller();
 int disarm_controller();
 int arm_controller();
 int saturate_number(float* val, float limit);
+int check_channels(balance_config_t* conf);
 int wait_for_starting_condition();
 int on_pause_press();
 int on_mode_release();
@@ -207,18 +208,20 @@ int main(){
 		printf("aborting, config file error\n");
 		return -1;
 	}
+	if(check_channels(&config)){
+		printf("aborting, fix the channels in %s\n", BALANCE_CONFIG_FILE);
+		return -1;
+	}
 
 
 	
 	// start a thread to slowly sample battery 
-	pthread_t  battery_thread;
-	pthread_create(&battery_thread, NULL, battery_checker, (void*) NULL);
+	cape_thread_create("battery", battery_checker, NULL, THREAD_APP);
 	
 	// start printf_thread if running from a terminal
 	// if it was started as a background process then don't bother
 	if(isatty(fileno(stdout))){
-		pthread_t  printf_thread;
-		pthread_create(&printf_thread, NULL, printf_loop, (void*) NULL);
+		cape_thread_create("printf", printf_loop, NULL, THREAD_APP);
 	}
 	
 	// // start listening for RC control from dsm2 radio
@@ -262,8 +265,7 @@ int main(){
 		}
 		else{
 			// start new thread to write the file occationally
-			pthread_t  logging_thread;
-			pthread_create(&logging_thread, NULL, log_writer, (void*) NULL);
+			cape_thread_create("log_writer", log_writer, NULL, THREAD_LOG);
 		}
 	}
 	
@@ -281,11 +283,10 @@ int main(){
 	// to make sure other setup functions don't interfere
 	printf("starting core IMU interrupt\n");
 	core_start_time_us = microsSinceEpoch();
-	set_imu_interrupt_func(&balance_core);
+	set_imu_ready_func(&balance_core);
 	
 	// start balance stack to control setpoints
-	pthread_t  balance_stack_thread;
-	pthread_create(&balance_stack_thread, NULL, balance_stack, (void*) NULL);
+	cape_thread_create("balance_stack", balance_stack, NULL, THREAD_CONTROL);
 	
 	printf("\nHold your MIP upright to begin balancing\n");
 	set_state(RUNNING);
@@ -308,6 +309,7 @@ int main(){
 *	should be the only things touching the controller setpoint.
 ************************************************************************/
 void* balance_stack(void* ptr){
+	balance_config_t new_config;
 	
 	// wait for IMU to settle
 	disarm_controller();
@@ -348,7 +350,14 @@ void* balance_stack(void* ptr){
 				// read config each time it's picked up to recognize new
 				// settings user may have changed
 				// only actually reads from disk if the file was modified
-				load_config(&config);
+				// and only used if the channels in it are valid
+				new_config = config;
+				if(load_config(&new_config)==1){
+					if(check_channels(&new_config)==0){
+						config = new_config;
+					}
+					else printf("keeping the previous config\n");
+				}
 				zero_out_controller();
 				arm_controller();
 			}
@@ -408,13 +417,14 @@ int balance_core(){
 	float compensated_D1_output = 0;
 	float dutyL = 0;
 	float dutyR = 0;
+	float duty[4];
+	static encoder_snapshot_t enc;
 	static log_entry_t new_log_entry;
 	
-	// if an IMU packet read failed, ignore and just return
-	// the mpu9150_read function may print it's own warnings
-	if (mpu9150_read(&mpu) != 0){
-		return -1;
-	}
+	// mpu was read and published to imu_ring by the imu thread before
+	// this was called, see set_imu_ready_func()
+	// tracks gyro drift whenever the robot sits still, armed or not
+	gyro_bias_update(&gyro_bias, &mpu);
 	
 	/***********************************************************************
 	*	STATE_ESTIMATION
@@ -428,10 +438,16 @@ int balance_core(){
 	cstate.current_theta = cstate.theta[0];
 	cstate.d_theta = (cstate.theta[0]-cstate.theta[1])/DT;
 	
-	// collect encoder positions
-	cstate.wheelAngleR = -(get_encoder_pos(config.encoder_channel_R) * 2*PI) \
+	// collect both encoder positions from the same instant. If that fails
+	// keep the last good positions for the estimate but disarm, then let
+	// the state handling below run as normal
+	if(get_encoder_snapshot(&enc) && setpoint.arm_state==ARMED){
+		printf("encoder read failed, disarming\n");
+		disarm_controller();
+	}
+	cstate.wheelAngleR = -(enc.pos[config.encoder_channel_R-1] * 2*PI) \
 							/(config.gearbox * config.encoder_res);
-	cstate.wheelAngleL = (get_encoder_pos(config.encoder_channel_L) * 2*PI)	\
+	cstate.wheelAngleL = (enc.pos[config.encoder_channel_L-1] * 2*PI)	\
 							/(config.gearbox * config.encoder_res);
 	
 	// log phi estimate
@@ -440,7 +456,12 @@ int balance_core(){
 	cstate.phi[2] = cstate.phi[1]; cstate.phi[1] = cstate.phi[0];
 	cstate.phi[0] = ((cstate.wheelAngleL + cstate.wheelAngleR)/2) +cstate.current_theta; 
 	cstate.current_phi = cstate.phi[0];
-	cstate.d_phi = (cstate.phi[0]-cstate.phi[1])/DT;
+	// wheel speed from the eQep hardware rather than differencing
+	// position, which is only a count or two per sample at low speed
+	cstate.d_phi = (((get_encoder_velocity(config.encoder_channel_L)	\
+					- get_encoder_velocity(config.encoder_channel_R))/2) 	\
+					* 2*PI/(config.gearbox * config.encoder_res)) 		\
+					+ cstate.d_theta;
 	
 	// body turning estimation
 	cstate.gamma[2] = cstate.gamma[1]; cstate.gamma[1] = cstate.phi[0];
@@ -580,10 +601,12 @@ int balance_core(){
 		dutyL  = compensated_D1_output - cstate.duty_split;
 		dutyR = compensated_D1_output + cstate.duty_split;	
 		
-		// send to motors
+		// send to motors, channels were checked by check_channels()
 		// one motor is flipped on chassis so reverse duty to L
-		set_motor(config.motor_channel_L,-dutyL); 
-		set_motor(config.motor_channel_R,dutyR); 
+		duty[config.motor_channel_L-1] = -dutyL;
+		duty[config.motor_channel_R-1] = dutyR;
+		set_motors(duty, MOTOR_MASK(config.motor_channel_L) 	\
+						| MOTOR_MASK(config.motor_channel_R));
 		cstate.time_us = microsSinceEpoch();
 		
 		// pass new information to the log with add_to_buffer
@@ -678,6 +701,27 @@ int saturate_number(float* val, float limit){
 	return 0;
 }
 
+/***********************************************************************
+*	check_channels()
+*	motor and encoder channels come from the config file and index the
+*	duty and encoder arrays in balance_core, so check them once whenever
+*	a config is loaded rather than every loop. return -1 if any is out
+*	of range
+************************************************************************/
+int check_channels(balance_config_t* conf){
+	if(conf->motor_channel_L<1 || conf->motor_channel_L>4 ||	\
+			conf->motor_channel_R<1 || conf->motor_channel_R>4){
+		printf("motor channels must be between 1 and 4\n");
+		return -1;
+	}
+	if(conf->encoder_channel_L<1 || conf->encoder_channel_L>3 ||	\
+			conf->encoder_channel_R<1 || conf->encoder_channel_R>3){
+		printf("encoder channels must be between 1 and 3\n");
+		return -1;
+	}
+	return 0;
+}
+
 /***********************************************************************
 *	wait_for_starting_condition()
 *	wait for MiP to be held upright long enough to begin
@@ -1005,6 +1049,8 @@ void* mavlink_sender(void* ptr){
 	uint8_t buf[MAV_BUF_LEN];
 	mavlink_message_t msg;
 	uint16_t len;
+	mpudata_t latest;
+	memset(&latest, 0, sizeof(latest));
 	while(get_state() != EXITING){
 		
 		// send heartbeat
@@ -1013,12 +1059,13 @@ void* mavlink_sender(void* ptr){
 		len = mavlink_msg_to_send_buffer(buf, &msg);
 		sendto(sock, buf, len, 0, (struct sockaddr*)&gcAddr, sizeof(struct sockaddr_in));
 		
-		//send attitude
+		//send attitude, reading mpu directly could catch it mid-update
+		imu_ring_get_latest(&imu_ring, &latest, NULL);
 		memset(&buf, 0, MAV_BUF_LEN);
 		mavlink_msg_attitude_pack(1, 200, &msg, microsSinceEpoch(), 
-											mpu.fusedEuler[VEC3_X], 
-											mpu.fusedEuler[VEC3_Y],
-											mpu.fusedEuler[VEC3_Z], 
+											latest.fusedEuler[VEC3_X], 
+											latest.fusedEuler[VEC3_Y],
+											latest.fusedEuler[VEC3_Z], 
 											0, 0, 0); //set gyro rates to 0 for simplicity
 		len = mavlink_msg_to_send_buffer(buf, &msg);
 		sendto(sock, buf, len, 0, (struct sockaddr*)&gcAddr, sizeof(struct sockaddr_in));
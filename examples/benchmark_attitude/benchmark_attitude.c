@@ -0,0 +1,172 @@
+// Time the host attitude estimators and compare them with the DMP
+// James Strawson - 2014
+
+#include <robotics_cape.h>
+
+#define ITERATIONS		1000000
+#define MAX_RECORD_LINE	256
+#define RECORD_RATE		200
+
+FILE* record_file;
+mpudata_t record_mpu;
+
+// gravity in the sensor frame as predicted by a sensor to earth quaternion
+void gravity_from_quat(quaternion_t q, vector3d_t g){
+	g[0] = 2.0f*(q[QUAT_X]*q[QUAT_Z] - q[QUAT_W]*q[QUAT_Y]);
+	g[1] = 2.0f*(q[QUAT_W]*q[QUAT_X] + q[QUAT_Y]*q[QUAT_Z]);
+	g[2] = q[QUAT_W]*q[QUAT_W] - q[QUAT_X]*q[QUAT_X] 
+		 - q[QUAT_Y]*q[QUAT_Y] + q[QUAT_Z]*q[QUAT_Z];
+}
+
+float tilt_error_deg(quaternion_t a, quaternion_t b){
+	vector3d_t ga, gb;
+	float c;
+	gravity_from_quat(a, ga);
+	gravity_from_quat(b, gb);
+	vector3DotProduct(ga, gb, &c);
+	if(c>1.0f) c = 1.0f;
+	return acosf(c)*RAD_TO_DEGREE;
+}
+
+void benchmark(const char* name, attitude_algo_t algo, int use_mag){
+	attitude_filter_t f;
+	float gyro[3] = {0.01f, -0.02f, 0.03f};
+	float accel[3] = {0.05f, -0.03f, 0.99f};
+	float mag[3] = {0.3f, 0.1f, 0.8f};
+	timespec start, end;
+	int i;
+	
+	attitude_init(&f, algo);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i=0; i<ITERATIONS; i++){
+		// wiggle the input so nothing settles into a fixed point
+		gyro[0] = -gyro[0];
+		attitude_update(&f, gyro, accel, use_mag?mag:NULL, 0.001f);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("%-16s %8.1f ns/update\n", name, 
+			(float)cape_elapsed_ns(start, end)/ITERATIONS);
+}
+
+// IMU interrupt function for -r, one line per DMP sample
+int record_samples(){
+	mpudata_t samples[DMP_MAX_BATCH];
+	float gyro_sens;
+	unsigned short accel_sens;
+	quaternion_t q;
+	int i, j, n;
+	
+	n = mpu9150_read_batch(&record_mpu, samples, DMP_MAX_BATCH);
+	if(n<=0) return 0;
+	mpu_get_gyro_sens(&gyro_sens);
+	mpu_get_accel_sens(&accel_sens);
+	for(i=0; i<n; i++){
+		for(j=0; j<4; j++) q[j] = (float)samples[i].rawQuat[j];
+		quaternionNormalize(q);
+		fprintf(record_file, "%lu %f %f %f %f %f %f %d %d %d %f %f %f %f\n",
+			samples[i].dmpTimestamp,
+			samples[i].rawGyro[0]*DEGREE_TO_RAD/gyro_sens,
+			samples[i].rawGyro[1]*DEGREE_TO_RAD/gyro_sens,
+			samples[i].rawGyro[2]*DEGREE_TO_RAD/gyro_sens,
+			// calibrated and in the gyro frame, same as attitude_update_imu
+			-(float)samples[i].calibratedAccel[VEC3_X]/accel_sens,
+			(float)samples[i].calibratedAccel[VEC3_Y]/accel_sens,
+			(float)samples[i].calibratedAccel[VEC3_Z]/accel_sens,
+			samples[i].calibratedMag[VEC3_X], -samples[i].calibratedMag[VEC3_Y],
+			-samples[i].calibratedMag[VEC3_Z],
+			q[QUAT_W], q[QUAT_X], q[QUAT_Y], q[QUAT_Z]);
+	}
+	return 0;
+}
+
+int record(const char* path){
+	signed char orientation[9] = ORIENTATION_FLAT;
+	record_file = fopen(path, "w");
+	if(record_file==NULL){
+		printf("can't open %s\n", path);
+		return -1;
+	}
+	initialize_cape();
+	if(initialize_imu(RECORD_RATE, orientation)){
+		fclose(record_file);
+		cleanup_cape();
+		return -1;
+	}
+	set_imu_interrupt_func(&record_samples);
+	printf("recording to %s, ctrl-c to stop\n", path);
+	while(get_state()!=EXITING){
+		sleep(1);
+	}
+	set_imu_interrupt_func(&null_func);
+	fclose(record_file);
+	cleanup_cape();
+	return 0;
+}
+
+int replay(const char* path, const char* name, attitude_algo_t algo, int use_mag){
+	attitude_filter_t f;
+	char line[MAX_RECORD_LINE];
+	unsigned long t, last_t = 0;
+	float gyro[3], accel[3], mag[3];
+	quaternion_t dmp_q;
+	timespec start, end;
+	uint64_t ns = 0;
+	float err, sum_sq = 0, worst = 0;
+	int n = 0;
+	FILE* file;
+	
+	file = fopen(path, "r");
+	if(file==NULL){
+		printf("can't open %s\n", path);
+		return -1;
+	}
+	attitude_init(&f, algo);
+	while(fgets(line, sizeof(line), file)){
+		if(sscanf(line, "%lu %f %f %f %f %f %f %f %f %f %f %f %f %f", &t,
+				&gyro[0], &gyro[1], &gyro[2], &accel[0], &accel[1], &accel[2],
+				&mag[0], &mag[1], &mag[2],
+				&dmp_q[QUAT_W], &dmp_q[QUAT_X], &dmp_q[QUAT_Y], &dmp_q[QUAT_Z])!=14){
+			continue;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		attitude_update(&f, gyro, accel, use_mag?mag:NULL,
+				last_t ? (t-last_t)/1000.0f : 1.0f/RECORD_RATE);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		ns += cape_elapsed_ns(start, end);
+		last_t = t;
+		err = tilt_error_deg(f.q, dmp_q);
+		sum_sq += err*err;
+		if(err>worst) worst = err;
+		n++;
+	}
+	fclose(file);
+	if(n==0){
+		printf("no samples in %s\n", path);
+		return -1;
+	}
+	printf("%-16s %6d samples, tilt vs DMP rms %6.2f max %6.2f deg, %8.1f ns/update\n",
+			name, n, sqrtf(sum_sq/n), worst, (float)ns/n);
+	return 0;
+}
+
+int main(int argc, char *argv[]){
+	if(argc==3 && strcmp(argv[1], "-r")==0){
+		return record(argv[2]);
+	}
+	if(argc==2){
+		printf("\nreplaying %s\n", argv[1]);
+		if(replay(argv[1], "mahony", ATTITUDE_MAHONY, 0)) return -1;
+		replay(argv[1], "mahony+mag", ATTITUDE_MAHONY, 1);
+		replay(argv[1], "madgwick", ATTITUDE_MADGWICK, 0);
+		replay(argv[1], "madgwick+mag", ATTITUDE_MADGWICK, 1);
+		printf("\n");
+		return 0;
+	}
+	printf("\n%d updates each\n", ITERATIONS);
+	benchmark("mahony", ATTITUDE_MAHONY, 0);
+	benchmark("mahony+mag", ATTITUDE_MAHONY, 1);
+	benchmark("madgwick", ATTITUDE_MADGWICK, 0);
+	benchmark("madgwick+mag", ATTITUDE_MADGWICK, 1);
+	printf("\n");
+	return 0;
+}
@@ -0,0 +1,115 @@
+// Compare data_fusion() with the Euler angle data_fusion_euler()
+// James Strawson - 2014
+
+#include <robotics_cape.h>
+
+#define SAMPLES		100000
+#define MAX_ERROR	0.001f	// rad
+#define MAX_QUAT_ERROR	1e-5f	// 1-|q.q|
+#define POLE_PERIOD	2000	// samples per pitch sweep through both poles
+#define MAX_PITCH	1.569f	// just short of 90 degrees
+#define MIX_FACTOR	10
+
+float rand_float(float min, float max){
+	return min + (max-min)*rand()/(float)RAND_MAX;
+}
+
+// difference of two angles wrapped to [0, pi]
+float angle_diff(float a, float b){
+	float d = fabsf(a-b);
+	if(d > (float)M_PI) d = TWO_PI - d;
+	return d;
+}
+
+mpudata_t inputs[SAMPLES];
+
+int main(){
+	static mpudata_t fast[SAMPLES], ref[SAMPLES];
+	mpudata_t fast_state, ref_state;
+	vector3d_t euler;
+	quaternion_t q;
+	timespec start, end;
+	uint64_t fast_ns, ref_ns;
+	float err, worst_euler = 0, worst_quat = 0, dot;
+	float pole = (float)M_PI/2.0f - 0.05f;
+	int i, j, at_pole = 0;
+	
+	mpu9150_set_yaw_mixing_factor(MIX_FACTOR);
+	srand(1);
+	
+	// a random walk of roll and yaw so the yaw mixing sees realistic steps,
+	// pitch sweeps through the band near both poles where roll is held
+	euler[VEC3_X] = euler[VEC3_Y] = euler[VEC3_Z] = 0;
+	for(i=0; i<SAMPLES; i++){
+		euler[VEC3_X] += rand_float(-0.05f, 0.05f);
+		euler[VEC3_Z] += rand_float(-0.05f, 0.05f);
+		euler[VEC3_Y] = MAX_PITCH*sinf(TWO_PI*i/POLE_PERIOD)
+				+ rand_float(-0.01f, 0.01f);
+		if(euler[VEC3_Y] > MAX_PITCH) euler[VEC3_Y] = MAX_PITCH;
+		if(euler[VEC3_Y] < -MAX_PITCH) euler[VEC3_Y] = -MAX_PITCH;
+		eulerToQuaternion(euler, q);
+		memset(&inputs[i], 0, sizeof(mpudata_t));
+		for(j=0; j<4; j++){
+			// DMP quaternions are Q30
+			inputs[i].rawQuat[j] = (long)(q[j]*1073741824.0f);
+		}
+		inputs[i].calibratedMag[VEC3_X] = rand_float(-300, 300);
+		inputs[i].calibratedMag[VEC3_Y] = rand_float(-300, 300);
+		inputs[i].calibratedMag[VEC3_Z] = rand_float(-300, 300);
+	}
+	
+	memset(&ref_state, 0, sizeof(mpudata_t));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i=0; i<SAMPLES; i++){
+		memcpy(ref_state.rawQuat, inputs[i].rawQuat, sizeof(ref_state.rawQuat));
+		memcpy(ref_state.calibratedMag, inputs[i].calibratedMag, sizeof(ref_state.calibratedMag));
+		data_fusion_euler(&ref_state);
+		ref[i] = ref_state;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ref_ns = cape_elapsed_ns(start, end);
+	
+	memset(&fast_state, 0, sizeof(mpudata_t));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i=0; i<SAMPLES; i++){
+		memcpy(fast_state.rawQuat, inputs[i].rawQuat, sizeof(fast_state.rawQuat));
+		memcpy(fast_state.calibratedMag, inputs[i].calibratedMag, sizeof(fast_state.calibratedMag));
+		data_fusion(&fast_state);
+		fast[i] = fast_state;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	fast_ns = cape_elapsed_ns(start, end);
+	
+	for(i=0; i<SAMPLES; i++){
+		if(fabsf(ref[i].fusedEuler[VEC3_Y]) >= pole) at_pole++;
+		for(j=0; j<3; j++){
+			err = angle_diff(fast[i].fusedEuler[j], ref[i].fusedEuler[j]);
+			if(err > worst_euler) worst_euler = err;
+		}
+		// q and -q are the same rotation
+		dot = 0;
+		for(j=0; j<4; j++) dot += fast[i].fusedQuat[j]*ref[i].fusedQuat[j];
+		err = 1.0f - fabsf(dot);
+		if(err > worst_quat) worst_quat = err;
+	}
+	
+	printf("\n%d samples, %d near the poles\n", SAMPLES, at_pole);
+	printf("data_fusion_euler: %8.1f ns/sample\n", (float)ref_ns/SAMPLES);
+	printf("data_fusion:       %8.1f ns/sample\n", (float)fast_ns/SAMPLES);
+	printf("speedup:           %8.2fx\n", (float)ref_ns/fast_ns);
+	printf("worst euler difference %g rad, worst 1-|q.q| %g\n\n", worst_euler, worst_quat);
+	
+	if(worst_euler > MAX_ERROR){
+		printf("FAIL: difference above %g rad\n", MAX_ERROR);
+		return -1;
+	}
+	if(worst_quat > MAX_QUAT_ERROR){
+		printf("FAIL: 1-|q.q| above %g\n", MAX_QUAT_ERROR);
+		return -1;
+	}
+	if(at_pole == 0){
+		printf("FAIL: pitch never reached the poles\n");
+		return -1;
+	}
+	return 0;
+}
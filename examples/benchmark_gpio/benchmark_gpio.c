@@ -0,0 +1,53 @@
+// Compare sysfs gpio write latency with and without a cached fd
+// James Strawson - 2014
+
+#include <robotics_cape.h>
+
+#define DEFAULT_PIN	67		// green LED gpio2.3 P8.8
+#define ITERATIONS	10000
+
+int main(int argc, char *argv[]){
+	unsigned int pin = DEFAULT_PIN;
+	timespec start, end;
+	uint64_t slow_ns, fast_ns;
+	int fd, i;
+	
+	if(argc>1){
+		pin = atoi(argv[1]);
+	}
+	
+	if(gpio_export(pin)){
+		printf("failed to export gpio %d\n", pin);
+		return -1;
+	}
+	gpio_set_dir(pin, OUTPUT_PIN);
+	
+	// old path, open/write/close for every call
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i=0; i<ITERATIONS; i++){
+		gpio_set_value(pin, i&1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	slow_ns = cape_elapsed_ns(start, end);
+	
+	// new path, one pwrite on an fd kept open
+	fd = gpio_value_fd_open(pin);
+	if(fd<0){
+		printf("failed to open gpio %d value file\n", pin);
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i=0; i<ITERATIONS; i++){
+		gpio_fd_set_value(fd, i&1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	fast_ns = cape_elapsed_ns(start, end);
+	gpio_fd_set_value(fd, LOW);
+	gpio_fd_close(fd);
+	
+	printf("\ngpio %d, %d writes each\n", pin, ITERATIONS);
+	printf("gpio_set_value:    %8.2f us/call\n", slow_ns/1000.0/ITERATIONS);
+	printf("gpio_fd_set_value: %8.2f us/call\n", fast_ns/1000.0/ITERATIONS);
+	printf("speedup:           %8.2fx\n\n", (float)slow_ns/fast_ns);
+	return 0;
+}
@@ -0,0 +1,136 @@
+// Check and time the online gyro bias estimator on synthetic data
+// James Strawson - 2014
+
+#include <robotics_cape.h>
+
+#define RATE			200		// Hz
+#define GYRO_NOISE		3		// uniform +-, raw units
+#define ACCEL_NOISE		200
+#define ONE_G			16384	// at the 2g range
+#define MAX_ERROR		1.0		// raw units
+#define TIMING_SAMPLES	10000000
+
+typedef enum phase_t {STILL, SPINNING, SLOW_TURN} phase_t;
+
+int noise(int amplitude){
+	return rand()%(2*amplitude+1) - amplitude;
+}
+
+// one simulated sample, t in seconds since the phase started
+void make_sample(mpudata_t* s, phase_t phase, const float bias[3], float t){
+	float rate[3] = {0,0,0};
+	float tilt = 0;
+	int i;
+	if(phase == SPINNING){
+		rate[0] = 800*sinf(6*t);
+		rate[2] = 400*cosf(3*t);
+		tilt = 0.5f*sinf(2*t);
+	}
+	else if(phase == SLOW_TURN){
+		// quiet, but turning 1.2deg/s about x tilts gravity
+		rate[0] = 20;
+		tilt = 0.021f*t;
+	}
+	for(i=0; i<3; i++){
+		s->rawGyro[i] = (short)roundf(rate[i] + bias[i]) + noise(GYRO_NOISE);
+	}
+	s->rawAccel[0] = noise(ACCEL_NOISE);
+	s->rawAccel[1] = (short)(ONE_G*sinf(tilt)) + noise(ACCEL_NOISE);
+	s->rawAccel[2] = (short)(ONE_G*cosf(tilt)) + noise(ACCEL_NOISE);
+}
+
+// runs one phase, returns the number of windows accepted
+int run_phase(gyro_bias_t* est, const char* name, phase_t phase,
+				const float bias[3], int seconds){
+	mpudata_t s;
+	int i, accepted = 0;
+	for(i=0; i<seconds*RATE; i++){
+		make_sample(&s, phase, bias, i/(float)RATE);
+		accepted += gyro_bias_update(est, &s);
+	}
+	printf("%-10s %2d s  %2d windows accepted  bias %6.2f %6.2f %6.2f\n",
+			name, seconds, accepted, est->bias[0], est->bias[1], est->bias[2]);
+	return accepted;
+}
+
+// register mode with the board mounted upright. The bias is in chip axes
+// and the offset registers take it out there, but the samples the
+// estimator sees are rotated into body axes. Returns the worst residual.
+float run_upright(const float chip_bias[3], int seconds){
+	signed char upright[9] = ORIENTATION_UPRIGHT
+	gyro_bias_t est;
+	mpudata_t s;
+	float residual[3], body[3], err, worst = 0;
+	int i, j, accepted = 0;
+	
+	gyro_bias_init(&est, GYRO_BIAS_REGISTERS, RATE);
+	gyro_bias_set_orientation(&est, upright);
+	for(i=0; i<seconds*RATE; i++){
+		for(j=0; j<3; j++) residual[j] = chip_bias[j] + est.offset[j]/2.0f;
+		for(j=0; j<3; j++){
+			body[j] = upright[3*j]*residual[0] + upright[3*j+1]*residual[1]
+					+ upright[3*j+2]*residual[2];
+		}
+		make_sample(&s, STILL, body, 0);
+		accepted += gyro_bias_update(&est, &s);
+		// stands in for gyro_bias_apply(), there is no chip to write to
+		est.pending = 0;
+	}
+	for(j=0; j<3; j++){
+		err = fabsf(chip_bias[j] + est.offset[j]/2.0f);
+		if(err > worst) worst = err;
+	}
+	printf("upright    %2d s  %2d windows accepted  offsets %d %d %d\n",
+			seconds, accepted, est.offset[0], est.offset[1], est.offset[2]);
+	return worst;
+}
+
+int main(){
+	float bias[3] = {30, -20, 12};
+	float drifted[3] = {34, -17, 10};
+	gyro_bias_t est;
+	mpudata_t* samples;
+	timespec start, end;
+	float err, worst = 0;
+	int i, failed = 0;
+	volatile int sink = 0;
+	
+	srand(1);
+	gyro_bias_init(&est, GYRO_BIAS_HOST, RATE);
+	
+	if(run_phase(&est, "still", STILL, bias, 3) == 0) failed = 1;
+	if(run_phase(&est, "spinning", SPINNING, bias, 5)) failed = 1;
+	if(run_phase(&est, "slow turn", SLOW_TURN, bias, 5)) failed = 1;
+	if(run_phase(&est, "drifted", STILL, drifted, 10) == 0) failed = 1;
+	
+	for(i=0; i<3; i++){
+		err = fabsf(est.bias[i] - drifted[i]);
+		if(err > worst) worst = err;
+	}
+	printf("\nworst final bias error %0.2f raw units (%0.3f deg/s)\n",
+			worst, worst/16.4f);
+	if(worst > MAX_ERROR) failed = 1;
+	
+	worst = run_upright(bias, 10);
+	printf("worst upright residual %0.2f raw units\n", worst);
+	if(worst > MAX_ERROR) failed = 1;
+	
+	// timing, on a batch of still samples so every window is accepted
+	samples = malloc(RATE*sizeof(mpudata_t));
+	for(i=0; i<RATE; i++) make_sample(&samples[i], STILL, bias, 0);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i=0; i<TIMING_SAMPLES; i++){
+		sink += gyro_bias_update(&est, &samples[i%RATE]);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("gyro_bias_update %0.1f ns per sample, %d windows\n",
+			cape_elapsed_ns(start, end)/(float)TIMING_SAMPLES, sink);
+	free(samples);
+	
+	if(failed){
+		printf("\nFAIL\n");
+		return -1;
+	}
+	printf("\nPASS\n");
+	return 0;
+}
@@ -0,0 +1,82 @@
+// Compare IMU register read cost over i2c with write+read, I2C_RDWR
+// and scatter-gather I2C_RDWR
+// James Strawson - 2014
+
+#include <robotics_cape.h>
+
+#define IMU_BUS		1
+#define IMU_ADDR	MPU6050_DEFAULT_ADDRESS
+#define ITERATIONS	2000
+
+void print_result(const char* name, uint64_t ns, unsigned long syscalls, int reads){
+	printf("%-22s %8.2f us/read %6.2f syscalls/read\n", name,
+			ns/1000.0/reads, (float)syscalls/reads);
+}
+
+int main(){
+	unsigned char accel[6], temp[2], gyro[6];
+	unsigned char reg;
+	linux_i2c_read_t reads[3];
+	timespec start, end;
+	unsigned long calls;
+	char path[32];
+	int fd, i;
+	
+	// old path, done by hand since linux_glue no longer works this way
+	sprintf(path, "/dev/i2c-%d", IMU_BUS);
+	fd = open(path, O_RDWR);
+	if(fd<0){
+		printf("failed to open %s\n", path);
+		return -1;
+	}
+	if(ioctl(fd, I2C_SLAVE, IMU_ADDR)<0){
+		printf("failed to select i2c slave 0x%02X\n", IMU_ADDR);
+		return -1;
+	}
+	reg = MPU6050_RA_ACCEL_XOUT_H;
+	calls = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i=0; i<ITERATIONS; i++){
+		if(write(fd, &reg, 1)!=1 || read(fd, accel, 6)!=6){
+			printf("write+read failed\n");
+			return -1;
+		}
+		calls += 2;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	close(fd);
+	printf("\nimu 0x%02X on i2c-%d, %d reads each\n", IMU_ADDR, IMU_BUS, ITERATIONS);
+	print_result("write+read:", cape_elapsed_ns(start, end), calls, ITERATIONS);
+	
+	// one combined transaction per register read
+	linux_set_i2c_bus(IMU_BUS);
+	calls = linux_i2c_get_syscalls();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i=0; i<ITERATIONS; i++){
+		if(linux_i2c_read(IMU_ADDR, MPU6050_RA_ACCEL_XOUT_H, 6, accel)){
+			printf("linux_i2c_read failed\n");
+			return -1;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	print_result("linux_i2c_read:", cape_elapsed_ns(start, end),
+			linux_i2c_get_syscalls()-calls, ITERATIONS);
+	
+	// accel, temp and gyro as three register reads in one ioctl
+	reads[0] = (linux_i2c_read_t){IMU_ADDR, MPU6050_RA_ACCEL_XOUT_H, 6, accel};
+	reads[1] = (linux_i2c_read_t){IMU_ADDR, MPU6050_RA_TEMP_OUT_H, 2, temp};
+	reads[2] = (linux_i2c_read_t){IMU_ADDR, MPU6050_RA_GYRO_XOUT_H, 6, gyro};
+	calls = linux_i2c_get_syscalls();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i=0; i<ITERATIONS; i++){
+		if(linux_i2c_read_multi(reads, 3)){
+			printf("linux_i2c_read_multi failed\n");
+			return -1;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	print_result("linux_i2c_read_multi:", cape_elapsed_ns(start, end),
+			linux_i2c_get_syscalls()-calls, 3*ITERATIONS);
+	printf("\n");
+	return 0;
+}
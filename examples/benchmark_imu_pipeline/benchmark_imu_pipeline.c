@@ -0,0 +1,155 @@
+// Compare control loop latency with the imu read done in the control
+// function against the pipelined set_imu_ready_func()
+// James Strawson - 2014
+
+#include <robotics_cape.h>
+
+#define SAMPLE_RATE_HZ	200
+#define PERIOD_NS		(1000000000/SAMPLE_RATE_HZ)
+#define SECONDS			5
+#define DEFAULT_COMPUTE	2000	// us of fake control math per sample
+#define SIM_BUS_US		1500	// simulated read, sleeps like the i2c ioctl
+
+int compute_us = DEFAULT_COMPUTE;
+volatile unsigned long loops;
+
+// busy work standing in for the controller
+void compute(){
+	uint64_t end = cape_monotonic_ns() + (uint64_t)compute_us*1000;
+	while(cape_monotonic_ns() < end);
+}
+
+// old style, the control function reads the imu itself
+int direct_core(){
+	if(mpu9150_read(&mpu) == 0) compute();
+	loops++;
+	return 0;
+}
+
+// pipelined, mpu is already filled in
+int ready_core(){
+	compute();
+	loops++;
+	return 0;
+}
+
+int run_hardware(){
+	imu_latency_t direct, pipelined;
+	unsigned long direct_loops;
+	signed char orientation[9] = ORIENTATION_FLAT;
+	
+	initialize_cape();
+	if(initialize_imu(SAMPLE_RATE_HZ, orientation)){
+		cleanup_cape();
+		return -1;
+	}
+	printf("%d us of compute per sample at %dhz\n\n", compute_us, SAMPLE_RATE_HZ);
+	
+	set_imu_interrupt_func(&direct_core);
+	sleep(SECONDS);
+	set_imu_interrupt_func(&null_func);
+	direct_loops = loops;
+	loops = 0;
+	
+	set_imu_ready_func(&ready_core);
+	sleep(SECONDS);
+	set_imu_interrupt_func(&null_func);
+	
+	get_imu_latency(&direct, &pipelined);
+	printf("direct    %5.1f loops/s\n", direct_loops/(float)SECONDS);
+	printf("pipelined %5.1f loops/s\n\n", loops/(float)SECONDS);
+	print_imu_latency();
+	cleanup_cape();
+	return 0;
+}
+
+/************************************************************************
+*	simulation, needs no hardware. An io thread stands in for the imu
+*	interrupt thread, sleeping through a fake bus read every period.
+************************************************************************/
+imu_pipeline_t sim_pipeline;
+imu_ring_t sim_ring;
+mpudata_t sim_out;
+imu_latency_t sim_direct;
+int sim_pipelined;
+unsigned long sim_edges, sim_missed;
+
+void sleep_until(uint64_t ns){
+	timespec t;
+	t.tv_sec = ns / 1000000000;
+	t.tv_nsec = ns % 1000000000;
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL);
+}
+
+void* sim_io_thread(void* ptr){
+	mpudata_t sample;
+	uint64_t edge = cape_monotonic_ns() + PERIOD_NS;
+	uint64_t start, now;
+	int i;
+	memset(&sample, 0, sizeof(sample));
+	for(i=0; i<SECONDS*SAMPLE_RATE_HZ; i++){
+		sleep_until(edge);
+		sim_edges++;
+		sample.sampleTimeNs = edge;
+		usleep(SIM_BUS_US);
+		if(sim_pipelined){
+			imu_pipeline_push(&sim_pipeline, &sample);
+		}
+		else{
+			start = cape_monotonic_ns();
+			ready_core();
+			imu_latency_add(&sim_direct, edge, start, cape_monotonic_ns());
+		}
+		// an edge that came while we were busy is lost
+		edge += PERIOD_NS;
+		now = cape_monotonic_ns();
+		while(edge < now){
+			edge += PERIOD_NS;
+			sim_missed++;
+			i++;
+		}
+	}
+	return NULL;
+}
+
+int run_sim(){
+	pthread_t io, ctrl;
+	unsigned long direct_missed, direct_loops;
+	
+	printf("simulated: %d us bus and %d us compute per sample at %dhz\n\n",
+			SIM_BUS_US, compute_us, SAMPLE_RATE_HZ);
+	
+	pthread_create(&io, NULL, sim_io_thread, NULL);
+	pthread_join(io, NULL);
+	direct_missed = sim_missed;
+	direct_loops = loops;
+	
+	sim_missed = 0;
+	loops = 0;
+	sim_pipelined = 1;
+	imu_ring_init(&sim_ring);
+	imu_pipeline_init(&sim_pipeline, &sim_ring, &sim_out);
+	imu_pipeline_set_func(&sim_pipeline, &ready_core);
+	pthread_create(&ctrl, NULL, imu_pipeline_thread, &sim_pipeline);
+	pthread_create(&io, NULL, sim_io_thread, NULL);
+	pthread_join(io, NULL);
+	usleep(100000);
+	imu_pipeline_stop(&sim_pipeline);
+	pthread_join(ctrl, NULL);
+	
+	printf("direct    %5lu loops, %4lu interrupts missed\n", direct_loops, direct_missed);
+	printf("pipelined %5lu loops, %4lu interrupts missed\n\n", loops, sim_missed);
+	imu_latency_print("direct", &sim_direct);
+	imu_latency_print("pipelined", &sim_pipeline.stats);
+	return 0;
+}
+
+int main(int argc, char* argv[]){
+	int i, sim = 0;
+	for(i=1; i<argc; i++){
+		if(strcmp(argv[i], "sim") == 0) sim = 1;
+		else compute_us = atoi(argv[i]);
+	}
+	if(sim) return run_sim();
+	return run_hardware();
+}
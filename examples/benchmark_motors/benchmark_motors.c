@@ -0,0 +1,73 @@
+// Compare per-channel set_motor() with batched set_motors()
+// for both the sysfs and ePWM register duty cycle backends.
+// motors stay in standby, only the gpio and pwm writes are timed
+// James Strawson - 2014
+
+#include <robotics_cape.h>
+
+#define ITERATIONS	2000
+
+int run_benchmark(pwm_backend_t backend, const char* name){
+	timespec start, end;
+	uint64_t single_ns, batch_ns, steady_ns;
+	float duty[4];
+	int i, ch;
+	
+	if(set_motor_pwm_backend(backend) || get_motor_pwm_backend()!=backend){
+		printf("\n%s backend not available, skipping\n", name);
+		return -1;
+	}
+	
+	// per-channel path, alternate direction so every write is real
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i=0; i<ITERATIONS; i++){
+		for(ch=1; ch<=4; ch++){
+			set_motor(ch, (i&1) ? 0.2 : -0.3);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	single_ns = cape_elapsed_ns(start, end);
+	
+	// batched path with the same changing values
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i=0; i<ITERATIONS; i++){
+		for(ch=0; ch<4; ch++){
+			duty[ch] = (i&1) ? 0.2 : -0.3;
+		}
+		set_motors(duty, MOTOR_MASK_ALL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	batch_ns = cape_elapsed_ns(start, end);
+	
+	// batched path holding steady, unchanged channels are skipped
+	for(ch=0; ch<4; ch++){
+		duty[ch] = 0.2;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i=0; i<ITERATIONS; i++){
+		set_motors(duty, MOTOR_MASK_ALL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	steady_ns = cape_elapsed_ns(start, end);
+	
+	kill_pwm();
+	
+	printf("\n%s backend, %d updates of all 4 motors\n", name, ITERATIONS);
+	printf("set_motor:             %8.2f us/call\n", single_ns/4000.0/ITERATIONS);
+	printf("4x set_motor:          %8.2f us/update\n", single_ns/1000.0/ITERATIONS);
+	printf("set_motors, changing:  %8.2f us/update\n", batch_ns/1000.0/ITERATIONS);
+	printf("set_motors, steady:    %8.2f us/update\n", steady_ns/1000.0/ITERATIONS);
+	return 0;
+}
+
+int main(){
+	initialize_cape();
+	disable_motors(); // keep H-bridges in standby
+	
+	run_benchmark(PWM_SYSFS, "sysfs");
+	run_benchmark(PWM_REGISTERS, "ePWM register");
+	printf("\n");
+	
+	cleanup_cape();
+	return 0;
+}
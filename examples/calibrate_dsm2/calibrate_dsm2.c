@@ -78,8 +78,7 @@ int main(){
 	
 	// start listening
 	listening = 1;
-	pthread_t  listening_thread;
-	pthread_create(&listening_thread, NULL, listen_func, (void*) NULL);
+	cape_thread_create("dsm2_listen", listen_func, NULL, THREAD_RADIO);
 	
 	// wait for user to hit enter
 	while(getchar() != '\n'){
@@ -87,7 +86,7 @@ int main(){
 	
 	//stop listening
 	listening=0;
-	pthread_join(listening_thread, NULL);
+	cape_thread_join("dsm2_listen");
 	
 	//if it looks like new data came in, write calibration file
 	if((rc_mins[0]==0) || (rc_mins[0]==rc_maxes[0])){ 
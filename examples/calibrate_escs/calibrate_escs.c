@@ -55,8 +55,7 @@ int main(){
 	//Send full throttle until the user hits enter
 	sending = 1;
 	width = SERVO_MAX_US;
-	pthread_t  send_pulse_thread;
-	pthread_create(&send_pulse_thread, NULL, send_pulses, (void*) NULL);
+	cape_thread_create("send_pulses", send_pulses, NULL, THREAD_APP);
 	
 	printf("\n");
 	printf("Now reapply power to the ESCs.\n");
@@ -74,7 +73,7 @@ int main(){
 	// cleanup and close
 	printf("\nCalibration complete, check with test_servos\n");
 	sending = 0;
-	pthread_join(send_pulse_thread, NULL);
+	cape_thread_join("send_pulses");
 	
 	cleanup_cape();
 	return 0;
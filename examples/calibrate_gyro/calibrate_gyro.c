@@ -1,27 +1,24 @@
 // calibrate_gyro.c
 // James Strawson - 2014
 
-// This routine samples the gyro for a second and saves a .cal file containing the offsets
+// This routine waits for two stationary seconds of gyro data and saves a .cal
+// file containing the offsets. It uses the same online estimator that
+// keeps refining them in any program that calls gyro_bias_update().
 
 #include <robotics_cape.h>
 #define SAMPLE_RATE_HZ	200  //can go as high as 200
-
-int  sum_x,sum_y,sum_z,samples;
+#define TIMEOUT_S		30
 
 int sample_imu_data(){
-	mpudata_t mpu; //struct to read IMU data into
-	memset(&mpu, 0, sizeof(mpudata_t)); //make sure it's clean before starting
 	if (mpu9150_read(&mpu) == 0) {
-		sum_x += mpu.rawGyro[VEC3_X];
-		sum_y += mpu.rawGyro[VEC3_Y]; 
-		sum_z += mpu.rawGyro[VEC3_Z];
-		samples ++;
-		fflush(stdout);
+		gyro_bias_update(&gyro_bias, &mpu);
 	}
 	return 0; 
 }
 
 int main(){
+	int16_t zero[3] = {0,0,0};
+	int i;
 	initialize_cape();
 	
 	printf("\nThis program will generate a new gyro calibration file\n");
@@ -30,43 +27,39 @@ int main(){
 	
 	//start up the IMU
 	signed char orientation[9] = ORIENTATION_FLAT;
-	initialize_imu(200,orientation);
+	initialize_imu(SAMPLE_RATE_HZ,orientation);
 
 	setXGyroOffset(0); //make sure gyro is zero'd first
 	setYGyroOffset(0);
 	setZGyroOffset(0);
+	gyro_bias_set_offsets(&gyro_bias, zero);
+	// starting from zero the bias can be big, the stillness tests still hold
+	gyro_bias.bias_max = 32767;
 
 	set_imu_interrupt_func(&sample_imu_data); //start the interrupt handler
-	sleep(1);//sample for a second
+	for(i=0; i<TIMEOUT_S*10 && gyro_bias.updates==0; i++){
+		usleep(100000);
+	}
 	set_imu_interrupt_func(&null_func); //stop sampling data
-
-	// construct a new file path string
-	char file_path[100];
-	strcpy (file_path, CONFIG_DIRECTORY);
-	strcat (file_path, GYRO_CAL_FILE);
 	
-	// open for writing
-	FILE* cal;
-	cal = fopen(file_path, "w");
-	if (cal == 0) {
-		mkdir(CONFIG_DIRECTORY, 0777);
-		cal = fopen(file_path, "w");
-		if (cal == 0){
-			printf("could not open config directory\n");
-			printf(CONFIG_DIRECTORY);
-			printf("\n");
-			return -1;
-		}
+	if(gyro_bias.updates == 0){
+		printf("\nthe beaglebone never sat still for two seconds\n");
+		printf("%lu windows checked, try again on a hard surface\n",
+				gyro_bias.windows);
+		gyro_bias.dirty = 0; // don't let cleanup_cape save zeros
+		cleanup_cape();
+		return -1;
 	}
+	// let the interrupt thread write the offsets
+	usleep(100000);
 	
-
-	printf("samples taken: %d\n", samples);
-	int xoffset = (int16_t)round(-2.0*sum_x/samples);
-	int yoffset = (int16_t)round(-2.0*sum_y/samples);
-	int zoffset = (int16_t)round(-2.0*sum_z/samples);
-	printf("new offsets: X: %d  Y: %d  Z: %d\n", xoffset,yoffset,zoffset);
-	fprintf(cal, "%d\n%d\n%d\n",  xoffset, yoffset, zoffset); 
-	fclose(cal);
+	printf("windows checked: %lu\n", gyro_bias.windows);
+	printf("new offsets: X: %d  Y: %d  Z: %d\n", gyro_bias.offset[0],
+			gyro_bias.offset[1], gyro_bias.offset[2]);
+	if(gyro_bias_save(&gyro_bias)){
+		cleanup_cape();
+		return -1;
+	}
 	
 	printf("\ngyro calibration file written\n");
 	printf("run test_imu to check performance\n");
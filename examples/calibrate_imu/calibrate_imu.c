@@ -0,0 +1,107 @@
+// calibrate_imu.c
+// James Strawson - 2014
+
+// Fits ellipsoids to the accelerometer and magnetometer while the board is
+// turned through every orientation and saves the offsets and ranges to
+// imu.cal, which initialize_imu() loads from then on.
+
+#include <robotics_cape.h>
+#define SAMPLE_RATE_HZ	100
+#define STILL_GYRO		50		// raw units, about 3deg/s
+#define ACCEL_SCALE		16384	// 1g at the 2g range
+#define MAG_SCALE		200		// roughly the earth's field in raw units
+
+ellipsoid_fit_t accel_fit, mag_fit;
+
+int sample_imu_data(){
+	static short last_mag[3];
+	int i, still = 1;
+	if (mpu9150_read(&mpu) != 0) {
+		return 0;
+	}
+	// accel only measures gravity alone while the board is held still
+	for(i=0; i<3; i++){
+		if(abs(mpu.rawGyro[i]) > STILL_GYRO) still = 0;
+	}
+	if(still){
+		ellipsoid_fit_add(&accel_fit, mpu.rawAccel);
+	}
+	// the compass updates slower than the imu, skip repeats
+	if(memcmp(last_mag, mpu.rawMag, sizeof(last_mag))){
+		ellipsoid_fit_add(&mag_fit, mpu.rawMag);
+		memcpy(last_mag, mpu.rawMag, sizeof(last_mag));
+	}
+	return 0;
+}
+
+int main(){
+	caldata_t accel, mag, loaded, fitted;
+	float error;
+	int i, fits = 0;
+	
+	initialize_cape();
+	
+	//start up the IMU, this loads any existing imu.cal
+	signed char orientation[9] = ORIENTATION_FLAT;
+	initialize_imu(SAMPLE_RATE_HZ, orientation);
+	
+	// keep the old values for a sensor whose fit fails
+	if(imu_cal_load(&accel, &mag)){
+		memset(&accel, 0, sizeof(caldata_t));
+		memset(&mag, 0, sizeof(caldata_t));
+	}
+	
+	ellipsoid_fit_init(&accel_fit, ACCEL_SCALE);
+	ellipsoid_fit_init(&mag_fit, MAG_SCALE);
+	
+	printf("\nThis program will generate a new accel & mag calibration file\n");
+	printf("Slowly turn the beaglebone through as many orientations as you\n");
+	printf("can, upside down and on every edge, pausing still for a second\n");
+	printf("in each. Hit enter when done.\n");
+	set_imu_interrupt_func(&sample_imu_data); //start the interrupt handler
+	while( getchar() != '\n' );
+	set_imu_interrupt_func(&null_func); //stop sampling data
+	usleep(100000);
+	
+	printf("\n%lu still accel samples, %lu mag samples\n", accel_fit.n, mag_fit.n);
+	if(ellipsoid_fit_solve(&accel_fit, &fitted, &error) == 0){
+		// samples were taken relative to the accel offset already loaded
+		if(mpu9150_get_accel_cal(&loaded) == 0){
+			for(i=0; i<3; i++) fitted.offset[i] += loaded.offset[i];
+		}
+		accel = fitted;
+		printf("accel offsets: %d %d %d  ranges: %d %d %d  error %0.1f%%\n",
+				accel.offset[0], accel.offset[1], accel.offset[2],
+				accel.range[0], accel.range[1], accel.range[2], 100*error);
+		if(error > ELLIPSOID_MAX_ERROR) printf("accel fit is poor\n");
+		fits++;
+	}
+	else printf("accel not calibrated\n");
+	
+	if(ellipsoid_fit_solve(&mag_fit, &fitted, &error) == 0){
+		mag = fitted;
+		printf("mag offsets: %d %d %d  ranges: %d %d %d  error %0.1f%%\n",
+				mag.offset[0], mag.offset[1], mag.offset[2],
+				mag.range[0], mag.range[1], mag.range[2], 100*error);
+		if(error > ELLIPSOID_MAX_ERROR){
+			printf("mag fit is poor, stay away from metal and motors\n");
+		}
+		fits++;
+	}
+	else printf("mag not calibrated\n");
+	
+	if(fits == 0){
+		printf("\nnothing to save, try again\n");
+		cleanup_cape();
+		return -1;
+	}
+	if(imu_cal_save(&accel, &mag)){
+		cleanup_cape();
+		return -1;
+	}
+	printf("\nimu calibration file written\n");
+	printf("run test_imu to check performance\n");
+	
+	cleanup_cape();
+	return 0;
+}
@@ -105,8 +105,7 @@ int main(){
 	set_imu_interrupt_func(&filter_loop); 
 	
 	// start slow thread printing data
-	pthread_t slow_thread;
-	pthread_create(&slow_thread, NULL, slow_loop_func, (void*) NULL);
+	cape_thread_create("slow_loop", slow_loop_func, NULL, THREAD_APP);
 	
 	setGRN(1);
 	while(get_state()!=EXITING){
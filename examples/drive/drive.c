@@ -142,14 +142,12 @@ int main(){
 	}
 	
 	// start a thread to slowly sample battery 
-	pthread_t  battery_thread;
-	pthread_create(&battery_thread, NULL, battery_checker, (void*) NULL);
+	cape_thread_create("battery", battery_checker, NULL, THREAD_APP);
 	
 	// start printf_thread if running from a terminal
 	// if it was started as a background process then don't bother
 	if(isatty(fileno(stdout))){
-		pthread_t  printf_thread;
-		pthread_create(&printf_thread, NULL, printf_loop, (void*) NULL);
+		cape_thread_create("printf", printf_loop, NULL, THREAD_APP);
 	}
 	
 	// start listening for RC control from dsm2 radio
@@ -158,14 +156,12 @@ int main(){
 				printf("failed to start DSM2\n");
 		}
 		else{
-			pthread_t  dsm2_thread;
-			pthread_create(&dsm2_thread, NULL, dsm2_watcher, (void*) NULL);
+			cape_thread_create("dsm2_watcher", dsm2_watcher, NULL, THREAD_CONTROL);
 		}
 	}
 
 	// this thread is in charge of arming and managing the core
-	pthread_t  drive_stack_thread;
-	pthread_create(&drive_stack_thread, NULL, drive_stack, (void*) NULL);
+	cape_thread_create("drive_stack", drive_stack, NULL, THREAD_CONTROL);
 	
 	// all threads have started, off we go
 	set_state(RUNNING);
@@ -284,9 +280,9 @@ void* drive_stack(void* ptr){
 			for (i=1; i<=4; i++){
 				saturate_number(&cstate.servos[i-1],.05,.95);
 				saturate_number(&cstate.motors[i-1],-config.motor_max,config.motor_max);
-				set_motor(i,cstate.motors[i-1]);
 				send_servo_pulse_normalized(i,cstate.servos[i-1]);
 			}
+			set_motors(cstate.motors, MOTOR_MASK_ALL);
 	
 		default:
 			break;
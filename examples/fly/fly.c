@@ -242,11 +242,13 @@ int print_flight_mode(flight_mode_t mode);
 
 //threads
 void* flight_stack(void* ptr);
-void* mavlink_sender(void* ptr);
-void* safety_thread_func(void* ptr);
-void* DSM2_watcher(void* ptr);
-void* led_manager(void* ptr);
-void* printf_thread_func(void* ptr);
+
+// periodic jobs run from the event loop in main()
+int mavlink_sender(int fd, void* ptr);
+int safety_check(int fd, void* ptr);
+int DSM2_watcher(int fd, void* ptr);
+int led_manager(int fd, void* ptr);
+int printf_func(int fd, void* ptr);
 
 // hardware interrupt routines
 int flight_core();
@@ -297,7 +299,7 @@ int initialize_filters(){
 /************************************************************************
 *	flight_core()
 *	Hardware Interrupt-Driven Flight Control Loop
-*	- read sensor values
+*	- sensor values arrive in mpu, read by the imu thread
 *	- estimate system state
 *	- read setpoint from flight_stack
 *	- if is position mode, calculate a new attitude setpoint
@@ -310,279 +312,280 @@ int flight_core(){
 	int i;	// general purpose
 	
 	/************************************************************************
-	*	Begin control loop if there was a valid interrupt with new IMU data
+	*	mpu was read by the imu thread before this was called, see
+	*	set_imu_ready_func()
 	************************************************************************/
-	if (mpu9150_read(&mpu) == 0) {
-		
-		/************************************************************************
-		*	Estimate system state if DISARMED or not
-		************************************************************************/
-		// // march system state history one step
-		// for(i=(STATE_LEN-1);i>0;i--){
-			// core_state.altitude[i] = core_state.altitude[i-1];
-			// core_state.roll[i] = core_state.roll[i-1];
-			// core_state.pitch[i] = core_state.pitch[i-1];
-			// core_state.yaw[i] = core_state.yaw[i-1];
-			// core_state.alt_err[i] = core_state.alt_err[i-1];
-			// core_state.dRoll_err[i] = core_state.dRoll_err[i-1];
-			// core_state.dPitch_err[i] = core_state.dPitch_err[i-1];
-			// core_state.yaw_err[i] = core_state.yaw_err[i-1];
-		// }
-		
-		// collect new IMU roll/pitch data
-		// positive roll right according to right hand rule
-		// MPU9150 driver has incorrect minus sign on Y axis, correct for it here
-		// positive pitch backwards according to right hand rule
-		core_state.roll  = -(mpu.fusedEuler[VEC3_Y] - core_state.imu_roll_err);
-		core_state.pitch =   mpu.fusedEuler[VEC3_X] - core_state.imu_pitch_err;
+	// tracks gyro drift whenever the frame sits still
+	gyro_bias_update(&gyro_bias, &mpu);
+	
+	/************************************************************************
+	*	Estimate system state if DISARMED or not
+	************************************************************************/
+	// // march system state history one step
+	// for(i=(STATE_LEN-1);i>0;i--){
+		// core_state.altitude[i] = core_state.altitude[i-1];
+		// core_state.roll[i] = core_state.roll[i-1];
+		// core_state.pitch[i] = core_state.pitch[i-1];
+		// core_state.yaw[i] = core_state.yaw[i-1];
+		// core_state.alt_err[i] = core_state.alt_err[i-1];
+		// core_state.dRoll_err[i] = core_state.dRoll_err[i-1];
+		// core_state.dPitch_err[i] = core_state.dPitch_err[i-1];
+		// core_state.yaw_err[i] = core_state.yaw_err[i-1];
+	// }
+	
+	// collect new IMU roll/pitch data
+	// positive roll right according to right hand rule
+	// MPU9150 driver has incorrect minus sign on Y axis, correct for it here
+	// positive pitch backwards according to right hand rule
+	core_state.roll  = -(mpu.fusedEuler[VEC3_Y] - core_state.imu_roll_err);
+	core_state.pitch =   mpu.fusedEuler[VEC3_X] - core_state.imu_pitch_err;
 
-		
-		// current roll/pitch/yaw rates straight from gyro 
-		// converted to rad/s with default FUll scale range
-		// raw gyro matches sign on MPU9150 coordinate system, unlike Euler angle
-		core_state.dRoll  = mpu.rawGyro[VEC3_Y] * GYRO_FSR * DEGREE_TO_RAD / 32767.0;
-		core_state.dPitch = mpu.rawGyro[VEC3_X] * GYRO_FSR * DEGREE_TO_RAD / 32767.0;
-		core_state.dYaw	  = mpu.rawGyro[VEC3_Z] * GYRO_FSR * DEGREE_TO_RAD / 32767.0;
-		
-		// if this is the first loop since being armed, reset yaw trim
-		if(previous_core_mode == DISARMED && 
-			core_setpoint.core_mode != DISARMED)
-		{	
-			core_state.num_yaw_spins = 0;
-			core_state.imu_yaw_on_takeoff = mpu.fusedEuler[VEC3_Z];
-		}
-		float new_yaw = -(mpu.fusedEuler[VEC3_Z] - core_state.imu_yaw_on_takeoff) + (
-													core_state.num_yaw_spins*2*PI);
-		
-		// detect the crossover point at Z = +-PI
-		if(new_yaw - core_state.last_yaw > 6){
-			core_state.num_yaw_spins -= 1;
-		}
-		else if(new_yaw - core_state.last_yaw < -6){
-			core_state.num_yaw_spins += 1;
-		}
-		
-		// record new yaw compensating for full rotation
-		core_state.last_yaw = core_state.yaw;
-		core_state.yaw = -(mpu.fusedEuler[VEC3_Z] - core_state.imu_yaw_on_takeoff) +
-												(core_state.num_yaw_spins*2*PI);
-		
+	
+	// current roll/pitch/yaw rates straight from gyro 
+	// converted to rad/s with default FUll scale range
+	// raw gyro matches sign on MPU9150 coordinate system, unlike Euler angle
+	core_state.dRoll  = mpu.rawGyro[VEC3_Y] * GYRO_FSR * DEGREE_TO_RAD / 32767.0;
+	core_state.dPitch = mpu.rawGyro[VEC3_X] * GYRO_FSR * DEGREE_TO_RAD / 32767.0;
+	core_state.dYaw	  = mpu.rawGyro[VEC3_Z] * GYRO_FSR * DEGREE_TO_RAD / 32767.0;
+	
+	// if this is the first loop since being armed, reset yaw trim
+	if(previous_core_mode == DISARMED && 
+		core_setpoint.core_mode != DISARMED)
+	{	
+		core_state.num_yaw_spins = 0;
+		core_state.imu_yaw_on_takeoff = mpu.fusedEuler[VEC3_Z];
+	}
+	float new_yaw = -(mpu.fusedEuler[VEC3_Z] - core_state.imu_yaw_on_takeoff) + (
+												core_state.num_yaw_spins*2*PI);
+	
+	// detect the crossover point at Z = +-PI
+	if(new_yaw - core_state.last_yaw > 6){
+		core_state.num_yaw_spins -= 1;
+	}
+	else if(new_yaw - core_state.last_yaw < -6){
+		core_state.num_yaw_spins += 1;
+	}
+	
+	// record new yaw compensating for full rotation
+	core_state.last_yaw = core_state.yaw;
+	core_state.yaw = -(mpu.fusedEuler[VEC3_Z] - core_state.imu_yaw_on_takeoff) +
+											(core_state.num_yaw_spins*2*PI);
+	
 
+	/************************************************************************
+	* 	manage the setpoints based on attitude or position mode
+	************************************************************************/
+	switch(core_setpoint.core_mode){
+	
 		/************************************************************************
-		* 	manage the setpoints based on attitude or position mode
-		************************************************************************/
-		switch(core_setpoint.core_mode){
-		
-			/************************************************************************
-			*	in Position control mode, evaluate an outer loop controller to
-			*	change the attitude setpoint. Discard user attitude setpoints
-			************************************************************************/
-			case POSITION:
-				// TODO: outer loop position controller
-				break;
-				
-			/************************************************************************
-			*	in attitude control mode, user has direct control over throttle
-			*	roll, and pitch angles. Absolute yaw setpoint gets updated at
-			*	user-commanded yaw_rate
-			************************************************************************/
-			case ATTITUDE:
-				// only when flying, update the yaw setpoint
-				if(core_setpoint.throttle > YAW_CUTOFF_TH){
-					core_setpoint.yaw += DT*core_setpoint.yaw_rate;
-				}
-				
-				break;
-				
-			/************************************************************************
-			*	if disarmed, reset controllers and return
-			************************************************************************/
-			case DISARMED:
-				core_state.dRoll_err_integrator  = 0;
-				core_state.dPitch_err_integrator = 0;
-				core_state.yaw_err_integrator = 0;
-				zeroFilter(&core_state.roll_ctrl);
-				zeroFilter(&core_state.pitch_ctrl);
-				core_setpoint.yaw=0;
-				memset(&core_state.esc_out,0,16);
-				previous_core_mode = DISARMED;
-				return 0;
-				break;		//should never get here
-				
-			default:
-				break;		//should never get here
-		}
-		
-		
-		/************************************************************************
-		* 	Finally run the attitude feedback controllers
-		************************************************************************/
-		float u[4];		// normalized throttle, roll, pitch, yaw control components 
-		
-		/************************************************************************
-		*	Throttle Controller
+		*	in Position control mode, evaluate an outer loop controller to
+		*	change the attitude setpoint. Discard user attitude setpoints
 		************************************************************************/
-		// compensate for roll/pitch angle to maintain Z thrust
-		float throttle_compensation;
-		throttle_compensation = 1 / cos(core_state.roll);
-		throttle_compensation *= 1 / cos(core_state.pitch);
-		float thr = core_setpoint.throttle*(MAX_THRUST_COMPONENT-core_config.idle_speed)
-						+ core_config.idle_speed;
-		
-		u[0] = throttle_compensation * thr;
-		
+		case POSITION:
+			// TODO: outer loop position controller
+			break;
+			
 		/************************************************************************
-		*	Roll & Pitch Controllers
+		*	in attitude control mode, user has direct control over throttle
+		*	roll, and pitch angles. Absolute yaw setpoint gets updated at
+		*	user-commanded yaw_rate
 		************************************************************************/
-		float dRoll_setpoint = (core_setpoint.roll - core_state.roll) *
-														core_config.roll_rate_per_rad;
-		float dPitch_setpoint = (core_setpoint.pitch - core_state.pitch) *
-														core_config.pitch_rate_per_rad;
-		core_state.dRoll_err  = dRoll_setpoint  - core_state.dRoll;
-		core_state.dPitch_err = dPitch_setpoint - core_state.dPitch;
-		
-		// // if last state was DISARMED, then errors will all be 0.
-		// // make the previous error the same
-		// if(previous_core_mode == DISARMED){
-			// preFillFilter(&core_state.roll_ctrl, core_state.dRoll_err);
-			// preFillFilter(&core_state.pitch_ctrl, core_state.dPitch_err);
-		// }
-		
-		// only run integrator if airborne 
-		// TODO: proper landing/takeoff detection
-		if(u[0] > INT_CUTOFF_TH){
-			core_state.dRoll_err_integrator  += core_state.dRoll_err  * DT;
-			core_state.dPitch_err_integrator += core_state.dPitch_err * DT;
-		}
-		
-				
-		marchFilter(&core_state.roll_ctrl, core_state.dRoll_err);
-		marchFilter(&core_state.pitch_ctrl, core_state.dPitch_err);
-		
-		if(core_setpoint.throttle<0.1){
-			saturateFilter(&core_state.roll_ctrl, -LAND_SATURATION,LAND_SATURATION);
-			saturateFilter(&core_state.pitch_ctrl, -LAND_SATURATION, LAND_SATURATION);
-		}
-		else{
-			saturateFilter(&core_state.roll_ctrl, -MAX_ROLL_COMPONENT, MAX_ROLL_COMPONENT);
-			saturateFilter(&core_state.pitch_ctrl, -MAX_PITCH_COMPONENT, MAX_PITCH_COMPONENT);
-		}
-		
-		u[1] = core_state.roll_ctrl.current_output;
-		u[2] = core_state.pitch_ctrl.current_output;
-		
-		
+		case ATTITUDE:
+			// only when flying, update the yaw setpoint
+			if(core_setpoint.throttle > YAW_CUTOFF_TH){
+				core_setpoint.yaw += DT*core_setpoint.yaw_rate;
+			}
+			
+			break;
+			
 		/************************************************************************
-		*	Yaw Controller
+		*	if disarmed, reset controllers and return
 		************************************************************************/
-		core_state.yaw_err = core_setpoint.yaw - core_state.yaw;
-		
-		// only run integrator if airborne 
-		if(u[0] > INT_CUTOFF_TH){
-			core_state.yaw_err_integrator += core_state.yaw_err * DT;
-		}
+		case DISARMED:
+			core_state.dRoll_err_integrator  = 0;
+			core_state.dPitch_err_integrator = 0;
+			core_state.yaw_err_integrator = 0;
+			zeroFilter(&core_state.roll_ctrl);
+			zeroFilter(&core_state.pitch_ctrl);
+			core_setpoint.yaw=0;
+			memset(&core_state.esc_out,0,16);
+			previous_core_mode = DISARMED;
+			return 0;
+			break;		//should never get here
+			
+		default:
+			break;		//should never get here
+	}
+	
+	
+	/************************************************************************
+	* 	Finally run the attitude feedback controllers
+	************************************************************************/
+	float u[4];		// normalized throttle, roll, pitch, yaw control components 
+	
+	/************************************************************************
+	*	Throttle Controller
+	************************************************************************/
+	// compensate for roll/pitch angle to maintain Z thrust
+	float throttle_compensation;
+	throttle_compensation = 1 / cos(core_state.roll);
+	throttle_compensation *= 1 / cos(core_state.pitch);
+	float thr = core_setpoint.throttle*(MAX_THRUST_COMPONENT-core_config.idle_speed)
+					+ core_config.idle_speed;
+	
+	u[0] = throttle_compensation * thr;
+	
+	/************************************************************************
+	*	Roll & Pitch Controllers
+	************************************************************************/
+	float dRoll_setpoint = (core_setpoint.roll - core_state.roll) *
+													core_config.roll_rate_per_rad;
+	float dPitch_setpoint = (core_setpoint.pitch - core_state.pitch) *
+													core_config.pitch_rate_per_rad;
+	core_state.dRoll_err  = dRoll_setpoint  - core_state.dRoll;
+	core_state.dPitch_err = dPitch_setpoint - core_state.dPitch;
+	
+	// // if last state was DISARMED, then errors will all be 0.
+	// // make the previous error the same
+	// if(previous_core_mode == DISARMED){
+		// preFillFilter(&core_state.roll_ctrl, core_state.dRoll_err);
+		// preFillFilter(&core_state.pitch_ctrl, core_state.dPitch_err);
+	// }
+	
+	// only run integrator if airborne 
+	// TODO: proper landing/takeoff detection
+	if(u[0] > INT_CUTOFF_TH){
+		core_state.dRoll_err_integrator  += core_state.dRoll_err  * DT;
+		core_state.dPitch_err_integrator += core_state.dPitch_err * DT;
+	}
+	
+			
+	marchFilter(&core_state.roll_ctrl, core_state.dRoll_err);
+	marchFilter(&core_state.pitch_ctrl, core_state.dPitch_err);
+	
+	if(core_setpoint.throttle<0.1){
+		saturateFilter(&core_state.roll_ctrl, -LAND_SATURATION,LAND_SATURATION);
+		saturateFilter(&core_state.pitch_ctrl, -LAND_SATURATION, LAND_SATURATION);
+	}
+	else{
+		saturateFilter(&core_state.roll_ctrl, -MAX_ROLL_COMPONENT, MAX_ROLL_COMPONENT);
+		saturateFilter(&core_state.pitch_ctrl, -MAX_PITCH_COMPONENT, MAX_PITCH_COMPONENT);
+	}
+	
+	u[1] = core_state.roll_ctrl.current_output;
+	u[2] = core_state.pitch_ctrl.current_output;
+	
+	
+	/************************************************************************
+	*	Yaw Controller
+	************************************************************************/
+	core_state.yaw_err = core_setpoint.yaw - core_state.yaw;
+	
+	// only run integrator if airborne 
+	if(u[0] > INT_CUTOFF_TH){
+		core_state.yaw_err_integrator += core_state.yaw_err * DT;
+	}
+
+	marchFilter(&core_state.yaw_ctrl, core_state.yaw_err);
+	
+	if(core_setpoint.throttle<0.1){
+		saturateFilter(&core_state.yaw_ctrl, -LAND_SATURATION,LAND_SATURATION);
+	}
+	else{
+		saturateFilter(&core_state.yaw_ctrl, -MAX_YAW_COMPONENT, MAX_YAW_COMPONENT);
+	}
+	u[3] = core_state.yaw_ctrl.current_output;
+	
+	/************************************************************************
+	*  Mixing for arducopter/pixhawk X-quadrator layout
+	*  CW 3	  1 CCW			
+	* 	   \ /				Y
+	*	   / \            	|_ X
+	* CCW 2	  4 CW
+	************************************************************************/
+	float new_esc[4];
+	
+	new_esc[0]=u[0]-u[1]+u[2]-u[3];
+	new_esc[1]=u[0]+u[1]-u[2]-u[3];
+	new_esc[2]=u[0]+u[1]+u[2]+u[3];
+	new_esc[3]=u[0]-u[1]-u[2]+u[3];	
+	
+	/************************************************************************
+	*	Prevent saturation under heavy vertical acceleration by reducing all
+	*	outputs evenly such that the largest doesn't exceed 1
+	************************************************************************/
+	// find control output limits 
+	float largest_value = 0;
+	float smallest_value = 1;
+	for(i=0;i<4;i++){
+		if(new_esc[i]>largest_value){
+			largest_value = new_esc[i];
 
-		marchFilter(&core_state.yaw_ctrl, core_state.yaw_err);
-		
-		if(core_setpoint.throttle<0.1){
-			saturateFilter(&core_state.yaw_ctrl, -LAND_SATURATION,LAND_SATURATION);
 		}
-		else{
-			saturateFilter(&core_state.yaw_ctrl, -MAX_YAW_COMPONENT, MAX_YAW_COMPONENT);
+		if(new_esc[i]<smallest_value){
+			smallest_value=new_esc[i];
 		}
-		u[3] = core_state.yaw_ctrl.current_output;
-		
-		/************************************************************************
-		*  Mixing for arducopter/pixhawk X-quadrator layout
-		*  CW 3	  1 CCW			
-		* 	   \ /				Y
-		*	   / \            	|_ X
-		* CCW 2	  4 CW
-		************************************************************************/
-		float new_esc[4];
-		
-		new_esc[0]=u[0]-u[1]+u[2]-u[3];
-		new_esc[1]=u[0]+u[1]-u[2]-u[3];
-		new_esc[2]=u[0]+u[1]+u[2]+u[3];
-		new_esc[3]=u[0]-u[1]-u[2]+u[3];	
+	}
+	// if upper saturation would have occurred, reduce all outputs evenly
+	if(largest_value>1){
+		for(i=0;i<4;i++){
+		float offset = largest_value - 1;
+			new_esc[i]-=offset;
+		}
+	}
 		
-		/************************************************************************
-		*	Prevent saturation under heavy vertical acceleration by reducing all
-		*	outputs evenly such that the largest doesn't exceed 1
-		************************************************************************/
-		// find control output limits 
-		float largest_value = 0;
-		float smallest_value = 1;
+	/************************************************************************
+	*	Send a servo pulse immediately at the end of the control loop.
+	*	Intended to update ESCs exactly once per control timestep
+	*	also record this action to core_state.new_esc_out[] for telemetry
+	************************************************************************/
+	
+	// if this is the first time armed, make sure to send minimum 
+	// pulse width to prevent ESCs from going into calibration
+	
+	if(previous_core_mode == DISARMED){
 		for(i=0;i<4;i++){
-			if(new_esc[i]>largest_value){
-				largest_value = new_esc[i];
-
-			}
-			if(new_esc[i]<smallest_value){
-				smallest_value=new_esc[i];
-			}
+			send_servo_pulse_normalized(i+1,0);
 		}
-		// if upper saturation would have occurred, reduce all outputs evenly
-		if(largest_value>1){
-			for(i=0;i<4;i++){
-			float offset = largest_value - 1;
-				new_esc[i]-=offset;
+	}
+	else{
+		for(i=0;i<4;i++){
+			if(new_esc[i]>1.0){
+				new_esc[i]=1.0;
 			}
-		}
-			
-		/************************************************************************
-		*	Send a servo pulse immediately at the end of the control loop.
-		*	Intended to update ESCs exactly once per control timestep
-		*	also record this action to core_state.new_esc_out[] for telemetry
-		************************************************************************/
-		
-		// if this is the first time armed, make sure to send minimum 
-		// pulse width to prevent ESCs from going into calibration
-		
-		if(previous_core_mode == DISARMED){
-			for(i=0;i<4;i++){
-				send_servo_pulse_normalized(i+1,0);
+			else if(new_esc[i]<0){
+				new_esc[i]=0;
 			}
+			send_servo_pulse_normalized(i+1,new_esc[i]);
+			core_state.esc_out[i] = new_esc[i];
+			core_state.control_u[i] = u[i];		
 		}
-		else{
-			for(i=0;i<4;i++){
-				if(new_esc[i]>1.0){
-					new_esc[i]=1.0;
-				}
-				else if(new_esc[i]<0){
-					new_esc[i]=0;
-				}
-				send_servo_pulse_normalized(i+1,new_esc[i]);
-				core_state.esc_out[i] = new_esc[i];
-				core_state.control_u[i] = u[i];		
-			}
-		}	
-		
-		// log some useful data if armed and flying
-		core_log_entry_t new_entry;
-		new_entry.num_loops	= core_state.control_loops;
-		new_entry.roll		= core_state.roll;
-		new_entry.pitch		= core_state.pitch;
-		new_entry.yaw		= core_state.yaw;
-		new_entry.dRoll		= core_state.dRoll;
-		new_entry.dPitch	= core_state.dPitch;
-		new_entry.dYaw		= core_state.dYaw;
-		new_entry.u_0		= core_state.control_u[0];
-		new_entry.u_1		= core_state.control_u[1];
-		new_entry.u_2		= core_state.control_u[2];
-		new_entry.u_3		= core_state.control_u[3];
-		new_entry.esc_1		= core_state.esc_out[0];
-		new_entry.esc_2		= core_state.esc_out[1];
-		new_entry.esc_3		= core_state.esc_out[2];
-		new_entry.esc_4		= core_state.esc_out[3];
-		new_entry.v_batt	= core_state.v_batt;
-			
-		log_core_data(&core_logger, &new_entry);
+	}	
+	
+	// log some useful data if armed and flying
+	core_log_entry_t new_entry;
+	new_entry.num_loops	= core_state.control_loops;
+	new_entry.roll		= core_state.roll;
+	new_entry.pitch		= core_state.pitch;
+	new_entry.yaw		= core_state.yaw;
+	new_entry.dRoll		= core_state.dRoll;
+	new_entry.dPitch	= core_state.dPitch;
+	new_entry.dYaw		= core_state.dYaw;
+	new_entry.u_0		= core_state.control_u[0];
+	new_entry.u_1		= core_state.control_u[1];
+	new_entry.u_2		= core_state.control_u[2];
+	new_entry.u_3		= core_state.control_u[3];
+	new_entry.esc_1		= core_state.esc_out[0];
+	new_entry.esc_2		= core_state.esc_out[1];
+	new_entry.esc_3		= core_state.esc_out[2];
+	new_entry.esc_4		= core_state.esc_out[3];
+	new_entry.v_batt	= core_state.v_batt;
 		
-		//remember the last state to detect transition from DISARMED to ARMED
-		previous_core_mode = core_setpoint.core_mode;
-		core_state.control_loops++;
-	}
+	log_core_data(&core_logger, &new_entry);
+	
+	//remember the last state to detect transition from DISARMED to ARMED
+	previous_core_mode = core_setpoint.core_mode;
+	core_state.control_loops++;
 	return 0;
 }
 
@@ -776,56 +779,50 @@ int on_pause_press(){
 
 /************************************************************************
 *	mavlink_sender
-*	send mavlink heartbeat and IMU attitude packets
+*	send mavlink heartbeat and IMU attitude packets, called at 10hz
 ************************************************************************/
-void* mavlink_sender(void* ptr){
+int mavlink_sender(int fd, void* ptr){
 	uint8_t buf[MAV_BUF_LEN];
 	mavlink_message_t msg;
 	uint16_t len;
-	while(get_state() != EXITING){
-		
-		// send heartbeat
-		memset(buf, 0, MAV_BUF_LEN);
-		mavlink_msg_heartbeat_pack(1, 200, &msg, MAV_TYPE_HELICOPTER, MAV_AUTOPILOT_GENERIC, MAV_MODE_GUIDED_ARMED, 0, MAV_STATE_ACTIVE);
-		len = mavlink_msg_to_send_buffer(buf, &msg);
-		sendto(sock, buf, len, 0, (struct sockaddr*)&gcAddr, sizeof(struct sockaddr_in));
-		
-		//send attitude
-		memset(buf, 0, MAV_BUF_LEN);
-		mavlink_msg_attitude_pack(1, 200, &msg, microsSinceEpoch(), 
-											core_state.roll, 
-											core_state.pitch,
-											core_state.yaw, 
-											core_state.dRoll,
-											core_state.dPitch,
-											core_state.dYaw);
-		len = mavlink_msg_to_send_buffer(buf, &msg);
-		sendto(sock, buf, len, 0, (struct sockaddr*)&gcAddr, sizeof(struct sockaddr_in));
-		
-		usleep(100000); // 10 hz
-	}
-	return NULL;
+	
+	// send heartbeat
+	memset(buf, 0, MAV_BUF_LEN);
+	mavlink_msg_heartbeat_pack(1, 200, &msg, MAV_TYPE_HELICOPTER, MAV_AUTOPILOT_GENERIC, MAV_MODE_GUIDED_ARMED, 0, MAV_STATE_ACTIVE);
+	len = mavlink_msg_to_send_buffer(buf, &msg);
+	sendto(sock, buf, len, 0, (struct sockaddr*)&gcAddr, sizeof(struct sockaddr_in));
+	
+	//send attitude
+	memset(buf, 0, MAV_BUF_LEN);
+	mavlink_msg_attitude_pack(1, 200, &msg, microsSinceEpoch(), 
+										core_state.roll, 
+										core_state.pitch,
+										core_state.yaw, 
+										core_state.dRoll,
+										core_state.dPitch,
+										core_state.dYaw);
+	len = mavlink_msg_to_send_buffer(buf, &msg);
+	sendto(sock, buf, len, 0, (struct sockaddr*)&gcAddr, sizeof(struct sockaddr_in));
+	
+	return 0;
 }
 
 /************************************************************************
-*	Safety thread 
+*	Safety check, called at 20hz
 *	check for rollover 
 *	TODO: check for low battery too
 ************************************************************************/
-void* safety_thread_func(void* ptr){
-	while(get_state()!=EXITING){
-		// check for tipover
-		if(core_setpoint.core_mode != DISARMED){
-			if(	fabs(core_state.roll)>TIP_THRESHOLD ||
-				fabs(core_state.pitch)>TIP_THRESHOLD)
-			{
-				printf("\nTIP DETECTED\n");
-				disarm();
-			}
+int safety_check(int fd, void* ptr){
+	// check for tipover
+	if(core_setpoint.core_mode != DISARMED){
+		if(	fabs(core_state.roll)>TIP_THRESHOLD ||
+			fabs(core_state.pitch)>TIP_THRESHOLD)
+		{
+			printf("\nTIP DETECTED\n");
+			disarm();
 		}
-		usleep(50000); // check at ~20hz
 	}
-	return NULL;
+	return 0;
 }
 
 /************************************************************************
@@ -833,114 +830,111 @@ void* safety_thread_func(void* ptr){
 *	Watch for loss of DSM2 radio communication
 *	after DSM2_LAND_TIMEOUT, go into emergency land mode
 * 	after DSM2_DISARM_TIMEOUT disarm the motors completely 
+*	called at 100hz
 ************************************************************************/
-void* DSM2_watcher(void* ptr){
-	timespec last_dsm2_time, current_time;
+int DSM2_watcher(int fd, void* ptr){
+	static timespec last_dsm2_time;
+	timespec current_time;
 	
 	// toggle using_dsm2 to 1 when first packet arrives
 	// only check timeouts if this is true
-	int using_dsm2; 
+	static int using_dsm2; 
 	
-	while(get_state()!=EXITING){
-		// record time and process new data
-		clock_gettime(CLOCK_MONOTONIC, &current_time);
+	// record time and process new data
+	clock_gettime(CLOCK_MONOTONIC, &current_time);
+	
+	switch (is_new_dsm2_data()){
+	case 1:	
+		using_dsm2 = 1;
 		
-		switch (is_new_dsm2_data()){
-		case 1:	
-			using_dsm2 = 1;
+		// record time and process new data
+		clock_gettime(CLOCK_MONOTONIC, &last_dsm2_time);
+		// user hit the kill switch, emergency disarm
+		if(get_dsm2_ch_normalized(5)<0){
+			user_interface.kill_switch = 1;
 			
-			// record time and process new data
-			clock_gettime(CLOCK_MONOTONIC, &last_dsm2_time);
-			// user hit the kill switch, emergency disarm
-			if(get_dsm2_ch_normalized(5)<0){
-				user_interface.kill_switch = 1;
-				
-				// it is not strictly necessary to call disarm here
-				// since flight_stack checks kill_switch, but in the
-				// event of a flight_stack crash this will disarm anyway
-				disarm(); 
+			// it is not strictly necessary to call disarm here
+			// since flight_stack checks kill_switch, but in the
+			// event of a flight_stack crash this will disarm anyway
+			disarm(); 
+		}
+		else{	
+			// user hasn't hit kill switch
+			user_interface.kill_switch = 0;
+			// configure your radio switch layout here
+			user_interface.throttle_stick = get_dsm2_ch_normalized(1);
+			// positive roll means tipping right
+			user_interface.roll_stick 	= -get_dsm2_ch_normalized(2);
+			// positive pitch means tipping backwards
+			user_interface.pitch_stick 	= -get_dsm2_ch_normalized(3);
+			// positive yaw means turning left
+			user_interface.yaw_stick 	= get_dsm2_ch_normalized(4);
+			
+			// only use ATTITUDE for now
+			if(get_dsm2_ch_normalized(6)>0){
+				user_interface.flight_mode = USER_ATTITUDE;
 			}
-			else{	
-				// user hasn't hit kill switch
-				user_interface.kill_switch = 0;
-				// configure your radio switch layout here
-				user_interface.throttle_stick = get_dsm2_ch_normalized(1);
-				// positive roll means tipping right
-				user_interface.roll_stick 	= -get_dsm2_ch_normalized(2);
-				// positive pitch means tipping backwards
-				user_interface.pitch_stick 	= -get_dsm2_ch_normalized(3);
-				// positive yaw means turning left
-				user_interface.yaw_stick 	= get_dsm2_ch_normalized(4);
-				
-				// only use ATTITUDE for now
-				if(get_dsm2_ch_normalized(6)>0){
-					user_interface.flight_mode = USER_ATTITUDE;
-				}
-				else{
-					user_interface.flight_mode = USER_ATTITUDE;
-				}
+			else{
+				user_interface.flight_mode = USER_ATTITUDE;
 			}
-			break;
+		}
+		break;
+		
+	// No new data, check for time-outs
+	case 0:
+		if(using_dsm2){
+			timespec timeout = diff(last_dsm2_time, current_time);
+			float timeout_secs = timeout.tv_sec + (timeout.tv_nsec/1000000000.0);
 			
-		// No new data, check for time-outs
-		case 0:
-			if(using_dsm2){
-				timespec timeout = diff(last_dsm2_time, current_time);
-				float timeout_secs = timeout.tv_sec + (timeout.tv_nsec/1000000000.0);
-				
-				// if core is armed and timeout met, disarm the core
-				if(core_setpoint.core_mode != DISARMED &&
-					timeout_secs > DSM2_DISARM_TIMEOUT){
-					printf("\n\nlost DSM2 communication for %0.1f seconds", timeout_secs);
-					disarm();
-				}
-				
-				// start landing the the cutout is still short
-				else if(user_interface.flight_mode != EMERGENCY_LAND &&
-							timeout_secs > DSM2_LAND_TIMEOUT){
-					printf("\n\nlost DSM2 communication for %0.1f seconds\n", timeout_secs);
-					printf("EMERGENCY LANDING\n");
-					user_interface.flight_mode = EMERGENCY_LAND;
-					user_interface.throttle_stick 	= -1;
-					user_interface.roll_stick 		= 0;
-					user_interface.pitch_stick 		= 0;
-					user_interface.yaw_stick 		= 0;
-				}
-				break;
+			// if core is armed and timeout met, disarm the core
+			if(core_setpoint.core_mode != DISARMED &&
+				timeout_secs > DSM2_DISARM_TIMEOUT){
+				printf("\n\nlost DSM2 communication for %0.1f seconds", timeout_secs);
+				disarm();
 			}
-		default:
-			break;  // should never get here
+			
+			// start landing the the cutout is still short
+			else if(user_interface.flight_mode != EMERGENCY_LAND &&
+						timeout_secs > DSM2_LAND_TIMEOUT){
+				printf("\n\nlost DSM2 communication for %0.1f seconds\n", timeout_secs);
+				printf("EMERGENCY LANDING\n");
+				user_interface.flight_mode = EMERGENCY_LAND;
+				user_interface.throttle_stick 	= -1;
+				user_interface.roll_stick 		= 0;
+				user_interface.pitch_stick 		= 0;
+				user_interface.yaw_stick 		= 0;
+			}
+			break;
 		}
-		
-		usleep(10000); // ~ 100hz
+	default:
+		break;  // should never get here
 	}
-	return NULL;
+	return 0;
 }
 
 /************************************************************************
 *	 flash the red LED is armed, or turn on green if disarmed
+*	called every half second
 ************************************************************************/
-void* led_manager(void* ptr){
-	int toggle;
-	while (get_state()!=EXITING){
-		if(core_setpoint.core_mode == DISARMED){
-			if(toggle){
-				setRED(LOW);
-				toggle = 1;
-			}
-			else{
-				setRED(HIGH);
-				toggle = 0;
-			}
+int led_manager(int fd, void* ptr){
+	static int toggle;
+
+	if(core_setpoint.core_mode == DISARMED){
+		if(toggle){
+			setRED(LOW);
+			toggle = 1;
 		}
 		else{
+			setRED(HIGH);
 			toggle = 0;
-			setGRN(HIGH);
-			setRED(LOW);
 		}
-		usleep(500000); //toggle LED every half second
 	}
-	return NULL;
+	else{
+		toggle = 0;
+		setGRN(HIGH);
+		setRED(LOW);
+	}
+	return 0;
 }
 
 /************************************************************************
@@ -980,60 +974,54 @@ int print_flight_mode(flight_mode_t mode){
 }
 
 /************************************************************************
-*	print stuff to the console
+*	print stuff to the console, called at 5hz
 ************************************************************************/
-void* printf_thread_func(void* ptr){
+int printf_func(int fd, void* ptr){
 	int i;
 	
-	printf("\nTurn your transmitter kill switch UP\n");
-	printf("Then move throttle UP then DOWN to arm\n");
+	printf("\r");
 	
-	while(get_state()!=EXITING){
-		printf("\r");
-		
-		// print core_state
-		printf("roll %0.2f ", core_state.roll); 
-		printf("pitch %0.2f ", core_state.pitch); 
-		printf("yaw %0.2f ", core_state.yaw); 
-		
-		// printf("dRoll %0.1f ", core_state.dRoll); 
-		// printf("dPitch %0.1f ", core_state.dPitch); 
-		// printf("dYaw %0.1f ", core_state.dYaw); 
-		
-		printf("err: R %0.1f ", core_state.dRoll_err); 
-		printf("P %0.1f ", core_state.dPitch_err); 
-		printf("Y %0.1f ", core_state.yaw_err); 
-		
-		// // print user inputs
-		// printf("user inputs: ");
-		// printf("thr %0.1f ", user_interface.throttle_stick); 
-		// printf("roll %0.1f ", user_interface.roll_stick); 
-		// printf("pitch %0.1f ", user_interface.pitch_stick); 
-		// printf("yaw %0.1f ", user_interface.yaw_stick); 
-		// printf("kill %d ", user_interface.kill_switch); 
-		
-		// // print setpoints
-		// printf("setpoints: ");
-		// printf("roll %0.1f ", core_setpoint.roll); 
-		// printf("pitch %0.1f ", core_setpoint.pitch); 
-		// printf("yaw: %0.1f ", core_setpoint.yaw); 
-		
-		// print control outputs
-		printf("u: ");
-		for(i=0; i<4; i++){
-			printf("%0.2f ", core_state.control_u[i]);
-		}
-		
-		// // print outputs to motors
-		// printf("esc: ");
-		// for(i=0; i<4; i++){
-			// printf("%0.2f ", core_state.esc_out[i]);
-		// }
-			
-		fflush(stdout);	
-		usleep(200000); // print at ~5hz
+	// print core_state
+	printf("roll %0.2f ", core_state.roll); 
+	printf("pitch %0.2f ", core_state.pitch); 
+	printf("yaw %0.2f ", core_state.yaw); 
+	
+	// printf("dRoll %0.1f ", core_state.dRoll); 
+	// printf("dPitch %0.1f ", core_state.dPitch); 
+	// printf("dYaw %0.1f ", core_state.dYaw); 
+	
+	printf("err: R %0.1f ", core_state.dRoll_err); 
+	printf("P %0.1f ", core_state.dPitch_err); 
+	printf("Y %0.1f ", core_state.yaw_err); 
+	
+	// // print user inputs
+	// printf("user inputs: ");
+	// printf("thr %0.1f ", user_interface.throttle_stick); 
+	// printf("roll %0.1f ", user_interface.roll_stick); 
+	// printf("pitch %0.1f ", user_interface.pitch_stick); 
+	// printf("yaw %0.1f ", user_interface.yaw_stick); 
+	// printf("kill %d ", user_interface.kill_switch); 
+	
+	// // print setpoints
+	// printf("setpoints: ");
+	// printf("roll %0.1f ", core_setpoint.roll); 
+	// printf("pitch %0.1f ", core_setpoint.pitch); 
+	// printf("yaw: %0.1f ", core_setpoint.yaw); 
+	
+	// print control outputs
+	printf("u: ");
+	for(i=0; i<4; i++){
+		printf("%0.2f ", core_state.control_u[i]);
 	}
-	return NULL;
+	
+	// // print outputs to motors
+	// printf("esc: ");
+	// for(i=0; i<4; i++){
+		// printf("%0.2f ", core_state.esc_out[i]);
+	// }
+		
+	fflush(stdout);	
+	return 0;
 }
 
 // Turn features on/off base don user options
@@ -1088,14 +1076,8 @@ int parse_arguments(int argc, char* argv[]){
 
 // Main only serves to initialize hardware and spawn threads
 int main(int argc, char* argv[]){
-	// not all threads may begin depending on user options
-	pthread_t mav_send_thread;
-	pthread_t led_thread;
-	pthread_t safety_thread;
-	pthread_t flight_stack_thread;
-	pthread_t DSM2_watcher_thread;
-	pthread_t printf_thread;
-	pthread_t core_logging_thread;
+	// slow periodic jobs all share one event loop run by main
+	event_loop_t loop;
 	
 	// first check for user options
 	if(parse_arguments(argc, argv)<0){
@@ -1140,31 +1122,37 @@ int main(int argc, char* argv[]){
 		printf("WARNING: failed to open a core_log file\n");
 	}
 	else{
-		pthread_create(&core_logging_thread, NULL, core_log_writer, &core_logger);
+		cape_thread_create("core_log", core_log_writer, &core_logger, THREAD_LOG);
 	}
 	
-	// start mavlink thread if enabled by user
+	if(event_loop_init(&loop)){
+		cleanup_cape();
+		return -1;
+	}
+	
+	// start mavlink if enabled by user
 	if(options.mavlink){
 		// open a udp port for mavlink
 		// sock and gcAddr are global variables needed to send and receive
 		gcAddr = initialize_mavlink_udp(DEFAULT_MAV_ADDRESS, &sock);
 		
-		// Start thread sending heartbeat and IMU attitude packets
-		pthread_create(&mav_send_thread, NULL, mavlink_sender, (void*) NULL);
+		// send heartbeat and IMU attitude packets at 10hz
+		event_loop_add_timer(&loop, 100000, 1, mavlink_sender, NULL);
 		printf("Sending Heartbeat Packets\n");
 	}
 
-	// Start LED Flasher Thread
-	pthread_create(&led_thread, NULL, led_manager, (void*) NULL);
+	// LED flasher every half second
+	event_loop_add_timer(&loop, 500000, 0, led_manager, NULL);
 	
-	// Start Safety checking thread
-	pthread_create(&safety_thread, NULL, safety_thread_func, (void*) NULL);
+	// Safety checking at 20hz, runs first if several jobs are due
+	event_loop_add_timer(&loop, 50000, 3, safety_check, NULL);
 	
-	// Begin flight Stack
-	pthread_create(&flight_stack_thread, NULL, flight_stack, (void*) NULL);
+	// Begin flight Stack, it blocks while waiting for arming
+	// so it keeps its own thread
+	cape_thread_create("flight_stack", flight_stack, NULL, THREAD_CONTROL);
 	
-	// start interpreting dsm2 packets
-	pthread_create(&DSM2_watcher_thread, NULL, DSM2_watcher, (void*) NULL);
+	// interpret dsm2 packets at 100hz
+	event_loop_add_timer(&loop, 10000, 2, DSM2_watcher, NULL);
 	
 	// Start the real-time interrupt driven control thread
 	signed char orientation[9] = ORIENTATION_FLAT;
@@ -1173,19 +1161,21 @@ int main(int argc, char* argv[]){
 		cleanup_cape();
 		return -1;
 	}
-	set_imu_interrupt_func(&flight_core);
+	set_imu_ready_func(&flight_core);
 	
-	// if the user didn't specify quiet mode, start printing
+	// if the user didn't specify quiet mode, start printing at 5hz
 	if(options.quiet == 0){
-		pthread_create(&printf_thread, NULL, printf_thread_func, (void*) NULL);
+		cape_thread_print_report();
+		printf("\nTurn your transmitter kill switch UP\n");
+		printf("Then move throttle UP then DOWN to arm\n");
+		event_loop_add_timer(&loop, 200000, 0, printf_func, NULL);
 	}
 	
-	//chill until something exits the program
-	while(get_state()!=EXITING){
-		usleep(100000);
-	}
+	// run the periodic jobs until something exits the program
+	event_loop_run(&loop);
 	
 	// cleanup before closing
+	event_loop_cleanup(&loop);
 	close(sock); 	// mavlink UDP socket
 	stop_core_log(&core_logger);// finish writing core_log
 	cleanup_cape();	// de-initialize cape hardware
@@ -0,0 +1,156 @@
+// Time button press to callback latency through a fifo stand-in
+// James Strawson - 2014
+
+#include <robotics_cape.h>
+
+#define FIFO_PATH		"/tmp/test_button_latency.fifo"
+#define DEFAULT_EVENTS	2000
+#define MAX_EVENTS		100000
+#define REOPEN_EVERY	50		// close and reopen the writer this often
+#define MAX_REOPEN_US	2000	// median after a reopen must beat this
+
+uint64_t* latency_ns;		// per event, in the order written
+int* after_reopen;			// first event written after a reopen
+volatile int handled = 0;
+
+// kernel style timestamp on CLOCK_REALTIME, like evdev's default
+uint64_t realtime_ns(){
+	timespec t;
+	clock_gettime(CLOCK_REALTIME, &t);
+	return (uint64_t)t.tv_sec*1000000000ULL + t.tv_nsec;
+}
+
+// every callback does the same thing, time it against the event stamp
+int on_event(){
+	struct timeval tv = get_button_event_time();
+	uint64_t stamp = (uint64_t)tv.tv_sec*1000000000ULL + tv.tv_usec*1000ULL;
+	latency_ns[handled] = realtime_ns() - stamp;
+	__sync_synchronize();
+	handled++;
+	return 0;
+}
+
+// open the write end, the dispatcher has to have the read end open first
+int open_writer(){
+	int fd, tries;
+	for(tries=0; tries<1000; tries++){
+		fd = open(FIFO_PATH, O_WRONLY | O_NONBLOCK);
+		if(fd >= 0) return fd;
+		usleep(1000);
+	}
+	printf("could not open %s for writing\n", FIFO_PATH);
+	return -1;
+}
+
+// one key record and the EV_SYN that follows it, as evdev sends them
+int write_key(int fd, int code, int value){
+	struct input_event ev[2];
+	uint64_t now = realtime_ns();
+	memset(ev, 0, sizeof(ev));
+	ev[0].time.tv_sec = now / 1000000000ULL;
+	ev[0].time.tv_usec = (now % 1000000000ULL) / 1000;
+	ev[0].type = EV_KEY;
+	ev[0].code = code;
+	ev[0].value = value;
+	ev[1].time = ev[0].time;
+	ev[1].type = EV_SYN;
+	return write(fd, ev, sizeof(ev)) == sizeof(ev) ? 0 : -1;
+}
+
+int cmp_u64(const void* a, const void* b){
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+// sorts v in place
+void print_distribution(const char* name, uint64_t* v, int n){
+	if(n == 0) return;
+	qsort(v, n, sizeof(uint64_t), cmp_u64);
+	printf("%-14s %6d %9.1f %9.1f %9.1f %9.1f\n", name, n, v[0]/1000.0,
+			v[n/2]/1000.0, v[(n*99)/100]/1000.0, v[n-1]/1000.0);
+}
+
+int main(int argc, char *argv[]){
+	int events = DEFAULT_EVENTS;
+	uint64_t *all, *reopened;
+	int i, fd, n_reopened = 0, failed = 0;
+	
+	if(argc>1) events = atoi(argv[1]);
+	if(events<1 || events>MAX_EVENTS){
+		printf("number of events must be between 1 and %d\n", MAX_EVENTS);
+		return -1;
+	}
+	latency_ns = calloc(events, sizeof(uint64_t));
+	after_reopen = calloc(events, sizeof(int));
+	all = calloc(events, sizeof(uint64_t));
+	reopened = calloc(events, sizeof(uint64_t));
+	
+	unlink(FIFO_PATH);
+	if(mkfifo(FIFO_PATH, 0600)){
+		printf("could not make %s\n", FIFO_PATH);
+		return -1;
+	}
+	set_button_input_device(FIFO_PATH);
+	set_pause_pressed_func(&on_event);
+	set_pause_unpressed_func(&on_event);
+	set_mode_pressed_func(&on_event);
+	set_mode_unpressed_func(&on_event);
+	if(initialize_button_handlers()){
+		return -1;
+	}
+	if((fd = open_writer()) < 0){
+		return -1;
+	}
+	
+	// alternate press and release of both buttons with an irregular gap,
+	// waiting for each callback so events never queue behind each other
+	for(i=0; i<events; i++){
+		if(i>0 && i%REOPEN_EVERY == 0){
+			// hang up, let the dispatcher see it, then come back
+			close(fd);
+			usleep(20000);
+			if((fd = open_writer()) < 0){
+				failed = 1;
+				break;
+			}
+			after_reopen[i] = 1;
+		}
+		usleep(200 + rand()%800);
+		if(write_key(fd, (i/2)%2 ? 2 : 1, (i+1)%2)){
+			printf("write to fifo failed\n");
+			failed = 1;
+			break;
+		}
+		while(handled <= i){
+			usleep(50);
+		}
+	}
+	close(fd);
+	set_state(EXITING);
+	
+	for(i=0; i<handled; i++){
+		all[i] = latency_ns[i];
+		if(after_reopen[i]) reopened[n_reopened++] = latency_ns[i];
+	}
+	printf("\nlatency, us        count       min    median       p99       max\n");
+	print_distribution("all events", all, handled);
+	print_distribution("after reopen", reopened, n_reopened);
+	
+	// the old dispatcher slept 10ms per hangup, a reopened writer
+	// waited 5ms on average for the next poll
+	if(n_reopened && reopened[n_reopened/2] > MAX_REOPEN_US*1000ULL){
+		printf("events after a writer reopen are being held back\n");
+		failed = 1;
+	}
+	if(handled != events){
+		printf("only %d of %d events reached a callback\n", handled, events);
+		failed = 1;
+	}
+	unlink(FIFO_PATH);
+	if(failed){
+		printf("\nFAIL\n");
+		return -1;
+	}
+	printf("\nPASS\n");
+	return 0;
+}
@@ -0,0 +1,125 @@
+// Check encoder_velocity_from_regs() against a model of the eQep registers
+// James Strawson - 2014
+
+#include <robotics_cape.h>
+
+#define CAP_HZ		(PWMSS_SYSCLK_HZ>>ENCODER_CCPS)	// capture clock
+#define UP_COUNTS	(1<<ENCODER_UPPS)	// counts per unit position event
+#define SPAN		5	// unit periods between reads, a 200hz loop
+
+int failed = 0;
+
+void check(const char* what, float got, float expect, float tol){
+	int ok = fabsf(got - expect) <= tol;
+	printf("%-46s %10.2f expected %10.2f  %s\n", what, got, expect,
+			ok ? "ok" : "BAD");
+	if(!ok) failed = 1;
+}
+
+// latched registers for a wheel turning at a steady vel counts per second,
+// read SPAN unit periods after the previous read which happened at t0
+void model_regs(double vel, double t0, int32_t* dpos, uint16_t* cprd,
+									uint16_t* ctmr, uint16_t* sts){
+	double t1 = t0 + SPAN*ENCODER_UNIT_PERIOD_US*1e-6;
+	double speed = fabs(vel);
+	double last_up, clocks;
+	
+	*dpos = (int32_t)(floor(vel*t1) - floor(vel*t0));
+	*sts = vel >= 0 ? QDF : 0;
+	// edges every 1/speed s, capture every UP_COUNTS of them
+	last_up = floor(speed*t1/UP_COUNTS)*UP_COUNTS/speed;
+	clocks = UP_COUNTS*CAP_HZ/speed;
+	if(clocks > 65535 || last_up <= 0){
+		*sts |= COEF;
+		*cprd = 65535;
+		*ctmr = 65535;
+		return;
+	}
+	*cprd = (uint16_t)round(clocks);
+	*ctmr = (uint16_t)fmin(65535, round((t1 - last_up)*CAP_HZ));
+}
+
+int main(){
+	int32_t dpos;
+	uint16_t cprd, ctmr, sts;
+	float v, got, tol, worst_count = 0, worst_period = 0;
+	float unit_hz = 1000000.0/ENCODER_UNIT_PERIOD_US;
+	float period_vel = UP_COUNTS*(float)CAP_HZ/3906;
+	int period_used, count_used;
+	
+	printf("count mode\n");
+	check("50 counts over 5 periods", 
+		encoder_velocity_from_regs(50, 5, 3906, 100, QDF), 50*unit_hz/5, 0.01);
+	check("-50 counts over 5 periods, direction from dpos", 
+		encoder_velocity_from_regs(-50, 5, 3906, 100, 0), -50*unit_hz/5, 0.01);
+	check("40 counts over 4 periods, same speed", 
+		encoder_velocity_from_regs(40, 4, 3906, 100, QDF), 50*unit_hz/5, 0.01);
+	check("periods of 0 counts as 1", 
+		encoder_velocity_from_regs(20, 0, 3906, 100, QDF), 20*unit_hz, 0.01);
+	
+	printf("\nperiod mode\n");
+	check("5 counts, 3906 capture clocks, QDF set", 
+		encoder_velocity_from_regs(5, 5, 3906, 100, QDF), period_vel, 0.01);
+	check("5 counts, 3906 capture clocks, QDF clear", 
+		encoder_velocity_from_regs(-5, 5, 3906, 100, 0), -period_vel, 0.01);
+	check("no edge for longer than the period, slowing", 
+		encoder_velocity_from_regs(1, 5, 3906, 7812, QDF),
+		UP_COUNTS*(float)CAP_HZ/7812, 0.01);
+	
+	printf("\nswitchover at %d counts\n", ENCODER_SLOW_COUNTS);
+	check("7 counts uses the period", 
+		encoder_velocity_from_regs(ENCODER_SLOW_COUNTS-1, 5, 3906, 100, QDF),
+		period_vel, 0.01);
+	check("8 counts uses the count", 
+		encoder_velocity_from_regs(ENCODER_SLOW_COUNTS, 5, 3906, 100, QDF),
+		ENCODER_SLOW_COUNTS*unit_hz/5, 0.01);
+	check("-8 counts uses the count", 
+		encoder_velocity_from_regs(-ENCODER_SLOW_COUNTS, 5, 3906, 100, 0),
+		-ENCODER_SLOW_COUNTS*unit_hz/5, 0.01);
+	
+	printf("\nQEPSTS error bits fall back to the count\n");
+	check("COEF, capture timer overflowed", 
+		encoder_velocity_from_regs(5, 5, 3906, 100, QDF|COEF), 5*unit_hz/5, 0.01);
+	check("CDEF, direction changed mid capture", 
+		encoder_velocity_from_regs(5, 5, 3906, 100, QDF|CDEF), 5*unit_hz/5, 0.01);
+	check("cprd of 0, no capture yet", 
+		encoder_velocity_from_regs(5, 5, 0, 0, QDF), 5*unit_hz/5, 0.01);
+	
+	// sweep steady speeds through the switchover, each at several phases
+	// of the encoder edges against the read. The count is good to one
+	// count over the span, the period to well under a percent
+	period_used = count_used = 0;
+	for(v=50; v<50000; v*=1.05){
+		double t0;
+		for(t0=0.1; t0<0.1+1.0/v; t0+=0.17/v){
+			model_regs(v, t0, &dpos, &cprd, &ctmr, &sts);
+			got = encoder_velocity_from_regs(dpos, SPAN, cprd, ctmr, sts);
+			if(dpos < ENCODER_SLOW_COUNTS){
+				tol = 0.01*v;
+				period_used++;
+				if(fabsf(got-v)/v > worst_period) worst_period = fabsf(got-v)/v;
+			}
+			else{
+				tol = 1.001*unit_hz/SPAN;
+				count_used++;
+				if(fabsf(got-v) > worst_count) worst_count = fabsf(got-v);
+			}
+			if(fabsf(got-v) > tol || fabsf(encoder_velocity_from_regs(-dpos,
+					SPAN, cprd, ctmr, sts^QDF) + got) > 0.001*v){
+				printf("%.1f counts/s read as %.1f\n", v, got);
+				failed = 1;
+			}
+		}
+	}
+	printf("\nsweep 50 to 50000 counts/s: %d reads by period, worst %.3f%%\n",
+			period_used, 100*worst_period);
+	printf("                            %d reads by count, worst %.1f counts/s\n",
+			count_used, worst_count);
+	
+	if(failed){
+		printf("\nFAIL\n");
+		return -1;
+	}
+	printf("\nPASS\n");
+	return 0;
+}
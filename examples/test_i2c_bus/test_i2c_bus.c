@@ -0,0 +1,232 @@
+// Check the shared i2c bus lock with simulated devices, needs no hardware
+// James Strawson - 2014
+
+#define _GNU_SOURCE		// sched_setaffinity
+#include <sched.h>
+#include <robotics_cape.h>
+
+#define SLAVE			0x68
+#define RT_READS		1000
+#define RT_PERIOD_US	1000
+#define RT_READ_US		200
+#define BG_WRITE_US		300
+#define BG_THREADS		2
+#define OTHER_READS		200
+#define INV_HOLD_US		2000	// background write holding the bus
+#define INV_SPIN_US		50000	// mid priority work that isn't on the bus
+#define INV_MAX_US		10000	// realtime read must finish within
+
+// one simulated bus, counts transactions and catches any overlap
+typedef struct sim_bus_t {
+	volatile int busy;
+	volatile unsigned long overlaps;
+	volatile unsigned long transactions;
+} sim_bus_t;
+
+sim_bus_t sims[3];
+linux_i2c_bus_t bus1, bus2, bus3;
+volatile int rt_done;
+uint64_t inv_read_ns;
+
+void spin_us(int us){
+	uint64_t end = cape_monotonic_ns() + (uint64_t)us*1000;
+	while(cape_monotonic_ns() < end);
+}
+
+int sim_transaction(sim_bus_t* sim, int us){
+	if(__sync_lock_test_and_set(&sim->busy, 1)){
+		__sync_fetch_and_add(&sim->overlaps, 1);
+	}
+	__sync_fetch_and_add(&sim->transactions, 1);
+	spin_us(us);
+	__sync_lock_release(&sim->busy);
+	return 0;
+}
+
+int sim_write(void* arg, unsigned char slave_addr, unsigned char reg_addr,
+			unsigned char length, unsigned char const* data){
+	return sim_transaction(arg, BG_WRITE_US);
+}
+
+int sim_read(void* arg, unsigned char slave_addr, unsigned char reg_addr,
+			unsigned char length, unsigned char* data){
+	memset(data, 0, length);
+	return sim_transaction(arg, RT_READ_US);
+}
+
+const linux_i2c_backend_t sim_backend = { sim_write, sim_read };
+
+int slow_write(void* arg, unsigned char slave_addr, unsigned char reg_addr,
+			unsigned char length, unsigned char const* data){
+	return sim_transaction(arg, INV_HOLD_US);
+}
+
+const linux_i2c_backend_t slow_backend = { slow_write, sim_read };
+
+// like the imu interrupt thread
+void* rt_thread(void* ptr){
+	unsigned char buf[14];
+	int i;
+	i2c_bus_set_priority(I2C_BUS_REALTIME);
+	linux_i2c_select_bus(&bus1);
+	for(i=0; i<RT_READS; i++){
+		linux_i2c_read(SLAVE, 0x3B, 14, buf);
+		usleep(RT_PERIOD_US);
+	}
+	rt_done = 1;
+	return NULL;
+}
+
+// configuration writes, calibration tools and the like
+void* bg_thread(void* ptr){
+	unsigned long* writes = ptr;
+	unsigned char v = 0;
+	linux_i2c_select_bus(&bus1);
+	while(!rt_done){
+		linux_i2c_write(SLAVE, 0x6B, 1, &v);
+		(*writes)++;
+	}
+	return NULL;
+}
+
+// a device on another bus, its selection must not leak into other threads
+void* other_bus_thread(void* ptr){
+	unsigned char buf[2];
+	int i;
+	linux_i2c_select_bus(&bus2);
+	for(i=0; i<OTHER_READS; i++){
+		linux_i2c_read(0x1E, 0x03, 2, buf);
+		usleep(RT_PERIOD_US);
+	}
+	return NULL;
+}
+
+// priority inversion, all on one cpu. A low priority background write
+// holds the bus, mid priority work wants the cpu and a high priority
+// realtime read wants the bus. The owner has to inherit the realtime
+// priority or the read waits for all of the mid priority work.
+void* inv_bg_thread(void* ptr){
+	unsigned char v = 0;
+	linux_i2c_select_bus(&bus3);
+	linux_i2c_write(SLAVE, 0x6B, 1, &v);
+	return NULL;
+}
+
+void* inv_mid_thread(void* ptr){
+	spin_us(INV_SPIN_US);
+	return NULL;
+}
+
+void* inv_rt_thread(void* ptr){
+	unsigned char buf[14];
+	uint64_t start;
+	i2c_bus_set_priority(I2C_BUS_REALTIME);
+	linux_i2c_select_bus(&bus3);
+	start = cape_monotonic_ns();
+	linux_i2c_read(SLAVE, 0x3B, 14, buf);
+	inv_read_ns = cape_monotonic_ns() - start;
+	return NULL;
+}
+
+int start_fifo(pthread_t* thread, int priority, void*(*func)(void*)){
+	pthread_attr_t attr;
+	struct sched_param param;
+	int ret;
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	param.sched_priority = priority;
+	pthread_attr_setschedparam(&attr, &param);
+	ret = pthread_create(thread, &attr, func, NULL);
+	pthread_attr_destroy(&attr);
+	return ret;
+}
+
+// returns -1 on failure, 1 if SCHED_FIFO isn't allowed
+int check_inversion(){
+	pthread_t bg, mid, rt;
+	struct sched_param param;
+	cpu_set_t cpus;
+	
+	CPU_ZERO(&cpus);
+	CPU_SET(0, &cpus);
+	param.sched_priority = 40;
+	if(sched_setaffinity(0, sizeof(cpus), &cpus) ||
+			sched_setscheduler(0, SCHED_FIFO, &param)){
+		printf("priority inversion check skipped, needs SCHED_FIFO\n");
+		return 1;
+	}
+	if(start_fifo(&bg, 10, inv_bg_thread)) return 1;
+	while(!sims[2].busy) usleep(100);
+	start_fifo(&mid, 20, inv_mid_thread);
+	start_fifo(&rt, 30, inv_rt_thread);
+	pthread_join(rt, NULL);
+	pthread_join(mid, NULL);
+	pthread_join(bg, NULL);
+	param.sched_priority = 0;
+	sched_setscheduler(0, SCHED_OTHER, &param);
+	
+	printf("realtime read behind a preempted owner took %0.1fus\n",
+			inv_read_ns/1000.0);
+	return inv_read_ns > INV_MAX_US*1000ULL ? -1 : 0;
+}
+
+int main(){
+	pthread_t rt, bg[BG_THREADS], other;
+	unsigned long writes[BG_THREADS], bg_total = 0;
+	i2c_bus_stats_t s;
+	float rt_wait, bg_wait;
+	int i, failed = 0;
+	
+	linux_i2c_bus_init(&bus1, 1);
+	bus1.backend = &sim_backend;
+	bus1.backend_arg = &sims[0];
+	linux_i2c_bus_init(&bus2, 2);
+	bus2.backend = &sim_backend;
+	bus2.backend_arg = &sims[1];
+	linux_i2c_bus_init(&bus3, 3);
+	bus3.backend = &slow_backend;
+	bus3.backend_arg = &sims[2];
+	
+	pthread_create(&rt, NULL, rt_thread, NULL);
+	for(i=0; i<BG_THREADS; i++){
+		writes[i] = 0;
+		pthread_create(&bg[i], NULL, bg_thread, &writes[i]);
+	}
+	pthread_create(&other, NULL, other_bus_thread, NULL);
+	pthread_join(rt, NULL);
+	for(i=0; i<BG_THREADS; i++){
+		pthread_join(bg[i], NULL);
+		bg_total += writes[i];
+	}
+	pthread_join(other, NULL);
+	
+	i2c_bus_print_report();
+	printf("\n");
+	
+	printf("bus 1: %lu transactions, %lu overlapping\n", sims[0].transactions,
+			sims[0].overlaps);
+	printf("bus 2: %lu transactions, %lu overlapping\n", sims[1].transactions,
+			sims[1].overlaps);
+	if(sims[0].overlaps || sims[1].overlaps) failed = 1;
+	if(sims[0].transactions != RT_READS + bg_total) failed = 1;
+	if(sims[1].transactions != OTHER_READS) failed = 1;
+	
+	// realtime only ever waits for the one transaction on the bus
+	i2c_bus_get_stats(1, &s);
+	rt_wait = s.rt_contended ? s.rt_wait_ns_total/1000.0/s.rt_contended : 0;
+	bg_wait = s.contended ? s.wait_ns_total/1000.0/s.contended : 0;
+	printf("realtime waited %lu times, %0.1fus mean, background %0.1fus mean\n",
+			s.rt_contended, rt_wait, bg_wait);
+	if(s.rt_contended == 0 || rt_wait > BG_WRITE_US) failed = 1;
+	if(rt_wait >= bg_wait || s.rt_preempts == 0) failed = 1;
+	
+	if(check_inversion() < 0) failed = 1;
+	
+	if(failed){
+		printf("\nFAIL\n");
+		return -1;
+	}
+	printf("\nPASS\n");
+	return 0;
+}
@@ -0,0 +1,161 @@
+// Check the i2c tracer against a simulated bus with known latencies
+// James Strawson - 2014
+
+#include <robotics_cape.h>
+#include <sys/prctl.h>
+
+#define SLAVE			0x68
+#define REG_ACCEL		0x3B	// 14 bytes, 300us
+#define REG_FIFO		0x74	// 48 bytes, 1200us
+#define REG_PWR			0x6B	// 1 byte write, 100us
+#define REG_MISSING		0x00	// always fails
+#define PERIODS			200
+#define PERIOD_US		5000
+#define WRITES			300
+#define TIMING_CALLS	1000000
+
+volatile int fast_bus;		// skip the simulated delays for timing
+linux_i2c_bus_t bus;		// selected by each thread that uses it
+
+void spin_us(int us){
+	timespec start, now;
+	if(fast_bus) return;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do clock_gettime(CLOCK_MONOTONIC, &now);
+	while((now.tv_sec-start.tv_sec)*1000000 + (now.tv_nsec-start.tv_nsec)/1000 < us);
+}
+
+int sim_write(void* arg, unsigned char slave_addr, unsigned char reg_addr,
+			unsigned char length, unsigned char const* data){
+	if(reg_addr == REG_MISSING) return -1;
+	spin_us(100);
+	return 0;
+}
+
+int sim_read(void* arg, unsigned char slave_addr, unsigned char reg_addr,
+			unsigned char length, unsigned char* data){
+	if(reg_addr == REG_MISSING) return -1;
+	spin_us(reg_addr==REG_FIFO ? 1200 : 300);
+	memset(data, 0, length);
+	return 0;
+}
+
+const linux_i2c_backend_t sim_backend = { sim_write, sim_read };
+
+// like the imu interrupt thread, two reads per period
+void* imu_thread(void* ptr){
+	unsigned char buf[48];
+	timespec next, now;
+	int i;
+	prctl(PR_SET_NAME, "imu_sim", 0, 0, 0);
+	linux_i2c_select_bus(&bus);
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for(i=0; i<PERIODS; i++){
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		i2c_trace_period_begin((uint64_t)now.tv_sec*1000000000 + now.tv_nsec);
+		linux_i2c_read(SLAVE, REG_ACCEL, 14, buf);
+		linux_i2c_read(SLAVE, REG_FIFO, 48, buf);
+		i2c_trace_period_end();
+		next.tv_nsec += PERIOD_US*1000;
+		if(next.tv_nsec >= 1000000000){
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+	return NULL;
+}
+
+void* config_thread(void* ptr){
+	unsigned char v = 1;
+	int i;
+	prctl(PR_SET_NAME, "config_sim", 0, 0, 0);
+	linux_i2c_select_bus(&bus);
+	for(i=0; i<WRITES; i++){
+		linux_i2c_write(SLAVE, REG_PWR, 1, &v);
+		linux_i2c_write(SLAVE, REG_MISSING, 1, &v);
+	}
+	return NULL;
+}
+
+// histogram bin holding the median, a preempted call only moves the mean
+int median_bin(const i2c_trace_stats_t* s){
+	uint32_t sum = 0;
+	int i;
+	for(i=0; i<I2C_TRACE_BINS; i++){
+		sum += s->hist[i];
+		if(2*sum >= s->count) return i;
+	}
+	return I2C_TRACE_BINS-1;
+}
+
+// counts, and the median in the bin of the simulated latency
+int check(const char* name, i2c_trace_op_t op, unsigned char reg,
+			uint32_t count, uint32_t errors, uint64_t bytes, int us){
+	i2c_trace_stats_t s;
+	uint32_t binned = 0;
+	float mean;
+	int i, ok, bin;
+	if(i2c_trace_get(op, SLAVE, reg, &s)){
+		printf("%-8s never traced\n", name);
+		return -1;
+	}
+	for(i=0; i<I2C_TRACE_BINS; i++) binned += s.hist[i];
+	mean = s.total_ns/1000.0/s.count;
+	ok = s.count==count && s.errors==errors && s.bytes==bytes && binned==count;
+	bin = median_bin(&s);
+	if(us){
+		ok = ok && i2c_trace_bin_upper_ns(bin) > us*1000 &&
+				i2c_trace_bin_upper_ns(bin) <= 2*us*1000;
+	}
+	printf("%-8s %5u calls %4u errors %6llu bytes, mean %7.1fus, median <%lluus  %s\n",
+			name, s.count, s.errors, (unsigned long long)s.bytes, mean,
+			(unsigned long long)(i2c_trace_bin_upper_ns(bin) >> I2C_TRACE_US_SHIFT),
+			ok?"ok":"BAD");
+	return ok ? 0 : -1;
+}
+
+int main(){
+	pthread_t imu, config;
+	unsigned char buf[14];
+	timespec start, end;
+	double on_ns, off_ns;
+	int i, failed = 0;
+	
+	linux_i2c_bus_init(&bus, 1);
+	bus.backend = &sim_backend;
+	linux_i2c_select_bus(&bus);
+	
+	pthread_create(&imu, NULL, imu_thread, NULL);
+	pthread_create(&config, NULL, config_thread, NULL);
+	pthread_join(imu, NULL);
+	pthread_join(config, NULL);
+	
+	if(check("accel", I2C_TRACE_READ, REG_ACCEL, PERIODS, 0, 14*PERIODS, 300)) failed = 1;
+	if(check("fifo", I2C_TRACE_READ, REG_FIFO, PERIODS, 0, 48*PERIODS, 1200)) failed = 1;
+	if(check("pwr", I2C_TRACE_WRITE, REG_PWR, WRITES, 0, WRITES, 100)) failed = 1;
+	if(check("missing", I2C_TRACE_WRITE, REG_MISSING, WRITES, WRITES, WRITES, 0)) failed = 1;
+	
+	i2c_trace_print_report();
+	
+	// overhead of tracing on a bus that costs nothing
+	fast_bus = 1;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i=0; i<TIMING_CALLS; i++) linux_i2c_read(SLAVE, REG_ACCEL, 14, buf);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	on_ns = ((end.tv_sec-start.tv_sec)*1e9 + (end.tv_nsec-start.tv_nsec))/TIMING_CALLS;
+	i2c_trace_enable(0);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i=0; i<TIMING_CALLS; i++) linux_i2c_read(SLAVE, REG_ACCEL, 14, buf);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	off_ns = ((end.tv_sec-start.tv_sec)*1e9 + (end.tv_nsec-start.tv_nsec))/TIMING_CALLS;
+	printf("\ntracing costs %0.1f ns per call (%0.1f traced, %0.1f not)\n",
+			on_ns-off_ns, on_ns, off_ns);
+	
+	if(failed){
+		printf("\nFAIL\n");
+		return -1;
+	}
+	printf("\nPASS\n");
+	return 0;
+}
@@ -45,6 +45,10 @@ int print_imu_data(){
     
 int main(int argc, char *argv[]){
 	int sample_rate;
+	mpu9150_stats_t stats;
+	timespec start, end;
+	unsigned long i2c_start;
+	float seconds;
 	signed char orientation[9] = ORIENTATION_FLAT; 
 	//signed char orientation[9] = ORIENTATION_UPRIGHT;
 	
@@ -61,12 +65,30 @@ int main(int argc, char *argv[]){
 	
 	initialize_cape();
 	initialize_imu(sample_rate, orientation);
+	cape_thread_print_report();
+	i2c_start = linux_i2c_get_syscalls();
+	clock_gettime(CLOCK_MONOTONIC, &start);
 	set_imu_interrupt_func(&print_imu_data); //start the interrupt handler
 	
 	//now just wait, print_imu_data will run
 	while (get_state() != EXITING) {
 		sleep(1);
 	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	
+	// interrupts that didn't match exactly one new fifo packet
+	mpu9150_get_stats(&stats);
+	printf("\n%lu interrupt reads, %lu empty, %lu behind\n",
+			stats.reads, stats.empty, stats.backlog);
+	// from the CLOCK_MONOTONIC interrupt edge times
+	printf("period mean %0.1fus min %0.1fus max %0.1fus jitter %0.1fus\n",
+			stats.period_mean_ns/1000.0, stats.period_min_ns/1000.0,
+			stats.period_max_ns/1000.0, stats.period_jitter_ns/1000.0);
+	// bus load, the compass is only read at its own rate
+	seconds = diff(start, end).tv_sec + diff(start, end).tv_nsec/1e9;
+	printf("%0.1f i2c transactions/s, %0.1f compass reads/s\n",
+			(linux_i2c_get_syscalls()-i2c_start)/seconds,
+			stats.mag_reads/seconds);
 	cleanup_cape();
 	return 0;
 }
@@ -0,0 +1,117 @@
+// Check the ellipsoid fit behind calibrate_imu on synthetic sensors
+// James Strawson - 2014
+
+#include <robotics_cape.h>
+
+#define SAMPLES			20000
+#define TIMING_SAMPLES	10000000
+
+typedef struct sensor_t {
+	const char* name;
+	float center[3];
+	float radius[3];
+	int noise;				// uniform +-, raw units
+	float scale;			// passed to ellipsoid_fit_init()
+	float max_offset_err;	// raw units
+	float max_range_err;	// fraction of the range
+} sensor_t;
+
+float rand_float(float min, float max){
+	return min + (max-min)*rand()/(float)RAND_MAX;
+}
+
+// a point on the sensor's ellipsoid, direction uniform over the sphere
+// or only within max_tilt of +z
+void make_sample(const sensor_t* s, float max_tilt, short v[3]){
+	float z = rand_float(cosf(max_tilt), 1);
+	float az = rand_float(0, TWO_PI);
+	float r = sqrtf(1 - z*z);
+	float dir[3] = {r*cosf(az), r*sinf(az), z};
+	int i;
+	for(i=0; i<3; i++){
+		v[i] = (short)roundf(s->center[i] + s->radius[i]*dir[i])
+				+ rand()%(2*s->noise+1) - s->noise;
+	}
+}
+
+int check_sensor(const sensor_t* s){
+	ellipsoid_fit_t fit;
+	caldata_t cal;
+	short v[3];
+	float error, offset_err = 0, range_err = 0, e;
+	int i, ok;
+	
+	ellipsoid_fit_init(&fit, s->scale);
+	for(i=0; i<SAMPLES; i++){
+		make_sample(s, M_PI, v);
+		ellipsoid_fit_add(&fit, v);
+	}
+	if(ellipsoid_fit_solve(&fit, &cal, &error)){
+		printf("%-6s fit failed\n", s->name);
+		return -1;
+	}
+	for(i=0; i<3; i++){
+		e = fabsf(cal.offset[i] - s->center[i]);
+		if(e > offset_err) offset_err = e;
+		e = fabsf(cal.range[i] - s->radius[i]) / s->radius[i];
+		if(e > range_err) range_err = e;
+	}
+	ok = offset_err <= s->max_offset_err && range_err <= s->max_range_err &&
+			error < ELLIPSOID_MAX_ERROR;
+	printf("%-6s offsets %6d %6d %6d  ranges %6d %6d %6d\n", s->name,
+			cal.offset[0], cal.offset[1], cal.offset[2],
+			cal.range[0], cal.range[1], cal.range[2]);
+	printf("       worst offset error %0.1f, range error %0.2f%%, fit error %0.2f%%  %s\n",
+			offset_err, 100*range_err, 100*error, ok ? "ok" : "BAD");
+	
+	// only turned within 60 degrees of upright, must be refused
+	ellipsoid_fit_init(&fit, s->scale);
+	for(i=0; i<SAMPLES; i++){
+		make_sample(s, M_PI/3, v);
+		ellipsoid_fit_add(&fit, v);
+	}
+	printf("       partial coverage: ");
+	if(ellipsoid_fit_solve(&fit, &cal, NULL) == 0){
+		printf("accepted, BAD\n");
+		ok = 0;
+	}
+	return ok ? 0 : -1;
+}
+
+int main(){
+	sensor_t accel = {"accel", {300,-150,500}, {16200,16500,15800}, 40,
+						16384, 30, 0.005};
+	sensor_t mag = {"mag", {40,-80,120}, {180,210,165}, 2, 200, 2, 0.01};
+	ellipsoid_fit_t fit;
+	caldata_t cal;
+	short v[64][3];
+	timespec start, end;
+	int i, failed = 0;
+	
+	srand(1);
+	if(check_sensor(&accel)) failed = 1;
+	if(check_sensor(&mag)) failed = 1;
+	
+	// timing, on a small table of samples to stay in cache
+	for(i=0; i<64; i++) make_sample(&mag, M_PI, v[i]);
+	ellipsoid_fit_init(&fit, mag.scale);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i=0; i<TIMING_SAMPLES; i++){
+		ellipsoid_fit_add(&fit, v[i&63]);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("\nellipsoid_fit_add %0.1f ns per sample, %d bytes of state\n",
+			cape_elapsed_ns(start, end)/(float)TIMING_SAMPLES, (int)sizeof(fit));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ellipsoid_fit_solve(&fit, &cal, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("ellipsoid_fit_solve %llu ns\n",
+			(unsigned long long)cape_elapsed_ns(start, end));
+	
+	if(failed){
+		printf("\nFAIL\n");
+		return -1;
+	}
+	printf("\nPASS\n");
+	return 0;
+}
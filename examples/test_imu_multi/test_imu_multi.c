@@ -0,0 +1,296 @@
+// Two imu contexts read at once from simulated MPU9150s, needs no hardware
+// James Strawson - 2014
+
+#include <robotics_cape.h>
+
+#define DEFAULT_SECONDS	3
+#define NUM_IMUS		2
+#define FIFO_PACKETS	40		// keep under half the fifo, no overflow
+#define PACKET_BYTES	12		// accel then gyro, both big endian
+#define ACCEL_Z			8192	// 0.5g at the 2g range
+#define GYRO_NOISE		100		// uniform +-, raw units
+#define SEQ_MOD			10000
+#define PAIRS			10000	// samples averaged for the noise figures
+
+// register numbers of the MPU9150, see gyro_reg_s in inv_mpu.c
+#define REG_ACCEL_OFFS	0x06
+#define REG_RAW_COMPASS	0x49
+#define REG_USER_CTRL	0x6A
+#define REG_PWR_MGMT_1	0x6B
+#define REG_FIFO_COUNT	0x72
+#define REG_FIFO_RW		0x74
+#define AKM_ADDR		0x0C
+
+// one simulated MPU9150 plus its AK8975 behind the bypass
+typedef struct sim_mpu_t{
+	int id;
+	unsigned char regs[128];
+	unsigned char akm[32];
+	int fifo_packets;
+	unsigned int seq;			// sequence of the next packet to read out
+	unsigned int lcg;			// gyro noise generator
+	unsigned long transactions;
+} sim_mpu_t;
+
+typedef struct reader_t{
+	pthread_t thread;
+	imu_t* imu;
+	int id;
+	int flipped;				// mounted rotated 180 degrees about z
+	int accel_cal;				// calibratedAccel z doubled by the cal
+	unsigned long samples;
+	unsigned long wrong_id;
+	unsigned long wrong_cal;
+	unsigned long seq_breaks;
+} reader_t;
+
+sim_mpu_t sims[NUM_IMUS];
+volatile int bus_busy;
+volatile unsigned long overlaps;
+volatile int running = 1;
+
+// anything touching the driver while another transaction runs means two
+// imus are in the driver at the same time
+static void enter_bus(sim_mpu_t* sim){
+	if(__sync_lock_test_and_set(&bus_busy, 1)){
+		__sync_fetch_and_add(&overlaps, 1);
+	}
+	sim->transactions++;
+}
+
+static void leave_bus(){
+	__sync_lock_release(&bus_busy);
+}
+
+static short noise(sim_mpu_t* sim){
+	sim->lcg = sim->lcg*1103515245 + 12345;
+	return (short)((int)((sim->lcg>>16) % (2*GYRO_NOISE+1)) - GYRO_NOISE);
+}
+
+static void put_short(unsigned char* p, short v){
+	p[0] = (unsigned char)((unsigned short)v >> 8);
+	p[1] = (unsigned char)(v & 0xFF);
+}
+
+static void make_packet(sim_mpu_t* sim, unsigned char* p){
+	put_short(p+0, (short)(1000*sim->id));
+	put_short(p+2, (short)(sim->seq % SEQ_MOD));
+	put_short(p+4, ACCEL_Z);
+	put_short(p+6, noise(sim));
+	put_short(p+8, noise(sim));
+	put_short(p+10, noise(sim));
+	sim->seq++;
+}
+
+int sim_write(void* arg, unsigned char slave_addr, unsigned char reg_addr,
+			unsigned char length, unsigned char const* data){
+	sim_mpu_t* sim = arg;
+	int i;
+	enter_bus(sim);
+	if(slave_addr == AKM_ADDR){
+		for(i=0; i<length && reg_addr+i<32; i++) sim->akm[reg_addr+i] = data[i];
+	}
+	else{
+		for(i=0; i<length && reg_addr+i<128; i++) sim->regs[reg_addr+i] = data[i];
+		// fifo reset bit, and the reset bit clears itself
+		if(reg_addr == REG_USER_CTRL && (data[0] & 0x04)) sim->fifo_packets = 0;
+		if(reg_addr == REG_PWR_MGMT_1) sim->regs[REG_PWR_MGMT_1] &= 0x7F;
+	}
+	leave_bus();
+	return 0;
+}
+
+int sim_read(void* arg, unsigned char slave_addr, unsigned char reg_addr,
+			unsigned char length, unsigned char* data){
+	sim_mpu_t* sim = arg;
+	int i, count;
+	enter_bus(sim);
+	if(slave_addr == AKM_ADDR){
+		sim->akm[0] = 0x48;		// WIA
+		for(i=0; i<length; i++) data[i] = sim->akm[(reg_addr+i) & 31];
+	}
+	else if(reg_addr == REG_FIFO_COUNT){
+		// a few more packets arrived since the last look
+		sim->fifo_packets += 1 + sim->transactions % 3;
+		if(sim->fifo_packets > FIFO_PACKETS) sim->fifo_packets = FIFO_PACKETS;
+		count = sim->fifo_packets * PACKET_BYTES;
+		data[0] = count >> 8;
+		data[1] = count & 0xFF;
+	}
+	else if(reg_addr == REG_FIFO_RW){
+		for(i=0; i+PACKET_BYTES<=length && sim->fifo_packets; i+=PACKET_BYTES){
+			make_packet(sim, data+i);
+			sim->fifo_packets--;
+		}
+	}
+	else if(reg_addr == REG_RAW_COMPASS){
+		memset(data, 0, length);
+		data[0] = 0x01;			// ST1 data ready
+		data[1] = (unsigned char)(100*sim->id);
+	}
+	else{
+		for(i=0; i<length; i++) data[i] = sim->regs[(reg_addr+i) & 127];
+	}
+	leave_bus();
+	return 0;
+}
+
+const linux_i2c_backend_t sim_backend = { sim_write, sim_read };
+
+void* reader(void* ptr){
+	reader_t* r = ptr;
+	mpudata_t samples[MPU_MAX_BATCH];
+	int i, n, have_last = 0;
+	short id_sign = r->flipped ? -1 : 1;
+	short seq, last = 0, z;
+
+	while(running){
+		n = imu_read_raw(r->imu, samples, MPU_MAX_BATCH);
+		if(n < 0){
+			printf("%s: read failed\n", r->imu->name);
+			running = 0;
+			break;
+		}
+		for(i=0; i<n; i++){
+			if(samples[i].rawAccel[0] != id_sign*1000*r->id){
+				r->wrong_id++;
+			}
+			z = samples[i].calibratedAccel[2];
+			if(z != (r->accel_cal ? 2*ACCEL_Z : ACCEL_Z)){
+				r->wrong_cal++;
+			}
+			seq = id_sign * samples[i].rawAccel[1];
+			if(have_last && seq != (last+1) % SEQ_MOD){
+				r->seq_breaks++;
+			}
+			last = seq;
+			have_last = 1;
+			r->samples++;
+		}
+	}
+	return NULL;
+}
+
+// standard deviation of the gyro x axis, raw units
+float stddev(const float* v, int n){
+	double sum = 0, sum_sq = 0;
+	int i;
+	for(i=0; i<n; i++){
+		sum += v[i];
+		sum_sq += v[i]*v[i];
+	}
+	return sqrt(sum_sq/n - (sum/n)*(sum/n));
+}
+
+// read both imus, average matching samples and fuse the averages
+int average_and_fuse(imu_t** imus){
+	static float single[PAIRS], averaged[PAIRS];
+	mpudata_t a[MPU_MAX_BATCH], b[MPU_MAX_BATCH];
+	attitude_filter_t filter;
+	float gyro[3], accel[3], dt = 0.001;
+	vector3d_t euler;
+	int i, j, na = 0, nb = 0, pairs = 0;
+
+	attitude_init(&filter, ATTITUDE_MAHONY);
+	while(pairs < PAIRS){
+		// each imu has its own backlog, keep what the other hasn't matched
+		if(na == 0) na = imu_read_raw(imus[0], a, MPU_MAX_BATCH);
+		if(nb == 0) nb = imu_read_raw(imus[1], b, MPU_MAX_BATCH);
+		if(na < 0 || nb < 0) return -1;
+		for(i=0; i<na && i<nb && pairs<PAIRS; i++, pairs++){
+			for(j=0; j<3; j++){
+				// both already rotated into the body frame
+				gyro[j] = (a[i].rawGyro[j] + b[i].rawGyro[j]) / 2.0f;
+				accel[j] = (a[i].rawAccel[j] + b[i].rawAccel[j]) / 2.0f;
+			}
+			single[pairs] = a[i].rawGyro[0];
+			averaged[pairs] = gyro[0];
+			for(j=0; j<3; j++) gyro[j] *= DEG_TO_RAD / 16.4f;
+			attitude_update(&filter, gyro, accel, NULL, dt);
+		}
+		memmove(a, a+i, (na-i)*sizeof(mpudata_t));
+		memmove(b, b+i, (nb-i)*sizeof(mpudata_t));
+		na -= i;
+		nb -= i;
+	}
+	attitude_get_euler(&filter, euler);
+	printf("gyro noise one imu %0.1f, two averaged %0.1f (raw units)\n",
+			stddev(single, PAIRS), stddev(averaged, PAIRS));
+	printf("fused roll %0.2f pitch %0.2f deg after %d averaged samples\n",
+			euler[VEC3_X]*RAD_TO_DEG, euler[VEC3_Y]*RAD_TO_DEG, PAIRS);
+	return 0;
+}
+
+int main(int argc, char* argv[]){
+	signed char upright[9] = {1,0,0, 0,1,0, 0,0,1};
+	signed char flipped[9] = {-1,0,0, 0,-1,0, 0,0,1};
+	caldata_t cal = {{0,0,0}, {16000,16000,16000}};
+	imu_t* imus[NUM_IMUS];
+	reader_t readers[NUM_IMUS];
+	caldata_t seen;
+	unsigned long unlocked_calls = 0, leaks = 0;
+	uint64_t end_ns;
+	int i, seconds = DEFAULT_SECONDS, failed = 0;
+
+	if(argc > 1) seconds = atoi(argv[1]);
+
+	// on-cape and external imus, both at 0x68 on different buses
+	imus[0] = imu_create("cape_sim", 1, 0x68);
+	imus[1] = imu_create("external_sim", 2, 0x68);
+	for(i=0; i<NUM_IMUS; i++){
+		if(imus[i] == NULL) return -1;
+		sims[i].id = i+1;
+		sims[i].lcg = 1234567 * (i+1);
+		sims[i].regs[REG_ACCEL_OFFS+3] = 0x01;	// product revision 2
+		imu_set_backend(imus[i], &sim_backend, &sims[i]);
+		if(imu_init_raw(imus[i], 1000, i ? flipped : upright)){
+			return -1;
+		}
+	}
+	// only the first imu gets an accel calibration
+	imu_lock(imus[0]);
+	mpu9150_set_accel_cal(&cal);
+	imu_unlock(imus[0]);
+
+	memset(readers, 0, sizeof(readers));
+	for(i=0; i<NUM_IMUS; i++){
+		readers[i].imu = imus[i];
+		readers[i].id = i+1;
+		readers[i].flipped = i;
+		readers[i].accel_cal = (i==0);
+		pthread_create(&readers[i].thread, NULL, reader, &readers[i]);
+	}
+	// meanwhile this thread never locks, so it must always see the
+	// default imu, which has no accel cal, whatever the readers select
+	end_ns = cape_monotonic_ns() + seconds*1000000000ULL;
+	while(cape_monotonic_ns() < end_ns){
+		if(mpu9150_get_accel_cal(&seen) == 0) leaks++;
+		unlocked_calls++;
+	}
+	running = 0;
+	for(i=0; i<NUM_IMUS; i++){
+		pthread_join(readers[i].thread, NULL);
+		printf("%-12s %9lu samples, %lu wrong imu, %lu wrong cal, %lu seq breaks\n",
+				readers[i].imu->name, readers[i].samples, readers[i].wrong_id,
+				readers[i].wrong_cal, readers[i].seq_breaks);
+		if(readers[i].samples == 0 || readers[i].wrong_id ||
+				readers[i].wrong_cal || readers[i].seq_breaks){
+			failed = 1;
+		}
+	}
+	printf("%lu overlapping bus transactions\n", overlaps);
+	if(overlaps) failed = 1;
+	printf("%lu of %lu unlocked calls saw a reader's imu\n", leaks,
+			unlocked_calls);
+	if(leaks) failed = 1;
+
+	if(average_and_fuse(imus)) failed = 1;
+
+	for(i=0; i<NUM_IMUS; i++) imu_destroy(imus[i]);
+	if(failed){
+		printf("\nFAIL\n");
+		return -1;
+	}
+	printf("\nPASS\n");
+	return 0;
+}
@@ -0,0 +1,82 @@
+// Sample Code for testing the raw FIFO MPU-9150 mode
+// James Strawson - 2014
+
+#include <robotics_cape.h>
+#define DEFAULT_SAMPLE_RATE	1000
+
+unsigned long samples_read;
+int sample_rate;
+attitude_filter_t filter;
+
+int read_raw_data(){
+	mpudata_t samples[MPU_MAX_BATCH];
+	int i, n;
+	n = mpu9150_read_raw(samples, MPU_MAX_BATCH);
+	if(n<=0) return 0;
+	samples_read += n;
+	
+	// no DMP here, fuse every sample on the host
+	for(i=0; i<n; i++){
+		attitude_update_imu(&filter, &samples[i], 1.0f/sample_rate);
+	}
+	
+	// only print the newest, but every sample is available here
+	printf("\r");
+	printf("X: %0.1f Y: %0.1f Z: %0.1f ",
+	samples[n-1].fusedEuler[VEC3_X] * RAD_TO_DEGREE, 
+	samples[n-1].fusedEuler[VEC3_Y] * RAD_TO_DEGREE, 
+	samples[n-1].fusedEuler[VEC3_Z] * RAD_TO_DEGREE);
+	printf("Xg: %06d Yg: %06d Zg: %06d ",
+	samples[n-1].rawGyro[VEC3_X], 
+	samples[n-1].rawGyro[VEC3_Y], 
+	samples[n-1].rawGyro[VEC3_Z]);
+	printf("Xa: %06d Ya: %06d Za: %06d ",
+	samples[n-1].rawAccel[VEC3_X], 
+	samples[n-1].rawAccel[VEC3_Y], 
+	samples[n-1].rawAccel[VEC3_Z]);
+	fflush(stdout);
+	return 0;
+}
+
+int main(int argc, char *argv[]){
+	signed char orientation[9] = ORIENTATION_FLAT; 
+	timespec start, end;
+	float seconds;
+	
+	// second argument picks the host filter
+	attitude_init(&filter, ATTITUDE_MAHONY);
+	if (argc>2 && strcmp(argv[2], "madgwick")==0){
+		attitude_init(&filter, ATTITUDE_MADGWICK);
+	}
+	
+	if (argc==1){
+		sample_rate = DEFAULT_SAMPLE_RATE;
+	}
+	else{
+		sample_rate = atoi(argv[1]);
+		if((sample_rate>MAX_RAW_SAMPLE_RATE)||(sample_rate<MIN_SAMPLE_RATE)){
+			printf("sample rate should be between %d and %d\n", MIN_SAMPLE_RATE,MAX_RAW_SAMPLE_RATE);
+			return -1;
+		}
+	}
+	
+	initialize_cape();
+	if(initialize_imu_raw(sample_rate, orientation)){
+		cleanup_cape();
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	set_imu_interrupt_func(&read_raw_data); //start the interrupt handler
+	
+	//now just wait, read_raw_data will run
+	while (get_state() != EXITING) {
+		sleep(1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	
+	seconds = diff(start, end).tv_sec + diff(start, end).tv_nsec/1e9;
+	printf("\n%lu samples in %0.1fs, %0.1f hz\n", samples_read, seconds,
+			samples_read/seconds);
+	cleanup_cape();
+	return 0;
+}
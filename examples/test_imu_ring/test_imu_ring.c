@@ -0,0 +1,132 @@
+// Stress test the lock-free imu sample ring, runs without hardware
+// James Strawson - 2014
+
+#include <robotics_cape.h>
+
+#define DEFAULT_SECONDS		5
+#define DEFAULT_CONSUMERS	4
+#define MAX_CONSUMERS		16
+#define READ_BATCH			16
+
+imu_ring_t ring;
+volatile int running = 1;
+volatile unsigned long published;
+
+typedef struct consumer_t{
+	pthread_t thread;
+	int use_cursor;
+	unsigned long reads;
+	unsigned long torn;
+	unsigned long backwards;
+	uint32_t lost;
+} consumer_t;
+
+// every field derived from n so a mix of two samples can't pass
+void fill_sample(mpudata_t* s, uint32_t n){
+	int i;
+	for(i=0; i<3; i++){
+		s->rawGyro[i] = (short)(n + i);
+		s->rawAccel[i] = (short)(n + 3 + i);
+		s->fusedEuler[i] = (float)(n & 0xFFFF) + i;
+	}
+	for(i=0; i<4; i++){
+		s->rawQuat[i] = (long)n * 4 + i;
+	}
+	s->dmpTimestamp = n;
+	s->sampleTimeNs = (uint64_t)n * 1000;
+}
+
+int check_sample(mpudata_t* s){
+	mpudata_t expect;
+	memset(&expect, 0, sizeof(expect));
+	fill_sample(&expect, (uint32_t)s->dmpTimestamp);
+	return memcmp(s, &expect, sizeof(mpudata_t)) == 0;
+}
+
+void* producer(void* ptr){
+	mpudata_t s;
+	uint32_t n = 0;
+	memset(&s, 0, sizeof(s));
+	while(running){
+		fill_sample(&s, n++);
+		imu_ring_publish(&ring, &s);
+		published++;
+	}
+	return NULL;
+}
+
+void* consumer(void* ptr){
+	consumer_t* c = (consumer_t*)ptr;
+	mpudata_t s[READ_BATCH];
+	uint32_t cursor = 0, seq, last = 0;
+	int have_last = 0;
+	int i, n;
+	
+	while(running){
+		if(c->use_cursor){
+			n = imu_ring_read_since(&ring, &cursor, s, READ_BATCH, &c->lost);
+		}
+		else{
+			n = imu_ring_get_latest(&ring, s, &seq) == 0;
+		}
+		for(i=0; i<n; i++){
+			c->reads++;
+			if(!check_sample(&s[i])){
+				c->torn++;
+				continue;
+			}
+			seq = (uint32_t)s[i].dmpTimestamp;
+			// read_since must be strictly increasing, latest non-decreasing
+			if(have_last && (seq < last || (c->use_cursor && seq == last))){
+				c->backwards++;
+			}
+			last = seq;
+			have_last = 1;
+		}
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[]){
+	consumer_t consumers[MAX_CONSUMERS];
+	pthread_t producer_thread;
+	unsigned long reads = 0, torn = 0, backwards = 0, lost = 0;
+	int seconds = DEFAULT_SECONDS;
+	int num = DEFAULT_CONSUMERS;
+	int i;
+	
+	if(argc>1) seconds = atoi(argv[1]);
+	if(argc>2) num = atoi(argv[2]);
+	if(num<1 || num>MAX_CONSUMERS){
+		printf("consumers should be between 1 and %d\n", MAX_CONSUMERS);
+		return -1;
+	}
+	
+	memset(consumers, 0, sizeof(consumers));
+	imu_ring_init(&ring);
+	pthread_create(&producer_thread, NULL, producer, NULL);
+	for(i=0; i<num; i++){
+		consumers[i].use_cursor = i&1;
+		pthread_create(&consumers[i].thread, NULL, consumer, &consumers[i]);
+	}
+	
+	sleep(seconds);
+	running = 0;
+	pthread_join(producer_thread, NULL);
+	for(i=0; i<num; i++){
+		pthread_join(consumers[i].thread, NULL);
+		reads += consumers[i].reads;
+		torn += consumers[i].torn;
+		backwards += consumers[i].backwards;
+		lost += consumers[i].lost;
+	}
+	
+	printf("\n%lu published, %d consumers, %lu read, %lu lapped\n",
+			published, num, reads, lost);
+	printf("%lu torn, %lu out of order\n\n", torn, backwards);
+	if(torn || backwards){
+		printf("FAIL\n");
+		return -1;
+	}
+	return 0;
+}
@@ -174,27 +174,31 @@ int stop_log(){
 * 	print_imu_data()
 *	hardware interrupt routine called from IMU interrupt
 *	prints new IMU data and adds data to log buffer
+*	every sample waiting in the FIFO is logged, not just the newest
 ************************************************************************/
 int print_imu_data(){
-	mpudata_t mpu; //struct to read IMU data into
-	memset(&mpu, 0, sizeof(mpudata_t)); //make sure it's clean before starting
+	static mpudata_t mpu; //yaw state carried between interrupts
+	mpudata_t samples[DMP_MAX_BATCH];
 	log_entry_t new_log_entry; // new struct to add to the log
+	int i, n;
 	
-	if (mpu9150_read(&mpu) == 0) {
-		printf("\r");
-		
-		printf("X: %0.1f Y: %0.1f Z: %0.1f ",
-		mpu.fusedEuler[VEC3_X] * RAD_TO_DEGREE, 
-		mpu.fusedEuler[VEC3_Y] * RAD_TO_DEGREE, 
-		mpu.fusedEuler[VEC3_Z] * RAD_TO_DEGREE);
-
-		fflush(stdout);
-		
-		new_log_entry.roll	= -mpu.fusedEuler[VEC3_X];
-		new_log_entry.pitch =  mpu.fusedEuler[VEC3_Y];
-		new_log_entry.yaw 	=  mpu.fusedEuler[VEC3_Z];
+	n = mpu9150_read_batch(&mpu, samples, DMP_MAX_BATCH);
+	if (n <= 0) return 0;
+	
+	for(i=0; i<n; i++){
+		new_log_entry.roll	= -samples[i].fusedEuler[VEC3_X];
+		new_log_entry.pitch =  samples[i].fusedEuler[VEC3_Y];
+		new_log_entry.yaw 	=  samples[i].fusedEuler[VEC3_Z];
 		write_entry(&new_log_entry);
 	}
+	
+	printf("\r");
+	printf("X: %0.1f Y: %0.1f Z: %0.1f ",
+	mpu.fusedEuler[VEC3_X] * RAD_TO_DEGREE, 
+	mpu.fusedEuler[VEC3_Y] * RAD_TO_DEGREE, 
+	mpu.fusedEuler[VEC3_Z] * RAD_TO_DEGREE);
+	fflush(stdout);
+	
 	return 0; 
 }
 
@@ -214,8 +218,7 @@ int main(){
 		return -1;
 	}
 	
-	pthread_t logging_thread;
-	pthread_create(&logging_thread, NULL, log_writer, log_file);
+	cape_thread_create("log_writer", log_writer, log_file, THREAD_LOG);
 	
 	
 	// Start reading from IMU to get data to log
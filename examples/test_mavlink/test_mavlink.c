@@ -84,8 +84,7 @@ int main(int argc, char* argv[]){
 	printf("Sending Attitude Packets\n");
 	
 	// start a thread listening for incoming packets
-	pthread_t  mav_listen_thread;
-	pthread_create(&mav_listen_thread, NULL, mavlink_listener, (void*) NULL);
+	cape_thread_create("mav_listen", mavlink_listener, NULL, THREAD_APP);
 	printf("Listening for Packets\n");
 		
 	// now use the main thread to send heartbeat packets until the program exits
@@ -0,0 +1,119 @@
+// Check the mmap gpio bank math and batching against a plain file
+// James Strawson - 2014
+
+#include <robotics_cape.h>
+
+#define GPIO_MAP_FILE "/tmp/test_mmap_gpio.map"
+#define UNTOUCHED	0xDEADBEEF
+
+int fd;
+int failed = 0;
+
+uint32_t read_reg(int bank, int reg){
+	uint32_t v = 0;
+	if(pread(fd, &v, 4, bank*getpagesize() + reg) != 4){
+		printf("could not read back bank %d reg 0x%x\n", bank, reg);
+		failed = 1;
+	}
+	return v;
+}
+
+void write_reg(int bank, int reg, uint32_t v){
+	if(pwrite(fd, &v, 4, bank*getpagesize() + reg) != 4){
+		printf("could not preset bank %d reg 0x%x\n", bank, reg);
+		failed = 1;
+	}
+}
+
+// preset every SET/CLEAR word so a store that shouldn't happen shows up
+void preset_regs(){
+	int i;
+	for(i=0; i<GPIO_BANKS; i++){
+		write_reg(i, GPIO_SETDATAOUT, UNTOUCHED);
+		write_reg(i, GPIO_CLEARDATAOUT, UNTOUCHED);
+	}
+}
+
+void check_reg(const char* what, int bank, int reg, uint32_t expect){
+	uint32_t v = read_reg(bank, reg);
+	int ok = v == expect;
+	printf("%-8s bank %d %-5s 0x%08x expected 0x%08x  %s\n", what, bank,
+			reg==GPIO_SETDATAOUT ? "set" : "clear", v, expect, ok?"ok":"BAD");
+	if(!ok) failed = 1;
+}
+
+void check(const char* what, int ok){
+	printf("%-44s %s\n", what, ok ? "ok" : "BAD");
+	if(!ok) failed = 1;
+}
+
+int main(){
+	mmap_gpio_batch_t batch;
+	
+	if(mmap_gpio_init_file(GPIO_MAP_FILE)){
+		printf("FAIL\n");
+		return -1;
+	}
+	if((fd = open(GPIO_MAP_FILE, O_RDWR)) == -1){
+		printf("could not reopen %s\nFAIL\n", GPIO_MAP_FILE);
+		return -1;
+	}
+	
+	// a batch touching banks 0, 1 and 3, bank 2 ends up with clears only
+	preset_regs();
+	mmap_gpio_batch_reset(&batch);
+	mmap_gpio_batch_add(&batch, 0, HIGH);		// gpio0_0
+	mmap_gpio_batch_add(&batch, 31, LOW);		// gpio0_31
+	mmap_gpio_batch_add(&batch, 60, HIGH);		// gpio1_28
+	mmap_gpio_batch_add(&batch, 48, HIGH);		// gpio1_16
+	mmap_gpio_batch_add(&batch, 66, LOW);		// gpio2_2
+	mmap_gpio_batch_add(&batch, 67, HIGH);		// gpio2_3
+	mmap_gpio_batch_add(&batch, 67, LOW);		// later add wins
+	mmap_gpio_batch_add(&batch, 127, HIGH);		// gpio3_31
+	check("gpio 128 refused by batch_add",
+			mmap_gpio_batch_add(&batch, 128, HIGH) == -1);
+	check("batch_commit returns 0", mmap_gpio_batch_commit(&batch) == 0);
+	check_reg("batch", 0, GPIO_SETDATAOUT,   0x00000001);
+	check_reg("batch", 0, GPIO_CLEARDATAOUT, 0x80000000);
+	check_reg("batch", 1, GPIO_SETDATAOUT,   0x10010000);
+	check_reg("batch", 1, GPIO_CLEARDATAOUT, UNTOUCHED);
+	check_reg("batch", 2, GPIO_SETDATAOUT,   UNTOUCHED);
+	check_reg("batch", 2, GPIO_CLEARDATAOUT, 0x0000000C);
+	check_reg("batch", 3, GPIO_SETDATAOUT,   0x80000000);
+	check_reg("batch", 3, GPIO_CLEARDATAOUT, UNTOUCHED);
+	
+	// an empty batch must not store anything
+	preset_regs();
+	mmap_gpio_batch_reset(&batch);
+	mmap_gpio_batch_commit(&batch);
+	check_reg("empty", 0, GPIO_SETDATAOUT,   UNTOUCHED);
+	check_reg("empty", 3, GPIO_CLEARDATAOUT, UNTOUCHED);
+	
+	// single pin writes, one word each
+	preset_regs();
+	mmap_gpio_write(69, HIGH);					// gpio2_5
+	mmap_gpio_write(45, LOW);					// gpio1_13
+	check_reg("single", 2, GPIO_SETDATAOUT,   0x00000020);
+	check_reg("single", 1, GPIO_CLEARDATAOUT, 0x00002000);
+	check_reg("single", 0, GPIO_SETDATAOUT,   UNTOUCHED);
+	check("gpio 128 refused by mmap_gpio_write",
+			mmap_gpio_write(128, HIGH) == -1);
+	
+	// reads come from DATAIN
+	write_reg(1, GPIO_DATAIN, 0x00400000);
+	check("gpio 54 reads high from DATAIN", mmap_gpio_read(54) == 1);
+	check("gpio 53 reads low from DATAIN", mmap_gpio_read(53) == 0);
+	
+	mmap_gpio_cleanup();
+	check("batch_commit refused once unmapped",
+			mmap_gpio_batch_commit(&batch) == -1);
+	close(fd);
+	unlink(GPIO_MAP_FILE);
+	
+	if(failed){
+		printf("\nFAIL\n");
+		return -1;
+	}
+	printf("\nPASS\n");
+	return 0;
+}
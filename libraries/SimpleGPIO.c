@@ -214,6 +214,59 @@ int gpio_fd_close(int fd)
 	return close(fd);
 }
 
+/****************************************************************
+ * gpio_value_fd_open - open a value file for repeated reads and
+ * writes, keep the fd and pass it to gpio_fd_set/get_value
+ ****************************************************************/
+
+int gpio_value_fd_open(unsigned int gpio)
+{
+	int fd;
+	char buf[MAX_BUF];
+
+	snprintf(buf, sizeof(buf), SYSFS_GPIO_DIR "/gpio%d/value", gpio);
+
+	fd = open(buf, O_RDWR);
+	if (fd < 0) {
+		perror("gpio/value_fd_open");
+	}
+	return fd;
+}
+
+/****************************************************************
+ * gpio_fd_set_value - single pwrite on an already open value fd
+ ****************************************************************/
+
+int gpio_fd_set_value(int fd, PIN_VALUE value)
+{
+	if (pwrite(fd, (value==LOW) ? "0" : "1", 1, 0) != 1) {
+		perror("gpio/fd_set_value");
+		return -1;
+	}
+	return 0;
+}
+
+/****************************************************************
+ * gpio_fd_get_value - single pread on an already open value fd
+ ****************************************************************/
+
+int gpio_fd_get_value(int fd, unsigned int *value)
+{
+	char ch;
+
+	if (pread(fd, &ch, 1, 0) != 1) {
+		perror("gpio/fd_get_value");
+		return -1;
+	}
+
+	if (ch != '0') {
+		*value = 1;
+	} else {
+		*value = 0;
+	}
+	return 0;
+}
+
 
 /****************************************************************
  * gpio_omap_mux_setup - Allow us to setup the omap mux mode for a pin
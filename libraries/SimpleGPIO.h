@@ -67,6 +67,9 @@ int gpio_get_value(unsigned int gpio, unsigned int *value);
 int gpio_set_edge(unsigned int gpio, char *edge);
 int gpio_fd_open(unsigned int gpio);
 int gpio_fd_close(int fd);
+int gpio_value_fd_open(unsigned int gpio);
+int gpio_fd_set_value(int fd, PIN_VALUE value);
+int gpio_fd_get_value(int fd, unsigned int *value);
 int gpio_omap_mux_setup(const char *omap_pin0_name, const char *mode);
 
 #endif /* SIMPLEGPIO_H_ */
@@ -0,0 +1,328 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <string.h>
+#include "attitude.h"
+
+static float inv_sqrt(float x){
+	return 1.0f/sqrtf(x);
+}
+
+void attitude_init(attitude_filter_t* f, attitude_algo_t algo){
+	f->algo = algo;
+	f->kp = MAHONY_DEFAULT_KP;
+	f->ki = MAHONY_DEFAULT_KI;
+	f->beta = MADGWICK_DEFAULT_BETA;
+	f->zeta = MADGWICK_DEFAULT_ZETA;
+	f->use_mag = 0;
+	attitude_reset(f);
+}
+
+void attitude_reset(attitude_filter_t* f){
+	int i;
+	f->initialized = 0;
+	f->q[QUAT_W] = 1.0f;
+	f->q[QUAT_X] = 0.0f;
+	f->q[QUAT_Y] = 0.0f;
+	f->q[QUAT_Z] = 0.0f;
+	for(i=0;i<3;i++){
+		f->bias[i] = 0.0f;
+		f->integral[i] = 0.0f;
+	}
+}
+
+// start from the accel's roll and pitch so the filter doesn't spend
+// seconds converging from level
+static void init_from_accel(attitude_filter_t* f, const float a[3]){
+	vector3d_t euler;
+	euler[VEC3_X] = atan2f(a[1], a[2]);
+	euler[VEC3_Y] = atan2f(-a[0], sqrtf(a[1]*a[1] + a[2]*a[2]));
+	euler[VEC3_Z] = 0.0f;
+	eulerToQuaternion(euler, f->q);
+	f->initialized = 1;
+}
+
+static void mahony_update(attitude_filter_t* f, float gx, float gy, float gz,
+				float ax, float ay, float az, const float* mag, float dt){
+	float q0 = f->q[QUAT_W], q1 = f->q[QUAT_X];
+	float q2 = f->q[QUAT_Y], q3 = f->q[QUAT_Z];
+	float recip, ex, ey, ez, vx, vy, vz;
+	float qa, qb, qc;
+	
+	if(ax!=0.0f || ay!=0.0f || az!=0.0f){
+		recip = inv_sqrt(ax*ax + ay*ay + az*az);
+		ax *= recip;
+		ay *= recip;
+		az *= recip;
+		
+		// half of gravity's direction in the sensor frame
+		vx = q1*q3 - q0*q2;
+		vy = q0*q1 + q2*q3;
+		vz = q0*q0 - 0.5f + q3*q3;
+		
+		// error is the cross product of measured and estimated gravity
+		ex = ay*vz - az*vy;
+		ey = az*vx - ax*vz;
+		ez = ax*vy - ay*vx;
+		
+		if(mag!=NULL && (mag[0]!=0.0f || mag[1]!=0.0f || mag[2]!=0.0f)){
+			float mx = mag[0], my = mag[1], mz = mag[2];
+			float hx, hy, bx, bz, wx, wy, wz;
+			recip = inv_sqrt(mx*mx + my*my + mz*mz);
+			mx *= recip;
+			my *= recip;
+			mz *= recip;
+			
+			// earth's field in the earth frame, flattened onto x and z
+			hx = 2.0f*(mx*(0.5f - q2*q2 - q3*q3) + my*(q1*q2 - q0*q3) + mz*(q1*q3 + q0*q2));
+			hy = 2.0f*(mx*(q1*q2 + q0*q3) + my*(0.5f - q1*q1 - q3*q3) + mz*(q2*q3 - q0*q1));
+			bx = sqrtf(hx*hx + hy*hy);
+			bz = 2.0f*(mx*(q1*q3 - q0*q2) + my*(q2*q3 + q0*q1) + mz*(0.5f - q1*q1 - q2*q2));
+			
+			// half of that field's direction back in the sensor frame
+			wx = bx*(0.5f - q2*q2 - q3*q3) + bz*(q1*q3 - q0*q2);
+			wy = bx*(q1*q2 - q0*q3) + bz*(q0*q1 + q2*q3);
+			wz = bx*(q0*q2 + q1*q3) + bz*(0.5f - q1*q1 - q2*q2);
+			
+			ex += my*wz - mz*wy;
+			ey += mz*wx - mx*wz;
+			ez += mx*wy - my*wx;
+		}
+		
+		// integral feedback soaks up the gyro bias
+		if(f->ki > 0.0f){
+			f->integral[0] += 2.0f*f->ki*ex*dt;
+			f->integral[1] += 2.0f*f->ki*ey*dt;
+			f->integral[2] += 2.0f*f->ki*ez*dt;
+			gx += f->integral[0];
+			gy += f->integral[1];
+			gz += f->integral[2];
+		}
+		gx += 2.0f*f->kp*ex;
+		gy += 2.0f*f->kp*ey;
+		gz += 2.0f*f->kp*ez;
+	}
+	
+	// integrate q' = 0.5 q x w
+	gx *= 0.5f*dt;
+	gy *= 0.5f*dt;
+	gz *= 0.5f*dt;
+	qa = q0;
+	qb = q1;
+	qc = q2;
+	q0 += -qb*gx - qc*gy - q3*gz;
+	q1 += qa*gx + qc*gz - q3*gy;
+	q2 += qa*gy - qb*gz + q3*gx;
+	q3 += qa*gz + qb*gy - qc*gx;
+	
+	recip = inv_sqrt(q0*q0 + q1*q1 + q2*q2 + q3*q3);
+	f->q[QUAT_W] = q0*recip;
+	f->q[QUAT_X] = q1*recip;
+	f->q[QUAT_Y] = q2*recip;
+	f->q[QUAT_Z] = q3*recip;
+	
+	f->bias[0] = -f->integral[0];
+	f->bias[1] = -f->integral[1];
+	f->bias[2] = -f->integral[2];
+}
+
+static void madgwick_update(attitude_filter_t* f, float gx, float gy, float gz,
+				float ax, float ay, float az, const float* mag, float dt){
+	float q0 = f->q[QUAT_W], q1 = f->q[QUAT_X];
+	float q2 = f->q[QUAT_Y], q3 = f->q[QUAT_Z];
+	float recip, s0, s1, s2, s3;
+	float qDot0, qDot1, qDot2, qDot3;
+	float ex, ey, ez;
+	int have_s = 0;
+	
+	if(ax!=0.0f || ay!=0.0f || az!=0.0f){
+		recip = inv_sqrt(ax*ax + ay*ay + az*az);
+		ax *= recip;
+		ay *= recip;
+		az *= recip;
+		
+		if(mag!=NULL && (mag[0]!=0.0f || mag[1]!=0.0f || mag[2]!=0.0f)){
+			float mx = mag[0], my = mag[1], mz = mag[2];
+			float hx, hy, _2bx, _2bz, _4bx, _4bz;
+			float _2q0mx, _2q0my, _2q0mz, _2q1mx;
+			float _2q0 = 2.0f*q0, _2q1 = 2.0f*q1, _2q2 = 2.0f*q2, _2q3 = 2.0f*q3;
+			float _2q0q2 = 2.0f*q0*q2, _2q2q3 = 2.0f*q2*q3;
+			float q0q0 = q0*q0, q0q1 = q0*q1, q0q2 = q0*q2, q0q3 = q0*q3;
+			float q1q1 = q1*q1, q1q2 = q1*q2, q1q3 = q1*q3;
+			float q2q2 = q2*q2, q2q3 = q2*q3, q3q3 = q3*q3;
+			float fx, fy, fz, bx, by, bz;
+			
+			recip = inv_sqrt(mx*mx + my*my + mz*mz);
+			mx *= recip;
+			my *= recip;
+			mz *= recip;
+			
+			// earth's field in the earth frame, flattened onto x and z
+			_2q0mx = 2.0f*q0*mx;
+			_2q0my = 2.0f*q0*my;
+			_2q0mz = 2.0f*q0*mz;
+			_2q1mx = 2.0f*q1*mx;
+			hx = mx*q0q0 - _2q0my*q3 + _2q0mz*q2 + mx*q1q1 + _2q1*my*q2
+				+ _2q1*mz*q3 - mx*q2q2 - mx*q3q3;
+			hy = _2q0mx*q3 + my*q0q0 - _2q0mz*q1 + _2q1mx*q2 - my*q1q1
+				+ my*q2q2 + _2q2*mz*q3 - my*q3q3;
+			_2bx = sqrtf(hx*hx + hy*hy);
+			_2bz = -_2q0mx*q2 + _2q0my*q1 + mz*q0q0 + _2q1mx*q3 - mz*q1q1
+				+ _2q2*my*q3 - mz*q2q2 + mz*q3q3;
+			_4bx = 2.0f*_2bx;
+			_4bz = 2.0f*_2bz;
+			
+			// objective function residuals, gravity then field
+			fx = 2.0f*q1q3 - _2q0q2 - ax;
+			fy = 2.0f*q0q1 + _2q2q3 - ay;
+			fz = 1.0f - 2.0f*q1q1 - 2.0f*q2q2 - az;
+			bx = _2bx*(0.5f - q2q2 - q3q3) + _2bz*(q1q3 - q0q2) - mx;
+			by = _2bx*(q1q2 - q0q3) + _2bz*(q0q1 + q2q3) - my;
+			bz = _2bx*(q0q2 + q1q3) + _2bz*(0.5f - q1q1 - q2q2) - mz;
+			
+			// gradient, jacobian transpose times residuals
+			s0 = -_2q2*fx + _2q1*fy - _2bz*q2*bx + (-_2bx*q3 + _2bz*q1)*by
+				+ _2bx*q2*bz;
+			s1 = _2q3*fx + _2q0*fy - 4.0f*q1*fz + _2bz*q3*bx
+				+ (_2bx*q2 + _2bz*q0)*by + (_2bx*q3 - _4bz*q1)*bz;
+			s2 = -_2q0*fx + _2q3*fy - 4.0f*q2*fz + (-_4bx*q2 - _2bz*q0)*bx
+				+ (_2bx*q1 + _2bz*q3)*by + (_2bx*q0 - _4bz*q2)*bz;
+			s3 = _2q1*fx + _2q2*fy + (-_4bx*q3 + _2bz*q1)*bx
+				+ (-_2bx*q0 + _2bz*q2)*by + _2bx*q1*bz;
+		}
+		else{
+			float _2q0 = 2.0f*q0, _2q1 = 2.0f*q1, _2q2 = 2.0f*q2, _2q3 = 2.0f*q3;
+			float _4q0 = 4.0f*q0, _4q1 = 4.0f*q1, _4q2 = 4.0f*q2;
+			float _8q1 = 8.0f*q1, _8q2 = 8.0f*q2;
+			float q0q0 = q0*q0, q1q1 = q1*q1, q2q2 = q2*q2, q3q3 = q3*q3;
+			
+			s0 = _4q0*q2q2 + _2q2*ax + _4q0*q1q1 - _2q1*ay;
+			s1 = _4q1*q3q3 - _2q3*ax + 4.0f*q0q0*q1 - _2q0*ay - _4q1
+				+ _8q1*q1q1 + _8q1*q2q2 + _4q1*az;
+			s2 = 4.0f*q0q0*q2 + _2q0*ax + _4q2*q3q3 - _2q3*ay - _4q2
+				+ _8q2*q1q1 + _8q2*q2q2 + _4q2*az;
+			s3 = 4.0f*q1q1*q3 - _2q1*ax + 4.0f*q2q2*q3 - _2q2*ay;
+		}
+		
+		recip = s0*s0 + s1*s1 + s2*s2 + s3*s3;
+		if(recip > 0.0f){
+			recip = inv_sqrt(recip);
+			s0 *= recip;
+			s1 *= recip;
+			s2 *= recip;
+			s3 *= recip;
+			have_s = 1;
+			
+			// gyro error is 2 q* x s, integrate it into the bias
+			ex = 2.0f*(q0*s1 - q1*s0 - q2*s3 + q3*s2);
+			ey = 2.0f*(q0*s2 + q1*s3 - q2*s0 - q3*s1);
+			ez = 2.0f*(q0*s3 - q1*s2 + q2*s1 - q3*s0);
+			f->bias[0] += ex*f->zeta*dt;
+			f->bias[1] += ey*f->zeta*dt;
+			f->bias[2] += ez*f->zeta*dt;
+		}
+	}
+	
+	gx -= f->bias[0];
+	gy -= f->bias[1];
+	gz -= f->bias[2];
+	
+	// q' = 0.5 q x w, less the gradient step
+	qDot0 = 0.5f*(-q1*gx - q2*gy - q3*gz);
+	qDot1 = 0.5f*(q0*gx + q2*gz - q3*gy);
+	qDot2 = 0.5f*(q0*gy - q1*gz + q3*gx);
+	qDot3 = 0.5f*(q0*gz + q1*gy - q2*gx);
+	if(have_s){
+		qDot0 -= f->beta*s0;
+		qDot1 -= f->beta*s1;
+		qDot2 -= f->beta*s2;
+		qDot3 -= f->beta*s3;
+	}
+	
+	q0 += qDot0*dt;
+	q1 += qDot1*dt;
+	q2 += qDot2*dt;
+	q3 += qDot3*dt;
+	
+	recip = inv_sqrt(q0*q0 + q1*q1 + q2*q2 + q3*q3);
+	f->q[QUAT_W] = q0*recip;
+	f->q[QUAT_X] = q1*recip;
+	f->q[QUAT_Y] = q2*recip;
+	f->q[QUAT_Z] = q3*recip;
+}
+
+void attitude_update(attitude_filter_t* f, const float gyro[3], 
+					const float accel[3], const float* mag, float dt){
+	if(!f->initialized){
+		if(accel[0]==0.0f && accel[1]==0.0f && accel[2]==0.0f) return;
+		init_from_accel(f, accel);
+	}
+	if(f->algo == ATTITUDE_MADGWICK){
+		madgwick_update(f, gyro[0], gyro[1], gyro[2],
+					accel[0], accel[1], accel[2], mag, dt);
+	}
+	else{
+		mahony_update(f, gyro[0], gyro[1], gyro[2],
+					accel[0], accel[1], accel[2], mag, dt);
+	}
+}
+
+int attitude_update_imu(attitude_filter_t* f, mpudata_t* sample, float dt){
+	float gyro_sens;
+	unsigned short accel_sens;
+	float gyro[3], accel[3], mag[3];
+	int i;
+	
+	if(mpu_get_gyro_sens(&gyro_sens) || mpu_get_accel_sens(&accel_sens)){
+		return -1;
+	}
+	for(i=0;i<3;i++){
+		gyro[i] = sample->rawGyro[i] * DEGREE_TO_RAD / gyro_sens;
+	}
+	// calibrated vectors have the accel and compass offsets and scales
+	// from imu.cal applied and the compass swapped onto the MPU axes, but
+	// calibrate_data() also flips accel x and compass y and z. Undo that
+	// to stay in the gyro's frame
+	accel[0] = -(float)sample->calibratedAccel[VEC3_X] / accel_sens;
+	accel[1] = (float)sample->calibratedAccel[VEC3_Y] / accel_sens;
+	accel[2] = (float)sample->calibratedAccel[VEC3_Z] / accel_sens;
+	mag[0] = sample->calibratedMag[VEC3_X];
+	mag[1] = -sample->calibratedMag[VEC3_Y];
+	mag[2] = -sample->calibratedMag[VEC3_Z];
+	
+	attitude_update(f, gyro, accel, f->use_mag ? mag : NULL, dt);
+	
+	memcpy(sample->fusedQuat, f->q, sizeof(quaternion_t));
+	quaternionToEuler(f->q, sample->fusedEuler);
+	return 0;
+}
+
+void attitude_get_euler(attitude_filter_t* f, vector3d_t euler){
+	quaternionToEuler(f->q, euler);
+}
@@ -0,0 +1,82 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Host side attitude estimators for raw gyro/accel(/mag) samples, an
+alternative to the DMP quaternion for use with initialize_imu_raw().
+Mahony is a PI complementary filter, its integral term is the gyro bias
+estimate. Madgwick is a gradient descent filter with the zeta gyro bias
+drift term. Both take an optional magnetometer vector for yaw, without it
+yaw is integrated gyro only. All math is single precision for the
+BeagleBone's VFP. The quaternion uses the QUAT_W..QUAT_Z order from
+quaternion.h and rotates the sensor frame into the earth frame.
+Strawson Design - 2014
+*/
+
+#ifndef ATTITUDE_H
+#define ATTITUDE_H
+
+#include "quaternion.h"
+#include "mpu9150.h"
+
+typedef enum attitude_algo_t{
+	ATTITUDE_MAHONY,
+	ATTITUDE_MADGWICK
+} attitude_algo_t;
+
+// default gains, change them in the struct after attitude_init()
+#define MAHONY_DEFAULT_KP		0.5f	// proportional, 1/s
+#define MAHONY_DEFAULT_KI		0.02f	// integral (bias), 1/s^2
+#define MADGWICK_DEFAULT_BETA	0.1f	// gradient step, rad/s
+#define MADGWICK_DEFAULT_ZETA	0.01f	// bias drift rate, 1/s
+
+typedef struct attitude_filter_t{
+	attitude_algo_t algo;
+	float kp, ki;			// mahony gains
+	float beta, zeta;		// madgwick gains
+	int use_mag;			// attitude_update_imu() uses the compass
+	int initialized;		// q set from the first accel sample
+	quaternion_t q;			// sensor to earth rotation
+	float bias[3];			// estimated gyro bias, rad/s
+	float integral[3];		// mahony integral feedback
+} attitude_filter_t;
+
+void attitude_init(attitude_filter_t* f, attitude_algo_t algo);
+void attitude_reset(attitude_filter_t* f);
+// gyro in rad/s, accel in any unit, mag in any unit or NULL, dt in seconds
+void attitude_update(attitude_filter_t* f, const float gyro[3], 
+					const float accel[3], const float* mag, float dt);
+// same from an mpudata_t sample, using rawGyro and the calibrated accel
+// and compass. Fills in fusedQuat and fusedEuler so the sample can be
+// used like a DMP one. Meant for raw mode samples, where calibratedMag is
+// rotated by the orientation matrix along with gyro and accel
+int attitude_update_imu(attitude_filter_t* f, mpudata_t* sample, float dt);
+void attitude_get_euler(attitude_filter_t* f, vector3d_t euler);
+
+#endif // ATTITUDE_H
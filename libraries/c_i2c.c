@@ -20,6 +20,50 @@
 //#define I2CLIB_DEBUG  1
 
 #include "c_i2c.h"
+#include "i2c_bus.h"
+
+/* Each transfer is one I2C_RDWR ioctl on the fd shared through i2c_bus.c,
+ * holding the bus so the imu drivers and other devices can't interleave.
+ * The slave address travels in every message, there is no I2C_SLAVE.
+ */
+static int transfer(i2c_t* i2c, struct i2c_msg* msgs, int nmsgs){
+  struct i2c_rdwr_ioctl_data xfer;
+  int fd, ret = -1;
+  if(i2c_bus_lock(i2c->bus))
+    return -1;
+  fd = i2c_bus_fd(i2c->bus);
+  if(fd >= 0){
+    xfer.msgs = msgs;
+    xfer.nmsgs = nmsgs;
+    if(ioctl(fd, I2C_RDWR, &xfer) == nmsgs)
+      ret = 0;
+  }
+  i2c_bus_unlock(i2c->bus);
+  return ret;
+}
+
+// register address then data with a repeated start
+static int read_regs(i2c_t* i2c, uint8_t regAddr, uint8_t* data, int length){
+  struct i2c_msg msgs[2];
+  msgs[0].addr = i2c->devAddr;
+  msgs[0].flags = 0;
+  msgs[0].len = 1;
+  msgs[0].buf = (char*)&regAddr;
+  msgs[1].addr = i2c->devAddr;
+  msgs[1].flags = I2C_M_RD;
+  msgs[1].len = length;
+  msgs[1].buf = (char*)data;
+  return transfer(i2c, msgs, 2);
+}
+
+static int write_data(i2c_t* i2c, uint8_t* data, int length){
+  struct i2c_msg msg;
+  msg.addr = i2c->devAddr;
+  msg.flags = 0;
+  msg.len = length;
+  msg.buf = (char*)data;
+  return transfer(i2c, &msg, 1);
+}
 
 void i2c_init(i2c_t* i2c, uint8_t bus, uint8_t devAddr){
   i2c->file = 0;
@@ -27,19 +71,19 @@ void i2c_init(i2c_t* i2c, uint8_t bus, uint8_t devAddr){
   i2c->bus     = bus;
 }
 
+// the fd is opened once per bus and shared, this just checks it opens
 bool openConnection(i2c_t* i2c){
   snprintf(i2c->filename, FILENAME_LENGTH-1, "/dev/i2c-%d", i2c->bus);
-  i2c->file = open(i2c->filename, O_RDWR);
-  if (i2c->file < 0)
-    return false;
-  if(ioctl(i2c->file, I2C_SLAVE, i2c->devAddr) < 0)
+  if(i2c_bus_lock(i2c->bus))
     return false;
-  return true;
+  i2c->file = i2c_bus_fd(i2c->bus) < 0 ? -1 : 0;
+  i2c_bus_unlock(i2c->bus);
+  return i2c->file == 0;
 }
 
+// the shared fd stays open for the other clients of the bus
 bool closeConnection(i2c_t* i2c){
   i2c->devAddr = 0;
-  if(close(i2c->file) < 0) return false;
   return true;
 }
 
@@ -79,12 +123,8 @@ int8_t readBytes(i2c_t* i2c, uint8_t regAddr, uint8_t length, uint8_t *data, uin
     int8_t count = 0;
     uint8_t status = 0;
 //    uint32_t t1 = millis();
-        // write first 
-        if(write(i2c->file, &regAddr, 1)!=1) 
-        /* error handling here */
-          status = 1;
-        // read later 
-        if(read(i2c->file, data, length)!=length)
+        // write and read in one transaction
+        if(read_regs(i2c, regAddr, data, length))
         /* error handling here */
           status = 1;  
 
@@ -156,12 +196,8 @@ int8_t readWords(i2c_t* i2c, uint8_t regAddr, uint8_t length, uint16_t *data, ui
 //    uint32_t t1 = millis();
        uint8_t intermediate[(uint8_t)length*2];
        uint8_t status = 0;
-        // write first 
-        if(write(i2c->file, &regAddr, 1)!=1)
-        /* error handling here */
-          status = 1;
-        // read later 
-        if(read(i2c->file, data, length*2)!=length*2)
+        // write and read in one transaction
+        if(read_regs(i2c, regAddr, intermediate, length*2))
         /* error handling here */
           status = 1;  
 
@@ -312,7 +348,7 @@ bool writeBytes(i2c_t* i2c, uint8_t regAddr, uint8_t length, uint8_t* data){
   for(i = 0; i < length; i++)
     writeData[i + 1] = data[i]; 
 
-    if(write(i2c->file, writeData, length+1) != length+1){
+    if(write_data(i2c, writeData, length+1)){
       status = 1;
 #ifdef I2CLIB_DEBUG
       fprintf(stderr, "writeBytes 0x%x error occurred\n", regAddr);
@@ -373,7 +409,7 @@ bool writeWords(i2c_t* i2c, uint8_t regAddr, uint8_t length, uint16_t* data) {
       writeData[i*2 + 2] = (uint8_t)(data[i]);
    }
 
-    if(write(i2c->file, writeData, length*2 + 1) != (length*2 +1))
+    if(write_data(i2c, writeData, length*2 + 1))
       status = 1;
      // Error handling here
 #ifdef I2CLIB_DEBUG
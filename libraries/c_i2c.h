@@ -28,7 +28,7 @@ typedef struct i2c_t {
   /* data */
   uint8_t devAddr;
   uint8_t bus;
-  int8_t file;
+  int8_t file;    // 0 once openConnection() succeeded, fds are shared, see i2c_bus.h
   // Parameterize 20
   char filename[FILENAME_LENGTH];
   /* buf */
@@ -0,0 +1,272 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Thread registry, see cape_thread.h
+Strawson Design - 2014
+*/
+
+#define _GNU_SOURCE		// sched_setaffinity, pthread_setname_np
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "cape_thread.h"
+
+#define PRIO_MAX	-1		// sched_get_priority_max(SCHED_FIFO)
+#define PRIO_HALF	-2		// half of the above, the old button priority
+#define CPU_ANY		-1
+#define CPU_LAST	-2		// highest numbered online cpu
+
+typedef struct class_settings_t {
+	const char* name;
+	int policy;
+	int priority;		// fixed value, or PRIO_MAX or PRIO_HALF
+	int priority_offset;	// subtracted from PRIO_MAX or PRIO_HALF
+	int cpu;
+	size_t stack_size;
+	size_t prefault;	// bytes of stack touched before func runs
+} class_settings_t;
+
+// One place to decide who preempts who. The imu thread runs the control
+// callback so it gets the top priority and the last cpu, away from the
+// network and usb interrupts that usually land on cpu 0. On the single
+// core BeagleBone the affinity is a no-op. Stacks are kept small because
+// mlockall(MCL_FUTURE) makes the whole stack resident when it is mapped.
+static const class_settings_t class_table[THREAD_NUM_CLASSES] = {
+//	 name		policy		priority	offset	cpu		 stack		prefault
+	{"imu",		SCHED_FIFO,	PRIO_MAX,	0,		CPU_LAST, 256*1024, 64*1024},
+	{"imu_ctrl",	SCHED_FIFO,	PRIO_MAX,	1,		CPU_LAST, 256*1024, 64*1024},
+	{"control",	SCHED_FIFO,	PRIO_MAX,	2,		CPU_LAST, 256*1024, 64*1024},
+	{"button",	SCHED_FIFO,	PRIO_HALF,	0,		CPU_ANY,  128*1024, 16*1024},
+	{"radio",	SCHED_FIFO,	PRIO_HALF,	1,		CPU_ANY,  128*1024, 16*1024},
+	{"log",		SCHED_OTHER, 0,			0,		CPU_ANY,  256*1024, 0},
+	{"app",		SCHED_OTHER, 0,			0,		CPU_ANY,  256*1024, 0}
+};
+
+static cape_thread_t threads[CAPE_THREAD_MAX];
+static int num_threads = 0;
+static int memory_locked = 0;
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/***********************************************************************
+*	int cape_thread_init()
+*	lock current and future pages into ram. Called from initialize_cape()
+*	before any thread is started. Returns -1 if the kernel refused, the
+*	program still runs but can page fault.
+************************************************************************/
+int cape_thread_init(){
+	if(memory_locked) return 0;
+	if(mlockall(MCL_CURRENT | MCL_FUTURE)){
+		printf("WARNING: mlockall failed, %s\n", strerror(errno));
+		return -1;
+	}
+	memory_locked = 1;
+	return 0;
+}
+
+static int class_priority(const class_settings_t* c){
+	int max;
+	if(c->policy == SCHED_OTHER) return 0;
+	max = sched_get_priority_max(c->policy);
+	if(c->priority == PRIO_MAX) return max - c->priority_offset;
+	if(c->priority == PRIO_HALF) return max/2 - c->priority_offset;
+	return c->priority;
+}
+
+static int class_cpu(const class_settings_t* c){
+	long ncpu;
+	if(c->cpu != CPU_LAST) return c->cpu;
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	return ncpu > 1 ? (int)ncpu-1 : CPU_ANY;
+}
+
+// touch the stack below us so those pages are faulted in, and with
+// mlockall stay in, before the thread does anything time critical
+static void __attribute__((noinline)) prefault_stack(size_t bytes){
+	unsigned char buf[bytes];
+	memset(buf, 0, bytes);
+	// keep the compiler from dropping the memset
+	__asm__ __volatile__("" : : "r"(buf) : "memory");
+}
+
+// every registered thread starts here, it applies its own class so the
+// settings are in place before func runs and the results are recorded
+static void* thread_start(void* ptr){
+	cape_thread_t* t = ptr;
+	const class_settings_t* c = &class_table[t->thread_class];
+	struct sched_param param;
+	cpu_set_t cpus;
+	
+	t->tid = (pid_t)syscall(SYS_gettid);
+	pthread_setname_np(pthread_self(), t->name);
+	
+	param.sched_priority = class_priority(c);
+	if(pthread_setschedparam(pthread_self(), c->policy, &param)){
+		t->errors++;
+	}
+	pthread_getschedparam(pthread_self(), &t->policy, &param);
+	t->priority = param.sched_priority;
+	
+	t->cpu = class_cpu(c);
+	if(t->cpu >= 0){
+		CPU_ZERO(&cpus);
+		CPU_SET(t->cpu, &cpus);
+		if(pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus)){
+			t->errors++;
+			t->cpu = CPU_ANY;
+		}
+	}
+	
+	if(c->prefault){
+		prefault_stack(c->prefault);
+		t->prefaulted = c->prefault;
+	}
+	
+	__sync_synchronize();
+	t->started = 1;
+	return t->func(t->arg);
+}
+
+/***********************************************************************
+*	int cape_thread_create(name, func, arg, thread_class)
+*	start func(arg) in a new thread with the settings of its class and
+*	add it to the registry. Returns once the thread has applied them so
+*	the caller knows the priority is in place. Failing to get real-time
+*	settings, usually from not running as root, is counted in the
+*	thread's errors and shown by cape_thread_print_report(), the thread
+*	still runs. Returns -1 only if no thread was started.
+************************************************************************/
+int cape_thread_create(const char* name, void* (*func)(void*), void* arg,
+						cape_thread_class_t thread_class){
+	pthread_attr_t attr;
+	cape_thread_t* t;
+	
+	if(thread_class<0 || thread_class>=THREAD_NUM_CLASSES){
+		printf("ERROR: invalid thread class %d\n", thread_class);
+		return -1;
+	}
+	pthread_mutex_lock(&registry_mutex);
+	if(num_threads >= CAPE_THREAD_MAX){
+		pthread_mutex_unlock(&registry_mutex);
+		printf("ERROR: too many threads, max is %d\n", CAPE_THREAD_MAX);
+		return -1;
+	}
+	t = &threads[num_threads];
+	memset(t, 0, sizeof(cape_thread_t));
+	strncpy(t->name, name, CAPE_THREAD_NAME_LEN-1);
+	t->thread_class = thread_class;
+	t->stack_size = class_table[thread_class].stack_size;
+	t->func = func;
+	t->arg = arg;
+	
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, t->stack_size);
+	if(pthread_create(&t->thread, &attr, thread_start, t)){
+		pthread_attr_destroy(&attr);
+		pthread_mutex_unlock(&registry_mutex);
+		printf("ERROR: failed to start thread %s\n", name);
+		return -1;
+	}
+	pthread_attr_destroy(&attr);
+	num_threads++;
+	pthread_mutex_unlock(&registry_mutex);
+	
+	while(!t->started){
+		usleep(100);
+	}
+	if(t->errors){
+		printf("WARNING: thread %s is missing real-time settings\n", t->name);
+	}
+	return 0;
+}
+
+int cape_thread_count(){
+	return num_threads;
+}
+
+const cape_thread_t* cape_thread_get(int index){
+	if(index<0 || index>=num_threads) return NULL;
+	return &threads[index];
+}
+
+/***********************************************************************
+*	int cape_thread_join(const char* name)
+*	wait for the registered thread with this name to return. It stays in
+*	the registry so the report still shows it. Returns -1 if there is no
+*	such thread or it was already joined.
+************************************************************************/
+int cape_thread_join(const char* name){
+	int i;
+	pthread_t thread;
+	
+	pthread_mutex_lock(&registry_mutex);
+	for(i=0; i<num_threads; i++){
+		if(!threads[i].joined && !strcmp(threads[i].name, name)) break;
+	}
+	if(i == num_threads){
+		pthread_mutex_unlock(&registry_mutex);
+		printf("ERROR: no thread %s to join\n", name);
+		return -1;
+	}
+	threads[i].joined = 1;
+	thread = threads[i].thread;
+	pthread_mutex_unlock(&registry_mutex);
+	return pthread_join(thread, NULL) ? -1 : 0;
+}
+
+/***********************************************************************
+*	int cape_thread_print_report()
+*	one line per registered thread with the settings it actually got
+************************************************************************/
+int cape_thread_print_report(){
+	int i;
+	const cape_thread_t* t;
+	
+	printf("memory %s\n", memory_locked ? "locked" : "NOT locked");
+	printf("  name            tid   class    policy prio cpu  stack prefault\n");
+	for(i=0; i<num_threads; i++){
+		t = &threads[i];
+		printf("  %-15s %5d %-8s %-6s %4d ", t->name, (int)t->tid,
+				class_table[t->thread_class].name,
+				t->policy==SCHED_FIFO ? "fifo" :
+				t->policy==SCHED_RR ? "rr" : "other",
+				t->priority);
+		if(t->cpu >= 0) printf("%3d ", t->cpu);
+		else printf("any ");
+		printf("%5dk %7dk", (int)(t->stack_size/1024), 
+				(int)(t->prefaulted/1024));
+		if(t->errors) printf("  (%d settings refused)", t->errors);
+		printf("\n");
+	}
+	return 0;
+}
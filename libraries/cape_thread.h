@@ -0,0 +1,87 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Registry for every thread the cape library and its programs start. A
+thread is created with a class instead of hand picked pthread settings
+and the class table in cape_thread.c decides scheduling policy, 
+priority, cpu affinity, stack size and how much of the stack is touched
+before the thread function runs. cape_thread_init() locks all current
+and future memory with mlockall so once a thread has prefaulted its
+stack the control path never takes a page fault.
+Strawson Design - 2014
+*/
+
+#ifndef CAPE_THREAD_H
+#define CAPE_THREAD_H
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#define CAPE_THREAD_MAX			32
+#define CAPE_THREAD_NAME_LEN	16	// kernel limit including the null
+
+// from highest to lowest priority, see class_table in cape_thread.c
+typedef enum cape_thread_class_t {
+	THREAD_IMU,		// imu interrupt, runs set_imu_interrupt_func() callbacks
+	THREAD_IMU_CTRL,	// control callback fed by the imu thread, see imu_pipeline.h
+	THREAD_CONTROL,	// setpoint and arming stacks feeding the controller
+	THREAD_BUTTON,	// button event dispatcher
+	THREAD_RADIO,	// uart4 dsm2 reader
+	THREAD_LOG,		// log file writers
+	THREAD_APP,		// printing, battery checks and other slow jobs
+	THREAD_NUM_CLASSES
+} cape_thread_class_t;
+
+typedef struct cape_thread_t {
+	char name[CAPE_THREAD_NAME_LEN];
+	cape_thread_class_t thread_class;
+	pthread_t thread;
+	pid_t tid;			// kernel thread id, for chrt and taskset
+	int policy;			// what was actually applied
+	int priority;
+	int cpu;			// -1 if not pinned
+	size_t stack_size;
+	size_t prefaulted;
+	int errors;			// settings the kernel refused, usually not root
+	void* (*func)(void*);
+	void* arg;
+	volatile int started;
+	int joined;			// set by cape_thread_join()
+} cape_thread_t;
+
+int cape_thread_init();
+int cape_thread_create(const char* name, void* (*func)(void*), void* arg,
+						cape_thread_class_t thread_class);
+int cape_thread_count();
+const cape_thread_t* cape_thread_get(int index);
+int cape_thread_join(const char* name);
+int cape_thread_print_report();
+
+#endif // CAPE_THREAD_H
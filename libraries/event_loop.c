@@ -0,0 +1,221 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+epoll and timerfd event loop, see event_loop.h
+Strawson Design - 2014
+*/
+
+#include "robotics_cape.h"
+#include <sys/timerfd.h>
+
+/***********************************************************************
+*	int event_loop_init(event_loop_t* loop)
+************************************************************************/
+int event_loop_init(event_loop_t* loop){
+	memset(loop, 0, sizeof(event_loop_t));
+	loop->epfd = epoll_create(EVENT_LOOP_MAX_SOURCES);
+	if(loop->epfd < 0){
+		printf("failed to create event loop\n");
+		return -1;
+	}
+	return 0;
+}
+
+// register an fd with epoll and remember its callback
+int add_source(event_loop_t* loop, int fd, int is_timer, int priority,
+										event_func_t func, void* arg){
+	struct epoll_event ev;
+	event_source_t* src;
+	
+	if(loop->num_sources >= EVENT_LOOP_MAX_SOURCES){
+		printf("event loop full, increase EVENT_LOOP_MAX_SOURCES\n");
+		return -1;
+	}
+	src = &loop->sources[loop->num_sources];
+	src->fd = fd;
+	src->is_timer = is_timer;
+	src->priority = priority;
+	src->overruns = 0;
+	src->func = func;
+	src->arg = arg;
+	
+	ev.events = EPOLLIN;
+	ev.data.ptr = src;
+	if(epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev)){
+		perror("event loop epoll_ctl");
+		return -1;
+	}
+	loop->num_sources++;
+	return 0;
+}
+
+/***********************************************************************
+*	int event_loop_add_fd(...)
+*	call func whenever fd is readable, func must do the read itself
+************************************************************************/
+int event_loop_add_fd(event_loop_t* loop, int fd, int priority, 
+										event_func_t func, void* arg){
+	return add_source(loop, fd, 0, priority, func, arg);
+}
+
+/***********************************************************************
+*	int event_loop_add_timer(...)
+*	call func every period_us microseconds. The timer runs off 
+*	CLOCK_MONOTONIC so wakeups don't drift like a usleep loop does.
+*	returns the timerfd, which can be passed to event_loop_remove()
+************************************************************************/
+int event_loop_add_timer(event_loop_t* loop, int period_us, int priority,
+										event_func_t func, void* arg){
+	int fd;
+	struct itimerspec spec;
+	
+	if(period_us <= 0){
+		printf("event loop timer period must be positive\n");
+		return -1;
+	}
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if(fd < 0){
+		perror("timerfd_create");
+		return -1;
+	}
+	spec.it_interval.tv_sec = period_us / 1000000;
+	spec.it_interval.tv_nsec = (period_us % 1000000) * 1000;
+	spec.it_value = spec.it_interval;
+	if(timerfd_settime(fd, 0, &spec, NULL)){
+		perror("timerfd_settime");
+		close(fd);
+		return -1;
+	}
+	if(add_source(loop, fd, 1, priority, func, arg)){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/***********************************************************************
+*	int event_loop_remove(event_loop_t* loop, int fd)
+*	stop watching fd. Timers created by the loop are closed, other fds
+*	are left for the caller to close. Don't call from inside a callback.
+************************************************************************/
+int event_loop_remove(event_loop_t* loop, int fd){
+	int i;
+	for(i=0; i<loop->num_sources; i++){
+		if(loop->sources[i].fd != fd){
+			continue;
+		}
+		epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+		if(loop->sources[i].is_timer){
+			close(fd);
+		}
+		// epoll data points into sources[], so re-register the one moved
+		loop->num_sources--;
+		if(i != loop->num_sources){
+			struct epoll_event ev;
+			loop->sources[i] = loop->sources[loop->num_sources];
+			ev.events = EPOLLIN;
+			ev.data.ptr = &loop->sources[i];
+			epoll_ctl(loop->epfd, EPOLL_CTL_MOD, loop->sources[i].fd, &ev);
+		}
+		return 0;
+	}
+	return -1;
+}
+
+/***********************************************************************
+*	int event_loop_run(event_loop_t* loop)
+*	dispatch events until get_state() is EXITING. When several sources
+*	are ready after one wakeup they run in order of priority.
+************************************************************************/
+int event_loop_run(event_loop_t* loop){
+	struct epoll_event events[EVENT_LOOP_MAX_SOURCES];
+	struct epoll_event tmp;
+	event_source_t* src;
+	uint64_t expirations;
+	int n, i, j;
+	
+	while(get_state() != EXITING){
+		n = epoll_wait(loop->epfd, events, EVENT_LOOP_MAX_SOURCES, 	\
+												EVENT_LOOP_TIMEOUT_MS);
+		if(n <= 0){
+			continue;
+		}
+		// insertion sort by priority, n is small
+		for(i=1; i<n; i++){
+			tmp = events[i];
+			j = i-1;
+			while(j>=0 && ((event_source_t*)events[j].data.ptr)->priority <	\
+							((event_source_t*)tmp.data.ptr)->priority){
+				events[j+1] = events[j];
+				j--;
+			}
+			events[j+1] = tmp;
+		}
+		for(i=0; i<n; i++){
+			src = events[i].data.ptr;
+			if(src->is_timer){
+				if(read(src->fd, &expirations, sizeof(expirations)) 	\
+											!= sizeof(expirations)){
+					continue;
+				}
+				if(expirations > 1){
+					src->overruns += expirations-1;
+				}
+			}
+			src->func(src->fd, src->arg);
+		}
+	}
+	return 0;
+}
+
+// pthread wrapper, pass a pointer to an initialized event_loop_t
+void* event_loop_thread(void* loop){
+	event_loop_run((event_loop_t*)loop);
+	return NULL;
+}
+
+/***********************************************************************
+*	int event_loop_cleanup(event_loop_t* loop)
+*	close the loop's timers and epoll fd
+************************************************************************/
+int event_loop_cleanup(event_loop_t* loop){
+	int i;
+	for(i=0; i<loop->num_sources; i++){
+		if(loop->sources[i].is_timer){
+			close(loop->sources[i].fd);
+		}
+	}
+	loop->num_sources = 0;
+	if(loop->epfd > 0){
+		close(loop->epfd);
+		loop->epfd = 0;
+	}
+	return 0;
+}
@@ -0,0 +1,75 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Single threaded event loop built on epoll and timerfd. File descriptors
+and periodic timers are registered with a callback and a priority, then
+one thread sleeps in event_loop_run() until something is ready. Use it
+to host the slow I/O and housekeeping of a program in one thread 
+instead of one usleep loop per job. The IMU interrupt and control loop
+should stay in their own real-time thread.
+Strawson Design - 2014
+*/
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#define EVENT_LOOP_MAX_SOURCES	16
+#define EVENT_LOOP_TIMEOUT_MS	100		// how often run() checks for EXITING
+
+// callbacks get the fd that became ready and the arg they were added
+// with. For timers the expirations are already read from the timerfd.
+typedef int (*event_func_t)(int fd, void* arg);
+
+typedef struct event_source_t {
+	int fd;
+	int is_timer;
+	int priority;		// higher runs first when several are ready at once
+	uint64_t overruns;	// timer periods missed because the loop was busy
+	event_func_t func;
+	void* arg;
+} event_source_t;
+
+typedef struct event_loop_t {
+	int epfd;
+	int num_sources;
+	event_source_t sources[EVENT_LOOP_MAX_SOURCES];
+} event_loop_t;
+
+int event_loop_init(event_loop_t* loop);
+int event_loop_add_fd(event_loop_t* loop, int fd, int priority, 
+										event_func_t func, void* arg);
+int event_loop_add_timer(event_loop_t* loop, int period_us, int priority,
+										event_func_t func, void* arg);
+int event_loop_remove(event_loop_t* loop, int fd);
+int event_loop_run(event_loop_t* loop);
+void* event_loop_thread(void* loop);
+int event_loop_cleanup(event_loop_t* loop);
+
+#endif
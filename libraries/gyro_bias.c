@@ -0,0 +1,233 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Online gyro bias estimator, see gyro_bias.h
+Strawson Design - 2014
+*/
+
+#include "robotics_cape.h"
+
+// samples thrown away after new offsets go in, the fifo may still hold
+// a few taken with the old ones
+#define SETTLE_DIVISOR	8
+
+static void reset_window(gyro_bias_t* est){
+	int i;
+	est->n = 0;
+	for(i=0; i<3; i++){
+		est->gyro_mean[i] = 0;
+		est->gyro_m2[i] = 0;
+		est->accel_mean[i] = 0;
+		est->accel_m2[i] = 0;
+	}
+}
+
+void gyro_bias_init(gyro_bias_t* est, gyro_bias_mode_t mode, int sample_rate){
+	memset(est, 0, sizeof(gyro_bias_t));
+	est->mode = mode;
+	est->window = (int)(sample_rate * GYRO_BIAS_WINDOW_S);
+	if(est->window < 2) est->window = 2;
+	est->gyro_var_max = GYRO_BIAS_GYRO_VAR;
+	est->accel_var_max = GYRO_BIAS_ACCEL_VAR;
+	est->accel_drift_max = GYRO_BIAS_ACCEL_DRIFT;
+	est->bias_max = GYRO_BIAS_MAX;
+	est->gain = GYRO_BIAS_GAIN;
+	est->orientation[0] = 1;
+	est->orientation[4] = 1;
+	est->orientation[8] = 1;
+}
+
+// the orientation passed to initialize_imu(), samples are rotated by it
+// but the offset registers are in chip axes
+void gyro_bias_set_orientation(gyro_bias_t* est, const signed char orientation[9]){
+	int i;
+	for(i=0; i<9; i++) est->orientation[i] = orientation[i];
+}
+
+// body axes back to chip axes, the orientations are signed permutations
+// so the transpose is the inverse
+static void to_chip(const gyro_bias_t* est, const float body[3], float chip[3]){
+	const signed char* r = est->orientation;
+	int i;
+	for(i=0; i<3; i++){
+		chip[i] = r[i]*body[0] + r[3+i]*body[1] + r[6+i]*body[2];
+	}
+}
+
+// offsets already in the chip, from loadGyroCalibration()
+void gyro_bias_set_offsets(gyro_bias_t* est, const int16_t offset[3]){
+	int i;
+	for(i=0; i<3; i++) est->offset[i] = offset[i];
+}
+
+// true when gyro and accel were both quiet over the finished window
+static int window_is_quiet(gyro_bias_t* est){
+	float inv = 1.0f / (est->n - 1);
+	int i;
+	for(i=0; i<3; i++){
+		if(est->gyro_m2[i]*inv > est->gyro_var_max) return 0;
+		if(est->accel_m2[i]*inv > est->accel_var_max) return 0;
+		if(fabsf(est->gyro_mean[i]) > est->bias_max) return 0;
+	}
+	return 1;
+}
+
+// a slow steady rotation is quiet too, but it tilts gravity between two
+// quiet windows in a row
+static int gravity_held_still(gyro_bias_t* est){
+	int i;
+	if(!est->have_last) return 0;
+	for(i=0; i<3; i++){
+		if(fabsf(est->accel_mean[i]-est->last_accel_mean[i]) >
+				est->accel_drift_max) return 0;
+	}
+	return 1;
+}
+
+static void take_estimate(gyro_bias_t* est){
+	// trust the first estimate fully, later ones only track drift
+	float gain = est->updates ? est->gain : 1.0f;
+	float chip[3];
+	int i;
+	if(est->mode == GYRO_BIAS_REGISTERS){
+		// samples already have the offsets applied, the mean is what is
+		// left over. offset registers count in half raw units.
+		to_chip(est, est->gyro_mean, chip);
+		for(i=0; i<3; i++){
+			est->offset[i] -= (int16_t)roundf(2.0f*gain*chip[i]);
+		}
+		// with set_imu_ready_func() another thread applies them
+		__sync_synchronize();
+		est->pending = 1;
+	}
+	else{
+		for(i=0; i<3; i++){
+			est->bias[i] += gain*(est->gyro_mean[i] - est->bias[i]);
+		}
+	}
+	est->dirty = 1;
+	est->updates++;
+}
+
+// feed one sample, returns 1 when it finished a stationary window and
+// a new estimate was taken
+int gyro_bias_update(gyro_bias_t* est, const mpudata_t* sample){
+	float inv, d;
+	int i, quiet, ok;
+	
+	// new offsets haven't reached the chip yet, or are just settling
+	if(est->pending) return 0;
+	if(est->n < 0){
+		est->n++;
+		return 0;
+	}
+	
+	est->n++;
+	inv = 1.0f / est->n;
+	for(i=0; i<3; i++){
+		d = sample->rawGyro[i] - est->gyro_mean[i];
+		est->gyro_mean[i] += d*inv;
+		est->gyro_m2[i] += d*(sample->rawGyro[i] - est->gyro_mean[i]);
+		d = sample->rawAccel[i] - est->accel_mean[i];
+		est->accel_mean[i] += d*inv;
+		est->accel_m2[i] += d*(sample->rawAccel[i] - est->accel_mean[i]);
+	}
+	if(est->n < est->window) return 0;
+	
+	est->windows++;
+	quiet = window_is_quiet(est);
+	ok = quiet && gravity_held_still(est);
+	if(ok){
+		est->stationary++;
+		take_estimate(est);
+	}
+	// the next window is compared against this one if it was quiet
+	est->have_last = quiet;
+	for(i=0; i<3; i++) est->last_accel_mean[i] = est->accel_mean[i];
+	reset_window(est);
+	return ok;
+}
+
+// write new offsets to the chip, call from the thread that owns the bus.
+// The cape library does this in the imu interrupt thread, gyro_bias_update()
+// may be running in the imu_ctrl thread at the same time.
+int gyro_bias_apply(gyro_bias_t* est){
+	if(!est->pending) return 0;
+	if(setXGyroOffset(est->offset[0]) || setYGyroOffset(est->offset[1]) ||
+			setZGyroOffset(est->offset[2])){
+		printf("problem setting gyro offset\n");
+		return -1;
+	}
+	// don't let samples from before the write into the next window
+	reset_window(est);
+	est->n = -(est->window / SETTLE_DIVISOR);
+	est->have_last = 0;
+	// the window reset has to be seen before update() starts using it
+	__sync_synchronize();
+	est->pending = 0;
+	return 0;
+}
+
+// offsets plus what is left of the bias in host mode
+static int16_t saved_offset(const gyro_bias_t* est, int i){
+	float chip[3];
+	if(est->mode == GYRO_BIAS_REGISTERS) return est->offset[i];
+	to_chip(est, est->bias, chip);
+	return (int16_t)roundf(est->offset[i] - 2.0f*chip[i]);
+}
+
+// same format as the calibrate_gyro example always wrote
+int gyro_bias_save(gyro_bias_t* est){
+	char file_path[100];
+	FILE* cal;
+	
+	strcpy (file_path, CONFIG_DIRECTORY);
+	strcat (file_path, GYRO_CAL_FILE);
+	cal = fopen(file_path, "w");
+	if (cal == 0) {
+		mkdir(CONFIG_DIRECTORY, 0777);
+		cal = fopen(file_path, "w");
+		if (cal == 0){
+			printf("could not open %s\n", file_path);
+			return -1;
+		}
+	}
+	fprintf(cal, "%d\n%d\n%d\n", saved_offset(est,0), saved_offset(est,1),
+			saved_offset(est,2));
+	fclose(cal);
+	est->dirty = 0;
+	return 0;
+}
+
+// raw gyro minus the host side bias, for GYRO_BIAS_HOST mode
+void gyro_bias_correct(const gyro_bias_t* est, const short raw[3], float out[3]){
+	int i;
+	for(i=0; i<3; i++) out[i] = raw[i] - est->bias[i];
+}
@@ -0,0 +1,99 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Online gyro bias estimator. Feed it every IMU sample from the interrupt
+function with gyro_bias_update(). It keeps streaming Welford statistics
+of gyro and accel over windows of about a second. A window where the
+gyro and accel are quiet, following another quiet window with the same
+accel mean, is taken as stationary and its gyro mean as the
+remaining bias. That is rotated back into chip axes and folded into the
+gyro offset registers, so the DMP quaternion benefits too, or into a host side bias vector for raw
+mode programs that subtract it themselves.
+Per sample it is a handful of multiply-adds, the register writes happen
+in gyro_bias_apply() and the file write in gyro_bias_save(), which the
+cape library calls from the interrupt thread and cleanup_cape().
+Strawson Design - 2014
+*/
+
+#ifndef GYRO_BIAS_H
+#define GYRO_BIAS_H
+
+#include <stdint.h>
+#include "mpu9150.h"
+
+// defaults, raw units at the 2000deg/s gyro and 2g accel ranges
+#define GYRO_BIAS_WINDOW_S		1.0		// seconds per stationary test
+#define GYRO_BIAS_GYRO_VAR		16.0	// 0.25deg/s rms
+#define GYRO_BIAS_ACCEL_VAR		250000.0 // 0.03g rms, allows vibration
+#define GYRO_BIAS_ACCEL_DRIFT	40.0	// accel mean change, about 0.15deg tilt
+#define GYRO_BIAS_MAX			82.0	// 5deg/s, more than that is rotation
+#define GYRO_BIAS_GAIN			0.5		// fraction of each new estimate used
+
+typedef enum gyro_bias_mode_t {
+	GYRO_BIAS_REGISTERS,	// fold the bias into the gyro offset registers
+	GYRO_BIAS_HOST			// only keep it in bias[], subtract it yourself
+} gyro_bias_mode_t;
+
+typedef struct gyro_bias_t {
+	gyro_bias_mode_t mode;
+	int window;					// samples per window
+	float gyro_var_max;
+	float accel_var_max;
+	float accel_drift_max;
+	float bias_max;
+	float gain;
+	signed char orientation[9];	// body from chip, the samples are in body axes
+	
+	// running window, Welford mean and sum of squared differences
+	int n;
+	float gyro_mean[3], gyro_m2[3];
+	float accel_mean[3], accel_m2[3];
+	float last_accel_mean[3];
+	int have_last;				// last window was quiet, last_accel_mean valid
+	
+	int16_t offset[3];			// gyro offset registers, 2 raw units per lsb
+	float bias[3];				// bias left in the samples, raw units
+	volatile int pending;		// offset[] changed, not written yet
+	volatile int dirty;			// changed since gyro_bias_save()
+	
+	unsigned long windows;
+	unsigned long stationary;
+	unsigned long updates;
+} gyro_bias_t;
+
+void gyro_bias_init(gyro_bias_t* est, gyro_bias_mode_t mode, int sample_rate);
+void gyro_bias_set_offsets(gyro_bias_t* est, const int16_t offset[3]);
+void gyro_bias_set_orientation(gyro_bias_t* est, const signed char orientation[9]);
+int gyro_bias_update(gyro_bias_t* est, const mpudata_t* sample);
+int gyro_bias_apply(gyro_bias_t* est);
+int gyro_bias_save(gyro_bias_t* est);
+void gyro_bias_correct(const gyro_bias_t* est, const short raw[3], float out[3]);
+
+#endif // GYRO_BIAS_H
@@ -0,0 +1,232 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Shared i2c bus manager, see i2c_bus.h
+Strawson Design - 2014
+*/
+
+#define _GNU_SOURCE		// pthread_mutexattr_setprotocol
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "i2c_bus.h"
+#include "robotics_cape.h"	// cape_monotonic_ns()
+
+typedef struct bus_t {
+	pthread_mutex_t owner;		// held for the whole transaction
+	pthread_mutex_t mutex;		// guards the fields below, held briefly
+	pthread_cond_t bg_turn;
+	int bg_admitted;			// a background client holds or is taking owner
+	int rt_active;				// realtime clients holding or waiting for owner
+	int bg_waiting;
+	int fd;						// 0 until opened
+	uint64_t locked_ns;
+	int owner_rt;				// the owner locked as a realtime client
+	i2c_bus_stats_t stats;
+} bus_t;
+
+static bus_t buses[I2C_BUS_COUNT];
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static __thread i2c_bus_priority_t thread_priority = I2C_BUS_BACKGROUND;
+
+static void init_buses(){
+	pthread_mutexattr_t attr;
+	int i;
+	pthread_mutexattr_init(&attr);
+	// realtime clients block on it, so a background owner runs at their
+	// priority until it lets go and can't be starved by mid priority work
+	pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+	for(i=0; i<I2C_BUS_COUNT; i++){
+		pthread_mutex_init(&buses[i].owner, &attr);
+		pthread_mutex_init(&buses[i].mutex, NULL);
+		pthread_cond_init(&buses[i].bg_turn, NULL);
+	}
+	pthread_mutexattr_destroy(&attr);
+}
+
+static bus_t* get_bus(int bus){
+	if(bus < 0 || bus >= I2C_BUS_COUNT){
+		printf("i2c bus %d doesn't exist\n", bus);
+		return NULL;
+	}
+	pthread_once(&once, init_buses);
+	return &buses[bus];
+}
+
+// applies to every lock the calling thread takes from now on
+void i2c_bus_set_priority(i2c_bus_priority_t priority){
+	thread_priority = priority;
+}
+
+// realtime clients go straight for the owner mutex. Only the one
+// background client already let in can be ahead of them.
+static void lock_realtime(bus_t* b){
+	uint64_t start, wait;
+	pthread_mutex_lock(&b->mutex);
+	b->stats.rt_locks++;
+	b->rt_active++;
+	pthread_mutex_unlock(&b->mutex);
+	
+	if(pthread_mutex_trylock(&b->owner) == 0) return;
+	start = cape_monotonic_ns();
+	pthread_mutex_lock(&b->owner);
+	wait = cape_monotonic_ns() - start;
+	
+	pthread_mutex_lock(&b->mutex);
+	b->stats.rt_contended++;
+	if(b->bg_waiting) b->stats.rt_preempts++;
+	cape_add_time(&b->stats.rt_wait_ns_total, &b->stats.rt_wait_ns_max, wait);
+	pthread_mutex_unlock(&b->mutex);
+}
+
+// background clients are let at the owner mutex one at a time, and only
+// while no realtime client wants it
+static void lock_background(bus_t* b){
+	uint64_t start = 0;
+	pthread_mutex_lock(&b->mutex);
+	b->stats.locks++;
+	if(b->bg_admitted || b->rt_active){
+		b->stats.contended++;
+		start = cape_monotonic_ns();
+		b->bg_waiting++;
+		while(b->bg_admitted || b->rt_active){
+			pthread_cond_wait(&b->bg_turn, &b->mutex);
+		}
+		b->bg_waiting--;
+	}
+	b->bg_admitted = 1;
+	pthread_mutex_unlock(&b->mutex);
+	
+	// a realtime client may still get in first, then this waits for it
+	pthread_mutex_lock(&b->owner);
+	if(start){
+		pthread_mutex_lock(&b->mutex);
+		cape_add_time(&b->stats.wait_ns_total, &b->stats.wait_ns_max,
+				cape_monotonic_ns() - start);
+		pthread_mutex_unlock(&b->mutex);
+	}
+}
+
+// blocks until the calling thread owns the bus, not recursive
+int i2c_bus_lock(int bus){
+	bus_t* b = get_bus(bus);
+	if(b == NULL) return -1;
+	if(thread_priority == I2C_BUS_REALTIME) lock_realtime(b);
+	else lock_background(b);
+	b->owner_rt = thread_priority == I2C_BUS_REALTIME;
+	b->locked_ns = cape_monotonic_ns();
+	return 0;
+}
+
+// the shared fd, only use it while holding the bus
+int i2c_bus_fd(int bus){
+	bus_t* b = get_bus(bus);
+	char path[32];
+	if(b == NULL) return -1;
+	if(b->fd == 0){
+		sprintf(path, "/dev/i2c-%d", bus);
+		b->fd = open(path, O_RDWR);
+		if(b->fd < 0){
+			perror("open(i2c_bus)");
+			b->fd = 0;
+			return -1;
+		}
+	}
+	return b->fd;
+}
+
+void i2c_bus_unlock(int bus){
+	bus_t* b = get_bus(bus);
+	uint64_t held;
+	int rt;
+	if(b == NULL) return;
+	held = cape_monotonic_ns() - b->locked_ns;
+	rt = b->owner_rt;
+	pthread_mutex_unlock(&b->owner);
+	pthread_mutex_lock(&b->mutex);
+	cape_add_time(&b->stats.hold_ns_total, &b->stats.hold_ns_max, held);
+	if(rt) b->rt_active--;
+	else b->bg_admitted = 0;
+	// background goes next only once no realtime client wants the bus
+	if(!b->rt_active && !b->bg_admitted && b->bg_waiting){
+		pthread_cond_broadcast(&b->bg_turn);
+	}
+	pthread_mutex_unlock(&b->mutex);
+}
+
+int i2c_bus_get_stats(int bus, i2c_bus_stats_t* stats){
+	bus_t* b = get_bus(bus);
+	if(b == NULL) return -1;
+	pthread_mutex_lock(&b->mutex);
+	*stats = b->stats;
+	pthread_mutex_unlock(&b->mutex);
+	return 0;
+}
+
+static float mean_us(uint64_t total, unsigned long n){
+	return n ? total/1000.0/n : 0;
+}
+
+void i2c_bus_print_report(){
+	i2c_bus_stats_t s;
+	int i, header = 0;
+	for(i=0; i<I2C_BUS_COUNT; i++){
+		i2c_bus_get_stats(i, &s);
+		if(s.locks + s.rt_locks == 0) continue;
+		if(!header){
+			printf("\ni2c bus contention\n");
+			printf("  bus  class        locks waited mean wait us max wait us\n");
+			header = 1;
+		}
+		printf("  %3d  background %7lu %6lu %12.1f %11.1f\n", i, s.locks,
+				s.contended, mean_us(s.wait_ns_total, s.contended),
+				s.wait_ns_max/1000.0);
+		printf("  %3d  realtime   %7lu %6lu %12.1f %11.1f\n", i, s.rt_locks,
+				s.rt_contended, mean_us(s.rt_wait_ns_total, s.rt_contended),
+				s.rt_wait_ns_max/1000.0);
+		printf("  %3d  held %0.1fus mean, %0.1fus max, realtime went ahead"
+				" of background %lu times\n", i,
+				mean_us(s.hold_ns_total, s.locks+s.rt_locks),
+				s.hold_ns_max/1000.0, s.rt_preempts);
+	}
+}
+
+// at exit, nothing may be on the bus
+void i2c_bus_close_all(){
+	int i;
+	for(i=0; i<I2C_BUS_COUNT; i++){
+		if(buses[i].fd){
+			close(buses[i].fd);
+			buses[i].fd = 0;
+		}
+	}
+}
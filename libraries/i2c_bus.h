@@ -0,0 +1,82 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Shared i2c bus manager. There is one /dev/i2c-N fd per bus for the whole
+program, opened on first use, and one lock per bus that every
+transaction holds from start to stop. linux_glue.c (the imu drivers)
+and c_i2c.c both go through it, so transfers from different threads
+can no longer interleave.
+
+The lock is priority aware. A thread that called
+i2c_bus_set_priority(I2C_BUS_REALTIME), like the imu interrupt thread,
+goes ahead of every queued background client. It only ever waits for
+the one transaction already on the bus. The owner holds a priority
+inheritance mutex for the whole transaction and realtime clients block
+on it, so a background owner runs at the realtime thread's priority
+until it unlocks.
+
+Contention counts and wait times per bus come from i2c_bus_get_stats().
+cleanup_cape() prints i2c_bus_print_report().
+Strawson Design - 2014
+*/
+
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <stdint.h>
+
+#define I2C_BUS_COUNT	8	// /dev/i2c-0 to /dev/i2c-7
+
+typedef enum i2c_bus_priority_t {
+	I2C_BUS_BACKGROUND,	// default for every thread
+	I2C_BUS_REALTIME	// the imu interrupt thread
+} i2c_bus_priority_t;
+
+typedef struct i2c_bus_stats_t {
+	unsigned long locks;
+	unsigned long contended;		// background locks that had to wait
+	unsigned long rt_locks;
+	unsigned long rt_contended;		// realtime locks that had to wait
+	unsigned long rt_preempts;		// realtime went ahead of queued background
+	uint64_t wait_ns_total, wait_ns_max;		// background
+	uint64_t rt_wait_ns_total, rt_wait_ns_max;	// realtime
+	uint64_t hold_ns_total, hold_ns_max;
+} i2c_bus_stats_t;
+
+void i2c_bus_set_priority(i2c_bus_priority_t priority);
+int i2c_bus_lock(int bus);
+int i2c_bus_fd(int bus);
+void i2c_bus_unlock(int bus);
+
+int i2c_bus_get_stats(int bus, i2c_bus_stats_t* stats);
+void i2c_bus_print_report();
+void i2c_bus_close_all();
+
+#endif // I2C_BUS_H
@@ -0,0 +1,321 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+I2C transaction tracer, see i2c_trace.h
+Strawson Design - 2014
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include "i2c_trace.h"
+#include "robotics_cape.h"	// cape_monotonic_ns()
+
+#define NAME_LEN	16
+
+typedef struct trace_slot_t {
+	volatile uint32_t key;		// op, slave and register plus one, 0 is empty
+	i2c_trace_stats_t stats;
+} trace_slot_t;
+
+typedef struct trace_thread_t {
+	char name[NAME_LEN];
+	trace_slot_t slots[I2C_TRACE_SLOTS];
+	uint32_t dropped;			// keys that didn't fit
+	uint64_t busy_ns;			// all bus time of this thread
+	
+	// control period accounting, see i2c_trace_period_begin()
+	uint64_t period_start_ns;
+	uint64_t period_busy_ns;	// busy_ns when the period began
+	uint64_t last_period_ns;
+	uint32_t periods;			// begin to begin intervals
+	uint64_t period_total_ns;
+	uint32_t callbacks;
+	uint64_t callback_i2c_ns;
+	uint32_t callback_max_ns;
+	float worst_share;			// largest i2c time over period
+	uint32_t callback_hist[I2C_TRACE_BINS];
+} trace_thread_t;
+
+static trace_thread_t threads[I2C_TRACE_THREADS];
+static volatile int threads_used;	// claimed buffers, never shrinks
+static volatile uint32_t threads_dropped;
+static volatile int enabled = 1;
+static __thread trace_thread_t* mine;
+static __thread int no_buffer;
+
+void i2c_trace_enable(int on){
+	enabled = on;
+}
+
+// start time for i2c_trace_record(), 0 while tracing is off
+uint64_t i2c_trace_start(){
+	return enabled ? cape_monotonic_ns() : 0;
+}
+
+// the calling thread's buffer, claimed the first time it is needed
+static trace_thread_t* my_buffer(){
+	int index;
+	if(mine != NULL || no_buffer) return mine;
+	index = __sync_fetch_and_add(&threads_used, 1);
+	if(index >= I2C_TRACE_THREADS){
+		__sync_fetch_and_add(&threads_dropped, 1);
+		no_buffer = 1;
+		return NULL;
+	}
+	mine = &threads[index];
+	prctl(PR_GET_NAME, mine->name, 0, 0, 0);
+	mine->name[NAME_LEN-1] = 0;
+	return mine;
+}
+
+static int bin_of(uint64_t ns){
+	uint64_t us = ns >> I2C_TRACE_US_SHIFT;
+	int bin;
+	if(us == 0) return 0;
+	bin = 64 - __builtin_clzll(us);
+	return bin < I2C_TRACE_BINS ? bin : I2C_TRACE_BINS-1;
+}
+
+uint64_t i2c_trace_bin_upper_ns(int bin){
+	return (uint64_t)1 << (I2C_TRACE_US_SHIFT + bin);
+}
+
+static uint32_t make_key(i2c_trace_op_t op, unsigned char slave_addr,
+						unsigned char reg_addr){
+	return (((uint32_t)op << 16) | ((uint32_t)slave_addr << 8) | reg_addr) + 1;
+}
+
+// open addressing, only the owner thread ever fills a slot
+static trace_slot_t* find_slot(trace_thread_t* t, uint32_t key, int insert){
+	unsigned int i, h = (key * 2654435761u) >> 26;
+	trace_slot_t* s;
+	for(i=0; i<I2C_TRACE_SLOTS; i++){
+		s = &t->slots[(h+i) % I2C_TRACE_SLOTS];
+		if(s->key == key) return s;
+		if(s->key == 0){
+			if(!insert) return NULL;
+			memset(&s->stats, 0, sizeof(s->stats));
+			// readers must not see the key before the zeroed stats
+			__sync_synchronize();
+			s->key = key;
+			return s;
+		}
+	}
+	if(insert) t->dropped++;
+	return NULL;
+}
+
+static void add_stats(i2c_trace_stats_t* s, unsigned int bytes, uint64_t ns,
+			uint64_t wait, int err){
+	s->count++;
+	s->wait_ns_total += wait;
+	if(wait > s->wait_max_ns) s->wait_max_ns = wait;
+	s->bytes += bytes;
+	if(err) s->errors++;
+	s->total_ns += ns;
+	if(ns > s->max_ns) s->max_ns = ns;
+	s->hist[bin_of(ns)]++;
+}
+
+// wait_ns is the i2c_trace_start() from before taking the bus lock,
+// start_ns the one from after
+void i2c_trace_record(i2c_trace_op_t op, unsigned char slave_addr,
+			unsigned char reg_addr, unsigned int bytes, uint64_t wait_ns,
+			uint64_t start_ns, int err){
+	trace_thread_t* t;
+	trace_slot_t* s;
+	uint64_t ns;
+	if(start_ns == 0) return;
+	ns = cape_monotonic_ns() - start_ns;
+	// tracing may have been turned on while waiting
+	wait_ns = wait_ns ? start_ns - wait_ns : 0;
+	t = my_buffer();
+	if(t == NULL) return;
+	t->busy_ns += ns;
+	s = find_slot(t, make_key(op, slave_addr, reg_addr), 1);
+	if(s != NULL) add_stats(&s->stats, bytes, ns, wait_ns, err);
+}
+
+// call at the top of each control period with the time it started,
+// the imu interrupt edge for the imu thread
+void i2c_trace_period_begin(uint64_t now){
+	trace_thread_t* t;
+	if(!enabled) return;
+	t = my_buffer();
+	if(t == NULL) return;
+	if(t->period_start_ns){
+		t->last_period_ns = now - t->period_start_ns;
+		t->period_total_ns += t->last_period_ns;
+		t->periods++;
+	}
+	t->period_start_ns = now;
+	t->period_busy_ns = t->busy_ns;
+}
+
+// call when the period's work is done
+void i2c_trace_period_end(){
+	trace_thread_t* t = mine;
+	uint64_t ns;
+	float share;
+	if(t == NULL || t->period_start_ns == 0) return;
+	ns = t->busy_ns - t->period_busy_ns;
+	t->callbacks++;
+	t->callback_i2c_ns += ns;
+	if(ns > t->callback_max_ns) t->callback_max_ns = ns;
+	t->callback_hist[bin_of(ns)]++;
+	if(t->last_period_ns){
+		share = (float)ns / t->last_period_ns;
+		if(share > t->worst_share) t->worst_share = share;
+	}
+}
+
+static void merge_stats(i2c_trace_stats_t* to, const i2c_trace_stats_t* from){
+	int i;
+	to->count += from->count;
+	to->errors += from->errors;
+	to->bytes += from->bytes;
+	to->total_ns += from->total_ns;
+	if(from->max_ns > to->max_ns) to->max_ns = from->max_ns;
+	to->wait_ns_total += from->wait_ns_total;
+	if(from->wait_max_ns > to->wait_max_ns) to->wait_max_ns = from->wait_max_ns;
+	for(i=0; i<I2C_TRACE_BINS; i++) to->hist[i] += from->hist[i];
+}
+
+static int claimed_threads(){
+	int n = threads_used;
+	return n < I2C_TRACE_THREADS ? n : I2C_TRACE_THREADS;
+}
+
+// totals over every thread for one key, returns -1 if it was never seen
+int i2c_trace_get(i2c_trace_op_t op, unsigned char slave_addr,
+			unsigned char reg_addr, i2c_trace_stats_t* out){
+	uint32_t key = make_key(op, slave_addr, reg_addr);
+	trace_slot_t* s;
+	int i, found = 0;
+	memset(out, 0, sizeof(i2c_trace_stats_t));
+	for(i=0; i<claimed_threads(); i++){
+		s = find_slot(&threads[i], key, 0);
+		if(s == NULL) continue;
+		merge_stats(out, &s->stats);
+		found = 1;
+	}
+	return found ? 0 : -1;
+}
+
+// upper bin edge below which the given fraction of the samples fell,
+// or the largest sample if that is lower
+static uint64_t percentile_ns(const uint32_t* hist, uint32_t count, float p,
+			uint64_t max_ns){
+	uint32_t sum = 0;
+	int i;
+	for(i=0; i<I2C_TRACE_BINS; i++){
+		sum += hist[i];
+		if(sum >= p*count) break;
+	}
+	if(i == I2C_TRACE_BINS) i--;
+	if(i2c_trace_bin_upper_ns(i) < max_ns) return i2c_trace_bin_upper_ns(i);
+	return max_ns;
+}
+
+static const char* op_name(int op){
+	switch(op){
+	case I2C_TRACE_WRITE:		return "write";
+	case I2C_TRACE_READ:		return "read";
+	case I2C_TRACE_READ_MULTI:	return "multi";
+	}
+	return "?";
+}
+
+static int compare_keys(const void* a, const void* b){
+	const trace_slot_t* x = a;
+	const trace_slot_t* y = b;
+	return (x->key > y->key) - (x->key < y->key);
+}
+
+static void print_periods(trace_thread_t* t){
+	float period, mean;
+	if(t->callbacks == 0) return;
+	period = t->periods ? t->period_total_ns / 1000.0 / t->periods : 0;
+	mean = t->callback_i2c_ns / 1000.0 / t->callbacks;
+	printf("  %-15s %7u periods of %8.1fus, i2c mean %7.1fus", t->name,
+			t->callbacks, period, mean);
+	if(period > 0) printf(" %5.1f%%", 100*mean/period);
+	printf(", p99 <=%lluus, max %7.1fus %5.1f%%\n",
+			(unsigned long long)(percentile_ns(t->callback_hist, t->callbacks,
+			0.99f, t->callback_max_ns) >> I2C_TRACE_US_SHIFT),
+			t->callback_max_ns/1000.0, 100*t->worst_share);
+}
+
+void i2c_trace_print_report(){
+	trace_slot_t* merged;
+	trace_slot_t* s;
+	i2c_trace_stats_t* st;
+	int i, j, k, n = 0, threads_n = claimed_threads();
+	uint32_t dropped = 0;
+	
+	if(threads_n == 0) return;
+	merged = calloc(threads_n * I2C_TRACE_SLOTS, sizeof(trace_slot_t));
+	if(merged == NULL) return;
+	for(i=0; i<threads_n; i++){
+		dropped += threads[i].dropped;
+		for(j=0; j<I2C_TRACE_SLOTS; j++){
+			s = &threads[i].slots[j];
+			if(s->key == 0) continue;
+			for(k=0; k<n && merged[k].key!=s->key; k++);
+			if(k == n) merged[n++].key = s->key;
+			merge_stats(&merged[k].stats, &s->stats);
+		}
+	}
+	qsort(merged, n, sizeof(trace_slot_t), compare_keys);
+	
+	printf("\ni2c trace\n");
+	printf("  slave reg op       count errors     bytes  mean us   p50 us   p99 us   max us  wait us  max wait\n");
+	for(k=0; k<n; k++){
+		st = &merged[k].stats;
+		printf("  0x%02X  0x%02X %-5s %8u %6u %9llu %8.1f %8llu %8llu %8.1f %8.1f %9.1f\n",
+				((merged[k].key-1) >> 8) & 0xFF, (merged[k].key-1) & 0xFF,
+				op_name((merged[k].key-1) >> 16), st->count, st->errors,
+				(unsigned long long)st->bytes, st->total_ns/1000.0/st->count,
+				(unsigned long long)(percentile_ns(st->hist, st->count, 0.5f,
+				st->max_ns) >> I2C_TRACE_US_SHIFT),
+				(unsigned long long)(percentile_ns(st->hist, st->count, 0.99f,
+				st->max_ns) >> I2C_TRACE_US_SHIFT),
+				st->max_ns/1000.0, st->wait_ns_total/1000.0/st->count,
+				st->wait_max_ns/1000.0);
+	}
+	for(i=0; i<threads_n; i++) print_periods(&threads[i]);
+	if(dropped || threads_dropped){
+		printf("  %u keys and %u threads didn't fit in the trace buffers\n",
+				dropped, threads_dropped);
+	}
+	free(merged);
+}
@@ -0,0 +1,90 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Always-on tracing of every linux_i2c_read(), linux_i2c_write() and
+linux_i2c_read_multi() call. Each thread records into its own buffer,
+claimed on its first transaction, so there are no locks or shared cache
+lines on the bus path. Keys are slave, register and direction. Each one
+keeps a count, bytes moved, errors, total and max time and a histogram
+of latency in powers of two. Latency starts once the bus lock is held,
+time spent waiting for the lock is kept separately.
+
+The period functions tell how much of each control period went to the
+bus. The cape library wraps the imu interrupt function in them, so the
+report shows i2c time per imu callback next to the interrupt period.
+
+i2c_trace_get() and i2c_trace_print_report() may be called from any
+thread while tracing runs. Their numbers are a snapshot, not an atomic
+cut. cleanup_cape() prints the report.
+Strawson Design - 2014
+*/
+
+#ifndef I2C_TRACE_H
+#define I2C_TRACE_H
+
+#include <stdint.h>
+
+#define I2C_TRACE_THREADS	16	// threads that can trace, others aren't counted
+#define I2C_TRACE_SLOTS		64	// distinct slave/register/op keys per thread
+#define I2C_TRACE_BINS		16	// bin 0 is under 1us, bin i 2^(i-1) to 2^i us
+#define I2C_TRACE_US_SHIFT	10	// bins count in 1024ns "microseconds"
+
+typedef enum i2c_trace_op_t {
+	I2C_TRACE_WRITE,
+	I2C_TRACE_READ,
+	I2C_TRACE_READ_MULTI	// keyed by the first register of the batch
+} i2c_trace_op_t;
+
+typedef struct i2c_trace_stats_t {
+	uint32_t count;
+	uint32_t errors;
+	uint64_t bytes;
+	uint64_t total_ns;
+	uint32_t max_ns;
+	uint32_t hist[I2C_TRACE_BINS];
+	uint64_t wait_ns_total;		// waiting for the bus lock, not in the above
+	uint32_t wait_max_ns;
+} i2c_trace_stats_t;
+
+void i2c_trace_enable(int on);
+uint64_t i2c_trace_start();
+void i2c_trace_record(i2c_trace_op_t op, unsigned char slave_addr,
+			unsigned char reg_addr, unsigned int bytes, uint64_t wait_ns,
+			uint64_t start_ns, int err);
+
+void i2c_trace_period_begin(uint64_t now_ns);
+void i2c_trace_period_end();
+
+int i2c_trace_get(i2c_trace_op_t op, unsigned char slave_addr,
+			unsigned char reg_addr, i2c_trace_stats_t* out);
+uint64_t i2c_trace_bin_upper_ns(int bin);
+void i2c_trace_print_report();
+
+#endif // I2C_TRACE_H
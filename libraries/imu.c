@@ -0,0 +1,294 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Multiple IMU contexts, see imu.h
+Strawson Design - 2014
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "imu.h"
+#include "robotics_cape.h"	// cape_monotonic_ns()
+
+#define IMU_LOCK_DEPTH	8	// imu_lock() calls one thread can nest
+
+// what was selected before each nested imu_lock(), only touched by the
+// thread holding driver_mutex
+typedef struct selection_t {
+	linux_i2c_bus_t* bus;
+	void* mpu_state;
+	void* dmp_state;
+	mpu9150_state_t* state;
+} selection_t;
+
+static imu_t cape_imu = { .name = "cape" };
+static pthread_mutex_t driver_mutex;
+static pthread_once_t mutex_once = PTHREAD_ONCE_INIT;
+static selection_t saved[IMU_LOCK_DEPTH];
+static int depth = 0;
+
+// recursive so the imu interrupt function, which runs with the cape imu
+// locked, can read another imu. Priority inheritance because a background
+// thread reading an imu holds it for several transactions while the
+// SCHED_FIFO imu thread may be waiting on it
+static void init_mutex(){
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+	pthread_mutex_init(&driver_mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+imu_t* imu_default(){
+	return &cape_imu;
+}
+
+/***********************************************************************
+*	imu_t* imu_create(const char* name, int i2c_bus, unsigned char addr)
+*	allocate the driver state for another MPU9150 on /dev/i2c-<i2c_bus>
+*	at addr, 0x68 or 0x69 with AD0 high. Nothing is sent to the chip
+*	until imu_init() or imu_init_raw().
+************************************************************************/
+imu_t* imu_create(const char* name, int i2c_bus, unsigned char addr){
+	imu_t* imu;
+	
+	if(i2c_bus<MIN_I2C_BUS || i2c_bus>MAX_I2C_BUS){
+		printf("invalid i2c bus %d\n", i2c_bus);
+		return NULL;
+	}
+	imu = calloc(1, sizeof(imu_t));
+	if(imu == NULL) return NULL;
+	imu->bus = malloc(sizeof(linux_i2c_bus_t));
+	imu->mpu_state = malloc(mpu_state_size());
+	imu->dmp_state = malloc(dmp_state_size());
+	imu->state = malloc(sizeof(mpu9150_state_t));
+	if(!imu->bus || !imu->mpu_state || !imu->dmp_state || !imu->state){
+		imu_destroy(imu);
+		return NULL;
+	}
+	strncpy(imu->name, name, IMU_NAME_LEN-1);
+	linux_i2c_bus_init(imu->bus, i2c_bus);
+	mpu_state_init(imu->mpu_state, addr);
+	dmp_state_init(imu->dmp_state);
+	mpu9150_state_init(imu->state);
+	return imu;
+}
+
+void imu_destroy(imu_t* imu){
+	if(imu == NULL || imu == &cape_imu) return;
+	// the fd belongs to the shared bus, see i2c_bus.h
+	free(imu->bus);
+	free(imu->mpu_state);
+	free(imu->dmp_state);
+	free(imu->state);
+	free(imu);
+}
+
+// talk to something other than /dev/i2c-N, see test_imu_multi
+void imu_set_backend(imu_t* imu, const linux_i2c_backend_t* backend, 
+					void* arg){
+	if(imu->bus == NULL){
+		printf("the cape imu always uses the real bus\n");
+		return;
+	}
+	imu_lock(imu);
+	imu->bus->backend = backend;
+	imu->bus->backend_arg = arg;
+	imu_unlock(imu);
+}
+
+/***********************************************************************
+*	void imu_lock(imu_t* imu)
+*	take the driver lock and select this imu in linux_glue, inv_mpu,
+*	the DMP driver and mpu9150. Calls can nest, including for different
+*	imus, each imu_unlock() returns to the previous selection.
+************************************************************************/
+void imu_lock(imu_t* imu){
+	pthread_once(&mutex_once, init_mutex);
+	pthread_mutex_lock(&driver_mutex);
+	if(depth >= IMU_LOCK_DEPTH){
+		printf("ERROR: imu_lock() nested too deep\n");
+		exit(-1);
+	}
+	saved[depth].bus = linux_i2c_select_bus(imu->bus);
+	saved[depth].mpu_state = mpu_select_state(imu->mpu_state);
+	saved[depth].dmp_state = dmp_select_state(imu->dmp_state);
+	saved[depth].state = mpu9150_select_state(imu->state);
+	depth++;
+}
+
+void imu_unlock(imu_t* imu){
+	depth--;
+	linux_i2c_select_bus(saved[depth].bus);
+	mpu_select_state(saved[depth].mpu_state);
+	dmp_select_state(saved[depth].dmp_state);
+	mpu9150_select_state(saved[depth].state);
+	pthread_mutex_unlock(&driver_mutex);
+}
+
+static int init_dmp(int sample_rate, const signed char orientation[9]){
+	uint64_t start_ns = cape_monotonic_ns();
+	uint64_t firmware_ns;
+	unsigned char reused = 0;
+	
+	if (mpu_init(NULL)) {
+		printf("\nmpu_init() failed\n");
+		return -1;
+	}
+ 
+	mpu_set_sensors(INV_XYZ_GYRO | INV_XYZ_ACCEL | INV_XYZ_COMPASS);
+	mpu_set_sample_rate(sample_rate);
+	
+	// compass run at 100hz max. 
+	if(sample_rate > 100){
+		// best to sample at a fraction of the gyro/accel
+		mpu_set_compass_sample_rate(sample_rate/2);
+	}
+	else{
+		mpu_set_compass_sample_rate(sample_rate);
+	}
+	mpu_set_lpf(188); //as little filtering as possible
+	
+	// skips the code upload if it survived from an earlier run
+	firmware_ns = cape_monotonic_ns();
+	if(dmp_load_motion_driver_firmware(sample_rate)){
+		printf("\ndmp_load_motion_driver_firmware() failed\n");
+		return -1;
+	}
+	firmware_ns = cape_monotonic_ns() - firmware_ns;
+	mpu_get_dmp_reused(&reused);
+
+	dmp_set_orientation(inv_orientation_matrix_to_scalar(orientation));
+  	dmp_enable_feature(DMP_FEATURE_6X_LP_QUAT | DMP_FEATURE_SEND_RAW_ACCEL 
+						| DMP_FEATURE_SEND_CAL_GYRO);
+
+	dmp_set_fifo_rate(sample_rate);
+	
+	if (mpu_set_dmp_state(1)) {
+		printf("\nmpu_set_dmp_state(1) failed\n");
+		return -1;
+	}
+	printf("DMP firmware %s in %0.1fms, IMU ready in %0.1fms\n",
+			reused ? "reused" : "loaded", firmware_ns/1e6,
+			(cape_monotonic_ns()-start_ns)/1e6);
+	return 0;
+}
+
+/***********************************************************************
+*	int imu_init(imu_t* imu, int sample_rate, signed char orientation[9])
+*	start the DMP on this imu, read it with imu_read()
+************************************************************************/
+int imu_init(imu_t* imu, int sample_rate, const signed char orientation[9]){
+	int ret;
+	if(sample_rate<MIN_SAMPLE_RATE || sample_rate>MAX_SAMPLE_RATE){
+		printf("sample rate should be between %d and %d\n",
+				MIN_SAMPLE_RATE, MAX_SAMPLE_RATE);
+		return -1;
+	}
+	imu_lock(imu);
+	ret = init_dmp(sample_rate, orientation);
+	imu_unlock(imu);
+	return ret;
+}
+
+static int init_raw(int sample_rate, const signed char orientation[9]){
+	if (mpu_init(NULL)) {
+		printf("\nmpu_init() failed\n");
+		return -1;
+	}
+	
+	mpu_set_sensors(INV_XYZ_GYRO | INV_XYZ_ACCEL | INV_XYZ_COMPASS);
+	// also enables the data ready interrupt since the DMP is off
+	if(mpu_configure_fifo(INV_XYZ_GYRO | INV_XYZ_ACCEL)){
+		printf("\nmpu_configure_fifo() failed\n");
+		return -1;
+	}
+	mpu_set_sample_rate(sample_rate);
+	
+	// compass run at 100hz max, and must divide the sample rate
+	if(sample_rate > 100){
+		mpu_set_compass_sample_rate(sample_rate/((sample_rate+99)/100));
+	}
+	else{
+		mpu_set_compass_sample_rate(sample_rate);
+	}
+	mpu_set_lpf(188); //as little filtering as possible
+	
+	// the DMP isn't there to rotate the data so do it on the host
+	mpu9150_set_orientation(orientation);
+	
+	// start from an empty fifo so the first read isn't a backlog
+	mpu_reset_fifo();
+	return 0;
+}
+
+/***********************************************************************
+*	int imu_init_raw(imu_t* imu, int sample_rate, signed char orientation[9])
+*	raw FIFO mode without the DMP, read it with imu_read_raw()
+************************************************************************/
+int imu_init_raw(imu_t* imu, int sample_rate, const signed char orientation[9]){
+	int ret;
+	if(sample_rate<MIN_SAMPLE_RATE || sample_rate>MAX_RAW_SAMPLE_RATE){
+		printf("raw sample rate should be between %d and %d\n",
+				MIN_SAMPLE_RATE, MAX_RAW_SAMPLE_RATE);
+		return -1;
+	}
+	imu_lock(imu);
+	ret = init_raw(sample_rate, orientation);
+	imu_unlock(imu);
+	return ret;
+}
+
+// newest DMP sample, calibrated and fused, 0 on success
+int imu_read(imu_t* imu, mpudata_t* out){
+	int ret;
+	imu_lock(imu);
+	ret = mpu9150_read(&imu->data);
+	if(ret == 0 && out != NULL){
+		memcpy(out, &imu->data, sizeof(mpudata_t));
+	}
+	imu_unlock(imu);
+	return ret;
+}
+
+// every raw sample waiting, see mpu9150_read_raw()
+int imu_read_raw(imu_t* imu, mpudata_t* samples, int max_samples){
+	int ret;
+	imu_lock(imu);
+	ret = mpu9150_read_raw(samples, max_samples);
+	if(ret > 0){
+		memcpy(&imu->data, &samples[ret-1], sizeof(mpudata_t));
+	}
+	imu_unlock(imu);
+	return ret;
+}
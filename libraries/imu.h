@@ -0,0 +1,76 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Several MPU9150s at once, for example the one on the cape plus an 
+external one on another bus or on address 0x69. Each imu_t carries its
+own i2c bus, InvenSense driver and DMP state, calibration and fusion
+state. Those drivers keep their state behind a "current chip" pointer
+per thread, imu_lock() takes the one driver lock and points the calling
+thread's at this imu, imu_unlock() puts back whatever was selected
+before. Other threads always see the cape imu outside of their own
+locks, so single imu programs calling the mpu9150_ functions directly
+keep working unchanged.
+The imu_ functions below lock for themselves. Only take the lock by hand
+to call the mpu_, dmp_ or mpu9150_ functions on an imu from imu_create().
+Strawson Design - 2014
+*/
+
+#ifndef IMU_H
+#define IMU_H
+
+#include "mpu9150.h"
+
+#define IMU_NAME_LEN	16
+
+typedef struct imu_t {
+	char name[IMU_NAME_LEN];
+	// all NULL for the cape imu, which uses the drivers' default state
+	linux_i2c_bus_t* bus;
+	void* mpu_state;
+	void* dmp_state;
+	mpu9150_state_t* state;
+	mpudata_t data;		// newest sample, carries the yaw fusion between reads
+} imu_t;
+
+imu_t* imu_default();
+imu_t* imu_create(const char* name, int i2c_bus, unsigned char addr);
+void imu_destroy(imu_t* imu);
+void imu_set_backend(imu_t* imu, const linux_i2c_backend_t* backend, 
+					void* arg);
+
+void imu_lock(imu_t* imu);
+void imu_unlock(imu_t* imu);
+
+int imu_init(imu_t* imu, int sample_rate, const signed char orientation[9]);
+int imu_init_raw(imu_t* imu, int sample_rate, const signed char orientation[9]);
+int imu_read(imu_t* imu, mpudata_t* out);
+int imu_read_raw(imu_t* imu, mpudata_t* samples, int max_samples);
+
+#endif // IMU_H
@@ -0,0 +1,235 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Ellipsoid fit for accel and mag calibration, see imu_cal.h
+Strawson Design - 2014
+*/
+
+#include <limits.h>
+#include "robotics_cape.h"
+
+void ellipsoid_fit_init(ellipsoid_fit_t* fit, float scale){
+	int i;
+	memset(fit, 0, sizeof(ellipsoid_fit_t));
+	fit->scale = scale;
+	for(i=0; i<3; i++){
+		fit->min[i] = SHRT_MAX;
+		fit->max[i] = SHRT_MIN;
+	}
+}
+
+void ellipsoid_fit_add(ellipsoid_fit_t* fit, const short v[3]){
+	double phi[ELLIPSOID_PARAMS];
+	double x, y, z;
+	int i, j;
+	
+	x = v[0] / fit->scale;
+	y = v[1] / fit->scale;
+	z = v[2] / fit->scale;
+	phi[0] = x*x;
+	phi[1] = y*y;
+	phi[2] = z*z;
+	phi[3] = x;
+	phi[4] = y;
+	phi[5] = z;
+	for(i=0; i<ELLIPSOID_PARAMS; i++){
+		for(j=i; j<ELLIPSOID_PARAMS; j++){
+			fit->ata[i][j] += phi[i]*phi[j];
+		}
+		fit->atb[i] += phi[i];
+	}
+	for(i=0; i<3; i++){
+		if(v[i] < fit->min[i]) fit->min[i] = v[i];
+		if(v[i] > fit->max[i]) fit->max[i] = v[i];
+	}
+	fit->n++;
+}
+
+// gaussian elimination with partial pivoting, a and b are overwritten
+static int solve_linear(double a[ELLIPSOID_PARAMS][ELLIPSOID_PARAMS],
+						double b[ELLIPSOID_PARAMS], double x[ELLIPSOID_PARAMS]){
+	int i, j, k, pivot;
+	double tmp, f;
+	
+	for(k=0; k<ELLIPSOID_PARAMS; k++){
+		pivot = k;
+		for(i=k+1; i<ELLIPSOID_PARAMS; i++){
+			if(fabs(a[i][k]) > fabs(a[pivot][k])) pivot = i;
+		}
+		if(fabs(a[pivot][k]) < 1e-12) return -1;
+		if(pivot != k){
+			for(j=0; j<ELLIPSOID_PARAMS; j++){
+				tmp = a[k][j];
+				a[k][j] = a[pivot][j];
+				a[pivot][j] = tmp;
+			}
+			tmp = b[k];
+			b[k] = b[pivot];
+			b[pivot] = tmp;
+		}
+		for(i=k+1; i<ELLIPSOID_PARAMS; i++){
+			f = a[i][k] / a[k][k];
+			for(j=k; j<ELLIPSOID_PARAMS; j++) a[i][j] -= f*a[k][j];
+			b[i] -= f*b[k];
+		}
+	}
+	for(i=ELLIPSOID_PARAMS-1; i>=0; i--){
+		tmp = b[i];
+		for(j=i+1; j<ELLIPSOID_PARAMS; j++) tmp -= a[i][j]*x[j];
+		x[i] = tmp / a[i][i];
+	}
+	return 0;
+}
+
+// solve for the center and semi-axes. error, if not NULL, gets the rms
+// radial error as a fraction of the range. Returns -1 when there are too
+// few samples, an axis wasn't turned through enough of its circle or the
+// samples don't describe an ellipsoid.
+int ellipsoid_fit_solve(const ellipsoid_fit_t* fit, caldata_t* cal, float* error){
+	double a[ELLIPSOID_PARAMS][ELLIPSOID_PARAMS];
+	double b[ELLIPSOID_PARAMS], p[ELLIPSOID_PARAMS];
+	double center[3], range[3], g, sse;
+	int i, j;
+	
+	if(fit->n < ELLIPSOID_MIN_SAMPLES){
+		printf("only %lu samples, need %d\n", fit->n, ELLIPSOID_MIN_SAMPLES);
+		return -1;
+	}
+	// fill in the lower triangle
+	for(i=0; i<ELLIPSOID_PARAMS; i++){
+		for(j=0; j<ELLIPSOID_PARAMS; j++){
+			a[i][j] = (j>=i) ? fit->ata[i][j] : fit->ata[j][i];
+		}
+		b[i] = fit->atb[i];
+	}
+	if(solve_linear(a, b, p)){
+		printf("ellipsoid fit is singular, turn through more orientations\n");
+		return -1;
+	}
+	
+	// complete the squares, A(x-x0)^2 + ... = 1 + A x0^2 + ...
+	g = 1;
+	for(i=0; i<3; i++){
+		if(p[i] <= 0){
+			printf("samples don't describe an ellipsoid\n");
+			return -1;
+		}
+		center[i] = -p[i+3] / (2*p[i]);
+		g += p[i]*center[i]*center[i];
+	}
+	for(i=0; i<3; i++){
+		range[i] = sqrt(g/p[i]);
+		center[i] *= fit->scale;
+		range[i] *= fit->scale;
+		if(fabs(center[i]) > SHRT_MAX || range[i] > SHRT_MAX || range[i] < 1){
+			printf("ellipsoid fit out of range\n");
+			return -1;
+		}
+		// seeing at least half of the diameter on every axis
+		if(fit->max[i] - fit->min[i] < range[i]){
+			printf("axis %d only covered %d of %d, turn through more orientations\n",
+					i, fit->max[i]-fit->min[i], (int)(2*range[i]));
+			return -1;
+		}
+		cal->offset[i] = (short)round(center[i]);
+		cal->range[i] = (short)round(range[i]);
+	}
+	
+	if(error != NULL){
+		// sum of squared residuals from the normal equations alone,
+		// p'(A'A)p - 2p'A'b + n. Near the surface the residual is twice
+		// the radial error over the radius, scaled by g.
+		sse = fit->n;
+		for(i=0; i<ELLIPSOID_PARAMS; i++){
+			sse -= 2*p[i]*fit->atb[i];
+			for(j=0; j<ELLIPSOID_PARAMS; j++){
+				sse += p[i]*p[j]*((j>=i) ? fit->ata[i][j] : fit->ata[j][i]);
+			}
+		}
+		if(sse < 0) sse = 0;
+		*error = sqrt(sse/fit->n) / (2*g);
+	}
+	return 0;
+}
+
+// IMU_CAL_FILE holds accel offsets, accel ranges, mag offsets, mag ranges,
+// three numbers per line
+int imu_cal_save(const caldata_t* accel, const caldata_t* mag){
+	char file_path[100];
+	FILE* cal;
+	
+	strcpy (file_path, CONFIG_DIRECTORY);
+	strcat (file_path, IMU_CAL_FILE);
+	cal = fopen(file_path, "w");
+	if (cal == 0) {
+		mkdir(CONFIG_DIRECTORY, 0777);
+		cal = fopen(file_path, "w");
+		if (cal == 0){
+			printf("could not open %s\n", file_path);
+			return -1;
+		}
+	}
+	fprintf(cal, "%d %d %d\n", accel->offset[0], accel->offset[1], accel->offset[2]);
+	fprintf(cal, "%d %d %d\n", accel->range[0], accel->range[1], accel->range[2]);
+	fprintf(cal, "%d %d %d\n", mag->offset[0], mag->offset[1], mag->offset[2]);
+	fprintf(cal, "%d %d %d\n", mag->range[0], mag->range[1], mag->range[2]);
+	fclose(cal);
+	return 0;
+}
+
+int imu_cal_load(caldata_t* accel, caldata_t* mag){
+	char file_path[100];
+	FILE* cal;
+	int v[12], i, read;
+	
+	strcpy (file_path, CONFIG_DIRECTORY);
+	strcat (file_path, IMU_CAL_FILE);
+	cal = fopen(file_path, "r");
+	if (cal == 0) {
+		// calibration file doesn't exist yet
+		return -1;
+	}
+	read = 0;
+	for(i=0; i<12; i++){
+		read += fscanf(cal, "%d", &v[i]);
+	}
+	fclose(cal);
+	if(read != 12){
+		printf("%s is incomplete\n", file_path);
+		return -1;
+	}
+	for(i=0; i<3; i++){
+		accel->offset[i] = v[i];
+		accel->range[i] = v[3+i];
+		mag->offset[i] = v[6+i];
+		mag->range[i] = v[9+i];
+	}
+	return 0;
+}
@@ -0,0 +1,68 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Accelerometer and magnetometer calibration by ellipsoid fit.
+Samples are streamed into ellipsoid_fit_add() which only accumulates the
+normal equations of the axis aligned ellipsoid
+	A x^2 + B y^2 + C z^2 + D x + E y + F z = 1
+so any number of samples takes the same small struct and no storage.
+ellipsoid_fit_solve() turns that into the center and semi-axes, which are
+the offset and range of caldata_t used by mpu9150_set_accel_cal() and
+mpu9150_set_mag_cal(). imu_cal_save() and imu_cal_load() keep both in
+IMU_CAL_FILE, initialize_imu() loads it. See the calibrate_imu example.
+Strawson Design - 2014
+*/
+
+#ifndef IMU_CAL_H
+#define IMU_CAL_H
+
+#include "mpu9150.h"
+
+#define ELLIPSOID_PARAMS	6
+#define ELLIPSOID_MIN_SAMPLES	100
+#define ELLIPSOID_MAX_ERROR	0.05	// rms radial error as a fraction of range
+
+typedef struct ellipsoid_fit_t {
+	float scale;		// rough radius in raw units, keeps the sums sane
+	unsigned long n;
+	double ata[ELLIPSOID_PARAMS][ELLIPSOID_PARAMS];	// upper triangle used
+	double atb[ELLIPSOID_PARAMS];
+	short min[3], max[3];	// coverage of each axis
+} ellipsoid_fit_t;
+
+void ellipsoid_fit_init(ellipsoid_fit_t* fit, float scale);
+void ellipsoid_fit_add(ellipsoid_fit_t* fit, const short v[3]);
+int ellipsoid_fit_solve(const ellipsoid_fit_t* fit, caldata_t* cal, float* error);
+
+// a range of 0 marks a sensor that isn't calibrated
+int imu_cal_save(const caldata_t* accel, const caldata_t* mag);
+int imu_cal_load(caldata_t* accel, caldata_t* mag);
+
+#endif // IMU_CAL_H
@@ -0,0 +1,136 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Pipelined IMU reads, see imu_pipeline.h
+Strawson Design - 2014
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "imu_pipeline.h"
+#include "robotics_cape.h"	// cape_monotonic_ns()
+
+#define WAIT_NS		100000000	// control thread checks for stop this often
+
+// one control function call, the edge is the sample's sampleTimeNs
+void imu_latency_add(imu_latency_t* l, uint64_t edge_ns, uint64_t start_ns,
+			uint64_t done_ns){
+	l->samples++;
+	cape_add_time(&l->start_ns_total, &l->start_ns_max, start_ns - edge_ns);
+	cape_add_time(&l->done_ns_total, &l->done_ns_max, done_ns - edge_ns);
+}
+
+void imu_latency_print(const char* name, const imu_latency_t* l){
+	float n = l->samples ? l->samples : 1;
+	printf("%-10s %7lu samples", name, l->samples);
+	if(l->read_ns_total){
+		printf("  read %7.1f/%7.1fus", l->read_ns_total/1000.0/n,
+				l->read_ns_max/1000.0);
+	}
+	printf("  start %7.1f/%7.1fus  done %7.1f/%7.1fus (mean/max)\n",
+			l->start_ns_total/1000.0/n, l->start_ns_max/1000.0,
+			l->done_ns_total/1000.0/n, l->done_ns_max/1000.0);
+	if(l->skipped || l->overlapped || l->read_fails){
+		printf("%-10s %7lu skipped, %lu reads overlapped the control function,"
+				" %lu failed\n", "", l->skipped, l->overlapped, l->read_fails);
+	}
+}
+
+int imu_pipeline_init(imu_pipeline_t* p, imu_ring_t* ring, mpudata_t* out){
+	memset(p, 0, sizeof(imu_pipeline_t));
+	p->ring = ring;
+	p->out = out;
+	p->running = 1;
+	if(sem_init(&p->ready, 0, 0)){
+		printf("imu_pipeline: sem_init failed\n");
+		return -1;
+	}
+	return 0;
+}
+
+void imu_pipeline_set_func(imu_pipeline_t* p, int (*func)(void)){
+	p->func = func;
+}
+
+// called by the io thread with a finished sample
+void imu_pipeline_push(imu_pipeline_t* p, const mpudata_t* sample){
+	cape_add_time(&p->stats.read_ns_total, &p->stats.read_ns_max,
+			cape_monotonic_ns() - sample->sampleTimeNs);
+	imu_ring_publish(p->ring, sample);
+	sem_post(&p->ready);
+}
+
+void imu_pipeline_read_failed(imu_pipeline_t* p){
+	p->stats.read_fails++;
+}
+
+// runs the control function once per sample, always on the newest one.
+// Posts that piled up while it was busy are soaked up without a call.
+void* imu_pipeline_thread(void* ptr){
+	imu_pipeline_t* p = ptr;
+	struct timespec deadline;
+	uint64_t start, done, edge, last_edge = 0;
+	uint32_t seq;
+	int (*func)(void);
+	
+	while(p->running){
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += WAIT_NS;
+		if(deadline.tv_nsec >= 1000000000){
+			deadline.tv_nsec -= 1000000000;
+			deadline.tv_sec++;
+		}
+		if(sem_timedwait(&p->ready, &deadline)) continue;
+		if(imu_ring_get_latest(p->ring, p->out, &seq)) continue;
+		if(p->have_last && seq == p->last_seq) continue;
+		if(p->have_last) p->stats.skipped += seq - p->last_seq - 1;
+		p->last_seq = seq;
+		p->have_last = 1;
+		
+		func = p->func;
+		if(func == NULL) continue;
+		edge = p->out->sampleTimeNs;
+		start = cape_monotonic_ns();
+		func();
+		done = cape_monotonic_ns();
+		imu_latency_add(&p->stats, edge, start, done);
+		// ran past the next edge, the io thread was reading meanwhile
+		if(last_edge && done - edge > edge - last_edge) p->stats.overlapped++;
+		last_edge = edge;
+	}
+	return NULL;
+}
+
+void imu_pipeline_stop(imu_pipeline_t* p){
+	p->running = 0;
+	sem_post(&p->ready);
+}
@@ -0,0 +1,92 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Pipelined IMU reads. The imu interrupt thread does only I/O, it drains
+the fifo, reads the compass and runs the fusion as soon as the edge
+arrives, then publishes the sample to an imu_ring_t and posts a
+semaphore. After initialize_imu_raw() it publishes every raw sample in
+the fifo instead, there is no fusion. A second thread waits on that,
+copies the newest sample out of the ring and runs the control function. The handoff is the lock-free
+ring. The semaphore only wakes the control thread.
+
+The control function no longer waits on the bus. Reading sample k+1
+overlaps computing sample k, since the i2c ioctl sleeps in the kernel
+even on the single core BeagleBone. The loop then only needs the larger
+of bus time and compute time to fit in a period, not their sum. Edge to
+actuation latency is still read plus compute. imu_latency_t keeps both
+numbers for the pipelined and the direct mode, so they can be compared.
+See set_imu_ready_func() in robotics_cape.c and benchmark_imu_pipeline.
+Strawson Design - 2014
+*/
+
+#ifndef IMU_PIPELINE_H
+#define IMU_PIPELINE_H
+
+#include <stdint.h>
+#include <semaphore.h>
+#include "mpu9150.h"
+#include "imu_ring.h"
+
+// all times from the interrupt edge, sampleTimeNs of the sample
+typedef struct imu_latency_t {
+	unsigned long samples;		// control function calls
+	unsigned long skipped;		// replaced in the ring before they were taken
+	unsigned long overlapped;	// call ran past the next edge and its read
+	unsigned long read_fails;
+	uint64_t read_ns_total, read_ns_max;	// sample ready, pipelined only
+	uint64_t start_ns_total, start_ns_max;	// control function starts
+	uint64_t done_ns_total, done_ns_max;	// control function returns
+} imu_latency_t;
+
+typedef struct imu_pipeline_t {
+	imu_ring_t* ring;
+	mpudata_t* out;				// filled before func runs, usually &mpu
+	int (*volatile func)(void);
+	sem_t ready;
+	volatile int running;
+	uint32_t last_seq;
+	int have_last;
+	imu_latency_t stats;		// read_* written by the io thread only
+} imu_pipeline_t;
+
+int imu_pipeline_init(imu_pipeline_t* p, imu_ring_t* ring, mpudata_t* out);
+void imu_pipeline_set_func(imu_pipeline_t* p, int (*func)(void));
+// io side, once per sample
+void imu_pipeline_push(imu_pipeline_t* p, const mpudata_t* sample);
+void imu_pipeline_read_failed(imu_pipeline_t* p);
+// control side, start with cape_thread_create(..., THREAD_IMU_CTRL)
+void* imu_pipeline_thread(void* ptr);
+void imu_pipeline_stop(imu_pipeline_t* p);
+
+void imu_latency_add(imu_latency_t* l, uint64_t edge_ns, uint64_t start_ns,
+			uint64_t done_ns);
+void imu_latency_print(const char* name, const imu_latency_t* l);
+
+#endif // IMU_PIPELINE_H
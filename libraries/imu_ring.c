@@ -0,0 +1,112 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <string.h>
+#include "imu_ring.h"
+
+void imu_ring_init(imu_ring_t* ring){
+	int i;
+	ring->head = 0;
+	for(i=0; i<IMU_RING_SIZE; i++){
+		ring->slots[i].seq = IMU_RING_BUSY;
+	}
+	__sync_synchronize();
+}
+
+void imu_ring_publish(imu_ring_t* ring, const mpudata_t* sample){
+	uint32_t n = ring->head;
+	imu_ring_slot_t* slot = &ring->slots[n & (IMU_RING_SIZE-1)];
+	
+	// readers still copying the old sample will see this and drop it
+	slot->seq = IMU_RING_BUSY;
+	__sync_synchronize();
+	memcpy(&slot->data, sample, sizeof(mpudata_t));
+	__sync_synchronize();
+	slot->seq = n;
+	ring->head = n+1;
+	__sync_synchronize();
+}
+
+uint32_t imu_ring_head(imu_ring_t* ring){
+	__sync_synchronize();
+	return ring->head;
+}
+
+// Copies sample number seq. Returns 0 on success, -1 if it hasn't been
+// published yet or was overwritten before or during the copy.
+int imu_ring_read(imu_ring_t* ring, uint32_t seq, mpudata_t* out){
+	imu_ring_slot_t* slot = &ring->slots[seq & (IMU_RING_SIZE-1)];
+	
+	__sync_synchronize();
+	if(slot->seq != seq) return -1;
+	__sync_synchronize();
+	memcpy(out, &slot->data, sizeof(mpudata_t));
+	__sync_synchronize();
+	if(slot->seq != seq) return -1;
+	return 0;
+}
+
+// Newest sample, seq may be NULL. Returns -1 if nothing was published.
+int imu_ring_get_latest(imu_ring_t* ring, mpudata_t* out, uint32_t* seq){
+	uint32_t head;
+	
+	// only fails if the producer laps us, in which case try the new head
+	do{
+		head = imu_ring_head(ring);
+		if(head == 0) return -1;
+	}while(imu_ring_read(ring, head-1, out));
+	
+	if(seq != NULL) *seq = head-1;
+	return 0;
+}
+
+// Copies up to max samples starting at *cursor and advances the cursor
+// past them. A cursor that has fallen more than the ring size behind is
+// moved up to the oldest sample still held, the number skipped is added
+// to *lost if that isn't NULL. Returns the number of samples copied.
+int imu_ring_read_since(imu_ring_t* ring, uint32_t* cursor, mpudata_t* out,
+						int max, uint32_t* lost){
+	uint32_t head;
+	int n = 0;
+	
+	while(n < max){
+		head = imu_ring_head(ring);
+		if(head - *cursor > IMU_RING_SIZE){
+			if(lost != NULL) *lost += head - IMU_RING_SIZE - *cursor;
+			*cursor = head - IMU_RING_SIZE;
+		}
+		if(*cursor == head) break;
+		if(imu_ring_read(ring, *cursor, &out[n]) == 0){
+			n++;
+			(*cursor)++;
+		}
+		// else lapped while copying, the check above skips ahead
+	}
+	return n;
+}
@@ -0,0 +1,78 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Single producer, multi consumer ring of IMU samples. One thread publishes
+the samples and any number of other threads can take the latest one or
+everything since their own cursor, without locks and without ever seeing
+a half written mpudata_t.
+The cape library fills imu_ring itself only in set_imu_ready_func() mode,
+where the imu interrupt thread publishes every sample it reads. With
+set_imu_interrupt_func() the callback does the reading, so it has to
+publish its samples itself for anything to reach the ring.
+Each slot carries the sequence number of the sample in it. The producer
+marks the slot busy, copies the sample and then stamps the sequence. A
+reader copies the slot and checks the stamp is the one it expected both
+before and after, otherwise the producer lapped it and the copy is
+thrown away. Only gcc's __sync_synchronize() full barrier is used so it
+builds with the older gcc on the BeagleBone.
+Sequence numbers are 32 bits, at 1khz they wrap after about 50 days.
+Strawson Design - 2014
+*/
+
+#ifndef IMU_RING_H
+#define IMU_RING_H
+
+#include <stdint.h>
+#include "mpu9150.h"
+
+#define IMU_RING_SIZE	64		// samples, must be a power of 2
+#define IMU_RING_BUSY	0xFFFFFFFF	// slot seq while being written
+
+typedef struct imu_ring_slot_t{
+	volatile uint32_t seq;
+	mpudata_t data;
+} imu_ring_slot_t;
+
+typedef struct imu_ring_t{
+	volatile uint32_t head;		// sequence number of the next sample
+	imu_ring_slot_t slots[IMU_RING_SIZE];
+} imu_ring_t;
+
+void imu_ring_init(imu_ring_t* ring);
+// producer only, one thread
+void imu_ring_publish(imu_ring_t* ring, const mpudata_t* sample);
+// any thread
+uint32_t imu_ring_head(imu_ring_t* ring);
+int imu_ring_read(imu_ring_t* ring, uint32_t seq, mpudata_t* out);
+int imu_ring_get_latest(imu_ring_t* ring, mpudata_t* out, uint32_t* seq);
+int imu_ring_read_since(imu_ring_t* ring, uint32_t* cursor, mpudata_t* out, 
+						int max, uint32_t* lost);
+
+#endif // IMU_RING_H
@@ -149,6 +149,8 @@ static inline int reg_int_cb(struct int_param_s *int_param)
 #endif
 
 static int set_int_enable(unsigned char enable);
+static int read_fifo_burst(unsigned short length, unsigned short max,
+    unsigned char *data, unsigned short *count, unsigned short *more);
 
 /* Hardware registers needed by driver. */
 struct gyro_reg_s {
@@ -265,6 +267,8 @@ struct chip_cfg_s {
     unsigned char dmp_on;
     /* Ensures that DMP will only be loaded once. */
     unsigned char dmp_loaded;
+    /* 1 if the image was already in DMP memory and the upload skipped. */
+    unsigned char dmp_reused;
     /* Sampling rate used when DMP is enabled. */
     unsigned short dmp_sample_rate;
 #ifdef AK89xx_SECONDARY
@@ -299,6 +303,8 @@ struct gyro_state_s {
     const struct hw_s *hw;
     struct chip_cfg_s chip_cfg;
     const struct test_s *test;
+    /* I2C address, hw->addr unless the AD0 pin is pulled high. */
+    unsigned char addr;
 };
 
 /* Filter configurations. */
@@ -513,10 +519,11 @@ const struct test_s test = {
     .max_accel_var  = 0.14f
 };
 
-static struct gyro_state_s st = {
+static struct gyro_state_s default_st = {
     .reg = &reg,
     .hw = &hw,
-    .test = &test
+    .test = &test,
+    .addr = 0x68
 };
 #elif defined MPU6500
 const struct gyro_reg_s reg = {
@@ -593,13 +600,20 @@ const struct test_s test = {
     .max_accel_var  = 0.14f
 };
 
-static struct gyro_state_s st = {
+static struct gyro_state_s default_st = {
     .reg = &reg,
     .hw = &hw,
-    .test = &test
+    .test = &test,
+    .addr = 0x68
 };
 #endif
 
+/* Every function works on the state the calling thread selected with
+ * mpu_select_state(), the static one above unless several chips are in use.
+ */
+static __thread struct gyro_state_s *cur_st = &default_st;
+#define st (*cur_st)
+
 #define MAX_PACKET_LENGTH (12)
 
 #ifdef AK89xx_SECONDARY
@@ -623,7 +637,7 @@ static int set_int_enable(unsigned char enable)
             tmp = BIT_DMP_INT_EN;
         else
             tmp = 0x00;
-        if (i2c_write(st.hw->addr, st.reg->int_enable, 1, &tmp))
+        if (i2c_write(st.addr, st.reg->int_enable, 1, &tmp))
             return -1;
         st.chip_cfg.int_enable = tmp;
     } else {
@@ -635,7 +649,7 @@ static int set_int_enable(unsigned char enable)
             tmp = BIT_DATA_RDY_EN;
         else
             tmp = 0x00;
-        if (i2c_write(st.hw->addr, st.reg->int_enable, 1, &tmp))
+        if (i2c_write(st.addr, st.reg->int_enable, 1, &tmp))
             return -1;
         st.chip_cfg.int_enable = tmp;
     }
@@ -654,7 +668,7 @@ int mpu_reg_dump(void)
     for (ii = 0; ii < st.hw->num_reg; ii++) {
         if (ii == st.reg->fifo_r_w || ii == st.reg->mem_r_w)
             continue;
-        if (i2c_read(st.hw->addr, ii, 1, &data))
+        if (i2c_read(st.addr, ii, 1, &data))
             return -1;
         log_i("%#5x: %#5x\r\n", ii, data);
     }
@@ -674,7 +688,7 @@ int mpu_read_reg(unsigned char reg, unsigned char *data)
         return -1;
     if (reg >= st.hw->num_reg)
         return -1;
-    return i2c_read(st.hw->addr, reg, 1, data);
+    return i2c_read(st.addr, reg, 1, data);
 }
 
 /**
@@ -696,18 +710,18 @@ int mpu_init(struct int_param_s *int_param)
 
     /* Reset device. */
     data[0] = BIT_RESET;
-    if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 1, data))
+    if (i2c_write(st.addr, st.reg->pwr_mgmt_1, 1, data))
         return -1;
     delay_ms(100);
 
     /* Wake up chip. */
     data[0] = 0x00;
-    if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 1, data))
+    if (i2c_write(st.addr, st.reg->pwr_mgmt_1, 1, data))
         return -1;
 
 #if defined MPU6050
     /* Check product revision. */
-    if (i2c_read(st.hw->addr, st.reg->accel_offs, 6, data))
+    if (i2c_read(st.addr, st.reg->accel_offs, 6, data))
         return -1;
     rev = ((data[5] & 0x01) << 2) | ((data[3] & 0x01) << 1) |
         (data[1] & 0x01);
@@ -723,7 +737,7 @@ int mpu_init(struct int_param_s *int_param)
             return -1;
         }
     } else {
-        if (i2c_read(st.hw->addr, st.reg->prod_id, 1, data))
+        if (i2c_read(st.addr, st.reg->prod_id, 1, data))
             return -1;
         rev = data[0] & 0x0F;
         if (!rev) {
@@ -751,7 +765,7 @@ int mpu_init(struct int_param_s *int_param)
      * first 3kB are needed by the DMP, we'll use the last 1kB for the FIFO.
      */
     data[0] = BIT_FIFO_SIZE_1024 | 0x8;
-    if (i2c_write(st.hw->addr, st.reg->accel_cfg2, 1, data))
+    if (i2c_write(st.addr, st.reg->accel_cfg2, 1, data))
         return -1;
 #endif
 
@@ -776,6 +790,7 @@ int mpu_init(struct int_param_s *int_param)
     memset(&st.chip_cfg.cache, 0, sizeof(st.chip_cfg.cache));
     st.chip_cfg.dmp_on = 0;
     st.chip_cfg.dmp_loaded = 0;
+    st.chip_cfg.dmp_reused = 0;
     st.chip_cfg.dmp_sample_rate = 0;
 
     if (mpu_set_gyro_fsr(2000))
@@ -832,7 +847,7 @@ int mpu_lp_accel_mode(unsigned char rate)
         mpu_set_int_latched(0);
         tmp[0] = 0;
         tmp[1] = BIT_STBY_XYZG;
-        if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 2, tmp))
+        if (i2c_write(st.addr, st.reg->pwr_mgmt_1, 2, tmp))
             return -1;
         st.chip_cfg.lp_accel_mode = 0;
         return 0;
@@ -861,7 +876,7 @@ int mpu_lp_accel_mode(unsigned char rate)
         mpu_set_lpf(20);
     }
     tmp[1] = (tmp[1] << 6) | BIT_STBY_XYZG;
-    if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 2, tmp))
+    if (i2c_write(st.addr, st.reg->pwr_mgmt_1, 2, tmp))
         return -1;
 #elif defined MPU6500
     /* Set wake frequency. */
@@ -885,10 +900,10 @@ int mpu_lp_accel_mode(unsigned char rate)
         tmp[0] = INV_LPA_320HZ;
     else
         tmp[0] = INV_LPA_640HZ;
-    if (i2c_write(st.hw->addr, st.reg->lp_accel_odr, 1, tmp))
+    if (i2c_write(st.addr, st.reg->lp_accel_odr, 1, tmp))
         return -1;
     tmp[0] = BIT_LPA_CYCLE;
-    if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 1, tmp))
+    if (i2c_write(st.addr, st.reg->pwr_mgmt_1, 1, tmp))
         return -1;
 #endif
     st.chip_cfg.sensors = INV_XYZ_ACCEL;
@@ -912,7 +927,7 @@ int mpu_get_gyro_reg(short *data, unsigned long *timestamp)
     if (!(st.chip_cfg.sensors & INV_XYZ_GYRO))
         return -1;
 
-    if (i2c_read(st.hw->addr, st.reg->raw_gyro, 6, tmp))
+    if (i2c_read(st.addr, st.reg->raw_gyro, 6, tmp))
         return -1;
     data[0] = (tmp[0] << 8) | tmp[1];
     data[1] = (tmp[2] << 8) | tmp[3];
@@ -935,7 +950,7 @@ int mpu_get_accel_reg(short *data, unsigned long *timestamp)
     if (!(st.chip_cfg.sensors & INV_XYZ_ACCEL))
         return -1;
 
-    if (i2c_read(st.hw->addr, st.reg->raw_accel, 6, tmp))
+    if (i2c_read(st.addr, st.reg->raw_accel, 6, tmp))
         return -1;
     data[0] = (tmp[0] << 8) | tmp[1];
     data[1] = (tmp[2] << 8) | tmp[3];
@@ -959,7 +974,7 @@ int mpu_get_temperature(long *data, unsigned long *timestamp)
     if (!(st.chip_cfg.sensors))
         return -1;
 
-    if (i2c_read(st.hw->addr, st.reg->temp, 2, tmp))
+    if (i2c_read(st.addr, st.reg->temp, 2, tmp))
         return -1;
     raw = (tmp[0] << 8) | tmp[1];
     if (timestamp)
@@ -988,7 +1003,7 @@ int mpu_set_accel_bias(const long *accel_bias)
     if (!accel_bias[0] && !accel_bias[1] && !accel_bias[2])
         return 0;
 
-    if (i2c_read(st.hw->addr, 3, 3, data))
+    if (i2c_read(st.addr, 3, 3, data))
         return -1;
     fg[0] = ((data[0] >> 4) + 8) & 0xf;
     fg[1] = ((data[1] >> 4) + 8) & 0xf;
@@ -998,7 +1013,7 @@ int mpu_set_accel_bias(const long *accel_bias)
     accel_hw[1] = (short)(accel_bias[1] * 2 / (64 + fg[1]));
     accel_hw[2] = (short)(accel_bias[2] * 2 / (64 + fg[2]));
 
-    if (i2c_read(st.hw->addr, 0x06, 6, data))
+    if (i2c_read(st.addr, 0x06, 6, data))
         return -1;
 
     got_accel[0] = ((short)data[0] << 8) | data[1];
@@ -1016,7 +1031,7 @@ int mpu_set_accel_bias(const long *accel_bias)
     data[4] = (accel_hw[2] >> 8) & 0xff;
     data[5] = (accel_hw[2]) & 0xff;
 
-    if (i2c_write(st.hw->addr, 0x06, 6, data))
+    if (i2c_write(st.addr, 0x06, 6, data))
         return -1;
     return 0;
 }
@@ -1033,50 +1048,50 @@ int mpu_reset_fifo(void)
         return -1;
 
     data = 0;
-    if (i2c_write(st.hw->addr, st.reg->int_enable, 1, &data))
+    if (i2c_write(st.addr, st.reg->int_enable, 1, &data))
         return -1;
-    if (i2c_write(st.hw->addr, st.reg->fifo_en, 1, &data))
+    if (i2c_write(st.addr, st.reg->fifo_en, 1, &data))
         return -1;
-    if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, &data))
+    if (i2c_write(st.addr, st.reg->user_ctrl, 1, &data))
         return -1;
 
     if (st.chip_cfg.dmp_on) {
         data = BIT_FIFO_RST | BIT_DMP_RST;
-        if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, &data))
+        if (i2c_write(st.addr, st.reg->user_ctrl, 1, &data))
             return -1;
         delay_ms(50);
         data = BIT_DMP_EN | BIT_FIFO_EN;
         if (st.chip_cfg.sensors & INV_XYZ_COMPASS)
             data |= BIT_AUX_IF_EN;
-        if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, &data))
+        if (i2c_write(st.addr, st.reg->user_ctrl, 1, &data))
             return -1;
         if (st.chip_cfg.int_enable)
             data = BIT_DMP_INT_EN;
         else
             data = 0;
-        if (i2c_write(st.hw->addr, st.reg->int_enable, 1, &data))
+        if (i2c_write(st.addr, st.reg->int_enable, 1, &data))
             return -1;
         data = 0;
-        if (i2c_write(st.hw->addr, st.reg->fifo_en, 1, &data))
+        if (i2c_write(st.addr, st.reg->fifo_en, 1, &data))
             return -1;
     } else {
         data = BIT_FIFO_RST;
-        if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, &data))
+        if (i2c_write(st.addr, st.reg->user_ctrl, 1, &data))
             return -1;
         if (st.chip_cfg.bypass_mode || !(st.chip_cfg.sensors & INV_XYZ_COMPASS))
             data = BIT_FIFO_EN;
         else
             data = BIT_FIFO_EN | BIT_AUX_IF_EN;
-        if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, &data))
+        if (i2c_write(st.addr, st.reg->user_ctrl, 1, &data))
             return -1;
         delay_ms(50);
         if (st.chip_cfg.int_enable)
             data = BIT_DATA_RDY_EN;
         else
             data = 0;
-        if (i2c_write(st.hw->addr, st.reg->int_enable, 1, &data))
+        if (i2c_write(st.addr, st.reg->int_enable, 1, &data))
             return -1;
-        if (i2c_write(st.hw->addr, st.reg->fifo_en, 1, &st.chip_cfg.fifo_enable))
+        if (i2c_write(st.addr, st.reg->fifo_en, 1, &st.chip_cfg.fifo_enable))
             return -1;
     }
     return 0;
@@ -1140,7 +1155,7 @@ int mpu_set_gyro_fsr(unsigned short fsr)
 
     if (st.chip_cfg.gyro_fsr == (data >> 3))
         return 0;
-    if (i2c_write(st.hw->addr, st.reg->gyro_cfg, 1, &data))
+    if (i2c_write(st.addr, st.reg->gyro_cfg, 1, &data))
         return -1;
     st.chip_cfg.gyro_fsr = data >> 3;
     return 0;
@@ -1205,7 +1220,7 @@ int mpu_set_accel_fsr(unsigned char fsr)
 
     if (st.chip_cfg.accel_fsr == (data >> 3))
         return 0;
-    if (i2c_write(st.hw->addr, st.reg->accel_cfg, 1, &data))
+    if (i2c_write(st.addr, st.reg->accel_cfg, 1, &data))
         return -1;
     st.chip_cfg.accel_fsr = data >> 3;
     return 0;
@@ -1274,7 +1289,7 @@ int mpu_set_lpf(unsigned short lpf)
 
     if (st.chip_cfg.lpf == data)
         return 0;
-    if (i2c_write(st.hw->addr, st.reg->lpf, 1, &data))
+    if (i2c_write(st.addr, st.reg->lpf, 1, &data))
         return -1;
     st.chip_cfg.lpf = data;
     return 0;
@@ -1327,7 +1342,7 @@ int mpu_set_sample_rate(unsigned short rate)
             rate = 1000;
 
         data = 1000 / rate - 1;
-        if (i2c_write(st.hw->addr, st.reg->rate_div, 1, &data))
+        if (i2c_write(st.addr, st.reg->rate_div, 1, &data))
             return -1;
 
         st.chip_cfg.sample_rate = 1000 / (1 + data);
@@ -1377,7 +1392,7 @@ int mpu_set_compass_sample_rate(unsigned short rate)
         return -1;
 
     div = st.chip_cfg.sample_rate / rate - 1;
-    if (i2c_write(st.hw->addr, st.reg->s4_ctrl, 1, &div))
+    if (i2c_write(st.addr, st.reg->s4_ctrl, 1, &div))
         return -1;
     st.chip_cfg.compass_sample_rate = st.chip_cfg.sample_rate / (div + 1);
     return 0;
@@ -1538,7 +1553,7 @@ int mpu_set_sensors(unsigned char sensors)
         data = 0;
     else
         data = BIT_SLEEP;
-    if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 1, &data)) {
+    if (i2c_write(st.addr, st.reg->pwr_mgmt_1, 1, &data)) {
         st.chip_cfg.sensors = 0;
         return -1;
     }
@@ -1553,7 +1568,7 @@ int mpu_set_sensors(unsigned char sensors)
         data |= BIT_STBY_ZG;
     if (!(sensors & INV_XYZ_ACCEL))
         data |= BIT_STBY_XYZA;
-    if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_2, 1, &data)) {
+    if (i2c_write(st.addr, st.reg->pwr_mgmt_2, 1, &data)) {
         st.chip_cfg.sensors = 0;
         return -1;
     }
@@ -1569,7 +1584,7 @@ int mpu_set_sensors(unsigned char sensors)
     else
         mpu_set_bypass(0);
 #else
-    if (i2c_read(st.hw->addr, st.reg->user_ctrl, 1, &user_ctrl))
+    if (i2c_read(st.addr, st.reg->user_ctrl, 1, &user_ctrl))
         return -1;
     /* Handle AKM power management. */
     if (sensors & INV_XYZ_COMPASS) {
@@ -1583,10 +1598,10 @@ int mpu_set_sensors(unsigned char sensors)
         user_ctrl |= BIT_DMP_EN;
     else
         user_ctrl &= ~BIT_DMP_EN;
-    if (i2c_write(st.hw->addr, st.reg->s1_do, 1, &data))
+    if (i2c_write(st.addr, st.reg->s1_do, 1, &data))
         return -1;
     /* Enable/disable I2C master mode. */
-    if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, &user_ctrl))
+    if (i2c_write(st.addr, st.reg->user_ctrl, 1, &user_ctrl))
         return -1;
 #endif
 #endif
@@ -1607,7 +1622,7 @@ int mpu_get_int_status(short *status)
     unsigned char tmp[2];
     if (!st.chip_cfg.sensors)
         return -1;
-    if (i2c_read(st.hw->addr, st.reg->dmp_int_status, 2, tmp))
+    if (i2c_read(st.addr, st.reg->dmp_int_status, 2, tmp))
         return -1;
     status[0] = (tmp[0] << 8) | tmp[1];
     return 0;
@@ -1657,7 +1672,7 @@ int mpu_read_fifo(short *gyro, short *accel, unsigned long *timestamp,
     if (st.chip_cfg.fifo_enable & INV_XYZ_ACCEL)
         packet_size += 6;
 
-    if (i2c_read(st.hw->addr, st.reg->fifo_count_h, 2, data))
+    if (i2c_read(st.addr, st.reg->fifo_count_h, 2, data))
         return -1;
     fifo_count = (data[0] << 8) | data[1];
     if (fifo_count < packet_size)
@@ -1665,7 +1680,7 @@ int mpu_read_fifo(short *gyro, short *accel, unsigned long *timestamp,
 //    log_i("FIFO count: %hd\n", fifo_count);
     if (fifo_count > (st.hw->max_fifo >> 1)) {
         /* FIFO is 50% full, better check overflow bit. */
-        if (i2c_read(st.hw->addr, st.reg->int_status, 1, data))
+        if (i2c_read(st.addr, st.reg->int_status, 1, data))
             return -1;
         if (data[0] & BIT_FIFO_OVERFLOW) {
             mpu_reset_fifo();
@@ -1674,7 +1689,7 @@ int mpu_read_fifo(short *gyro, short *accel, unsigned long *timestamp,
     }
     get_ms((unsigned long*)timestamp);
 
-    if (i2c_read(st.hw->addr, st.reg->fifo_r_w, packet_size, data))
+    if (i2c_read(st.addr, st.reg->fifo_r_w, packet_size, data))
         return -1;
     more[0] = fifo_count / packet_size - 1;
     sensors[0] = 0;
@@ -1705,6 +1720,87 @@ int mpu_read_fifo(short *gyro, short *accel, unsigned long *timestamp,
     return 0;
 }
 
+/**
+ *  @brief      Get every waiting packet from the FIFO in one burst.
+ *  Same as mpu_read_fifo but the FIFO count is read once and up to @e max
+ *  packets are read back to back. Used when streaming raw gyro/accel data
+ *  at up to 1kHz with the DMP off. Arrays are indexed by packet, oldest
+ *  first. The read time is stamped on the newest packet and the older
+ *  ones are stepped back by the sample rate.
+ *  @param[in]  max         Size of the output arrays.
+ *  @param[out] gyro        Gyro data in hardware units.
+ *  @param[out] accel       Accel data in hardware units.
+ *  @param[out] timestamp   Timestamp in milliseconds.
+ *  @param[out] sensors     Mask of sensors read from FIFO.
+ *  @param[out] count       Number of packets read, zero if FIFO is empty.
+ *  @param[out] more        Number of packets still in the FIFO.
+ *  @return     0 if successful.
+ */
+int mpu_read_fifo_multi(unsigned short max, short (*gyro)[3],
+    short (*accel)[3], unsigned long *timestamp, unsigned char *sensors,
+    unsigned short *count, unsigned short *more)
+{
+    unsigned char data[MPU_MAX_BATCH * MAX_PACKET_LENGTH];
+    unsigned char packet_size = 0;
+    unsigned short ii, index;
+    unsigned long now, period;
+
+    count[0] = 0;
+    more[0] = 0;
+    sensors[0] = 0;
+    if (st.chip_cfg.dmp_on)
+        return -1;
+    if (!st.chip_cfg.sensors)
+        return -1;
+    if (!st.chip_cfg.fifo_enable)
+        return -1;
+
+    if (st.chip_cfg.fifo_enable & INV_X_GYRO)
+        packet_size += 2;
+    if (st.chip_cfg.fifo_enable & INV_Y_GYRO)
+        packet_size += 2;
+    if (st.chip_cfg.fifo_enable & INV_Z_GYRO)
+        packet_size += 2;
+    if (st.chip_cfg.fifo_enable & INV_XYZ_ACCEL)
+        packet_size += 6;
+
+    if (max > MPU_MAX_BATCH)
+        max = MPU_MAX_BATCH;
+    if (read_fifo_burst(packet_size, max, data, count, more))
+        return -1;
+
+    get_ms(&now);
+    period = st.chip_cfg.sample_rate ? 1000 / st.chip_cfg.sample_rate : 0;
+    if (st.chip_cfg.fifo_enable & INV_XYZ_ACCEL)
+        sensors[0] |= INV_XYZ_ACCEL;
+    sensors[0] |= st.chip_cfg.fifo_enable & INV_XYZ_GYRO;
+
+    for (ii = 0; ii < count[0]; ii++) {
+        unsigned char *packet = data + ii * packet_size;
+        index = 0;
+        if (st.chip_cfg.fifo_enable & INV_XYZ_ACCEL) {
+            accel[ii][0] = (packet[index+0] << 8) | packet[index+1];
+            accel[ii][1] = (packet[index+2] << 8) | packet[index+3];
+            accel[ii][2] = (packet[index+4] << 8) | packet[index+5];
+            index += 6;
+        }
+        if (st.chip_cfg.fifo_enable & INV_X_GYRO) {
+            gyro[ii][0] = (packet[index+0] << 8) | packet[index+1];
+            index += 2;
+        }
+        if (st.chip_cfg.fifo_enable & INV_Y_GYRO) {
+            gyro[ii][1] = (packet[index+0] << 8) | packet[index+1];
+            index += 2;
+        }
+        if (st.chip_cfg.fifo_enable & INV_Z_GYRO) {
+            gyro[ii][2] = (packet[index+0] << 8) | packet[index+1];
+            index += 2;
+        }
+        timestamp[ii] = now - (count[0] - 1 - ii) * period;
+    }
+    return 0;
+}
+
 /**
  *  @brief      Get one unparsed packet from the FIFO.
  *  This function should be used if the packet is to be parsed elsewhere.
@@ -1722,7 +1818,7 @@ int mpu_read_fifo_stream(unsigned short length, unsigned char *data,
     if (!st.chip_cfg.sensors)
         return -1;
 
-    if (i2c_read(st.hw->addr, st.reg->fifo_count_h, 2, tmp))
+    if (i2c_read(st.addr, st.reg->fifo_count_h, 2, tmp))
         return -1;
     fifo_count = (tmp[0] << 8) | tmp[1];
     if (fifo_count < length) {
@@ -1731,7 +1827,7 @@ int mpu_read_fifo_stream(unsigned short length, unsigned char *data,
     }
     if (fifo_count > (st.hw->max_fifo >> 1)) {
         /* FIFO is 50% full, better check overflow bit. */
-        if (i2c_read(st.hw->addr, st.reg->int_status, 1, tmp))
+        if (i2c_read(st.addr, st.reg->int_status, 1, tmp))
             return -1;
         if (tmp[0] & BIT_FIFO_OVERFLOW) {
             mpu_reset_fifo();
@@ -1739,12 +1835,77 @@ int mpu_read_fifo_stream(unsigned short length, unsigned char *data,
         }
     }
 
-    if (i2c_read(st.hw->addr, st.reg->fifo_r_w, length, data))
+    if (i2c_read(st.addr, st.reg->fifo_r_w, length, data))
         return -1;
     more[0] = fifo_count / length - 1;
     return 0;
 }
 
+/**
+ *  @brief      Get several unparsed packets from the FIFO at once.
+ *  The FIFO count is read a single time and as many whole packets as fit in
+ *  @e data are read back to back. i2c_read takes an 8-bit length, so the
+ *  burst is split into the fewest reads that each hold whole packets.
+ *  @param[in]  length  Length of one FIFO packet.
+ *  @param[in]  max     Maximum number of packets to read.
+ *  @param[out] data    FIFO packets, oldest first.
+ *  @param[out] count   Number of packets read.
+ *  @param[out] more    Number of packets still in the FIFO.
+ *  @return     0 if successful. An empty FIFO is not an error, @e count is
+ *  zero in that case.
+ */
+int mpu_read_fifo_stream_multi(unsigned short length, unsigned short max,
+    unsigned char *data, unsigned short *count, unsigned short *more)
+{
+    count[0] = 0;
+    more[0] = 0;
+    if (!st.chip_cfg.dmp_on)
+        return -1;
+    if (!st.chip_cfg.sensors)
+        return -1;
+    return read_fifo_burst(length, max, data, count, more);
+}
+
+/* FIFO count read and burst read shared by the DMP and raw FIFO paths. */
+static int read_fifo_burst(unsigned short length, unsigned short max,
+    unsigned char *data, unsigned short *count, unsigned short *more)
+{
+    unsigned char tmp[2];
+    unsigned short fifo_count, packets, chunk, done;
+    if (!length || length > 255)
+        return -1;
+
+    if (i2c_read(st.addr, st.reg->fifo_count_h, 2, tmp))
+        return -1;
+    fifo_count = (tmp[0] << 8) | tmp[1];
+    if (fifo_count < length)
+        return 0;
+    if (fifo_count > (st.hw->max_fifo >> 1)) {
+        /* FIFO is 50% full, better check overflow bit. */
+        if (i2c_read(st.addr, st.reg->int_status, 1, tmp))
+            return -1;
+        if (tmp[0] & BIT_FIFO_OVERFLOW) {
+            mpu_reset_fifo();
+            return -2;
+        }
+    }
+
+    packets = fifo_count / length;
+    if (packets > max)
+        packets = max;
+    chunk = 255 / length;
+    for (done = 0; done < packets; done += chunk) {
+        if (chunk > packets - done)
+            chunk = packets - done;
+        if (i2c_read(st.addr, st.reg->fifo_r_w, chunk * length,
+            data + done * length))
+            return -1;
+    }
+    count[0] = packets;
+    more[0] = fifo_count / length - packets;
+    return 0;
+}
+
 /**
  *  @brief      Set device to bypass mode.
  *  @param[in]  bypass_on   1 to enable bypass mode.
@@ -1758,10 +1919,10 @@ int mpu_set_bypass(unsigned char bypass_on)
         return 0;
 
     if (bypass_on) {
-        if (i2c_read(st.hw->addr, st.reg->user_ctrl, 1, &tmp))
+        if (i2c_read(st.addr, st.reg->user_ctrl, 1, &tmp))
             return -1;
         tmp &= ~BIT_AUX_IF_EN;
-        if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, &tmp))
+        if (i2c_write(st.addr, st.reg->user_ctrl, 1, &tmp))
             return -1;
         delay_ms(3);
         tmp = BIT_BYPASS_EN;
@@ -1769,17 +1930,17 @@ int mpu_set_bypass(unsigned char bypass_on)
             tmp |= BIT_ACTL;
         if (st.chip_cfg.latched_int)
             tmp |= BIT_LATCH_EN | BIT_ANY_RD_CLR;
-        if (i2c_write(st.hw->addr, st.reg->int_pin_cfg, 1, &tmp))
+        if (i2c_write(st.addr, st.reg->int_pin_cfg, 1, &tmp))
             return -1;
     } else {
         /* Enable I2C master mode if compass is being used. */
-        if (i2c_read(st.hw->addr, st.reg->user_ctrl, 1, &tmp))
+        if (i2c_read(st.addr, st.reg->user_ctrl, 1, &tmp))
             return -1;
         if (st.chip_cfg.sensors & INV_XYZ_COMPASS)
             tmp |= BIT_AUX_IF_EN;
         else
             tmp &= ~BIT_AUX_IF_EN;
-        if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, &tmp))
+        if (i2c_write(st.addr, st.reg->user_ctrl, 1, &tmp))
             return -1;
         delay_ms(3);
         if (st.chip_cfg.active_low_int)
@@ -1788,7 +1949,7 @@ int mpu_set_bypass(unsigned char bypass_on)
             tmp = 0;
         if (st.chip_cfg.latched_int)
             tmp |= BIT_LATCH_EN | BIT_ANY_RD_CLR;
-        if (i2c_write(st.hw->addr, st.reg->int_pin_cfg, 1, &tmp))
+        if (i2c_write(st.addr, st.reg->int_pin_cfg, 1, &tmp))
             return -1;
     }
     st.chip_cfg.bypass_mode = bypass_on;
@@ -1826,7 +1987,7 @@ int mpu_set_int_latched(unsigned char enable)
         tmp |= BIT_BYPASS_EN;
     if (st.chip_cfg.active_low_int)
         tmp |= BIT_ACTL;
-    if (i2c_write(st.hw->addr, st.reg->int_pin_cfg, 1, &tmp))
+    if (i2c_write(st.addr, st.reg->int_pin_cfg, 1, &tmp))
         return -1;
     st.chip_cfg.latched_int = enable;
     return 0;
@@ -1837,7 +1998,7 @@ static int get_accel_prod_shift(float *st_shift)
 {
     unsigned char tmp[4], shift_code[3], ii;
 
-    if (i2c_read(st.hw->addr, 0x0D, 4, tmp))
+    if (i2c_read(st.addr, 0x0D, 4, tmp))
         return 0x07;
 
     shift_code[0] = ((tmp[0] & 0xE0) >> 3) | ((tmp[3] & 0x30) >> 4);
@@ -1884,7 +2045,7 @@ static int gyro_self_test(long *bias_regular, long *bias_st)
     unsigned char tmp[3];
     float st_shift, st_shift_cust, st_shift_var;
 
-    if (i2c_read(st.hw->addr, 0x0D, 3, tmp))
+    if (i2c_read(st.addr, 0x0D, 3, tmp))
         return 0x07;
 
     tmp[0] &= 0x1F;
@@ -1970,60 +2131,60 @@ static int get_st_biases(long *gyro, long *accel, unsigned char hw_test)
 
     data[0] = 0x01;
     data[1] = 0;
-    if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 2, data))
+    if (i2c_write(st.addr, st.reg->pwr_mgmt_1, 2, data))
         return -1;
     delay_ms(200);
     data[0] = 0;
-    if (i2c_write(st.hw->addr, st.reg->int_enable, 1, data))
+    if (i2c_write(st.addr, st.reg->int_enable, 1, data))
         return -1;
-    if (i2c_write(st.hw->addr, st.reg->fifo_en, 1, data))
+    if (i2c_write(st.addr, st.reg->fifo_en, 1, data))
         return -1;
-    if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 1, data))
+    if (i2c_write(st.addr, st.reg->pwr_mgmt_1, 1, data))
         return -1;
-    if (i2c_write(st.hw->addr, st.reg->i2c_mst, 1, data))
+    if (i2c_write(st.addr, st.reg->i2c_mst, 1, data))
         return -1;
-    if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, data))
+    if (i2c_write(st.addr, st.reg->user_ctrl, 1, data))
         return -1;
     data[0] = BIT_FIFO_RST | BIT_DMP_RST;
-    if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, data))
+    if (i2c_write(st.addr, st.reg->user_ctrl, 1, data))
         return -1;
     delay_ms(15);
     data[0] = st.test->reg_lpf;
-    if (i2c_write(st.hw->addr, st.reg->lpf, 1, data))
+    if (i2c_write(st.addr, st.reg->lpf, 1, data))
         return -1;
     data[0] = st.test->reg_rate_div;
-    if (i2c_write(st.hw->addr, st.reg->rate_div, 1, data))
+    if (i2c_write(st.addr, st.reg->rate_div, 1, data))
         return -1;
     if (hw_test)
         data[0] = st.test->reg_gyro_fsr | 0xE0;
     else
         data[0] = st.test->reg_gyro_fsr;
-    if (i2c_write(st.hw->addr, st.reg->gyro_cfg, 1, data))
+    if (i2c_write(st.addr, st.reg->gyro_cfg, 1, data))
         return -1;
 
     if (hw_test)
         data[0] = st.test->reg_accel_fsr | 0xE0;
     else
         data[0] = test.reg_accel_fsr;
-    if (i2c_write(st.hw->addr, st.reg->accel_cfg, 1, data))
+    if (i2c_write(st.addr, st.reg->accel_cfg, 1, data))
         return -1;
     if (hw_test)
         delay_ms(200);
 
     /* Fill FIFO for test.wait_ms milliseconds. */
     data[0] = BIT_FIFO_EN;
-    if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, data))
+    if (i2c_write(st.addr, st.reg->user_ctrl, 1, data))
         return -1;
 
     data[0] = INV_XYZ_GYRO | INV_XYZ_ACCEL;
-    if (i2c_write(st.hw->addr, st.reg->fifo_en, 1, data))
+    if (i2c_write(st.addr, st.reg->fifo_en, 1, data))
         return -1;
     delay_ms(test.wait_ms);
     data[0] = 0;
-    if (i2c_write(st.hw->addr, st.reg->fifo_en, 1, data))
+    if (i2c_write(st.addr, st.reg->fifo_en, 1, data))
         return -1;
 
-    if (i2c_read(st.hw->addr, st.reg->fifo_count_h, 2, data))
+    if (i2c_read(st.addr, st.reg->fifo_count_h, 2, data))
         return -1;
 
     fifo_count = (data[0] << 8) | data[1];
@@ -2033,7 +2194,7 @@ static int get_st_biases(long *gyro, long *accel, unsigned char hw_test)
 
     for (ii = 0; ii < packet_count; ii++) {
         short accel_cur[3], gyro_cur[3];
-        if (i2c_read(st.hw->addr, st.reg->fifo_r_w, MAX_PACKET_LENGTH, data))
+        if (i2c_read(st.addr, st.reg->fifo_r_w, MAX_PACKET_LENGTH, data))
             return -1;
         accel_cur[0] = ((short)data[0] << 8) | data[1];
         accel_cur[1] = ((short)data[2] << 8) | data[3];
@@ -2221,9 +2382,9 @@ int mpu_write_mem(unsigned short mem_addr, unsigned short length,
     if (tmp[1] + length > st.hw->bank_size)
         return -1;
 
-    if (i2c_write(st.hw->addr, st.reg->bank_sel, 2, tmp))
+    if (i2c_write(st.addr, st.reg->bank_sel, 2, tmp))
         return -1;
-    if (i2c_write(st.hw->addr, st.reg->mem_r_w, length, data))
+    if (i2c_write(st.addr, st.reg->mem_r_w, length, data))
         return -1;
     return 0;
 }
@@ -2254,10 +2415,61 @@ int mpu_read_mem(unsigned short mem_addr, unsigned short length,
     if (tmp[1] + length > st.hw->bank_size)
         return -1;
 
-    if (i2c_write(st.hw->addr, st.reg->bank_sel, 2, tmp))
+    if (i2c_write(st.addr, st.reg->bank_sel, 2, tmp))
         return -1;
-    if (i2c_read(st.hw->addr, st.reg->mem_r_w, length, data))
+    if (i2c_read(st.addr, st.reg->mem_r_w, length, data))
+        return -1;
+    return 0;
+}
+
+/* Largest transfer that divides evenly into st.hw->bank_size, so no
+ * chunk crosses a bank, and still fits the 8 bit i2c_read length.
+ */
+#define LOAD_CHUNK  (128)
+
+/**
+ *  @brief      Write part of a DMP image and verify it.
+ *  Everything is written first in LOAD_CHUNK pieces and then read back
+ *  in a second pass, instead of a read back after every write.
+ *  @param[in]  from        First byte of the image to load.
+ *  @param[in]  to          One past the last byte to load.
+ *  @param[in]  firmware    DMP code.
+ *  @return     0 if successful, -2 if the read back differs.
+ */
+static int write_firmware(unsigned short from, unsigned short to,
+    const unsigned char *firmware)
+{
+    unsigned short ii;
+    unsigned short this_len;
+    unsigned char cur[LOAD_CHUNK];
+
+    for (ii = from; ii < to; ii += this_len) {
+        this_len = min(LOAD_CHUNK, to - ii);
+        if (mpu_write_mem(ii, this_len, (unsigned char*)&firmware[ii]))
+            return -1;
+    }
+    for (ii = from; ii < to; ii += this_len) {
+        this_len = min(LOAD_CHUNK, to - ii);
+        if (mpu_read_mem(ii, this_len, cur))
+            return -1;
+        if (memcmp(firmware+ii, cur, this_len))
+            return -2;
+    }
+    return 0;
+}
+
+static int set_program_start(unsigned short start_addr,
+    unsigned short sample_rate)
+{
+    unsigned char tmp[2];
+
+    tmp[0] = start_addr >> 8;
+    tmp[1] = start_addr & 0xFF;
+    if (i2c_write(st.addr, st.reg->prgm_start_h, 2, tmp))
         return -1;
+
+    st.chip_cfg.dmp_loaded = 1;
+    st.chip_cfg.dmp_sample_rate = sample_rate;
     return 0;
 }
 
@@ -2272,11 +2484,7 @@ int mpu_read_mem(unsigned short mem_addr, unsigned short length,
 int mpu_load_firmware(unsigned short length, const unsigned char *firmware,
     unsigned short start_addr, unsigned short sample_rate)
 {
-    unsigned short ii;
-    unsigned short this_write;
-    /* Must divide evenly into st.hw->bank_size to avoid bank crossings. */
-#define LOAD_CHUNK  (16)
-    unsigned char cur[LOAD_CHUNK], tmp[2];
+    int result;
 
     if (st.chip_cfg.dmp_loaded)
         /* DMP should only be loaded once. */
@@ -2284,24 +2492,54 @@ int mpu_load_firmware(unsigned short length, const unsigned char *firmware,
 
     if (!firmware)
         return -1;
-    for (ii = 0; ii < length; ii += this_write) {
-        this_write = min(LOAD_CHUNK, length - ii);
-        if (mpu_write_mem(ii, this_write, (unsigned char*)&firmware[ii]))
-            return -1;
-        if (mpu_read_mem(ii, this_write, cur))
-            return -1;
-        if (memcmp(firmware+ii, cur, this_write))
-            return -2;
-    }
 
-    /* Set program start address. */
-    tmp[0] = start_addr >> 8;
-    tmp[1] = start_addr & 0xFF;
-    if (i2c_write(st.hw->addr, st.reg->prgm_start_h, 2, tmp))
+    result = write_firmware(0, length, firmware);
+    if (result)
+        return result;
+    st.chip_cfg.dmp_reused = 0;
+    return set_program_start(start_addr, sample_rate);
+}
+
+/**
+ *  @brief      Warm start, reload only the DMP data memory.
+ *  Use when the caller has already checked that the code from start_addr
+ *  on survived from a previous load. The data below start_addr holds the
+ *  DMP's running state so it is always rewritten from the image.
+ *  @param[in]  length      Length of DMP image.
+ *  @param[in]  firmware    DMP code.
+ *  @param[in]  start_addr  Starting address of DMP code memory.
+ *  @param[in]  sample_rate Fixed sampling rate used when DMP is enabled.
+ *  @return     0 if successful.
+ */
+int mpu_reload_firmware_data(unsigned short length,
+    const unsigned char *firmware, unsigned short start_addr,
+    unsigned short sample_rate)
+{
+    int result;
+
+    if (st.chip_cfg.dmp_loaded)
         return -1;
 
-    st.chip_cfg.dmp_loaded = 1;
-    st.chip_cfg.dmp_sample_rate = sample_rate;
+    if (!firmware || start_addr > length)
+        return -1;
+
+    result = write_firmware(0, start_addr, firmware);
+    if (result)
+        return result;
+    st.chip_cfg.dmp_reused = 1;
+    return set_program_start(start_addr, sample_rate);
+}
+
+/**
+ *  @brief      Check whether the last load reused the DMP code.
+ *  @param[out] reused  1 if loaded with mpu_reload_firmware_data().
+ *  @return     0 if successful.
+ */
+int mpu_get_dmp_reused(unsigned char *reused)
+{
+    if (!st.chip_cfg.dmp_loaded)
+        return -1;
+    reused[0] = st.chip_cfg.dmp_reused;
     return 0;
 }
 
@@ -2327,7 +2565,7 @@ int mpu_set_dmp_state(unsigned char enable)
         mpu_set_sample_rate(st.chip_cfg.dmp_sample_rate);
         /* Remove FIFO elements. */
         tmp = 0;
-        i2c_write(st.hw->addr, 0x23, 1, &tmp);
+        i2c_write(st.addr, 0x23, 1, &tmp);
         st.chip_cfg.dmp_on = 1;
         /* Enable DMP interrupt. */
         set_int_enable(1);
@@ -2337,7 +2575,7 @@ int mpu_set_dmp_state(unsigned char enable)
         set_int_enable(0);
         /* Restore FIFO settings. */
         tmp = st.chip_cfg.fifo_enable;
-        i2c_write(st.hw->addr, 0x23, 1, &tmp);
+        i2c_write(st.addr, 0x23, 1, &tmp);
         st.chip_cfg.dmp_on = 0;
         mpu_reset_fifo();
     }
@@ -2406,53 +2644,53 @@ static int setup_compass(void)
 
     /* Set up master mode, master clock, and ES bit. */
     data[0] = 0x40;
-    if (i2c_write(st.hw->addr, st.reg->i2c_mst, 1, data))
+    if (i2c_write(st.addr, st.reg->i2c_mst, 1, data))
         return -1;
 
     /* Slave 0 reads from AKM data registers. */
     data[0] = BIT_I2C_READ | st.chip_cfg.compass_addr;
-    if (i2c_write(st.hw->addr, st.reg->s0_addr, 1, data))
+    if (i2c_write(st.addr, st.reg->s0_addr, 1, data))
         return -1;
 
     /* Compass reads start at this register. */
     data[0] = AKM_REG_ST1;
-    if (i2c_write(st.hw->addr, st.reg->s0_reg, 1, data))
+    if (i2c_write(st.addr, st.reg->s0_reg, 1, data))
         return -1;
 
     /* Enable slave 0, 8-byte reads. */
     data[0] = BIT_SLAVE_EN | 8;
-    if (i2c_write(st.hw->addr, st.reg->s0_ctrl, 1, data))
+    if (i2c_write(st.addr, st.reg->s0_ctrl, 1, data))
         return -1;
 
     /* Slave 1 changes AKM measurement mode. */
     data[0] = st.chip_cfg.compass_addr;
-    if (i2c_write(st.hw->addr, st.reg->s1_addr, 1, data))
+    if (i2c_write(st.addr, st.reg->s1_addr, 1, data))
         return -1;
 
     /* AKM measurement mode register. */
     data[0] = AKM_REG_CNTL;
-    if (i2c_write(st.hw->addr, st.reg->s1_reg, 1, data))
+    if (i2c_write(st.addr, st.reg->s1_reg, 1, data))
         return -1;
 
     /* Enable slave 1, 1-byte writes. */
     data[0] = BIT_SLAVE_EN | 1;
-    if (i2c_write(st.hw->addr, st.reg->s1_ctrl, 1, data))
+    if (i2c_write(st.addr, st.reg->s1_ctrl, 1, data))
         return -1;
 
     /* Set slave 1 data. */
     data[0] = AKM_SINGLE_MEASUREMENT;
-    if (i2c_write(st.hw->addr, st.reg->s1_do, 1, data))
+    if (i2c_write(st.addr, st.reg->s1_do, 1, data))
         return -1;
 
     /* Trigger slave 0 and slave 1 actions at each sample. */
     data[0] = 0x03;
-    if (i2c_write(st.hw->addr, st.reg->i2c_delay_ctrl, 1, data))
+    if (i2c_write(st.addr, st.reg->i2c_delay_ctrl, 1, data))
         return -1;
 
 #ifdef MPU9150
     /* For the MPU9150, the auxiliary I2C bus needs to be set to VDD. */
     data[0] = BIT_I2C_MST_VDDIO;
-    if (i2c_write(st.hw->addr, st.reg->yg_offs_tc, 1, data))
+    if (i2c_write(st.addr, st.reg->yg_offs_tc, 1, data))
         return -1;
 #endif
 
@@ -2483,7 +2721,7 @@ int mpu_get_compass_reg(short *data, unsigned long *timestamp)
     if (i2c_write(st.chip_cfg.compass_addr, AKM_REG_CNTL, 1, tmp+8))
         return -1;
 #else
-    if (i2c_read(st.hw->addr, st.reg->raw_compass, 8, tmp))
+    if (i2c_read(st.addr, st.reg->raw_compass, 8, tmp))
         return -1;
 #endif
 
@@ -2642,7 +2880,7 @@ int mpu_lp_motion_interrupt(unsigned short thresh, unsigned char time,
          * reading.
          */
         data[0] = INV_FILTER_256HZ_NOLPF2;
-        if (i2c_write(st.hw->addr, st.reg->lpf, 1, data))
+        if (i2c_write(st.addr, st.reg->lpf, 1, data))
             return -1;
 
         /* NOTE: Digital high pass filter should be configured here. Since this
@@ -2653,19 +2891,19 @@ int mpu_lp_motion_interrupt(unsigned short thresh, unsigned char time,
         /* Configure the device to send motion interrupts. */
         /* Enable motion interrupt. */
         data[0] = BIT_MOT_INT_EN;
-        if (i2c_write(st.hw->addr, st.reg->int_enable, 1, data))
+        if (i2c_write(st.addr, st.reg->int_enable, 1, data))
             goto lp_int_restore;
 
         /* Set motion interrupt parameters. */
         data[0] = thresh_hw;
         data[1] = time;
-        if (i2c_write(st.hw->addr, st.reg->motion_thr, 2, data))
+        if (i2c_write(st.addr, st.reg->motion_thr, 2, data))
             goto lp_int_restore;
 
         /* Force hardware to "lock" current accel sample. */
         delay_ms(5);
         data[0] = (st.chip_cfg.accel_fsr << 3) | BITS_HPF;
-        if (i2c_write(st.hw->addr, st.reg->accel_cfg, 1, data))
+        if (i2c_write(st.addr, st.reg->accel_cfg, 1, data))
             goto lp_int_restore;
 
         /* Set up LP accel mode. */
@@ -2679,7 +2917,7 @@ int mpu_lp_motion_interrupt(unsigned short thresh, unsigned char time,
         else
             data[1] = INV_LPA_40HZ;
         data[1] = (data[1] << 6) | BIT_STBY_XYZG;
-        if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 2, data))
+        if (i2c_write(st.addr, st.reg->pwr_mgmt_1, 2, data))
             goto lp_int_restore;
 
         st.chip_cfg.int_motion_only = 1;
@@ -2692,12 +2930,12 @@ int mpu_lp_motion_interrupt(unsigned short thresh, unsigned char time,
         data[0] = 0;
         data[1] = 0;
         data[2] = BIT_STBY_XYZG;
-        if (i2c_write(st.hw->addr, st.reg->user_ctrl, 3, data))
+        if (i2c_write(st.addr, st.reg->user_ctrl, 3, data))
             goto lp_int_restore;
 
         /* Set motion threshold. */
         data[0] = thresh_hw;
-        if (i2c_write(st.hw->addr, st.reg->motion_thr, 1, data))
+        if (i2c_write(st.addr, st.reg->motion_thr, 1, data))
             goto lp_int_restore;
 
         /* Set wake frequency. */
@@ -2721,22 +2959,22 @@ int mpu_lp_motion_interrupt(unsigned short thresh, unsigned char time,
             data[0] = INV_LPA_320HZ;
         else
             data[0] = INV_LPA_640HZ;
-        if (i2c_write(st.hw->addr, st.reg->lp_accel_odr, 1, data))
+        if (i2c_write(st.addr, st.reg->lp_accel_odr, 1, data))
             goto lp_int_restore;
 
         /* Enable motion interrupt (MPU6500 version). */
         data[0] = BITS_WOM_EN;
-        if (i2c_write(st.hw->addr, st.reg->accel_intel, 1, data))
+        if (i2c_write(st.addr, st.reg->accel_intel, 1, data))
             goto lp_int_restore;
 
         /* Enable cycle mode. */
         data[0] = BIT_LPA_CYCLE;
-        if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 1, data))
+        if (i2c_write(st.addr, st.reg->pwr_mgmt_1, 1, data))
             goto lp_int_restore;
 
         /* Enable interrupt. */
         data[0] = BIT_MOT_INT_EN;
-        if (i2c_write(st.hw->addr, st.reg->int_enable, 1, data))
+        if (i2c_write(st.addr, st.reg->int_enable, 1, data))
             goto lp_int_restore;
 
         st.chip_cfg.int_motion_only = 1;
@@ -2775,7 +3013,7 @@ lp_int_restore:
 #ifdef MPU6500
     /* Disable motion interrupt (MPU6500 version). */
     data[0] = 0;
-    if (i2c_write(st.hw->addr, st.reg->accel_intel, 1, data))
+    if (i2c_write(st.addr, st.reg->accel_intel, 1, data))
         goto lp_int_restore;
 #endif
 
@@ -2783,6 +3021,47 @@ lp_int_restore:
     return 0;
 }
 
+/**
+ *  @brief      Size of the driver state for one chip.
+ *  @return     Bytes to allocate for mpu_state_init().
+ */
+unsigned int mpu_state_size(void)
+{
+    return sizeof(struct gyro_state_s);
+}
+
+/**
+ *  @brief      Set up driver state for another chip.
+ *  The register maps are shared, the configuration starts empty so
+ *  mpu_init() must be called with this state selected.
+ *  @param[out] state   mpu_state_size() bytes.
+ *  @param[in]  addr    I2C address of the chip, 0x68 or 0x69.
+ */
+void mpu_state_init(void *state, unsigned char addr)
+{
+    struct gyro_state_s *s = state;
+
+    memset(s, 0, sizeof(struct gyro_state_s));
+    s->reg = default_st.reg;
+    s->hw = default_st.hw;
+    s->test = default_st.test;
+    s->addr = addr;
+}
+
+/**
+ *  @brief      Select the chip the rest of the API talks to.
+ *  Only for the calling thread, the caller serializes access to each chip.
+ *  @param[in]  state   From mpu_state_init(), NULL for the default chip.
+ *  @return     The previously selected state.
+ */
+void *mpu_select_state(void *state)
+{
+    void *prev = cur_st;
+
+    cur_st = state ? state : &default_st;
+    return prev;
+}
+
 /**
  *  @}
  */
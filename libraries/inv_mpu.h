@@ -109,8 +109,15 @@ int mpu_get_temperature(long *data, unsigned long *timestamp);
 int mpu_get_int_status(short *status);
 int mpu_read_fifo(short *gyro, short *accel, unsigned long *timestamp,
     unsigned char *sensors, unsigned char *more);
+/* Burst version of mpu_read_fifo. 1024 byte FIFO / 12 byte packets. */
+#define MPU_MAX_BATCH   (85)
+int mpu_read_fifo_multi(unsigned short max, short (*gyro)[3],
+    short (*accel)[3], unsigned long *timestamp, unsigned char *sensors,
+    unsigned short *count, unsigned short *more);
 int mpu_read_fifo_stream(unsigned short length, unsigned char *data,
     unsigned char *more);
+int mpu_read_fifo_stream_multi(unsigned short length, unsigned short max,
+    unsigned char *data, unsigned short *count, unsigned short *more);
 int mpu_reset_fifo(void);
 
 int mpu_write_mem(unsigned short mem_addr, unsigned short length,
@@ -119,6 +126,15 @@ int mpu_read_mem(unsigned short mem_addr, unsigned short length,
     unsigned char *data);
 int mpu_load_firmware(unsigned short length, const unsigned char *firmware,
     unsigned short start_addr, unsigned short sample_rate);
+int mpu_reload_firmware_data(unsigned short length,
+    const unsigned char *firmware, unsigned short start_addr,
+    unsigned short sample_rate);
+int mpu_get_dmp_reused(unsigned char *reused);
+
+/* Several chips, one driver state per chip. */
+unsigned int mpu_state_size(void);
+void mpu_state_init(void *state, unsigned char addr);
+void *mpu_select_state(void *state);
 
 int mpu_reg_dump(void);
 int mpu_read_reg(unsigned char reg, unsigned char *data);
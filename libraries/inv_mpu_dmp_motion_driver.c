@@ -462,6 +462,22 @@ static const unsigned short sStartAddress = 0x0400;
 
 /* END OF SECTION COPIED FROM dmpDefaultMPU6050.c */
 
+/* Places in the code banks that the CFG_ keys in this driver patch. They
+ * hold whatever the last run configured, so dmp_code_present() counts them
+ * as zero on both sides when it checks the code from an earlier load.
+ */
+static const struct {
+    unsigned short addr;
+    unsigned char len;
+} code_patches[] = {
+    {FCFG_1, 3}, {FCFG_2, 3}, {FCFG_7, 3}, {FCFG_3, 3},
+    {CFG_MOTION_BIAS, 9}, {CFG_ANDROID_ORIENT_INT, 1}, {CFG_20, 1},
+    {CFG_FIFO_ON_EVENT, 11}, {CFG_LP_QUAT, 4}, {CFG_8, 4},
+    {CFG_GYRO_RAW_DATA, 4}, {CFG_15, 10}, {CFG_27, 1}, {CFG_6, 12}
+};
+/* Divides the 256 byte banks so no read crosses one. */
+#define CODE_CHUNK          (128)
+
 #define INT_SRC_TAP             (0x01)
 #define INT_SRC_ANDROID_ORIENT  (0x08)
 
@@ -474,8 +490,8 @@ static const unsigned short sStartAddress = 0x0400;
 //#define DMP_SAMPLE_RATE     (200)
 //#define GYRO_SF             (46850825LL * 200 / DMP_SAMPLE_RATE)
  
-int dmp_sample_rate; //now global variable
-#define GYRO_SF             (46850825LL * 200 / dmp_sample_rate)
+//// now kept per chip in dmp.sample_rate
+#define GYRO_SF             (46850825LL * 200 / dmp.sample_rate)
 
 #define FIFO_CORRUPTION_CHECK
 #ifdef FIFO_CORRUPTION_CHECK
@@ -492,17 +508,23 @@ struct dmp_s {
     unsigned short feature_mask;
     unsigned short fifo_rate;
     unsigned char packet_length;
+    int sample_rate;
 };
 
-static struct dmp_s dmp = {
+static struct dmp_s default_dmp = {
     .tap_cb = NULL,
     .android_orient_cb = NULL,
     .orient = 0,
     .feature_mask = 0,
     .fifo_rate = 0,
-    .packet_length = 0
+    .packet_length = 0,
+    .sample_rate = 0
 };
 
+/* See dmp_select_state(), one per chip and thread like mpu_select_state(). */
+static __thread struct dmp_s *cur_dmp = &default_dmp;
+#define dmp (*cur_dmp)
+
 /**
  *  @brief  Load the DMP with this image.
  *  @return 0 if successful.
@@ -510,11 +532,77 @@ static struct dmp_s dmp = {
 int dmp_load_motion_driver_firmware(int sample_rate)
 {
 	//new sample rate variable saved
-	dmp_sample_rate = sample_rate;
+	dmp.sample_rate = sample_rate;
+    if (dmp_code_present())
+        return mpu_reload_firmware_data(DMP_CODE_SIZE, dmp_memory,
+            sStartAddress, sample_rate);
     return mpu_load_firmware(DMP_CODE_SIZE, dmp_memory, sStartAddress,
         sample_rate);
 }
 
+static int code_patched(unsigned short addr)
+{
+    unsigned int ii;
+
+    for (ii = 0; ii < sizeof(code_patches)/sizeof(code_patches[0]); ii++) {
+        if (addr >= code_patches[ii].addr &&
+            addr < code_patches[ii].addr + code_patches[ii].len)
+            return 1;
+    }
+    return 0;
+}
+
+/* CRC-32 (IEEE) of len bytes of code starting at addr, continuing crc. */
+static unsigned long code_crc(unsigned long crc, unsigned short addr,
+    unsigned short len, const unsigned char *data)
+{
+    unsigned short ii;
+    unsigned char bit, byte;
+
+    for (ii = 0; ii < len; ii++) {
+        byte = code_patched(addr + ii) ? 0 : data[ii];
+        crc ^= byte;
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320UL & -(crc & 1));
+    }
+    return crc;
+}
+
+/**
+ *  @brief  Check for DMP code left by an earlier load.
+ *  If the chip stayed powered since an earlier run the code can still be
+ *  in memory and only the data banks need reloading. The whole code range
+ *  from sStartAddress up is read back a chunk at a time and each chunk's
+ *  CRC compared with the image's, leaving out the bytes the CFG_ keys
+ *  patch. On a cold chip the first chunk already differs.
+ *  @return 1 if the code is present.
+ */
+int dmp_code_present(void)
+{
+    static unsigned long image_crc[(DMP_CODE_SIZE - 1) / CODE_CHUNK + 1];
+    static unsigned char image_crc_ready = 0;
+    unsigned char cur[CODE_CHUNK];
+    unsigned short ii, this_len;
+
+    if (!image_crc_ready) {
+        for (ii = sStartAddress; ii < DMP_CODE_SIZE; ii += this_len) {
+            this_len = min(CODE_CHUNK, DMP_CODE_SIZE - ii);
+            image_crc[ii / CODE_CHUNK] = code_crc(0xFFFFFFFFUL, ii, this_len,
+                dmp_memory + ii);
+        }
+        image_crc_ready = 1;
+    }
+
+    for (ii = sStartAddress; ii < DMP_CODE_SIZE; ii += this_len) {
+        this_len = min(CODE_CHUNK, DMP_CODE_SIZE - ii);
+        if (mpu_read_mem(ii, this_len, cur))
+            return 0;
+        if (code_crc(0xFFFFFFFFUL, ii, this_len, cur) != image_crc[ii / CODE_CHUNK])
+            return 0;
+    }
+    return 1;
+}
+
 /**
  *  @brief      Push gyro and accel orientation to the DMP.
  *  The orientation is represented here as the output of
@@ -688,9 +776,9 @@ int dmp_set_fifo_rate(unsigned short rate)
     unsigned short div;
     unsigned char tmp[8];
 
-    if (rate > dmp_sample_rate)
+    if (rate > dmp.sample_rate)
         return -1;
-    div = dmp_sample_rate / rate - 1;
+    div = dmp.sample_rate / rate - 1;
     tmp[0] = (unsigned char)((div >> 8) & 0xFF);
     tmp[1] = (unsigned char)(div & 0xFF);
     if (mpu_write_mem(D_0_22, 2, tmp))
@@ -727,7 +815,7 @@ int dmp_set_tap_thresh(unsigned char axis, unsigned short thresh)
     if (!(axis & TAP_XYZ) || thresh > 1600)
         return -1;
 
-    scaled_thresh = (float)thresh / dmp_sample_rate;
+    scaled_thresh = (float)thresh / dmp.sample_rate;
 
     mpu_get_accel_fsr(&accel_fsr);
     switch (accel_fsr) {
@@ -826,7 +914,7 @@ int dmp_set_tap_time(unsigned short time)
     unsigned short dmp_time;
     unsigned char tmp[2];
 
-    dmp_time = time / (1000 / dmp_sample_rate);
+    dmp_time = time / (1000 / dmp.sample_rate);
     tmp[0] = (unsigned char)(dmp_time >> 8);
     tmp[1] = (unsigned char)(dmp_time & 0xFF);
     return mpu_write_mem(DMP_TAPW_MIN, 2, tmp);
@@ -842,7 +930,7 @@ int dmp_set_tap_time_multi(unsigned short time)
     unsigned short dmp_time;
     unsigned char tmp[2];
 
-    dmp_time = time / (1000 / dmp_sample_rate);
+    dmp_time = time / (1000 / dmp.sample_rate);
     tmp[0] = (unsigned char)(dmp_time >> 8);
     tmp[1] = (unsigned char)(dmp_time & 0xFF);
     return mpu_write_mem(D_1_218, 2, tmp);
@@ -878,7 +966,7 @@ int dmp_set_shake_reject_time(unsigned short time)
 {
     unsigned char tmp[2];
 
-    time /= (1000 / dmp_sample_rate);
+    time /= (1000 / dmp.sample_rate);
     tmp[0] = time >> 8;
     tmp[1] = time & 0xFF;
     return mpu_write_mem(D_1_90,2,tmp);
@@ -896,7 +984,7 @@ int dmp_set_shake_reject_timeout(unsigned short time)
 {
     unsigned char tmp[2];
 
-    time /= (1000 / dmp_sample_rate);
+    time /= (1000 / dmp.sample_rate);
     tmp[0] = time >> 8;
     tmp[1] = time & 0xFF;
     return mpu_write_mem(D_1_88,2,tmp);
@@ -1245,30 +1333,10 @@ int dmp_set_interrupt_mode(unsigned char mode)
     }
 }
 
-/**
- *  @brief      Get one packet from the FIFO.
- *  If @e sensors does not contain a particular sensor, disregard the data
- *  returned to that pointer.
- *  \n @e sensors can contain a combination of the following flags:
- *  \n INV_X_GYRO, INV_Y_GYRO, INV_Z_GYRO
- *  \n INV_XYZ_GYRO
- *  \n INV_XYZ_ACCEL
- *  \n INV_WXYZ_QUAT
- *  \n If the FIFO has no new data, @e sensors will be zero.
- *  \n If the FIFO is disabled, @e sensors will be zero and this function will
- *  return a non-zero error code.
- *  @param[out] gyro        Gyro data in hardware units.
- *  @param[out] accel       Accel data in hardware units.
- *  @param[out] quat        3-axis quaternion data in hardware units.
- *  @param[out] timestamp   Timestamp in milliseconds.
- *  @param[out] sensors     Mask of sensors read from FIFO.
- *  @param[out] more        Number of remaining packets.
- *  @return     0 if successful.
- */
-int dmp_read_fifo(short *gyro, short *accel, long *quat,
-    unsigned long *timestamp, short *sensors, unsigned char *more)
+/* Decode one DMP packet. Shared by the single and multi-packet reads. */
+static int parse_packet(unsigned char *fifo_data, short *gyro,
+    short *accel, long *quat, short *sensors)
 {
-    unsigned char fifo_data[MAX_PACKET_LENGTH];
     unsigned char ii = 0;
 
     /* TODO: sensors[0] only changes when dmp_enable_feature is called. We can
@@ -1276,10 +1344,6 @@ int dmp_read_fifo(short *gyro, short *accel, long *quat,
      */
     sensors[0] = 0;
 
-    /* Get a packet. */
-    if (mpu_read_fifo_stream(dmp.packet_length, fifo_data, more))
-        return -1;
-
     /* Parse DMP packet. */
     if (dmp.feature_mask & (DMP_FEATURE_LP_QUAT | DMP_FEATURE_6X_LP_QUAT)) {
 #ifdef FIFO_CORRUPTION_CHECK
@@ -1342,10 +1406,92 @@ int dmp_read_fifo(short *gyro, short *accel, long *quat,
     if (dmp.feature_mask & (DMP_FEATURE_TAP | DMP_FEATURE_ANDROID_ORIENT))
         decode_gesture(fifo_data + ii);
 
+    return 0;
+}
+
+/**
+ *  @brief      Get one packet from the FIFO.
+ *  If @e sensors does not contain a particular sensor, disregard the data
+ *  returned to that pointer.
+ *  \n @e sensors can contain a combination of the following flags:
+ *  \n INV_X_GYRO, INV_Y_GYRO, INV_Z_GYRO
+ *  \n INV_XYZ_GYRO
+ *  \n INV_XYZ_ACCEL
+ *  \n INV_WXYZ_QUAT
+ *  \n If the FIFO has no new data, @e sensors will be zero.
+ *  \n If the FIFO is disabled, @e sensors will be zero and this function will
+ *  return a non-zero error code.
+ *  @param[out] gyro        Gyro data in hardware units.
+ *  @param[out] accel       Accel data in hardware units.
+ *  @param[out] quat        3-axis quaternion data in hardware units.
+ *  @param[out] timestamp   Timestamp in milliseconds.
+ *  @param[out] sensors     Mask of sensors read from FIFO.
+ *  @param[out] more        Number of remaining packets.
+ *  @return     0 if successful.
+ */
+int dmp_read_fifo(short *gyro, short *accel, long *quat,
+    unsigned long *timestamp, short *sensors, unsigned char *more)
+{
+    unsigned char fifo_data[MAX_PACKET_LENGTH];
+
+    /* Get a packet. */
+    if (mpu_read_fifo_stream(dmp.packet_length, fifo_data, more)) {
+        sensors[0] = 0;
+        return -1;
+    }
+
+    if (parse_packet(fifo_data, gyro, accel, quat, sensors))
+        return -1;
+
     get_ms(timestamp);
     return 0;
 }
 
+/**
+ *  @brief      Get every waiting packet from the FIFO in one burst.
+ *  Same as dmp_read_fifo but the FIFO count is read once and up to @e max
+ *  packets are read back to back, so a caller that fell behind sees each
+ *  sample rather than only the newest one. Arrays are indexed by packet,
+ *  oldest first. The read time is stamped on the newest packet and the
+ *  older ones are stepped back by the FIFO rate.
+ *  @param[in]  max         Size of the output arrays.
+ *  @param[out] gyro        Gyro data in hardware units.
+ *  @param[out] accel       Accel data in hardware units.
+ *  @param[out] quat        3-axis quaternion data in hardware units.
+ *  @param[out] timestamp   Timestamp in milliseconds.
+ *  @param[out] sensors     Mask of sensors read from FIFO.
+ *  @param[out] count       Number of packets read.
+ *  @param[out] more        Number of packets still in the FIFO.
+ *  @return     0 if successful.
+ */
+int dmp_read_fifo_multi(unsigned short max, short (*gyro)[3],
+    short (*accel)[3], long (*quat)[4], unsigned long *timestamp,
+    short *sensors, unsigned short *count, unsigned short *more)
+{
+    unsigned char fifo_data[DMP_MAX_BATCH * MAX_PACKET_LENGTH];
+    unsigned long now, period;
+    unsigned short ii;
+
+    if (max > DMP_MAX_BATCH)
+        max = DMP_MAX_BATCH;
+    if (mpu_read_fifo_stream_multi(dmp.packet_length, max, fifo_data, count,
+        more))
+        return -1;
+
+    get_ms(&now);
+    period = dmp.fifo_rate ? 1000 / dmp.fifo_rate : 0;
+    for (ii = 0; ii < count[0]; ii++) {
+        if (parse_packet(fifo_data + ii * dmp.packet_length, gyro[ii],
+            accel[ii], quat[ii], &sensors[ii])) {
+            count[0] = 0;
+            more[0] = 0;
+            return -1;
+        }
+        timestamp[ii] = now - (count[0] - 1 - ii) * period;
+    }
+    return 0;
+}
+
 /**
  *  @brief      Register a function to be executed on a tap event.
  *  The tap direction is represented by one of the following:
@@ -1375,6 +1521,38 @@ int dmp_register_android_orient_cb(void (*func)(unsigned char))
     return 0;
 }
 
+/**
+ *  @brief      Size of the DMP state for one chip.
+ *  @return     Bytes to allocate for dmp_state_init().
+ */
+unsigned int dmp_state_size(void)
+{
+    return sizeof(struct dmp_s);
+}
+
+/**
+ *  @brief      Set up DMP state for another chip.
+ *  @param[out] state   dmp_state_size() bytes.
+ */
+void dmp_state_init(void *state)
+{
+    memset(state, 0, sizeof(struct dmp_s));
+}
+
+/**
+ *  @brief      Select the chip the rest of the API talks to.
+ *  Select the matching chip with mpu_select_state() as well.
+ *  @param[in]  state   From dmp_state_init(), NULL for the default chip.
+ *  @return     The previously selected state.
+ */
+void *dmp_select_state(void *state)
+{
+    void *prev = cur_dmp;
+
+    cur_dmp = state ? state : &default_dmp;
+    return prev;
+}
+
 /**
  *  @}
  */
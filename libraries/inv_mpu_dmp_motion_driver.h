@@ -51,6 +51,12 @@
 
 /* Set up functions. */
 int dmp_load_motion_driver_firmware(int sample_rate);
+int dmp_code_present(void);
+
+/* Several chips, one DMP state per chip. */
+unsigned int dmp_state_size(void);
+void dmp_state_init(void *state);
+void *dmp_select_state(void *state);
 int dmp_set_fifo_rate(unsigned short rate);
 int dmp_get_fifo_rate(unsigned short *rate);
 int dmp_enable_feature(unsigned short mask);
@@ -93,5 +99,11 @@ int dmp_enable_gyro_cal(unsigned char enable);
 int dmp_read_fifo(short *gyro, short *accel, long *quat,
     unsigned long *timestamp, short *sensors, unsigned char *more);
 
+/* Burst version of dmp_read_fifo, returns up to DMP_MAX_BATCH packets. */
+#define DMP_MAX_BATCH   (32)
+int dmp_read_fifo_multi(unsigned short max, short (*gyro)[3],
+    short (*accel)[3], long (*quat)[4], unsigned long *timestamp,
+    short *sensors, unsigned short *count, unsigned short *more);
+
 #endif  /* #ifndef _INV_MPU_DMP_MOTION_DRIVER_H_ */
 
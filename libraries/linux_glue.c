@@ -31,86 +31,78 @@
 #include <sys/types.h>
 #include <fcntl.h>
 #include <linux/i2c-dev.h>
+#include <linux/i2c.h>
 #include "linux_glue.h"
+#include "i2c_trace.h"
+#include "i2c_bus.h"
 
 #define MAX_WRITE_LEN 511
 
 // default is the RPi
-int i2c_bus = 1;
+static linux_i2c_bus_t default_bus = { .bus = 1 };
 
-int i2c_fd;
-int current_slave;
-unsigned char txBuff[MAX_WRITE_LEN + 1];
+// every call goes to the bus the calling thread selected with
+// linux_i2c_select_bus()
+static __thread linux_i2c_bus_t *cur_bus = &default_bus;
+
+// ioctl(I2C_RDWR) calls made, see linux_i2c_get_syscalls()
+unsigned long i2c_syscalls;
 
 
 void __no_operation(void) { }
 
-int i2c_open()
+// Every message carries its own slave address, so there is no I2C_SLAVE
+// ioctl to keep in sync. Messages in one call are joined by repeated starts.
+// Call with the bus locked, the fd is shared with every other client.
+static int i2c_transfer(struct i2c_msg *msgs, int nmsgs)
 {
-	char buff[32];
+	struct i2c_rdwr_ioctl_data xfer;
+	int fd = i2c_bus_fd(cur_bus->bus);
 
-	if (!i2c_fd) {
-		sprintf(buff, "/dev/i2c-%d", i2c_bus);
+	if (fd < 0)
+		return -1;
 
-#ifdef I2C_DEBUG
-		printf("\t\t\ti2c_open() : %s\n", buff);
-#endif
+	xfer.msgs = msgs;
+	xfer.nmsgs = nmsgs;
 
-		i2c_fd = open(buff, O_RDWR);
+	__sync_fetch_and_add(&i2c_syscalls, 1);
 
-		if (i2c_fd < 0) {
-			perror("open(i2c_bus)");
-			i2c_fd = 0;
-			return -1;
-		}
+	if (ioctl(fd, I2C_RDWR, &xfer) != nmsgs) {
+		perror("ioctl(I2C_RDWR)");
+		return -1;
 	}
 
 	return 0;
 }
 
-void i2c_close()
+void linux_set_i2c_bus(int bus)
 {
-	if (i2c_fd) {
-		close(i2c_fd);
-		i2c_fd = 0;
-		current_slave = 0;
-	}
+	cur_bus->bus = bus;
 }
 
-int i2c_select_slave(unsigned char slave_addr)
+void linux_i2c_bus_init(linux_i2c_bus_t *b, int bus)
 {
-	if (current_slave == slave_addr)
-		return 0;
-
-	if (i2c_open())
-		return -1;
-
-#ifdef I2C_DEBUG
-	printf("\t\ti2c_select_slave(%02X)\n", slave_addr);
-#endif
-
-	if (ioctl(i2c_fd, I2C_SLAVE, slave_addr) < 0) {
-		perror("ioctl(I2C_SLAVE)");
-		return -1;
-	}
-
-	current_slave = slave_addr;
-
-	return 0;
+	memset(b, 0, sizeof(linux_i2c_bus_t));
+	b->bus = bus;
 }
 
-void linux_set_i2c_bus(int bus)
+// Returns the bus that was selected before. NULL selects the default bus
+// used by programs with a single IMU. Only affects the calling thread.
+linux_i2c_bus_t *linux_i2c_select_bus(linux_i2c_bus_t *b)
 {
-	if (i2c_fd)
-		i2c_close();
+	linux_i2c_bus_t *prev = cur_bus;
 
-	i2c_bus = bus;
+	cur_bus = b ? b : &default_bus;
+
+	return prev;
 }
 
-int linux_i2c_write(unsigned char slave_addr, unsigned char reg_addr,
+static int write_reg(unsigned char slave_addr, unsigned char reg_addr,
        unsigned char length, unsigned char const *data)
 {
-	int result, i;
+	unsigned char txBuff[MAX_WRITE_LEN + 1];
+	struct i2c_msg msg;
+	int i;
 
 	if (length > MAX_WRITE_LEN) {
 		printf("Max write length exceeded in linux_i2c_write()\n");
@@ -131,46 +123,56 @@ int linux_i2c_write(unsigned char slave_addr, unsigned char reg_addr,
 	}
 #endif
 
-	if (i2c_select_slave(slave_addr))
-		return -1;
+	if (cur_bus->backend)
+		return cur_bus->backend->write(cur_bus->backend_arg, slave_addr,
+					reg_addr, length, data);
 
-	if (length == 0) {
-		result = write(i2c_fd, &reg_addr, 1);
+	txBuff[0] = reg_addr;
 
-		if (result < 0) {
-			perror("write:1");
-			return result;
-		}
-		else if (result != 1) {
-			printf("Write fail:1 Tried 1 Wrote 0\n");
-			return -1;
-		}
-	}
-	else {
-		txBuff[0] = reg_addr;
-
-		for (i = 0; i < length; i++)
-			txBuff[i+1] = data[i];
+	for (i = 0; i < length; i++)
+		txBuff[i+1] = data[i];
 
-		result = write(i2c_fd, txBuff, length + 1);
+	msg.addr = slave_addr;
+	msg.flags = 0;
+	msg.len = length + 1;
+	msg.buf = txBuff;
 
-		if (result < 0) {
-			perror("write:2");
-			return result;
-		}
-		else if (result < (int)length) {
-			printf("Write fail:2 Tried %u Wrote %d\n", length, result); 
-			return -1;
-		}
+	if (i2c_transfer(&msg, 1)) {
+		printf("Write fail: slave %02X reg %02X len %u\n", slave_addr, reg_addr, length);
+		return -1;
 	}
 
 	return 0;
 }
 
-int linux_i2c_read(unsigned char slave_addr, unsigned char reg_addr,
+// Every write is timed and counted by the tracer, see i2c_trace.h. The
+// time waiting for the bus lock is kept apart from the transaction.
+int linux_i2c_write(unsigned char slave_addr, unsigned char reg_addr,
+       unsigned char length, unsigned char const *data)
+{
+	uint64_t wait = i2c_trace_start();
+	uint64_t start;
+	int ret;
+
+	if (i2c_bus_lock(cur_bus->bus))
+		return -1;
+
+	start = i2c_trace_start();
+	ret = write_reg(slave_addr, reg_addr, length, data);
+	i2c_bus_unlock(cur_bus->bus);
+
+	i2c_trace_record(I2C_TRACE_WRITE, slave_addr, reg_addr, length, wait,
+			start, ret);
+
+	return ret;
+}
+
+// The register address write and the data read go out as one combined
+// transaction with a repeated start, in a single ioctl.
+static int read_reg(unsigned char slave_addr, unsigned char reg_addr,
        unsigned char length, unsigned char *data)
 {
-	int tries, result, total;
+	struct i2c_msg msgs[2];
 
 #ifdef I2C_DEBUG
 	int i;
@@ -178,42 +180,111 @@ int linux_i2c_read(unsigned char slave_addr, unsigned char reg_addr,
 	printf("\tlinux_i2c_read(%02X, %02X, %u, ...)\n", slave_addr, reg_addr, length);
 #endif
 
-	if (linux_i2c_write(slave_addr, reg_addr, 0, NULL))
+	if (cur_bus->backend)
+		return cur_bus->backend->read(cur_bus->backend_arg, slave_addr,
+					reg_addr, length, data);
+
+	msgs[0].addr = slave_addr;
+	msgs[0].flags = 0;
+	msgs[0].len = 1;
+	msgs[0].buf = &reg_addr;
+
+	msgs[1].addr = slave_addr;
+	msgs[1].flags = I2C_M_RD;
+	msgs[1].len = length;
+	msgs[1].buf = data;
+
+	if (i2c_transfer(msgs, 2))
 		return -1;
 
-	total = 0;
-	tries = 0;
+#ifdef I2C_DEBUG
+	printf("\tLeaving linux_i2c_read(), read %d bytes: ", length);
 
-	while (total < length && tries < 5) {
-		result = read(i2c_fd, data + total, length - total);
+	for (i = 0; i < length; i++)
+		printf("%02X ", data[i]); 
 
-		if (result < 0) {
-			perror("read");
-			break;
-		}
+	printf("\n");
+#endif
+
+	return 0;
+}
+
+int linux_i2c_read(unsigned char slave_addr, unsigned char reg_addr,
+       unsigned char length, unsigned char *data)
+{
+	uint64_t wait = i2c_trace_start();
+	uint64_t start;
+	int ret;
+
+	if (i2c_bus_lock(cur_bus->bus))
+		return -1;
 
-		total += result;
+	start = i2c_trace_start();
+	ret = read_reg(slave_addr, reg_addr, length, data);
+	i2c_bus_unlock(cur_bus->bus);
 
-		if (total == length)
-			break;
+	i2c_trace_record(I2C_TRACE_READ, slave_addr, reg_addr, length, wait,
+			start, ret);
 
-		tries++;		
-		linux_delay_ms(10);
+	return ret;
+}
+
+// Scatter-gather version of linux_i2c_read. All n register reads are
+// queued as write/read message pairs and issued in one ioctl.
+int linux_i2c_read_multi(linux_i2c_read_t *reads, int n)
+{
+	struct i2c_msg msgs[2 * MAX_READ_MULTI];
+	unsigned int bytes = 0;
+	uint64_t wait, start;
+	int i, ret;
+
+	if (n < 1 || n > MAX_READ_MULTI) {
+		printf("linux_i2c_read_multi() takes 1 to %d reads\n", MAX_READ_MULTI);
+		return -1;
+	}
+
+	if (cur_bus->backend) {
+		for (i = 0; i < n; i++) {
+			if (linux_i2c_read(reads[i].slave_addr, reads[i].reg_addr,
+					reads[i].length, reads[i].data))
+				return -1;
+		}
+
+		return 0;
 	}
 
-	if (total < length)
+	for (i = 0; i < n; i++) {
+		msgs[2*i].addr = reads[i].slave_addr;
+		msgs[2*i].flags = 0;
+		msgs[2*i].len = 1;
+		msgs[2*i].buf = &reads[i].reg_addr;
+
+		msgs[2*i+1].addr = reads[i].slave_addr;
+		msgs[2*i+1].flags = I2C_M_RD;
+		msgs[2*i+1].len = reads[i].length;
+		msgs[2*i+1].buf = reads[i].data;
+		bytes += reads[i].length;
+	}
+
+	// backend reads above are traced one by one in linux_i2c_read()
+	wait = i2c_trace_start();
+
+	if (i2c_bus_lock(cur_bus->bus))
 		return -1;
 
-#ifdef I2C_DEBUG
-	printf("\tLeaving linux_i2c_read(), read %d bytes: ", total);
+	start = i2c_trace_start();
+	ret = i2c_transfer(msgs, 2 * n);
+	i2c_bus_unlock(cur_bus->bus);
 
-	for (i = 0; i < total; i++)
-		printf("%02X ", data[i]); 
+	i2c_trace_record(I2C_TRACE_READ_MULTI, reads[0].slave_addr,
+			reads[0].reg_addr, bytes, wait, start, ret);
 
-	printf("\n");
-#endif
+	return ret;
+}
 
-	return 0;
+unsigned long linux_i2c_get_syscalls()
+{
+	return i2c_syscalls;
 }
 
 int linux_delay_ms(unsigned long num_ms)
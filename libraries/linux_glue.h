@@ -49,11 +49,45 @@ void __no_operation(void);
 
 void linux_set_i2c_bus(int bus);
 
+// Replaces /dev/i2c-N for a bus, used to test the drivers without
+// hardware. Same arguments as linux_i2c_write() and linux_i2c_read().
+typedef struct linux_i2c_backend_t {
+	int (*write)(void *arg, unsigned char slave_addr, unsigned char reg_addr,
+			unsigned char length, unsigned char const *data);
+	int (*read)(void *arg, unsigned char slave_addr, unsigned char reg_addr,
+			unsigned char length, unsigned char *data);
+} linux_i2c_backend_t;
+
+// One per imu. The fd and the lock belong to the bus number and are
+// shared with every other client of that bus, see i2c_bus.h
+typedef struct linux_i2c_bus_t {
+	int bus;
+	const linux_i2c_backend_t *backend;	// NULL for /dev/i2c-<bus>
+	void *backend_arg;
+} linux_i2c_bus_t;
+
+void linux_i2c_bus_init(linux_i2c_bus_t *b, int bus);
+linux_i2c_bus_t *linux_i2c_select_bus(linux_i2c_bus_t *b);
+
 int linux_i2c_write(unsigned char slave_addr, unsigned char reg_addr,
        unsigned char length, unsigned char const *data);
 
 int linux_i2c_read(unsigned char slave_addr, unsigned char reg_addr,
        unsigned char length, unsigned char *data);
+
+// one register read for linux_i2c_read_multi()
+typedef struct linux_i2c_read_t {
+	unsigned char slave_addr;
+	unsigned char reg_addr;
+	unsigned char length;
+	unsigned char *data;
+} linux_i2c_read_t;
+
+// the kernel takes at most 42 messages per I2C_RDWR, two per read
+#define MAX_READ_MULTI 21
+
+int linux_i2c_read_multi(linux_i2c_read_t *reads, int n);
+unsigned long linux_i2c_get_syscalls();
  
 int linux_delay_ms(unsigned long num_ms);
 int linux_get_ms(unsigned long *count);
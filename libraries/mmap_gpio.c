@@ -0,0 +1,198 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Memory mapped GPIO bank access, see mmap_gpio.h
+Strawson Design - 2014
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "mmap_gpio.h"
+
+const unsigned int gpio_bank_base[GPIO_BANKS] = 
+					{GPIO0_BASE, GPIO1_BASE, GPIO2_BASE, GPIO3_BASE};
+
+volatile char *gpio_map_base[GPIO_BANKS];
+int gpio_map_ready = 0;
+
+#define GPIO_REG(bank, reg) (*(volatile uint32_t*)(gpio_map_base[bank]+(reg)))
+
+// map all 4 banks from an open fd, offsets[] says where each bank starts
+int map_gpio_banks(int fd, const unsigned int offsets[GPIO_BANKS]){
+	int i;
+	for(i=0; i<GPIO_BANKS; i++){
+		gpio_map_base[i] = mmap(0, getpagesize(), PROT_READ|PROT_WRITE, \
+										MAP_SHARED, fd, offsets[i]);
+		if(gpio_map_base[i] == (void *) -1){
+			printf("Unable to mmap gpio bank %d\n", i);
+			gpio_map_base[i] = NULL;
+			mmap_gpio_cleanup();
+			return -1;
+		}
+	}
+	gpio_map_ready = 1;
+	return 0;
+}
+
+/***********************************************************************
+*	int mmap_gpio_init()
+*	map the 4 hardware gpio banks through /dev/mem
+************************************************************************/
+int mmap_gpio_init(){
+	int dev_mem, ret;
+	if(gpio_map_ready){
+		return 0;
+	}
+	if ((dev_mem = open("/dev/mem", O_RDWR | O_SYNC))==-1){
+		printf("Could not open /dev/mem \n");
+		return -1;
+	}
+	ret = map_gpio_banks(dev_mem, gpio_bank_base);
+	close(dev_mem);
+	return ret;
+}
+
+/***********************************************************************
+*	int mmap_gpio_init_file(const char *path)
+*	map an ordinary file in place of /dev/mem, one page per bank.
+*	Lets the pin to bank math and batching be checked on any linux
+*	machine by inspecting the SETDATAOUT and CLEARDATAOUT words written
+*	to the file. Nothing is driven, it's just memory.
+************************************************************************/
+int mmap_gpio_init_file(const char *path){
+	int fd, i, ret;
+	unsigned int offsets[GPIO_BANKS];
+	if(gpio_map_ready){
+		mmap_gpio_cleanup();
+	}
+	if((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1){
+		printf("Could not open %s\n", path);
+		return -1;
+	}
+	if(ftruncate(fd, GPIO_BANKS*getpagesize())){
+		printf("Could not size %s\n", path);
+		close(fd);
+		return -1;
+	}
+	for(i=0; i<GPIO_BANKS; i++){
+		offsets[i] = i*getpagesize();
+	}
+	ret = map_gpio_banks(fd, offsets);
+	close(fd);
+	return ret;
+}
+
+int mmap_gpio_is_ready(){
+	return gpio_map_ready;
+}
+
+int mmap_gpio_cleanup(){
+	int i;
+	for(i=0; i<GPIO_BANKS; i++){
+		if(gpio_map_base[i] != NULL){
+			munmap((void*)gpio_map_base[i], getpagesize());
+			gpio_map_base[i] = NULL;
+		}
+	}
+	gpio_map_ready = 0;
+	return 0;
+}
+
+/***********************************************************************
+*	single pin access, one register store or load
+************************************************************************/
+int mmap_gpio_write(unsigned int gpio, PIN_VALUE value){
+	if(!gpio_map_ready || GPIO_BANK(gpio)>=GPIO_BANKS){
+		return -1;
+	}
+	if(value==LOW){
+		GPIO_REG(GPIO_BANK(gpio), GPIO_CLEARDATAOUT) = GPIO_BIT(gpio);
+	}
+	else{
+		GPIO_REG(GPIO_BANK(gpio), GPIO_SETDATAOUT) = GPIO_BIT(gpio);
+	}
+	return 0;
+}
+
+int mmap_gpio_read(unsigned int gpio){
+	if(!gpio_map_ready || GPIO_BANK(gpio)>=GPIO_BANKS){
+		return -1;
+	}
+	return (GPIO_REG(GPIO_BANK(gpio), GPIO_DATAIN) & GPIO_BIT(gpio)) != 0;
+}
+
+/***********************************************************************
+*	batched writes
+*	collect any number of pins with mmap_gpio_batch_add() then 
+*	mmap_gpio_batch_commit() does at most one CLEARDATAOUT and one
+*	SETDATAOUT store per bank. Clears go first so an H-bridge input
+*	pair passes through LOW/LOW (coast) rather than HIGH/HIGH.
+************************************************************************/
+void mmap_gpio_batch_reset(mmap_gpio_batch_t *batch){
+	memset(batch, 0, sizeof(mmap_gpio_batch_t));
+}
+
+int mmap_gpio_batch_add(mmap_gpio_batch_t *batch, unsigned int gpio, PIN_VALUE value){
+	unsigned int bank = GPIO_BANK(gpio);
+	if(bank>=GPIO_BANKS){
+		printf("gpio %d is not in banks 0-3\n", gpio);
+		return -1;
+	}
+	if(value==LOW){
+		batch->clear[bank] |= GPIO_BIT(gpio);
+		batch->set[bank] &= ~GPIO_BIT(gpio);
+	}
+	else{
+		batch->set[bank] |= GPIO_BIT(gpio);
+		batch->clear[bank] &= ~GPIO_BIT(gpio);
+	}
+	return 0;
+}
+
+int mmap_gpio_batch_commit(mmap_gpio_batch_t *batch){
+	int i;
+	if(!gpio_map_ready){
+		return -1;
+	}
+	for(i=0; i<GPIO_BANKS; i++){
+		if(batch->clear[i]){
+			GPIO_REG(i, GPIO_CLEARDATAOUT) = batch->clear[i];
+		}
+	}
+	for(i=0; i<GPIO_BANKS; i++){
+		if(batch->set[i]){
+			GPIO_REG(i, GPIO_SETDATAOUT) = batch->set[i];
+		}
+	}
+	return 0;
+}
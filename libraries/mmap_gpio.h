@@ -0,0 +1,82 @@
+/*
+Copyright (c) 2014, James Strawson
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Memory mapped access to the AM335x GPIO0-3 banks through /dev/mem.
+Pins must still be exported and set as outputs through sysfs first so
+the kernel sets up the pinmux and bank clocks, after that data writes
+go straight to the bank registers with no system call.
+Strawson Design - 2014
+*/
+
+#ifndef MMAP_GPIO_H
+#define MMAP_GPIO_H
+
+#include <stdint.h>
+#include "SimpleGPIO.h"
+
+#define GPIO_BANKS			4
+#define GPIO_PINS_PER_BANK	32
+
+//// bank base addresses
+#define GPIO0_BASE	0x44E07000
+#define GPIO1_BASE	0x4804C000
+#define GPIO2_BASE	0x481AC000
+#define GPIO3_BASE	0x481AE000
+
+//// register offsets from each bank's base address
+#define GPIO_OE				0x134
+#define GPIO_DATAIN			0x138
+#define GPIO_DATAOUT		0x13C
+#define GPIO_CLEARDATAOUT	0x190
+#define GPIO_SETDATAOUT		0x194
+
+// gpio # for gpio_a.b = (32*a)+b
+#define GPIO_BANK(gpio)	((gpio)/GPIO_PINS_PER_BANK)
+#define GPIO_BIT(gpio)	(1u<<((gpio)%GPIO_PINS_PER_BANK))
+
+// pins to set and clear, collected per bank then written in one pass
+typedef struct mmap_gpio_batch_t {
+	uint32_t set[GPIO_BANKS];
+	uint32_t clear[GPIO_BANKS];
+} mmap_gpio_batch_t;
+
+int mmap_gpio_init();
+int mmap_gpio_init_file(const char *path);
+int mmap_gpio_is_ready();
+int mmap_gpio_cleanup();
+
+int mmap_gpio_write(unsigned int gpio, PIN_VALUE value);
+int mmap_gpio_read(unsigned int gpio);
+
+void mmap_gpio_batch_reset(mmap_gpio_batch_t *batch);
+int mmap_gpio_batch_add(mmap_gpio_batch_t *batch, unsigned int gpio, PIN_VALUE value);
+int mmap_gpio_batch_commit(mmap_gpio_batch_t *batch);
+
+#endif
@@ -24,19 +24,136 @@
 #include <stdio.h>
 #include <string.h>
 #include "mpu9150.h"
+#include "robotics_cape.h"	// cape_monotonic_ns()
 
-int debug_on;
-int yaw_mixing_factor;
+static mpu9150_state_t default_state = {
+	.raw_orientation = { 1, 0, 0,
+	                     0, 1, 0,
+	                     0, 0, 1 }
+};
 
-int use_accel_cal;
-caldata_t accel_cal_data;
-
-int use_mag_cal;
-caldata_t mag_cal_data;
+// every function works on the state the calling thread selected with
+// mpu9150_select_state()
+static __thread mpu9150_state_t *cur = &default_state;
 
 void mpu9150_set_debug(int on)
 {
-	debug_on = on;
+	cur->debug_on = on;
+}
+
+// Clear state for another IMU. The orientation starts as identity.
+void mpu9150_state_init(mpu9150_state_t *state)
+{
+	int i;
+
+	memset(state, 0, sizeof(mpu9150_state_t));
+
+	for (i = 0; i < 3; i++)
+		state->raw_orientation[4*i] = 1;
+}
+
+// NULL selects the default state, returns the one selected before.
+// Not thread safe on its own, see imu_lock().
+mpu9150_state_t *mpu9150_select_state(mpu9150_state_t *state)
+{
+	mpu9150_state_t *prev = cur;
+
+	cur = state ? state : &default_state;
+
+	return prev;
+}
+
+void mpu9150_set_yaw_mixing_factor(int mix_factor)
+{
+	cur->yaw_mixing_factor = mix_factor;
+}
+
+// When on, the read functions assume the caller was woken by the DMP
+// interrupt and skip the data_ready() status read. The FIFO count, which is
+// read anyway, is checked instead and mismatches go in the stats.
+void mpu9150_trust_interrupt(int on)
+{
+	cur->trust_interrupt = on;
+}
+
+// Called by imu_interrupt_handler() with the time poll() returned, and
+// with 0 once the interrupt function is done. Also keeps the period stats.
+void mpu9150_set_interrupt_time(uint64_t ns)
+{
+	uint64_t period;
+
+	cur->interrupt_ns = ns;
+
+	if (ns == 0)
+		return;
+
+	if (cur->last_interrupt_ns) {
+		period = ns - cur->last_interrupt_ns;
+
+		if (cur->read_stats.periods == 0 || period < cur->read_stats.period_min_ns)
+			cur->read_stats.period_min_ns = period;
+
+		if (period > cur->read_stats.period_max_ns)
+			cur->read_stats.period_max_ns = period;
+
+		cur->period_sum += period;
+		cur->period_sum_sq += (double)period * period;
+		cur->read_stats.periods++;
+	}
+
+	cur->last_interrupt_ns = ns;
+}
+
+void mpu9150_get_stats(mpu9150_stats_t *stats)
+{
+	double mean, var;
+
+	memcpy(stats, &cur->read_stats, sizeof(mpu9150_stats_t));
+
+	if (cur->read_stats.periods) {
+		mean = cur->period_sum / cur->read_stats.periods;
+		var = cur->period_sum_sq / cur->read_stats.periods - mean * mean;
+		stats->period_mean_ns = mean;
+		stats->period_jitter_ns = var > 0 ? sqrt(var) : 0;
+	}
+}
+
+// Time of the newest packet in the fifo, the interrupt edge if there was
+// one, otherwise now.
+static uint64_t newest_sample_ns()
+{
+	return cur->interrupt_ns ? cur->interrupt_ns : cape_monotonic_ns();
+}
+
+// depth is the number of packets that were queued behind this one
+static uint64_t sample_time_ns(uint64_t newest, unsigned int depth, unsigned short rate)
+{
+	if (rate == 0)
+		return newest;
+
+	return newest - (uint64_t)depth * 1000000000ULL / rate;
+}
+
+// data_ready() unless the interrupt is trusted
+static int fifo_ready()
+{
+	if (!cur->trust_interrupt)
+		return data_ready();
+
+	cur->read_stats.reads++;
+	return 1;
+}
+
+// check a trusted interrupt against what the fifo actually held
+static void check_fifo_count(unsigned short count, unsigned short more)
+{
+	if (!cur->trust_interrupt)
+		return;
+
+	if (count == 0)
+		cur->read_stats.empty++;
+	else if (count + more > 1)
+		cur->read_stats.backlog++;
 }
 
 int mpu9150_init(int i2c_bus, int sample_rate, int mix_factor)
@@ -60,7 +177,7 @@ int mpu9150_init(int i2c_bus, int sample_rate, int mix_factor)
 		return -1;
 	}
 
-	yaw_mixing_factor = mix_factor;
+	cur->yaw_mixing_factor = mix_factor;
 
 	linux_set_i2c_bus(i2c_bus);
 
@@ -165,31 +282,42 @@ void mpu9150_set_accel_cal(caldata_t *cal)
 	long bias[3];
 
 	if (!cal) {
-		use_accel_cal = 0;
+		cur->use_accel_cal = 0;
 		return;
 	}
 
-	memcpy(&accel_cal_data, cal, sizeof(caldata_t));
+	memcpy(&cur->accel_cal_data, cal, sizeof(caldata_t));
 
 	for (i = 0; i < 3; i++) {
-		if (accel_cal_data.range[i] < 1)
-			accel_cal_data.range[i] = 1;
-		else if (accel_cal_data.range[i] > ACCEL_SENSOR_RANGE)
-			accel_cal_data.range[i] = ACCEL_SENSOR_RANGE;
+		if (cur->accel_cal_data.range[i] < 1)
+			cur->accel_cal_data.range[i] = 1;
+		else if (cur->accel_cal_data.range[i] > ACCEL_SENSOR_RANGE)
+			cur->accel_cal_data.range[i] = ACCEL_SENSOR_RANGE;
 
-		bias[i] = -accel_cal_data.offset[i];
+		bias[i] = -cur->accel_cal_data.offset[i];
 	}
 
-	if (debug_on) {
+	if (cur->debug_on) {
 		printf("\naccel cal (range : offset)\n");
 
 		for (i = 0; i < 3; i++)
-			printf("%d : %d\n", accel_cal_data.range[i], accel_cal_data.offset[i]);
+			printf("%d : %d\n", cur->accel_cal_data.range[i], cur->accel_cal_data.offset[i]);
 	}
 
 	mpu_set_accel_bias(bias);
 
-	use_accel_cal = 1;
+	cur->use_accel_cal = 1;
+}
+
+// the accel offset lives in the chip's bias registers, so raw samples
+// are relative to it. Returns -1 if no accel cal is loaded.
+int mpu9150_get_accel_cal(caldata_t *cal)
+{
+	if (!cur->use_accel_cal)
+		return -1;
+
+	memcpy(cal, &cur->accel_cal_data, sizeof(caldata_t));
+	return 0;
 }
 
 void mpu9150_set_mag_cal(caldata_t *cal)
@@ -197,55 +325,125 @@ void mpu9150_set_mag_cal(caldata_t *cal)
 	int i;
 
 	if (!cal) {
-		use_mag_cal = 0;
+		cur->use_mag_cal = 0;
 		return;
 	}
 
-	memcpy(&mag_cal_data, cal, sizeof(caldata_t));
+	memcpy(&cur->mag_cal_data, cal, sizeof(caldata_t));
 
 	for (i = 0; i < 3; i++) {
-		if (mag_cal_data.range[i] < 1)
-			mag_cal_data.range[i] = 1;
-		else if (mag_cal_data.range[i] > MAG_SENSOR_RANGE)
-			mag_cal_data.range[i] = MAG_SENSOR_RANGE;
-
-		if (mag_cal_data.offset[i] < -MAG_SENSOR_RANGE)
-			mag_cal_data.offset[i] = -MAG_SENSOR_RANGE;
-		else if (mag_cal_data.offset[i] > MAG_SENSOR_RANGE)
-			mag_cal_data.offset[i] = MAG_SENSOR_RANGE;
+		if (cur->mag_cal_data.range[i] < 1)
+			cur->mag_cal_data.range[i] = 1;
+		else if (cur->mag_cal_data.range[i] > MAG_SENSOR_RANGE)
+			cur->mag_cal_data.range[i] = MAG_SENSOR_RANGE;
+
+		if (cur->mag_cal_data.offset[i] < -MAG_SENSOR_RANGE)
+			cur->mag_cal_data.offset[i] = -MAG_SENSOR_RANGE;
+		else if (cur->mag_cal_data.offset[i] > MAG_SENSOR_RANGE)
+			cur->mag_cal_data.offset[i] = MAG_SENSOR_RANGE;
 	}
 
-	if (debug_on) {
+	if (cur->debug_on) {
 		printf("\nmag cal (range : offset)\n");
 
 		for (i = 0; i < 3; i++)
-			printf("%d : %d\n", mag_cal_data.range[i], mag_cal_data.offset[i]);
+			printf("%d : %d\n", cur->mag_cal_data.range[i], cur->mag_cal_data.offset[i]);
 	}
 
-	use_mag_cal = 1;
+	cur->use_mag_cal = 1;
 }
 
-int mpu9150_read_dmp(mpudata_t *mpu)
+// Drains the FIFO with one count read and burst reads of whole packets.
+// Every sample is decoded into samples[], oldest first, each with its own
+// dmpTimestamp. Returns the number of samples or -1 on error. If the FIFO
+// holds more than max_samples packets the oldest are kept and the rest are
+// left for the next call.
+int mpu9150_read_dmp_batch(mpudata_t *samples, int max_samples)
 {
-	short sensors;
-	unsigned char more;
+	short gyro[DMP_MAX_BATCH][3];
+	short accel[DMP_MAX_BATCH][3];
+	long quat[DMP_MAX_BATCH][4];
+	unsigned long timestamp[DMP_MAX_BATCH];
+	short sensors[DMP_MAX_BATCH];
+	unsigned short count, more, rate;
+	uint64_t newest;
+	int i;
+
+	if (max_samples < 1)
+		return -1;
+
+	if (max_samples > DMP_MAX_BATCH)
+		max_samples = DMP_MAX_BATCH;
+
+	if (!fifo_ready())
+		return -1;
 
-	if (!data_ready())
+	newest = newest_sample_ns();
+	dmp_get_fifo_rate(&rate);
+
+	if (dmp_read_fifo_multi(max_samples, gyro, accel, quat, timestamp, sensors, &count, &more) < 0) {
+		printf("dmp_read_fifo_multi() failed\n");
 		return -1;
+	}
 
-	if (dmp_read_fifo(mpu->rawGyro, mpu->rawAccel, mpu->rawQuat, &mpu->dmpTimestamp, &sensors, &more) < 0) {
-		printf("dmp_read_fifo() failed\n");
+	check_fifo_count(count, more);
+
+	if (count == 0)
 		return -1;
+
+	for (i = 0; i < count; i++) {
+		memcpy(samples[i].rawGyro, gyro[i], sizeof(gyro[i]));
+		memcpy(samples[i].rawAccel, accel[i], sizeof(accel[i]));
+		memcpy(samples[i].rawQuat, quat[i], sizeof(quat[i]));
+		samples[i].dmpTimestamp = timestamp[i];
+		samples[i].sampleTimeNs = sample_time_ns(newest, count + more - 1 - i, rate);
 	}
 
+	return count;
+}
+
+int mpu9150_read_dmp(mpudata_t *mpu)
+{
+	short gyro[DMP_MAX_BATCH][3];
+	short accel[DMP_MAX_BATCH][3];
+	long quat[DMP_MAX_BATCH][4];
+	unsigned long timestamp[DMP_MAX_BATCH];
+	short sensors[DMP_MAX_BATCH];
+	unsigned short count, more;
+	int last;
+	uint64_t newest;
+
+	if (!fifo_ready())
+		return -1;
+
+	newest = newest_sample_ns();
+
+	if (dmp_read_fifo_multi(DMP_MAX_BATCH, gyro, accel, quat, timestamp, sensors, &count, &more) < 0) {
+		printf("dmp_read_fifo_multi() failed\n");
+		return -1;
+	}
+
+	check_fifo_count(count, more);
+
+	if (count == 0)
+		return -1;
+
+	// one burst normally empties the fifo, only loop if it was overfull
 	while (more) {
-		// Fell behind, reading again
-		if (dmp_read_fifo(mpu->rawGyro, mpu->rawAccel, mpu->rawQuat, &mpu->dmpTimestamp, &sensors, &more) < 0) {
-			printf("dmp_read_fifo() failed\n");
+		if (dmp_read_fifo_multi(DMP_MAX_BATCH, gyro, accel, quat, timestamp, sensors, &count, &more) < 0) {
+			printf("dmp_read_fifo_multi() failed\n");
 			return -1;
 		}
 	}
 
+	// only the newest sample is wanted here
+	last = count - 1;
+	memcpy(mpu->rawGyro, gyro[last], sizeof(gyro[last]));
+	memcpy(mpu->rawAccel, accel[last], sizeof(accel[last]));
+	memcpy(mpu->rawQuat, quat[last], sizeof(quat[last]));
+	mpu->dmpTimestamp = timestamp[last];
+	mpu->sampleTimeNs = newest;
+
 	return 0;
 }
 
@@ -259,12 +457,46 @@ int mpu9150_read_mag(mpudata_t *mpu)
 	return 0;
 }
 
+// The compass runs at mpu_get_compass_sample_rate(), at most 100hz and
+// often half the DMP rate, so reading it on every sample mostly returns
+// the same data. Only read it once per compass period and otherwise fill
+// rawMag from the cache. A not-ready compass keeps the cached sample.
+static int read_mag_cached(mpudata_t *mpu)
+{
+	unsigned short rate;
+	unsigned long now;
+	int ret;
+
+	get_ms(&now);
+
+	if (mpu_get_compass_sample_rate(&rate) || rate == 0)
+		rate = MAX_SAMPLE_RATE;
+
+	if (!cur->mag_cached || now - cur->cached_mag_timestamp >= 1000 / rate) {
+		ret = mpu_get_compass_reg(cur->cached_mag, &cur->cached_mag_timestamp);
+
+		if (ret == 0) {
+			cur->mag_cached = 1;
+			cur->read_stats.mag_reads++;
+		}
+		else if (ret != -2 || !cur->mag_cached) {
+			printf("mpu_get_compass_reg() failed\n");
+			return -1;
+		}
+	}
+
+	memcpy(mpu->rawMag, cur->cached_mag, sizeof(mpu->rawMag));
+	mpu->magTimestamp = cur->cached_mag_timestamp;
+
+	return 0;
+}
+
 int mpu9150_read(mpudata_t *mpu)
 {
 	if (mpu9150_read_dmp(mpu) != 0)
 		return -1;
 
-	if (mpu9150_read_mag(mpu) != 0)
+	if (read_mag_cached(mpu) != 0)
 		return -1;
 
 	calibrate_data(mpu);
@@ -272,6 +504,128 @@ int mpu9150_read(mpudata_t *mpu)
 	return data_fusion(mpu);
 }
 
+// Same as mpu9150_read but every sample waiting in the FIFO is calibrated
+// and fused into samples[], oldest first. The compass is read once and
+// shared by the batch. mpu carries the yaw state between calls and is left
+// holding the newest sample so code reading it directly still works.
+// Returns the number of samples or -1 on error.
+int mpu9150_read_batch(mpudata_t *mpu, mpudata_t *samples, int max_samples)
+{
+	int i, n;
+
+	n = mpu9150_read_dmp_batch(samples, max_samples);
+	if (n <= 0)
+		return -1;
+
+	if (read_mag_cached(mpu) != 0)
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		memcpy(mpu->rawGyro, samples[i].rawGyro, sizeof(mpu->rawGyro));
+		memcpy(mpu->rawAccel, samples[i].rawAccel, sizeof(mpu->rawAccel));
+		memcpy(mpu->rawQuat, samples[i].rawQuat, sizeof(mpu->rawQuat));
+		mpu->dmpTimestamp = samples[i].dmpTimestamp;
+		mpu->sampleTimeNs = samples[i].sampleTimeNs;
+
+		calibrate_data(mpu);
+
+		if (data_fusion(mpu) != 0)
+			return -1;
+
+		memcpy(&samples[i], mpu, sizeof(mpudata_t));
+	}
+
+	return n;
+}
+
+void mpu9150_set_orientation(const signed char *orientation)
+{
+	memcpy(cur->raw_orientation, orientation, sizeof(cur->raw_orientation));
+}
+
+static void orient(short *v)
+{
+	short in[3];
+	int i;
+
+	memcpy(in, v, sizeof(in));
+
+	for (i = 0; i < 3; i++)
+		v[i] = cur->raw_orientation[3*i] * in[0] + cur->raw_orientation[3*i+1] * in[1]
+			+ cur->raw_orientation[3*i+2] * in[2];
+}
+
+// calibrate_data() swaps the compass axes onto the MPU's and flips x the
+// same way it does for calibratedAccel. Undo the flip so the rotation is
+// applied in chip axes like orient() is for gyro and accel, then redo it.
+static void orient_mag(short *v)
+{
+	v[VEC3_X] = -v[VEC3_X];
+	orient(v);
+	v[VEC3_X] = -v[VEC3_X];
+}
+
+// Raw FIFO mode, DMP off. Drains every gyro/accel packet waiting in the
+// FIFO into samples[], oldest first, rotated by the orientation matrix.
+// The compass is filled in from the cache and calibrate_data() is run on
+// each sample. rawMag stays in compass axes for calibrate_imu, the rotation
+// is applied to calibratedMag so it lines up with calibratedAccel. There
+// is no DMP quaternion so attitude is left to the caller. Returns the
+// number of samples, 0 if the FIFO was empty or -1 on error.
+int mpu9150_read_raw(mpudata_t *samples, int max_samples)
+{
+	short gyro[MPU_MAX_BATCH][3];
+	short accel[MPU_MAX_BATCH][3];
+	unsigned long timestamp[MPU_MAX_BATCH];
+	unsigned char sensors;
+	unsigned short count, more, rate;
+	uint64_t newest;
+	mpudata_t mag;
+	int i;
+
+	if (max_samples < 1)
+		return -1;
+
+	if (max_samples > MPU_MAX_BATCH)
+		max_samples = MPU_MAX_BATCH;
+
+	// no int status check here, the DMP bits data_ready() looks for are
+	// never set with the DMP off. The fifo count says what is there.
+	if (cur->trust_interrupt)
+		cur->read_stats.reads++;
+
+	newest = newest_sample_ns();
+	mpu_get_sample_rate(&rate);
+
+	if (mpu_read_fifo_multi(max_samples, gyro, accel, timestamp, &sensors, &count, &more) < 0) {
+		printf("mpu_read_fifo_multi() failed\n");
+		return -1;
+	}
+
+	check_fifo_count(count, more);
+
+	if (count == 0)
+		return 0;
+
+	if (read_mag_cached(&mag) != 0)
+		return -1;
+
+	for (i = 0; i < count; i++) {
+		orient(gyro[i]);
+		orient(accel[i]);
+		memcpy(samples[i].rawGyro, gyro[i], sizeof(gyro[i]));
+		memcpy(samples[i].rawAccel, accel[i], sizeof(accel[i]));
+		samples[i].dmpTimestamp = timestamp[i];
+		samples[i].sampleTimeNs = sample_time_ns(newest, count + more - 1 - i, rate);
+		memcpy(samples[i].rawMag, mag.rawMag, sizeof(mag.rawMag));
+		samples[i].magTimestamp = mag.magTimestamp;
+		calibrate_data(&samples[i]);
+		orient_mag(samples[i].calibratedMag);
+	}
+
+	return count;
+}
+
 int data_ready()
 {
 	short status;
@@ -290,15 +644,15 @@ int data_ready()
 
 void calibrate_data(mpudata_t *mpu)
 {
-	if (use_mag_cal) {
-      mpu->calibratedMag[VEC3_Y] = -(short)(((long)(mpu->rawMag[VEC3_X] - mag_cal_data.offset[VEC3_X])
-			* (long)MAG_SENSOR_RANGE) / (long)mag_cal_data.range[VEC3_X]);
+	if (cur->use_mag_cal) {
+      mpu->calibratedMag[VEC3_Y] = -(short)(((long)(mpu->rawMag[VEC3_X] - cur->mag_cal_data.offset[VEC3_X])
+			* (long)MAG_SENSOR_RANGE) / (long)cur->mag_cal_data.range[VEC3_X]);
 
-      mpu->calibratedMag[VEC3_X] = (short)(((long)(mpu->rawMag[VEC3_Y] - mag_cal_data.offset[VEC3_Y])
-			* (long)MAG_SENSOR_RANGE) / (long)mag_cal_data.range[VEC3_Y]);
+      mpu->calibratedMag[VEC3_X] = (short)(((long)(mpu->rawMag[VEC3_Y] - cur->mag_cal_data.offset[VEC3_Y])
+			* (long)MAG_SENSOR_RANGE) / (long)cur->mag_cal_data.range[VEC3_Y]);
 
-      mpu->calibratedMag[VEC3_Z] = (short)(((long)(mpu->rawMag[VEC3_Z] - mag_cal_data.offset[VEC3_Z])
-			* (long)MAG_SENSOR_RANGE) / (long)mag_cal_data.range[VEC3_Z]);
+      mpu->calibratedMag[VEC3_Z] = (short)(((long)(mpu->rawMag[VEC3_Z] - cur->mag_cal_data.offset[VEC3_Z])
+			* (long)MAG_SENSOR_RANGE) / (long)cur->mag_cal_data.range[VEC3_Z]);
 	}
 	else {
 		mpu->calibratedMag[VEC3_Y] = -mpu->rawMag[VEC3_X];
@@ -306,15 +660,15 @@ void calibrate_data(mpudata_t *mpu)
 		mpu->calibratedMag[VEC3_Z] = mpu->rawMag[VEC3_Z];
 	}
 
-	if (use_accel_cal) {
+	if (cur->use_accel_cal) {
       mpu->calibratedAccel[VEC3_X] = -(short)(((long)mpu->rawAccel[VEC3_X] * (long)ACCEL_SENSOR_RANGE)
-			/ (long)accel_cal_data.range[VEC3_X]);
+			/ (long)cur->accel_cal_data.range[VEC3_X]);
 
       mpu->calibratedAccel[VEC3_Y] = (short)(((long)mpu->rawAccel[VEC3_Y] * (long)ACCEL_SENSOR_RANGE)
-			/ (long)accel_cal_data.range[VEC3_Y]);
+			/ (long)cur->accel_cal_data.range[VEC3_Y]);
 
       mpu->calibratedAccel[VEC3_Z] = (short)(((long)mpu->rawAccel[VEC3_Z] * (long)ACCEL_SENSOR_RANGE)
-			/ (long)accel_cal_data.range[VEC3_Z]);
+			/ (long)cur->accel_cal_data.range[VEC3_Z]);
 	}
 	else {
 		mpu->calibratedAccel[VEC3_X] = -mpu->rawAccel[VEC3_X];
@@ -333,22 +687,178 @@ void tilt_compensate(quaternion_t magQ, quaternion_t unfusedQ)
 	quaternionMultiply(unfusedQ, tempQ, magQ);
 }
 
+// Steps the fused yaw by the DMP's yaw change and pulls it toward the
+// tilt compensated compass heading by 1/yaw_mixing_factor. Both yaws are
+// in radians with the sign already flipped to match fusedEuler.
+static float fuse_yaw(mpudata_t *mpu, float dmpYaw, float newMagYaw)
+{
+	float deltaDMPYaw;
+	float deltaMagYaw;
+	float newYaw;
+
+	deltaDMPYaw = -dmpYaw + mpu->lastDMPYaw;
+	mpu->lastDMPYaw = dmpYaw;
+
+	if (newMagYaw < 0.0f)
+		newMagYaw = TWO_PI + newMagYaw;
+
+	newYaw = mpu->lastYaw + deltaDMPYaw;
+
+	if (newYaw > TWO_PI)
+		newYaw -= TWO_PI;
+	else if (newYaw < 0.0f)
+		newYaw += TWO_PI;
+	 
+	deltaMagYaw = newMagYaw - newYaw;
+	
+	if (deltaMagYaw >= (float)M_PI)
+		deltaMagYaw -= TWO_PI;
+	else if (deltaMagYaw < -(float)M_PI)
+		deltaMagYaw += TWO_PI;
+
+	if (cur->yaw_mixing_factor > 0)
+		newYaw += deltaMagYaw / cur->yaw_mixing_factor;
+
+	if (newYaw > TWO_PI)
+		newYaw -= TWO_PI;
+	else if (newYaw < 0.0f)
+		newYaw += TWO_PI;
+
+	mpu->lastYaw = newYaw;
+
+	if (newYaw > (float)M_PI)
+		newYaw -= TWO_PI;
+
+	return newYaw;
+}
+
+// cos and sin of half an angle from the angle's cos and sin, a in (-pi, pi]
+static void half_angle(float c, float s, float *ch, float *sh)
+{
+	if (c >= 0.0f) {
+		*ch = sqrtf(0.5f * (1.0f + c));
+		*sh = s / (2.0f * *ch);
+	}
+	else {
+		*sh = sqrtf(0.5f * (1.0f - c));
+		if (s < 0.0f)
+			*sh = -*sh;
+		*ch = s / (2.0f * *sh);
+	}
+}
+
+// Same result as data_fusion_euler() without the Euler round trips. The
+// roll and pitch rotation is built straight from the DMP quaternion's
+// rotation matrix terms, the compass is rotated by that matrix and the
+// output quaternion is assembled from half angles. That is asinf, three
+// atan2f and one sinf/cosf pair per sample instead of sixteen
+// transcendental calls. Near +-90 degrees pitch the last roll is held and,
+// like data_fusion_euler(), used for the compass and fusedQuat too.
 int data_fusion(mpudata_t *mpu)
+{
+	float w, x, y, z, inv;
+	float sp, cp, sr, cr, rx, ry;
+	float mx, my, mz, vx, vy;
+	float cr2, sr2, cp2, sp2, cy2, sy2;
+	float uw, ux, uy, uz;
+	float dmpYaw, newMagYaw, newYaw;
+	float pole = (float)M_PI / 2.0f - 0.05f;
+
+	w = (float)mpu->rawQuat[QUAT_W];
+	x = (float)mpu->rawQuat[QUAT_X];
+	y = (float)mpu->rawQuat[QUAT_Y];
+	z = (float)mpu->rawQuat[QUAT_Z];
+
+	// the terms below are all quadratic so 1/|q|^2 stands in for normalizing
+	inv = w * w + x * x + y * y + z * z;
+	if (inv == 0.0f)
+		return -1;
+	inv = 1.0f / inv;
+
+	sp = 2.0f * (w * y - x * z) * inv;
+	if (sp > 1.0f)
+		sp = 1.0f;
+	else if (sp < -1.0f)
+		sp = -1.0f;
+
+	ry = 2.0f * (y * z + w * x) * inv;
+	rx = (w * w - x * x - y * y + z * z) * inv;
+	cp = sqrtf(rx * rx + ry * ry);
+
+	if (cp > 0.0f) {
+		cr = rx / cp;
+		sr = ry / cp;
+	}
+	else {
+		cr = 1.0f;
+		sr = 0.0f;
+	}
+
+	// Euler outputs, computed once
+	mpu->fusedEuler[VEC3_Y] = -asinf(sp);
+	if (mpu->fusedEuler[VEC3_Y] < pole && mpu->fusedEuler[VEC3_Y] > -pole) {
+		mpu->fusedEuler[VEC3_X] = atan2f(ry, rx);
+	}
+	else {
+		cr = cosf(mpu->fusedEuler[VEC3_X]);
+		sr = sinf(mpu->fusedEuler[VEC3_X]);
+	}
+
+	dmpYaw = atan2f(2.0f * (x * y + w * z) * inv, (w * w + x * x - y * y - z * z) * inv);
+
+	// tilt compensate the compass, Ry(-pitch) * Rx(roll) * mag
+	mx = mpu->calibratedMag[VEC3_X];
+	my = mpu->calibratedMag[VEC3_Y];
+	mz = mpu->calibratedMag[VEC3_Z];
+	vx = cp * mx - sp * (sr * my + cr * mz);
+	vy = cr * my - sr * mz;
+
+	newMagYaw = -atan2f(vy, vx);
+
+	if (newMagYaw != newMagYaw) {
+		printf("newMagYaw NAN\n");
+		return -1;
+	}
+
+	newYaw = fuse_yaw(mpu, dmpYaw, newMagYaw);
+	mpu->fusedEuler[VEC3_Z] = newYaw;
+
+	// fusedQuat = qz(yaw) * qy(-pitch) * qx(roll)
+	half_angle(cr, sr, &cr2, &sr2);
+	half_angle(cp, -sp, &cp2, &sp2);
+	uw = cp2 * cr2;
+	ux = cp2 * sr2;
+	uy = sp2 * cr2;
+	uz = -sp2 * sr2;
+
+	cy2 = cosf(0.5f * newYaw);
+	sy2 = sinf(0.5f * newYaw);
+	mpu->fusedQuat[QUAT_W] = cy2 * uw - sy2 * uz;
+	mpu->fusedQuat[QUAT_X] = cy2 * ux - sy2 * uy;
+	mpu->fusedQuat[QUAT_Y] = cy2 * uy + sy2 * ux;
+	mpu->fusedQuat[QUAT_Z] = cy2 * uz + sy2 * uw;
+
+	return 0;
+}
+
+// The original Euler angle implementation, kept as the reference for
+// data_fusion(). See the benchmark_fusion example.
+int data_fusion_euler(mpudata_t *mpu)
 {
 	quaternion_t dmpQuat;
 	vector3d_t dmpEuler;
 	quaternion_t magQuat;
 	quaternion_t unfusedQuat;
-	float deltaDMPYaw;
-	float deltaMagYaw;
 	float newMagYaw;
-	float newYaw;
 	
 	dmpQuat[QUAT_W] = (float)mpu->rawQuat[QUAT_W];
 	dmpQuat[QUAT_X] = (float)mpu->rawQuat[QUAT_X];
 	dmpQuat[QUAT_Y] = (float)mpu->rawQuat[QUAT_Y];
 	dmpQuat[QUAT_Z] = (float)mpu->rawQuat[QUAT_Z];
 
+	// roll is left alone near the poles, hold the last one
+	dmpEuler[VEC3_X] = mpu->fusedEuler[VEC3_X];
+
 	quaternionNormalize(dmpQuat);	
 	quaternionToEuler(dmpQuat, dmpEuler);
 
@@ -358,9 +868,6 @@ int data_fusion(mpudata_t *mpu)
 
 	eulerToQuaternion(mpu->fusedEuler, unfusedQuat);
 
-	deltaDMPYaw = -dmpEuler[VEC3_Z] + mpu->lastDMPYaw;
-	mpu->lastDMPYaw = dmpEuler[VEC3_Z];
-
 	magQuat[QUAT_W] = 0;
 	magQuat[QUAT_X] = mpu->calibratedMag[VEC3_X];
   	magQuat[QUAT_Y] = mpu->calibratedMag[VEC3_Y];
@@ -375,37 +882,7 @@ int data_fusion(mpudata_t *mpu)
 		return -1;
 	}
 
-	if (newMagYaw < 0.0f)
-		newMagYaw = TWO_PI + newMagYaw;
-
-	newYaw = mpu->lastYaw + deltaDMPYaw;
-
-	if (newYaw > TWO_PI)
-		newYaw -= TWO_PI;
-	else if (newYaw < 0.0f)
-		newYaw += TWO_PI;
-	 
-	deltaMagYaw = newMagYaw - newYaw;
-	
-	if (deltaMagYaw >= (float)M_PI)
-		deltaMagYaw -= TWO_PI;
-	else if (deltaMagYaw < -(float)M_PI)
-		deltaMagYaw += TWO_PI;
-
-	if (yaw_mixing_factor > 0)
-		newYaw += deltaMagYaw / yaw_mixing_factor;
-
-	if (newYaw > TWO_PI)
-		newYaw -= TWO_PI;
-	else if (newYaw < 0.0f)
-		newYaw += TWO_PI;
-
-	mpu->lastYaw = newYaw;
-
-	if (newYaw > (float)M_PI)
-		newYaw -= TWO_PI;
-
-	mpu->fusedEuler[VEC3_Z] = newYaw;
+	mpu->fusedEuler[VEC3_Z] = fuse_yaw(mpu, dmpEuler[VEC3_Z], newMagYaw);
 
 	eulerToQuaternion(mpu->fusedEuler, mpu->fusedQuat);
 
@@ -27,6 +27,7 @@
 #ifndef MPU9150_H
 #define MPU9150_H
 
+#include <stdint.h>
 #include "quaternion.h"
 #include "linux_glue.h"
 #include "inv_mpu.h"
@@ -47,6 +48,10 @@
 #define MIN_SAMPLE_RATE 5
 #define MAX_SAMPLE_RATE 200
 
+// With the DMP off the gyro and accel go straight into the FIFO at up to
+// the 1khz internal rate. See initialize_imu_raw() and mpu9150_read_raw().
+#define MAX_RAW_SAMPLE_RATE 1000
+
 typedef struct {
 	short offset[3];
 	short range[3];
@@ -61,6 +66,11 @@ typedef struct {
 	short rawMag[3];
 	unsigned long magTimestamp;
 
+	// CLOCK_MONOTONIC ns when the sample was taken. The newest packet in
+	// the fifo is stamped with the interrupt edge, older ones are stepped
+	// back one sample period per packet behind them.
+	uint64_t sampleTimeNs;
+
 	short calibratedAccel[3];
 	short calibratedMag[3];
 
@@ -72,19 +82,77 @@ typedef struct {
 } mpudata_t;
 
 
+// Counts kept by the read functions. In interrupt-trusting mode the FIFO
+// count should show exactly one new packet per interrupt, anything else is
+// tallied here. mag_reads shows how often the compass was actually read.
+typedef struct {
+	unsigned long reads;		// reads that skipped data_ready()
+	unsigned long empty;		// interrupt but no packet in the fifo
+	unsigned long backlog;		// interrupt but more than one packet
+	unsigned long mag_reads;	// compass reads made by mpu9150_read()
+
+	// time between interrupt edges
+	unsigned long periods;
+	uint64_t period_min_ns;
+	uint64_t period_max_ns;
+	uint64_t period_mean_ns;
+	uint64_t period_jitter_ns;	// standard deviation
+} mpu9150_stats_t;
+
+// Everything the functions below keep between calls, one per IMU. The
+// default one is used unless another is picked with mpu9150_select_state().
+typedef struct {
+	int debug_on;
+	int yaw_mixing_factor;
+
+	int use_accel_cal;
+	caldata_t accel_cal_data;
+
+	int use_mag_cal;
+	caldata_t mag_cal_data;
+
+	int trust_interrupt;
+	mpu9150_stats_t read_stats;
+
+	// interrupt edge the current read was woken by, 0 outside the interrupt
+	uint64_t interrupt_ns;
+	uint64_t last_interrupt_ns;
+	double period_sum, period_sum_sq;
+
+	// applied on the host in raw mode, the DMP does this itself otherwise
+	signed char raw_orientation[9];
+
+	// latest good compass sample, handed out until the compass has a new one
+	int mag_cached;
+	short cached_mag[3];
+	unsigned long cached_mag_timestamp;
+} mpu9150_state_t;
+
+void mpu9150_state_init(mpu9150_state_t *state);
+mpu9150_state_t *mpu9150_select_state(mpu9150_state_t *state);
+void mpu9150_set_yaw_mixing_factor(int mix_factor);
 void mpu9150_set_debug(int on);
+void mpu9150_trust_interrupt(int on);
+void mpu9150_set_interrupt_time(uint64_t ns);
+void mpu9150_get_stats(mpu9150_stats_t *stats);
 int mpu9150_init(int i2c_bus, int sample_rate, int yaw_mixing_factor);
 void mpu9150_exit();
 int mpu9150_read(mpudata_t *mpu);
 int mpu9150_read_dmp(mpudata_t *mpu);
+int mpu9150_read_dmp_batch(mpudata_t *samples, int max_samples);
+int mpu9150_read_batch(mpudata_t *mpu, mpudata_t *samples, int max_samples);
+int mpu9150_read_raw(mpudata_t *samples, int max_samples);
+void mpu9150_set_orientation(const signed char *orientation);
 int mpu9150_read_mag(mpudata_t *mpu);
 void mpu9150_set_accel_cal(caldata_t *cal);
 void mpu9150_set_mag_cal(caldata_t *cal);
+int mpu9150_get_accel_cal(caldata_t *cal);
 
 int data_ready();
 void calibrate_data(mpudata_t *mpu);
 void tilt_compensate(quaternion_t magQ, quaternion_t unfusedQ);
 int data_fusion(mpudata_t *mpu);
+int data_fusion_euler(mpudata_t *mpu);
 unsigned short inv_row_2_scale(const signed char *row);
 unsigned short inv_orientation_matrix_to_scalar(const signed char *mtx);
 
@@ -68,12 +68,24 @@ unsigned int out_gpio_pins[] =
 					 PAIRING_PIN, SPI1_SS1_GPIO_PIN,
 					 SPI1_SS2_GPIO_PIN};
 
+// index of each non-motor pin in out_gpio_pins[] 
+#define MOT_STBY_INDEX	8
+#define GRN_LED_INDEX	9
+#define RED_LED_INDEX	10
+#define SPI1_SS1_INDEX	12
+#define SPI1_SS2_INDEX	13
+
+// value file descriptors for out_gpio_pins[], opened once by
+// initialize_cape() so writes don't need to open/close sysfs files
+int out_gpio_fds[NUM_OUT_PINS];
+
 								 
 //// eQep and pwmss registers, more in tipwmss.h
 #define PWM0_BASE   0x48300000
 #define PWM1_BASE   0x48302000
 #define PWM2_BASE   0x48304000
 #define EQEP_OFFSET  0x180
+#define EPWM_OFFSET  0x200
 
 //// MPU-9150 defs
 #define MPU_ADDR 0x68
@@ -87,11 +99,10 @@ unsigned int out_gpio_pins[] =
 #define ARRAY_SIZE(array) sizeof(array)/sizeof(array[0]) 
 
 // local function declarations
-int initialize_button_handlers();
-void* pause_pressed_handler(void* ptr);
-void* pause_unpressed_handler(void* ptr);
-void* mode_pressed_handler(void* ptr);
-void* mode_unpressed_handler(void* ptr);
+int set_out_pin(int index, PIN_VALUE value);
+int write_motor_duty(int ch, int duty_ns);
+void* button_dispatcher(void* ptr);
+void dispatch_button_event(struct input_event* ev);
 
 // state variable for loop and thread control
 enum state_t state = UNINITIALIZED;
@@ -112,6 +123,12 @@ int set_state(enum state_t new_state){
 // buttons
 int pause_btn_state, mode_btn_state;
 int (*imu_interrupt_func)();
+// set_imu_ready_func() state and the latency of both imu modes
+static imu_pipeline_t imu_pipeline;
+static int imu_pipeline_started;
+static imu_latency_t direct_latency;
+static int imu_raw_mode;	// initialize_imu_raw(), no DMP
+static mpudata_t raw_samples[MPU_MAX_BATCH];	// imu thread only
 int (*pause_unpressed_func)();
 int (*pause_pressed_func)();
 int (*mode_unpressed_func)();
@@ -140,6 +157,12 @@ int set_mode_unpressed_func(int (*func)(void)){
 	return 0;
 }
 
+// button input device and the kernel time of the event being handled
+#define BUTTON_INPUT_PATH "/dev/input/event1"
+#define BUTTON_EVENT_BATCH 16	// input_event records read per syscall
+char button_input_path[64] = BUTTON_INPUT_PATH;
+struct timeval button_event_time;
+
 int get_pause_button_state(){
 	return pause_btn_state;
 }
@@ -159,10 +182,35 @@ char pwm_files[][64] = {"/sys/devices/ocp.3/pwm_test_P9_14.12/",
 FILE *pwm_duty_pointers[4]; //store pointers to 4 pwm channels for frequent writes
 int pwm_period_ns=0; //stores current pwm period in nanoseconds
 
+// last direction (1 forward, -1 reverse, 0 unknown) and duty in ns
+// (-1 unknown) written to each motor so set_motors() can skip writes
+int motor_dir[4];
+int motor_duty_ns[4];
+
 
 // eQEP Encoder mmap arrays
 volatile char *pwm_map_base[3];
 
+// last raw count and wrap extended position for get_encoder_snapshot()
+uint32_t encoder_last_raw[3];
+int64_t encoder_pos64[3];
+
+// eQep velocity state per channel, set up on first get_encoder_velocity()
+int encoder_vel_ready[3];
+uint32_t encoder_last_lat[3];
+uint64_t encoder_last_lat_ns[3];
+float encoder_velocity[3];
+
+// motors 1-4 are ePWM 1A, 1B, 2A, 2B: PWMSS module and compare register
+const int motor_pwmss[4] = {1, 1, 2, 2};
+const int motor_cmp_reg[4] = {CMPA, CMPB, CMPA, CMPB};
+
+// duty cycle backend, PWM_REGISTERS is used once initialize_cape()
+// confirms the ePWM time base is running, otherwise sysfs
+pwm_backend_t requested_pwm_backend = PWM_REGISTERS;
+pwm_backend_t pwm_backend = PWM_SYSFS;
+int motor_tbprd[4]; // time base period in counts for each motor channel
+
 // DSM2 Spektrum radio & UART4
 int rc_channels[RC_CHANNELS];
 int rc_maxes[RC_CHANNELS];
@@ -212,6 +260,9 @@ int initialize_cape(){
 	fflush(fd);
 	fclose(fd);
 	
+	// lock memory before any thread starts so their stacks stay resident
+	cape_thread_init();
+	
 	// ensure gpios are exported
 	printf("Initializing GPIO\n");
 	for(i=0; i<NUM_OUT_PINS; i++){
@@ -220,6 +271,18 @@ int initialize_cape(){
 			return -1;
 		};
 		gpio_set_dir(out_gpio_pins[i], OUTPUT_PIN);
+		// keep value file open for future writes
+		if(!out_gpio_fds[i]){
+			out_gpio_fds[i] = gpio_value_fd_open(out_gpio_pins[i]);
+			if(out_gpio_fds[i] < 0){
+				out_gpio_fds[i] = 0;
+			}
+		}
+	}
+	
+	// map the gpio banks so outputs can be written without syscalls
+	if(mmap_gpio_init()){
+		printf("WARNING: gpio mmap failed, using sysfs gpio\n");
 	}
 	
 	// set up default values for some gpio
@@ -250,6 +313,8 @@ int initialize_cape(){
 		strcpy(path, pwm_files[i]);
 		strcat(path, "duty");
 		pwm_duty_pointers[i] = fopen(path, "a");
+		motor_dir[i] = 0;
+		motor_duty_ns[i] = -1;
 	}
 	
 	//read in the pwm period defined in device tree overlay .dts
@@ -280,6 +345,9 @@ int initialize_cape(){
 	}
 	close(dev_mem);
 	
+	// pick the motor duty backend now that PWMSS is mapped
+	set_motor_pwm_backend(requested_pwm_backend);
+	
 	// Test eqep and reset position
 	for(i=1;i<3;i++){
 		if(set_encoder_pos(i,0)){
@@ -347,10 +415,154 @@ int set_motor(int motor, float duty){
 		b=HIGH;
 		duty=-duty;
 	}
-	gpio_set_value(out_gpio_pins[(motor-1)*2],a);
-	gpio_set_value(out_gpio_pins[(motor-1)*2+1],b);
-	fprintf(pwm_duty_pointers[motor-1], "%d", (int)(duty*pwm_period_ns));	
-	fflush(pwm_duty_pointers[motor-1]);
+	// write both sides of the H-bridge together when gpio banks are mapped
+	if(mmap_gpio_is_ready()){
+		mmap_gpio_batch_t batch;
+		mmap_gpio_batch_reset(&batch);
+		mmap_gpio_batch_add(&batch, out_gpio_pins[(motor-1)*2], a);
+		mmap_gpio_batch_add(&batch, out_gpio_pins[(motor-1)*2+1], b);
+		mmap_gpio_batch_commit(&batch);
+	}
+	else{
+		set_out_pin((motor-1)*2,a);
+		set_out_pin((motor-1)*2+1,b);
+	}
+	motor_dir[motor-1] = (a==HIGH) ? 1 : -1;
+	return write_motor_duty(motor-1, (int)(duty*pwm_period_ns));
+}
+
+// write a duty cycle in nanoseconds to motor channel ch (0-3)
+int write_motor_duty(int ch, int duty_ns){
+	if(pwm_backend == PWM_REGISTERS){
+		// compare value in time base counts, scaled by TBPRD the same way
+		// the kernel pwm driver does, and clamped so full duty can't wrap.
+		// shadowed by hardware so it takes effect at the next period
+		uint64_t cmp = ((uint64_t)duty_ns * motor_tbprd[ch]) / pwm_period_ns;
+		if(cmp > motor_tbprd[ch]){
+			cmp = motor_tbprd[ch];
+		}
+		*(volatile uint16_t*)(pwm_map_base[motor_pwmss[ch]] + EPWM_OFFSET	\
+			+ motor_cmp_reg[ch]) = (uint16_t)cmp;
+	}
+	else{
+		fprintf(pwm_duty_pointers[ch], "%d", duty_ns);	
+		fflush(pwm_duty_pointers[ch]);
+	}
+	motor_duty_ns[ch] = duty_ns;
+	return 0;
+}
+
+/***********************************************************************
+*	int set_motor_pwm_backend(pwm_backend_t backend)
+*	choose how set_motor() writes duty cycles. Call before 
+*	initialize_cape() to pick the backend used from the start, or any
+*	time after to switch. PWM_REGISTERS writes CMPA/CMPB directly in 
+*	the PWMSS mapping and needs the kernel pwm_test driver to have 
+*	already set up the period and polarity, which initialize_cape()
+*	does. Falls back to PWM_SYSFS if the time base isn't running.
+************************************************************************/
+int set_motor_pwm_backend(pwm_backend_t backend){
+	int i;
+	requested_pwm_backend = backend;
+	// PWMSS not mapped yet, initialize_cape() will call again
+	if(pwm_map_base[1]==NULL || pwm_map_base[1]==(void*)-1 ||	\
+			pwm_map_base[2]==NULL || pwm_map_base[2]==(void*)-1){
+		pwm_backend = PWM_SYSFS;
+		return 0;
+	}
+	if(backend == PWM_REGISTERS){
+		for(i=0; i<4; i++){
+			motor_tbprd[i] = *(volatile uint16_t*)(pwm_map_base[motor_pwmss[i]]	\
+										+ EPWM_OFFSET + TBPRD);
+			if(motor_tbprd[i]==0 || pwm_period_ns<=0){
+				printf("ePWM time base not running, using sysfs pwm\n");
+				pwm_backend = PWM_SYSFS;
+				return -1;
+			}
+		}
+	}
+	pwm_backend = backend;
+	// force the next write to each channel through the new backend
+	for(i=0; i<4; i++){
+		motor_duty_ns[i] = -1;
+	}
+	return 0;
+}
+
+pwm_backend_t get_motor_pwm_backend(){
+	return pwm_backend;
+}
+
+/***********************************************************************
+*	int set_motors(const float duty[4], int mask)
+*	set several motors at once. duty[i] is motor i+1 from -1 to +1,
+*	only motors whose bit is set in mask are touched, MOTOR_MASK_ALL
+*	for all four. All values are worked out first, then the direction
+*	pins of every motor that changed direction go out as one gpio batch
+*	and only duty cycles that actually changed are written.
+************************************************************************/
+int set_motors(const float duty[4], int mask){
+	int i;
+	int dir[4];
+	int duty_ns[4];
+	int dir_changed = 0;
+	float d;
+	mmap_gpio_batch_t batch;
+	
+	if(state == UNINITIALIZED){
+		initialize_cape();
+	}
+	mask &= MOTOR_MASK_ALL;
+	
+	// saturate and split into direction and duty in ns
+	for(i=0; i<4; i++){
+		if(!(mask & (1<<i))){
+			continue;
+		}
+		d = duty[i];
+		if(d>1){
+			d = 1;
+		}
+		else if(d<-1){
+			d = -1;
+		}
+		if(d>=0){
+			dir[i] = 1;
+		}
+		else{
+			dir[i] = -1;
+			d = -d;
+		}
+		duty_ns[i] = (int)(d*pwm_period_ns);
+	}
+	
+	// direction pins, same H-bridge convention as set_motor
+	mmap_gpio_batch_reset(&batch);
+	for(i=0; i<4; i++){
+		if(!(mask & (1<<i)) || dir[i]==motor_dir[i]){
+			continue;
+		}
+		if(mmap_gpio_is_ready()){
+			mmap_gpio_batch_add(&batch, out_gpio_pins[i*2], (dir[i]>0)?HIGH:LOW);
+			mmap_gpio_batch_add(&batch, out_gpio_pins[i*2+1], (dir[i]>0)?LOW:HIGH);
+		}
+		else{
+			set_out_pin(i*2, (dir[i]>0)?HIGH:LOW);
+			set_out_pin(i*2+1, (dir[i]>0)?LOW:HIGH);
+		}
+		motor_dir[i] = dir[i];
+		dir_changed = 1;
+	}
+	if(dir_changed && mmap_gpio_is_ready()){
+		mmap_gpio_batch_commit(&batch);
+	}
+	
+	// duty cycles
+	for(i=0; i<4; i++){
+		if((mask & (1<<i)) && duty_ns[i]!=motor_duty_ns[i]){
+			write_motor_duty(i, duty_ns[i]);
+		}
+	}
 	return 0;
 }
 
@@ -368,20 +580,19 @@ int kill_pwm(){
 		printf("opened pwm duty files\n");
 	}
 	for(ch=0;ch<4;ch++){
-		fprintf(pwm_duty_pointers[ch], "%d", 0);	
-		fflush(pwm_duty_pointers[ch]);
+		write_motor_duty(ch, 0);
 	}
 	return 0;
 }
 
 int enable_motors(){
 	kill_pwm();
-	return gpio_set_value(MOT_STBY, HIGH);
+	return set_out_pin(MOT_STBY_INDEX, HIGH);
 }
 
 int disable_motors(){
 	kill_pwm();
-	return gpio_set_value(MOT_STBY, LOW);
+	return set_out_pin(MOT_STBY_INDEX, LOW);
 }
 
 //// eQep Encoder read/write
@@ -399,26 +610,189 @@ int set_encoder_pos(int ch, long value){
 		return -1;
 	}
 	*(unsigned long*)(pwm_map_base[ch-1] + EQEP_OFFSET +QPOSCNT) = value;
+	encoder_last_raw[ch-1] = (uint32_t)value;
+	encoder_pos64[ch-1] = (int32_t)value;
 	return 0;
 }
 
+/***********************************************************************
+*	int get_encoder_snapshot(encoder_snapshot_t* snap)
+*	read all 3 eQep counters back to back so positions used together,
+*	like both wheels for odometry and steering, come from the same 
+*	instant. The timestamp is taken on each side of the reads and the
+*	midpoint kept. Positions are extended to 64 bits using the change 
+*	since the last snapshot, so call this from one thread only and
+*	often enough that no counter moves more than 2^31 in between.
+************************************************************************/
+int get_encoder_snapshot(encoder_snapshot_t* snap){
+	struct timespec t0, t1;
+	uint32_t raw[3];
+	int i;
+	
+	if(pwm_map_base[0]==NULL){
+		printf("eQep not initialized, call initialize_cape()\n");
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	raw[0] = *(volatile uint32_t*)(pwm_map_base[0] + EQEP_OFFSET + QPOSCNT);
+	raw[1] = *(volatile uint32_t*)(pwm_map_base[1] + EQEP_OFFSET + QPOSCNT);
+	raw[2] = *(volatile uint32_t*)(pwm_map_base[2] + EQEP_OFFSET + QPOSCNT);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	
+	snap->time_ns = (((uint64_t)t0.tv_sec*1000000000 + t0.tv_nsec) 		\
+					+ ((uint64_t)t1.tv_sec*1000000000 + t1.tv_nsec)) / 2;
+	for(i=0; i<3; i++){
+		encoder_pos64[i] += (int32_t)(raw[i] - encoder_last_raw[i]);
+		encoder_last_raw[i] = raw[i];
+		snap->pos[i] = encoder_pos64[i];
+	}
+	return 0;
+}
+
+
+/***********************************************************************
+*	float get_encoder_velocity(int ch)
+*	encoder speed in counts per second measured by the eQep hardware.
+*	The unit timer latches the position every ENCODER_UNIT_PERIOD_US
+*	and the capture unit times every 2^ENCODER_UPPS counts. The first 
+*	call sets this up and returns 0. After that each call picks up the
+*	newest unit timer latch. The unit period is kept well under a 200hz
+*	control loop so every call finds a latch at most one unit period old,
+*	however the loop drifts against the timer. The latches passed since
+*	the last call are counted from the unit timer, so the position change
+*	is divided by the right time span.
+************************************************************************/
+float get_encoder_velocity(int ch){
+	volatile char* eqep;
+	uint32_t lat, utmr;
+	uint16_t cprd, ctmr, sts;
+	uint64_t now_ns, lat_ns;
+	int periods;
+	
+	if(ch<1 || ch>3){
+		printf("Encoder Channel must be 1, 2 or 3\n");
+		return 0;
+	}
+	eqep = pwm_map_base[ch-1] + EQEP_OFFSET;
+	
+	if(!encoder_vel_ready[ch-1]){
+		*(volatile uint32_t*)(eqep+QUPRD) = (PWMSS_SYSCLK_HZ/1000000)	\
+													* ENCODER_UNIT_PERIOD_US;
+		// prescalers can only change while capture is disabled
+		*(volatile uint16_t*)(eqep+QCAPCTL) = 0;
+		*(volatile uint16_t*)(eqep+QCAPCTL) = CEN | (ENCODER_CCPS<<4)	\
+															| ENCODER_UPPS;
+		// latch on unit time out, keep the rest of the driver's setup
+		*(volatile uint16_t*)(eqep+QEPCTL) |= UTE | QCLM;
+		encoder_last_lat[ch-1] = *(volatile uint32_t*)(eqep+QPOSCNT);
+		encoder_last_lat_ns[ch-1] = cape_monotonic_ns();
+		encoder_velocity[ch-1] = 0;
+		encoder_vel_ready[ch-1] = 1;
+		return 0;
+	}
+	
+	// nothing new until the next unit time out
+	if(!(*(volatile uint16_t*)(eqep+QFLG) & UTOF)){
+		return encoder_velocity[ch-1];
+	}
+	// the unit timer counts up from the last latch, so it dates that latch.
+	// if it wraps while the latched registers are read they may belong to
+	// the next latch, read again
+	do{
+		utmr = *(volatile uint32_t*)(eqep+QUTMR);
+		now_ns = cape_monotonic_ns();
+		*(volatile uint16_t*)(eqep+QCLR) = UTOF; // write 1 to clear
+		lat  = *(volatile uint32_t*)(eqep+QPOSLAT);
+		cprd = *(volatile uint16_t*)(eqep+QCPRDLAT);
+		ctmr = *(volatile uint16_t*)(eqep+QCTMRLAT);
+		sts  = *(volatile uint16_t*)(eqep+QEPSTS);
+	} while(*(volatile uint32_t*)(eqep+QUTMR) < utmr);
+	*(volatile uint16_t*)(eqep+QEPSTS) = COEF | CDEF;
+	
+	lat_ns = now_ns - (uint64_t)utmr*(1000000000/PWMSS_SYSCLK_HZ);
+	periods = (lat_ns - encoder_last_lat_ns[ch-1] 					\
+				+ ENCODER_UNIT_PERIOD_US*500) / (ENCODER_UNIT_PERIOD_US*1000);
+	encoder_velocity[ch-1] = encoder_velocity_from_regs(		\
+				(int32_t)(lat - encoder_last_lat[ch-1]), periods, cprd, ctmr, sts);
+	encoder_last_lat[ch-1] = lat;
+	encoder_last_lat_ns[ch-1] = lat_ns;
+	return encoder_velocity[ch-1];
+}
+
+/***********************************************************************
+*	float encoder_velocity_from_regs(dpos, periods, cprd, ctmr, qepsts)
+*	turns latched eQep registers into counts per second. No hardware
+*	access so it can be checked anywhere, see test_encoder_velocity.
+*	dpos:	change in QPOSLAT since the last latch that was read
+*	periods: unit periods that change spans, less than 1 counts as 1
+*	cprd:	QCPRDLAT, capture clocks between the last two position events
+*	ctmr:	QCTMRLAT, capture clocks since the last position event
+*	qepsts:	QEPSTS for the direction and capture error flags
+*	At speed the count over those periods is accurate enough. At low
+*	speed that's only a few counts, so use the time between edges, 
+*	unless the capture timer overflowed or direction changed mid
+*	capture, then the period is meaningless and the count is used.
+************************************************************************/
+float encoder_velocity_from_regs(int32_t dpos, int periods, uint16_t cprd,
+											uint16_t ctmr, uint16_t qepsts){
+	float count_vel, period_vel;
+	
+	if(periods<1){
+		periods = 1;
+	}
+	count_vel = dpos * (1000000.0/ENCODER_UNIT_PERIOD_US) / periods;
+	if(dpos>=ENCODER_SLOW_COUNTS || dpos<=-ENCODER_SLOW_COUNTS){
+		return count_vel;
+	}
+	if((qepsts & (COEF|CDEF)) || cprd==0){
+		return count_vel;
+	}
+	// if it's been longer since the last edge than the last period, 
+	// the wheel is slowing and that time is the better bound
+	if(ctmr > cprd){
+		cprd = ctmr;
+	}
+	period_vel = (float)(1<<ENCODER_UPPS) * (PWMSS_SYSCLK_HZ>>ENCODER_CCPS)	\
+																	/ cprd;
+	return (qepsts & QDF) ? period_vel : -period_vel;
+}
+
+//// Output pin write
+// index is the pin's position in out_gpio_pins[]
+// uses the mapped gpio bank if available, then the cached value fd,
+// then falls back to the sysfs open/write/close
+int set_out_pin(int index, PIN_VALUE value){
+	if(mmap_gpio_is_ready()){
+		return mmap_gpio_write(out_gpio_pins[index], value);
+	}
+	if(out_gpio_fds[index]){
+		return gpio_fd_set_value(out_gpio_fds[index], value);
+	}
+	return gpio_set_value(out_gpio_pins[index], value);
+}
 
 //// LED functions
 // PIN_VALUE and be HIGH or LOW
 int setGRN(PIN_VALUE i){
-	return gpio_set_value(GRN_LED, i);
+	return set_out_pin(GRN_LED_INDEX, i);
 }
 int setRED(PIN_VALUE i){
-	return gpio_set_value(RED_LED, i);
+	return set_out_pin(RED_LED_INDEX, i);
 }
 int getGRN(){
 	unsigned int val = 0;
-	gpio_get_value(GRN_LED, &val);
+	if(out_gpio_fds[GRN_LED_INDEX]){
+		gpio_fd_get_value(out_gpio_fds[GRN_LED_INDEX], &val);
+	}
+	else gpio_get_value(GRN_LED, &val);
 	return (int)val;
 }
 int getRED(){
 	unsigned int val = 0;
-	gpio_get_value(RED_LED, &val);
+	if(out_gpio_fds[RED_LED_INDEX]){
+		gpio_fd_get_value(out_gpio_fds[RED_LED_INDEX], &val);
+	}
+	else gpio_get_value(RED_LED, &val);
 	return (int)val;
 }
 
@@ -453,127 +827,142 @@ float getJackVoltage(){
 }
 
 /***********************************************************************
-*	int initialize_button_interrups()
-*	start 4 threads to handle 4 interrupt routines for pressing and
-*	releasing the two buttons.
+*	int initialize_button_handlers()
+*	start one thread which waits on the button input device with epoll
+*	and dispatches pressing and releasing of both buttons to the 4 
+*	user callbacks
 ************************************************************************/
 int initialize_button_handlers(){
-	pthread_t pause_pressed_thread;
-	pthread_t pause_unpressed_thread;
-	pthread_t mode_pressed_thread;
-	pthread_t mode_unpressed_thread;
-	struct sched_param params;
-	
-	params.sched_priority = sched_get_priority_max(SCHED_FIFO)/2;
-	
-	pthread_create(&pause_pressed_thread, NULL,			 \
-				pause_pressed_handler, (void*) NULL);
-	pthread_create(&pause_unpressed_thread, NULL,			 \
-				pause_unpressed_handler, (void*) NULL);
-	pthread_create(&mode_pressed_thread, NULL,			 \
-					mode_pressed_handler, (void*) NULL);
-	pthread_create(&mode_unpressed_thread, NULL,			 \
-					mode_unpressed_handler, (void*) NULL);
-	
-	// apply medium priority to all threads
-	pthread_setschedparam(pause_pressed_thread, SCHED_FIFO, &params);
-	pthread_setschedparam(pause_unpressed_thread, SCHED_FIFO, &params);
-	pthread_setschedparam(mode_pressed_thread, SCHED_FIFO, &params);
-	pthread_setschedparam(mode_unpressed_thread, SCHED_FIFO, &params);
-	 
+	// medium priority, see THREAD_BUTTON in cape_thread.c
+	if(cape_thread_create("buttons", button_dispatcher, NULL, THREAD_BUTTON)){
+		printf("failed to start button thread\n");
+		return -1;
+	}
 	return 0;
 }
 
 /***********************************************************************
-*	void* pause_pressed_handler(void* ptr) 
-*	wait on falling edge of pause button
+*	int set_button_input_device(const char* path)
+*	input event device the button thread reads, default is
+*	/dev/input/event1. Call before initialize_cape(). Anything that
+*	produces struct input_event records works, like a fifo, which is
+*	handy for timing the dispatcher without the cape.
 ************************************************************************/
-void* pause_pressed_handler(void* ptr){
-	int fd;
-    fd = open("/dev/input/event1", O_RDONLY);
-    struct input_event ev;
-	while (get_state() != EXITING){
-        read(fd, &ev, sizeof(struct input_event));
-		// uncomment printf to see how event codes work
-		// printf("type %i key %i state %i\n", ev.type, ev.code, ev.value); 
-        if(ev.type==1 && ev.code==1){ //only new data
-			if(ev.value == 1){
-				pause_btn_state = PRESSED;
-				(*pause_pressed_func)();
-			}
-		}
-		usleep(10000); // wait
-    }
-	return NULL;
+int set_button_input_device(const char* path){
+	if(strlen(path) >= sizeof(button_input_path)){
+		printf("button input path too long\n");
+		return -1;
+	}
+	strcpy(button_input_path, path);
+	return 0;
 }
 
 /***********************************************************************
-*	void* pause_unpressed_handler(void* ptr) 
-*	wait on rising edge of pause button
+*	struct timeval get_button_event_time()
+*	kernel timestamp of the input event being handled, read this from 
+*	inside a button callback to see when the press actually happened
 ************************************************************************/
-void* pause_unpressed_handler(void* ptr){
-	int fd;
-    fd = open("/dev/input/event1", O_RDONLY);
-    struct input_event ev;
-	while (get_state() != EXITING){
-        read(fd, &ev, sizeof(struct input_event));
-		// uncomment printf to see how event codes work
-		// printf("type %i key %i state %i\n", ev.type, ev.code, ev.value); 
-        if(ev.type==1 && ev.code==1){ //only new data
-			if(ev.value == 0){
-			
-				pause_btn_state = UNPRESSED;
-				(*pause_unpressed_func)();
-			}
-		}
-		usleep(10000); // wait
-    }
-	return NULL;
+struct timeval get_button_event_time(){
+	return button_event_time;
 }
 
 /***********************************************************************
-*	void* mode_pressed_handler(void* ptr) 
-*	wait on falling edge of mode button
+*	void dispatch_button_event(struct input_event* ev)
+*	key code 1 is pause, 2 is mode. value 1 is press, 0 release,
+*	2 is autorepeat which is ignored
 ************************************************************************/
-void* mode_pressed_handler(void* ptr){
-	int fd;
-    fd = open("/dev/input/event1", O_RDONLY);
-    struct input_event ev;
-	while (get_state() != EXITING){
-        read(fd, &ev, sizeof(struct input_event));
-		// uncomment printf to see how event codes work
-		// printf("type %i key %i state %i\n", ev.type, ev.code, ev.value); 
-        if(ev.type==1 && ev.code==2){ //only new data
-			if(ev.value == 1){
-				mode_btn_state = PRESSED;
-				(*mode_pressed_func)();
-			}
+void dispatch_button_event(struct input_event* ev){
+	// uncomment printf to see how event codes work
+	// printf("type %i key %i state %i\n", ev->type, ev->code, ev->value); 
+	if(ev->type != EV_KEY){
+		return;
+	}
+	button_event_time = ev->time;
+	if(ev->code==1){
+		if(ev->value == 1){
+			pause_btn_state = PRESSED;
+			(*pause_pressed_func)();
 		}
-		usleep(10000); // wait
-    }
-	return NULL;
+		else if(ev->value == 0){
+			pause_btn_state = UNPRESSED;
+			(*pause_unpressed_func)();
+		}
+	}
+	else if(ev->code==2){
+		if(ev->value == 1){
+			mode_btn_state = PRESSED;
+			(*mode_pressed_func)();
+		}
+		else if(ev->value == 0){
+			mode_btn_state = UNPRESSED;
+			(*mode_unpressed_func)();
+		}
+	}
 }
 
 /***********************************************************************
-*	void* mode_unpressed_handler(void* ptr) 
-*	wait on rising edge of mode button
+*	void* button_dispatcher(void* ptr) 
+*	opens the input device once and sleeps in epoll_wait until events
+*	arrive, then reads everything queued in one go and dispatches each
+*	record. Wakes every POLL_TIMEOUT to check for EXITING.
 ************************************************************************/
-void* mode_unpressed_handler(void* ptr){
-	int fd;
-    fd = open("/dev/input/event1", O_RDONLY);
-    struct input_event ev;
+void* button_dispatcher(void* ptr){
+	int fd, epfd, n, i, count;
+	int leftover = 0;
+	struct epoll_event ev;
+	struct input_event events[BUTTON_EVENT_BATCH];
+	
+	fd = open(button_input_path, O_RDONLY | O_NONBLOCK);
+	if(fd < 0){
+		printf("failed to open %s\n", button_input_path);
+		return NULL;
+	}
+	epfd = epoll_create(1);
+	if(epfd < 0){
+		printf("failed to create button epoll\n");
+		close(fd);
+		return NULL;
+	}
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+	
 	while (get_state() != EXITING){
-        read(fd, &ev, sizeof(struct input_event));
-		// uncomment printf to see how event codes work
-		// printf("type %i key %i state %i\n", ev.type, ev.code, ev.value); 
-        if(ev.type==1 && ev.code==2){ //only new data
-			if(ev.value == 0){
-				mode_btn_state = UNPRESSED; //pressed
-				(*mode_unpressed_func)();
+		if(epoll_wait(epfd, &ev, 1, POLL_TIMEOUT) <= 0){
+			continue;
+		}
+		// drain the device. evdev only returns whole records but a fifo
+		// may not, so carry any partial record over to the next read
+		while((n = read(fd, (char*)events + leftover, 	\
+								sizeof(events) - leftover)) > 0){
+			n += leftover;
+			count = n / sizeof(struct input_event);
+			for(i=0; i<count; i++){
+				dispatch_button_event(&events[i]);
 			}
+			leftover = n - count*sizeof(struct input_event);
+			memmove(events, &events[count], leftover);
 		}
-		usleep(10000); // wait
-    }
+		// writer end of a fifo went away. A fresh read end doesn't report
+		// the hangup, so reopen and let epoll sleep until the next writer
+		if(n == 0 && (ev.events & EPOLLHUP)){
+			epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+			close(fd);
+			leftover = 0;
+			fd = open(button_input_path, O_RDONLY | O_NONBLOCK);
+			if(fd < 0){
+				printf("failed to reopen %s\n", button_input_path);
+				break;
+			}
+			ev.events = EPOLLIN;
+			ev.data.fd = fd;
+			epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+		}
+	}
+	close(epfd);
+	if(fd >= 0){
+		close(fd);
+	}
 	return NULL;
 }
 
@@ -605,8 +994,9 @@ int initialize_dsm2(){
 		printf("DSM2 Calibration Loaded\n");
 	}
 	fclose(cal);
-	pthread_t uart4_thread;
-	pthread_create(&uart4_thread, NULL, uart4_checker, (void*) NULL);
+	if(cape_thread_create("dsm2", uart4_checker, NULL, THREAD_RADIO)){
+		return -1;
+	}
 	printf("DSM2 Thread Started\n");
 	return 0;
 }
@@ -819,52 +1209,76 @@ int initialize_imu(int sample_rate, signed char orientation[9]){
 	gpio_set_edge(INTERRUPT_PIN, "falling");  // Can be rising, falling or both
 		
 	linux_set_i2c_bus(1);
-
 	
-	if (mpu_init(NULL)) {
-		printf("\nmpu_init() failed\n");
+	// chip setup is shared with any other imu, see imu.c
+	if(imu_init(imu_default(), sample_rate, orientation)){
 		return -1;
 	}
- 
-	mpu_set_sensors(INV_XYZ_GYRO | INV_XYZ_ACCEL | INV_XYZ_COMPASS);
-	mpu_set_sample_rate(sample_rate);
-	
-	// compass run at 100hz max. 
-	if(sample_rate > 100){
-		// best to sample at a fraction of the gyro/accel
-		mpu_set_compass_sample_rate(sample_rate/2);
-	}
-	else{
-		mpu_set_compass_sample_rate(sample_rate);
+	imu_raw_mode = 0;
+	gyro_bias_init(&gyro_bias, GYRO_BIAS_REGISTERS, sample_rate);
+	gyro_bias_set_orientation(&gyro_bias, orientation);
+	if(loadGyroCalibration()){
+		printf("\nGyro Calibration File Doesn't Exist Yet\n");
+		printf("Use calibrate_gyro example to create one\n");
+		printf("Using 0 offset for now\n");
+	};
+	if(loadImuCalibration()){
+		printf("No accel & mag calibration, use calibrate_imu to make one\n");
 	}
-	mpu_set_lpf(188); //as little filtering as possible
-	dmp_load_motion_driver_firmware(sample_rate);
+	
+	start_imu_interrupt_thread();
+	return 0;
+}
 
-	dmp_set_orientation(inv_orientation_matrix_to_scalar(orientation));
-  	dmp_enable_feature(DMP_FEATURE_6X_LP_QUAT | DMP_FEATURE_SEND_RAW_ACCEL 
-						| DMP_FEATURE_SEND_CAL_GYRO);
+// the imu_interrupt_thread gets the highest priority since this is used
+// for real-time control with time-sensitive IMU data
+int start_imu_interrupt_thread(){
+	imu_ring_init(&imu_ring);
+	set_imu_interrupt_func(&null_func);
+	return cape_thread_create("imu", imu_interrupt_handler, NULL, THREAD_IMU);
+}
 
-	dmp_set_fifo_rate(sample_rate);
+// Raw FIFO mode, the DMP firmware is never loaded. Gyro and accel go
+// straight into the FIFO at up to 1khz and the data ready interrupt fires
+// once per sample. Read them from the interrupt function with
+// mpu9150_read_raw(), which drains every waiting sample. There is no DMP
+// quaternion in this mode, attitude has to be fused on the host.
+int initialize_imu_raw(int sample_rate, signed char orientation[9]){
+	printf("Initializing IMU in raw FIFO mode\n");
+	if(sample_rate<MIN_SAMPLE_RATE || sample_rate>MAX_RAW_SAMPLE_RATE){
+		printf("raw sample rate should be between %d and %d\n",
+				MIN_SAMPLE_RATE, MAX_RAW_SAMPLE_RATE);
+		return -1;
+	}
+	//set up gpio interrupt pin connected to imu
+	if(gpio_export(INTERRUPT_PIN)){
+		printf("can't export gpio %d \n", INTERRUPT_PIN);
+		return (-1);
+	}
+	gpio_set_dir(INTERRUPT_PIN, INPUT_PIN);
+	gpio_set_edge(INTERRUPT_PIN, "falling");
 	
-	if (mpu_set_dmp_state(1)) {
-		printf("\nmpu_set_dmp_state(1) failed\n");
+	linux_set_i2c_bus(1);
+	
+	if(imu_init_raw(imu_default(), sample_rate, orientation)){
 		return -1;
 	}
+	imu_raw_mode = 1;
+	gyro_bias_init(&gyro_bias, GYRO_BIAS_REGISTERS, sample_rate);
+	gyro_bias_set_orientation(&gyro_bias, orientation);
+	
 	if(loadGyroCalibration()){
 		printf("\nGyro Calibration File Doesn't Exist Yet\n");
 		printf("Use calibrate_gyro example to create one\n");
 		printf("Using 0 offset for now\n");
 	};
+	if(loadImuCalibration()){
+		printf("No accel & mag calibration, use calibrate_imu to make one\n");
+	}
 	
-	// set the imu_interrupt_thread to highest priority since this is used
-	// for real-time control with time-sensitive IMU data
-	set_imu_interrupt_func(&null_func);
-	pthread_t imu_interrupt_thread;
-	struct sched_param params;
-	pthread_create(&imu_interrupt_thread, NULL, imu_interrupt_handler, (void*) NULL);
-	params.sched_priority = sched_get_priority_max(SCHED_FIFO);
-	pthread_setschedparam(imu_interrupt_thread, SCHED_FIFO, &params);
-	
+	// start from an empty fifo so the first read isn't a backlog
+	mpu_reset_fifo();
+	start_imu_interrupt_thread();
 	return 0;
 }
 
@@ -912,6 +1326,7 @@ int loadGyroCalibration(){
 	else{
 		int xoffset, yoffset, zoffset;
 		fscanf(cal,"%d\n%d\n%d\n", &xoffset, &yoffset, &zoffset);
+		fclose(cal);
 		if(setXGyroOffset((int16_t)xoffset)){
 			printf("problem setting gyro offset\n");
 			return -1;
@@ -924,33 +1339,125 @@ int loadGyroCalibration(){
 			printf("problem setting gyro offset\n");
 			return -1;
 		}
+		// the online estimator refines these from here on
+		int16_t offsets[3] = {xoffset, yoffset, zoffset};
+		gyro_bias_set_offsets(&gyro_bias, offsets);
+	}
+	return 0;
+}
+
+// accel and mag offsets & ranges from calibrate_imu, a range of 0 in
+// the file leaves that sensor uncalibrated
+int loadImuCalibration(){
+	caldata_t accel, mag;
+	if(imu_cal_load(&accel, &mag)){
+		return -1;
+	}
+	if(accel.range[0] && accel.range[1] && accel.range[2]){
+		mpu9150_set_accel_cal(&accel);
+	}
+	if(mag.range[0] && mag.range[1] && mag.range[2]){
+		mpu9150_set_mag_cal(&mag);
 	}
-	fclose(cal);
 	return 0;
 }
 
 // IMU interrupt stuff
 // see test_imu and calibrate_gyro for examples
+// the function reads the imu itself, in the imu interrupt thread
 int set_imu_interrupt_func(int (*func)(void)){
+	imu_pipeline_set_func(&imu_pipeline, NULL);
 	imu_interrupt_func = func;
 	return 0;
 }
 
+// Pipelined alternative to set_imu_interrupt_func(). The imu interrupt
+// thread reads each sample into mpu and publishes it to imu_ring, then
+// the function runs in the imu_ctrl thread with mpu already filled while
+// the next read proceeds. It must not read the imu itself. Works after
+// either initialize_imu() or initialize_imu_raw(), in raw mode every
+// sample in the fifo is published and the function gets the newest.
+int set_imu_ready_func(int (*func)(void)){
+	if(!imu_pipeline_started){
+		if(imu_pipeline_init(&imu_pipeline, &imu_ring, &mpu)) return -1;
+		if(cape_thread_create("imu_ctrl", imu_pipeline_thread, &imu_pipeline,
+				THREAD_IMU_CTRL)){
+			return -1;
+		}
+		imu_pipeline_started = 1;
+	}
+	imu_interrupt_func = &null_func;
+	imu_pipeline_set_func(&imu_pipeline, func);
+	return 0;
+}
+
+// edge to control function latency of both modes so far
+void get_imu_latency(imu_latency_t* direct, imu_latency_t* pipelined){
+	if(direct != NULL) *direct = direct_latency;
+	if(pipelined != NULL) *pipelined = imu_pipeline.stats;
+}
+
+void print_imu_latency(){
+	imu_latency_print("direct", &direct_latency);
+	imu_latency_print("pipelined", &imu_pipeline.stats);
+}
+
 void* imu_interrupt_handler(void* ptr){
 	struct pollfd fdset[1];
 	char buf[MAX_BUF];
 	int imu_gpio_fd = gpio_fd_open(INTERRUPT_PIN);
 	fdset[0].fd = imu_gpio_fd;
 	fdset[0].events = POLLPRI; // high-priority interrupt
+	uint64_t edge_ns, start_ns;
+	int i, n;
+	// carries the yaw fusion state from one mpu9150_read() to the next
+	mpudata_t sample = {0};
+	// other i2c clients wait for this thread between transactions
+	i2c_bus_set_priority(I2C_BUS_REALTIME);
 	// keep running until the program closes
 	while(get_state() != EXITING) {
 		// system hangs here until IMU FIFO interrupt
 		poll(fdset, 1, POLL_TIMEOUT);        
+		// stamp the edge before anything else can delay us
+		edge_ns = cape_monotonic_ns();
 		if (fdset[0].revents & POLLPRI) {
 			lseek(fdset[0].fd, 0, SEEK_SET);  
 			read(fdset[0].fd, buf, MAX_BUF);
-			// user selectable with set_inu_interrupt_func() defined above
-			imu_interrupt_func(); 
+			// keeps threads reading other imus off the drivers meanwhile
+			imu_lock(imu_default());
+			// bus time spent in this period, see i2c_trace.h
+			i2c_trace_period_begin(edge_ns);
+			// the falling edge already says a DMP packet is ready, so
+			// reads made from the callback skip the int status register
+			mpu9150_trust_interrupt(1);
+			mpu9150_set_interrupt_time(edge_ns);
+			if(imu_pipeline.func != NULL){
+				// only the read here, control runs in the imu_ctrl thread
+				if(imu_raw_mode){
+					n = mpu9150_read_raw(raw_samples, MPU_MAX_BATCH);
+					if(n < 0) imu_pipeline_read_failed(&imu_pipeline);
+					for(i=0; i<n; i++){
+						imu_pipeline_push(&imu_pipeline, &raw_samples[i]);
+					}
+				}
+				else if(mpu9150_read(&sample) == 0){
+					imu_pipeline_push(&imu_pipeline, &sample);
+				}
+				else imu_pipeline_read_failed(&imu_pipeline);
+			}
+			else if(imu_interrupt_func != &null_func){
+				// user selectable with set_inu_interrupt_func() defined above
+				start_ns = cape_monotonic_ns();
+				imu_interrupt_func(); 
+				imu_latency_add(&direct_latency, edge_ns, start_ns,
+						cape_monotonic_ns());
+			}
+			// offsets found by gyro_bias_update() in either callback
+			gyro_bias_apply(&gyro_bias);
+			mpu9150_set_interrupt_time(0);
+			mpu9150_trust_interrupt(0);
+			i2c_trace_period_end();
+			imu_unlock(imu_default());
 		}
 	}
 	gpio_fd_close(imu_gpio_fd);
@@ -1053,6 +1560,25 @@ uint64_t microsSinceEpoch(){
 	return micros;
 }
 
+// CLOCK_MONOTONIC in nanoseconds, for timestamps and latency stats
+uint64_t cape_monotonic_ns(){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec*1000000000ULL + t.tv_nsec;
+}
+
+// nanoseconds from start to end, both from the same clock
+uint64_t cape_elapsed_ns(timespec start, timespec end){
+	return (uint64_t)(end.tv_sec-start.tv_sec)*1000000000ULL
+			+ end.tv_nsec - start.tv_nsec;
+}
+
+// adds one time to a running total and keeps the largest
+void cape_add_time(uint64_t* total, uint64_t* max, uint64_t ns){
+	*total += ns;
+	if(ns > *max) *max = ns;
+}
+
 
 // Mavlink easy setup for UDP
 // This function mostly taken from Bryan Godbolt's mavlink_udp example
@@ -1099,9 +1625,9 @@ int initialize_spi1(){ // returns a file descriptor to spi device
         return -1; 
 	}
 	gpio_set_dir(SPI1_SS1_GPIO_PIN, OUTPUT_PIN);
-	gpio_set_value(SPI1_SS1_GPIO_PIN, HIGH);
+	set_out_pin(SPI1_SS1_INDEX, HIGH);
 	gpio_set_dir(SPI1_SS2_GPIO_PIN, OUTPUT_PIN);
-	gpio_set_value(SPI1_SS2_GPIO_PIN, HIGH);
+	set_out_pin(SPI1_SS2_INDEX, HIGH);
 	
 	return spi1_fd;
 }
@@ -1109,11 +1635,11 @@ int initialize_spi1(){ // returns a file descriptor to spi device
 int select_spi1_slave(int slave){
 	switch(slave){
 		case 1:
-			gpio_set_value(SPI1_SS2_GPIO_PIN, HIGH);
-			return gpio_set_value(SPI1_SS1_GPIO_PIN, LOW);
+			set_out_pin(SPI1_SS2_INDEX, HIGH);
+			return set_out_pin(SPI1_SS1_INDEX, LOW);
 		case 2:
-			gpio_set_value(SPI1_SS1_GPIO_PIN, HIGH);
-			return gpio_set_value(SPI1_SS2_GPIO_PIN, LOW);
+			set_out_pin(SPI1_SS1_INDEX, HIGH);
+			return set_out_pin(SPI1_SS2_INDEX, LOW);
 		default:
 			printf("SPI slave number must be 1 or 2\n");
 			return -1;
@@ -1122,9 +1648,9 @@ int select_spi1_slave(int slave){
 int deselect_spi1_slave(int slave){
 	switch(slave){
 		case 1:
-			return gpio_set_value(SPI1_SS1_GPIO_PIN, HIGH);
+			return set_out_pin(SPI1_SS1_INDEX, HIGH);
 		case 2:
-			return gpio_set_value(SPI1_SS2_GPIO_PIN, HIGH);
+			return set_out_pin(SPI1_SS2_INDEX, HIGH);
 		default:
 			printf("SPI slave number must be 1 or 2\n");
 			return -1;
@@ -1143,7 +1669,14 @@ void ctrl_c(int signo){
 // cleanup_cape() should be at the end of every main() function
 int cleanup_cape(){
 	set_state(EXITING);
+	if(imu_pipeline_started){
+		imu_pipeline_stop(&imu_pipeline);
+	}
 	usleep(500000); // let final threads clean up
+	// keep what the online gyro bias estimator learned for next time
+	if(gyro_bias.dirty){
+		gyro_bias_save(&gyro_bias);
+	}
 	FILE* fd;
 	// clean up the lockfile if it still exists
 	fd = fopen(LOCKFILE, "r");
@@ -1158,6 +1691,20 @@ int cleanup_cape(){
 	disable_motors();
 	deselect_spi1_slave(1);	
 	deselect_spi1_slave(2);	
+	
+	// close cached gpio value files
+	int i;
+	for(i=0; i<NUM_OUT_PINS; i++){
+		if(out_gpio_fds[i]){
+			gpio_fd_close(out_gpio_fds[i]);
+			out_gpio_fds[i] = 0;
+		}
+	}
+	mmap_gpio_cleanup();
+	// nothing prints if no thread used the bus
+	i2c_trace_print_report();
+	i2c_bus_print_report();
+	i2c_bus_close_all();
 	prussdrv_pru_disable(PRU_NUM);
     prussdrv_exit();
 	printf("\nExiting Cleanly\n");
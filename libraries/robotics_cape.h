@@ -48,6 +48,7 @@ either expressed or implied, of the FreeBSD Project.
 #include <pthread.h>    // multi-threading
 #include <linux/input.h>// buttons
 #include <poll.h> 		// interrupt events
+#include <sys/epoll.h>	// button events
 #include <sys/mman.h>	// mmap for accessing eQep
 #include <sys/socket.h>	// mavlink udp socket	
 #include <netinet/in.h> // mavlink udp socket	
@@ -56,8 +57,19 @@ either expressed or implied, of the FreeBSD Project.
 #include <ctype.h>		// for isprint()
 
 #include "SimpleGPIO.h"
+#include "mmap_gpio.h"	// direct gpio bank register access
+#include "event_loop.h"	// epoll & timerfd event loop
+#include "cape_thread.h"	// real-time thread classes & registry
+#include "attitude.h"	// host side mahony & madgwick filters
+#include "imu_ring.h"	// lock-free imu sample ring
 #include "c_i2c.h"		// i2c lib
 #include "mpu9150.h"	// general DMP library
+#include "imu.h"		// several imus, one context each
+#include "gyro_bias.h"	// online gyro bias estimator
+#include "imu_cal.h"	// accel & mag ellipsoid calibration
+#include "i2c_bus.h"		// shared i2c fds & priority bus lock
+#include "i2c_trace.h"	// per register i2c latency histograms
+#include "imu_pipeline.h"	// imu reads overlapped with control
 #include "MPU6050.h" 	// gyro offset registers
 #include "tipwmss.h"	// pwmss and eqep registers
 #include "mavlink/mavlink.h"
@@ -101,6 +113,10 @@ either expressed or implied, of the FreeBSD Project.
 #define SERVO_MIN_US 			800	// min pulse to send to servos	in microseconds
 #define SERVO_MAX_US 			2200	// max pulse to send to servos in microseconds
 
+//// Motor channel bitmask for set_motors(), bit 0 is motor 1
+#define MOTOR_MASK(motor)	(1<<((motor)-1))
+#define MOTOR_MASK_ALL		0x0F
+
 #define PRESSED 1
 #define UNPRESSED 0
 	
@@ -120,7 +136,16 @@ enum state_t get_state();
 int set_state(enum state_t);
 
 //// Motor, ESC, PWM ///
+// how motor duty cycles are written, see set_motor_pwm_backend()
+typedef enum pwm_backend_t {
+	PWM_SYSFS,		// pwm_test duty files, always available
+	PWM_REGISTERS	// ePWM compare registers through the PWMSS mmap
+} pwm_backend_t;
+
+int set_motor_pwm_backend(pwm_backend_t backend);
+pwm_backend_t get_motor_pwm_backend();
 int set_motor(int motor, float duty);
+int set_motors(const float duty[4], int mask);
 int set_esc(int esc, float normalized_duty);
 int kill_pwm();
 int set_all_esc(float duty);
@@ -129,8 +154,26 @@ int enable_motors();
 int disable_motors();
 
 //// eQep encoder counter
+// velocity measurement setup, see get_encoder_velocity()
+#define PWMSS_SYSCLK_HZ			100000000	// eQep module clock
+#define ENCODER_UNIT_PERIOD_US	1000	// unit timer latches position every 1ms
+#define ENCODER_UPPS			2		// unit position event every 2^2 counts
+#define ENCODER_CCPS			7		// capture clock SYSCLK/2^7, 781.25khz
+#define ENCODER_SLOW_COUNTS		8		// fewer counts since the last read
+										// than this uses the edge period
+
+// all 3 counters read back to back, see get_encoder_snapshot()
+typedef struct encoder_snapshot{
+	uint64_t time_ns;	// CLOCK_MONOTONIC halfway through the reads
+	int64_t pos[3];		// channels 1-3, extended past 32 bit wrap
+} encoder_snapshot_t;
+
 long int get_encoder_pos(int ch);
 int set_encoder_pos(int ch, long value);
+float get_encoder_velocity(int ch);
+int get_encoder_snapshot(encoder_snapshot_t* snap);
+float encoder_velocity_from_regs(int32_t dpos, int periods, uint16_t cprd,
+											uint16_t ctmr, uint16_t qepsts);
  
 //// Buttons LEDS interrupt functions///
 int setGRN(PIN_VALUE i);
@@ -143,6 +186,9 @@ int set_mode_pressed_func(int (*func)(void));
 int set_mode_unpressed_func(int (*func)(void));
 int get_pause_button_state();
 int get_mode_button_state();
+int set_button_input_device(const char* path);
+int initialize_button_handlers(); // called by initialize_cape()
+struct timeval get_button_event_time();
 void* read_events(void* ptr); //background thread for polling inputs
 
 //// Battery & power
@@ -151,13 +197,26 @@ float getJackVoltage();
 
 //// MPU9150 IMU DMP
 mpudata_t mpu; //struct to read IMU data into
+// filled by the imu interrupt thread only with set_imu_ready_func(). With
+// set_imu_interrupt_func() publish mpu from the callback yourself with
+// imu_ring_publish(). Read it from other threads with imu_ring_get_latest()
+imu_ring_t imu_ring;
+// feed samples with gyro_bias_update() from the imu interrupt function,
+// new offsets are written after it returns and saved by cleanup_cape()
+gyro_bias_t gyro_bias;
 int initialize_imu(int sample_rate, signed char orientation[9]);
+int initialize_imu_raw(int sample_rate, signed char orientation[9]);
+int start_imu_interrupt_thread();
 int setXGyroOffset(int16_t offset);
 int setYGyroOffset(int16_t offset);
 int setZGyroOffset(int16_t offset);
 int loadGyroCalibration();
+int loadImuCalibration();
 void* imu_interrupt_handler(void* ptr);
 int set_imu_interrupt_func(int (*func)(void));
+int set_imu_ready_func(int (*func)(void)); // dmp or raw mode, mpu is filled
+void get_imu_latency(imu_latency_t* direct, imu_latency_t* pipelined);
+void print_imu_latency();
 
 //// DSM2 Spektrum RC radio functions
 int initialize_dsm2();
@@ -189,6 +248,9 @@ char *byte_to_binary(unsigned char x); // for diagnostic prints
 typedef struct timespec	timespec;
 timespec diff(timespec start, timespec end); // subtract timespec structs for nanosleep()
 uint64_t microsSinceEpoch();
+uint64_t cape_monotonic_ns(); // CLOCK_MONOTONIC in nanoseconds
+uint64_t cape_elapsed_ns(timespec start, timespec end);
+void cape_add_time(uint64_t* total, uint64_t* max, uint64_t ns); // total and max
 
 //// Cleanup and Shutdown
 void ctrl_c(int signo); // signal catcher
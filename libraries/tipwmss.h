@@ -11,6 +11,20 @@
 #define PWMSS_ECAPCLK_EN_ACK	BIT(0)
 #define PWMSS_EPWMCLK_EN_ACK	BIT(8)
 
+// ePWM register offsets from its base IO address, all 16 bit
+#define TBCTL      0x0000
+#define TBSTS      0x0002
+#define TBPHSHR    0x0004
+#define TBPHS      0x0006
+#define TBCNT      0x0008
+#define TBPRD      0x000A
+#define CMPCTL     0x000E
+#define CMPAHR     0x0010
+#define CMPA       0x0012
+#define CMPB       0x0014
+#define AQCTLA     0x0016
+#define AQCTLB     0x0018
+
 // eQEP register offsets from its base IO address
 #define QPOSCNT    0x0000
 #define QPOSINIT   0x0004
@@ -97,6 +111,16 @@
 #define PCSPW1    (0x0001 << 1)
 #define PCSPW0    (0x0001 << 0)
 
+// Bits for the QEPSTS register
+#define UPEVNT     (0x0001 << 7)
+#define FIDF       (0x0001 << 6)
+#define QDF        (0x0001 << 5)
+#define QDLF       (0x0001 << 4)
+#define COEF       (0x0001 << 3)
+#define CDEF       (0x0001 << 2)
+#define FIMF       (0x0001 << 1)
+#define PCEF       (0x0001 << 0)
+
 // Bits for the interrupt registers
 #define EQEP_INTERRUPT_MASK (0x0FFF)
 #define UTOF                (0x0001 << 11)